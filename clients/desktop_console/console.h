@@ -28,11 +28,12 @@
 #include <string.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdatomic.h>
 #include <wayland-client.h>
 
 #include <ctypes/os/file.h>
 #include <ctypes/os/exec.h>
-#include <ctypes/radix.h>
+#include <ctypes/vector.h>
 #include <twclient/client.h>
 #include <twclient/ui.h>
 #include <twidgets/nk_backends.h>
@@ -93,6 +94,30 @@ enum console_icon_type {
 	CONSOLE_ICON_DEVICE = 1 << 4,
 };
 
+/**
+ * @brief a search or exec command issued by the console thread.
+ *
+ * Only the latest command of each kind is kept, a newer one replaces the
+ * untaken one in the module slot.
+ */
+struct console_module_command {
+	unsigned int gen; /**< the search generation, 0 for exec */
+	char command[];
+};
+
+/**
+ * @brief a result published by the module thread.
+ *
+ * The module thread swaps it into the module slot atomically, the console
+ * thread takes it out the same way. Whoever holds the pointer owns it.
+ */
+struct console_module_result {
+	unsigned int gen; /**< the search generation it was made for */
+	int ret;
+	vector_t search_results;
+	char *exec_res;
+};
+
 /**
  * @brief a console module provides its set of features to the console
  *
@@ -103,21 +128,22 @@ enum console_icon_type {
 struct console_module {
 	const char name[32];
 	struct desktop_console *console;
-	struct radix *radix;
 	uint32_t supported_icons;
 	const bool support_cache;
-	bool quit;
-
+	atomic_bool quit;
+	atomic_bool cache_stale; /**< the module data changed under the cache */
 
+	/* commands, written by console thread */
 	struct {
-		pthread_mutex_t command_mutex;
-		char *search_command, *exec_command;
+		_Atomic(struct console_module_command *) search_command;
+		_Atomic(struct console_module_command *) exec_command;
+		atomic_uint search_gen; /**< bumped by every new search */
+		unsigned int running_gen; /**< module thread only */
 	};
+	/* results, written by module thread */
 	struct {
-		pthread_mutex_t results_mutex;
-		vector_t search_results;
-		int search_ret, exec_ret;
-		char *exec_res;
+		_Atomic(struct console_module_result *) search_result;
+		_Atomic(struct console_module_result *) exec_result;
 	};
 
 	int (*search)(struct console_module *, const char *, vector_t *);
@@ -142,6 +168,33 @@ void
 console_module_command(struct console_module *module, const char *search,
                        const char *exec);
 
+/**
+ * @brief drop the cached search results of the module.
+ *
+ * For modules whose data changes in the background, the module thread drops
+ * the cache before it runs the next search.
+ */
+static inline void
+console_module_invalidate_cache(struct console_module *module)
+{
+	atomic_store(&module->cache_stale, true);
+}
+
+/**
+ * @brief cancellation point for the module search.
+ *
+ * Searches can check this periodically and bail out early, the result would
+ * be discarded anyway as a newer search is already issued.
+ */
+static inline bool
+console_module_search_cancelled(struct console_module *module)
+{
+	return atomic_load_explicit(&module->quit, memory_order_relaxed) ||
+		atomic_load_explicit(&module->search_gen,
+		                     memory_order_relaxed) !=
+		module->running_gen;
+}
+
 
 //all the search component returns this
 typedef struct {
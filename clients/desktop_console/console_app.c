@@ -19,10 +19,6 @@
  *
  */
 
-#ifndef _GNU_SOURCE /* for qsort_r */
-#define _GNU_SOURCE
-#endif
-
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -43,10 +39,12 @@
 #include <ctypes/hash.h>
 
 #include "console.h"
+#include "console_fuzzy.h"
 
 static struct app_module_data {
 	vector_t  xdg_app_vector;
 	vector_t icons;
+	struct console_fuzzy_index index;
 } module_data = {0};
 
 static inline void
@@ -103,37 +101,30 @@ xdg_app_module_search(struct console_module *module, const char *to_search,
 	struct nk_image *icon = NULL;
 	console_search_entry_t *entry = NULL;
 	struct app_module_data *userdata = module->user_data;
+	const struct console_fuzzy_match *matches = NULL;
 	vector_t *apps = &userdata->xdg_app_vector;
 	vector_t *icons = &userdata->icons;
+	uint32_t n;
 
 	vector_init_zero(result, sizeof(console_search_entry_t),
 			 search_entry_free);
 
-	//TODO replace this brute force with a more efficient algorithm
-	for (int i = 0; i < apps->len; i++) {
-		app = vector_at(apps, i);
-		icon = vector_at(icons, i);
-		if (strcasestr(app->name, to_search)) {
-			 entry = vector_newelem(result);
-			if (strlen(app->name) < 32) {
-				strcpy(entry->sstr, app->name);
-				entry->pstr = NULL;
-			} else
-				entry->pstr = strdup(app->name);
-			entry->img = *icon;
-		}
+	//matches are ranked already
+	n = console_fuzzy_index_search(&userdata->index, to_search, &matches);
+	for (uint32_t i = 0; i < n; i++) {
+		app = vector_at(apps, matches[i].index);
+		icon = vector_at(icons, matches[i].index);
+		entry = vector_newelem(result);
+		if (strlen(app->name) < 32) {
+			strcpy(entry->sstr, app->name);
+			entry->pstr = NULL;
+		} else
+			entry->pstr = strdup(app->name);
+		entry->img = *icon;
 	}
-	//now we can have a sort, but it requires edit distance
-	/* qsort_r(result->elems, result->len, result->elemsize, NULL, to_search); */
 	return 0;
 }
 
-static bool
-xdg_app_filter(const char *command, const char *last)
-{
-	return strcasestr(last, command) != NULL;
-}
-
 /*******************************************************************************
  * inits
  ******************************************************************************/
@@ -176,8 +167,10 @@ xdg_app_module_init(struct console_module *module)
 {
 	struct app_module_data *userdata = module->user_data;
 	struct wl_array apps_data;
+	struct xdg_app_entry *app = NULL;
 	vector_t *apps = &userdata->xdg_app_vector;
 	vector_t *images = &userdata->icons;
+	const char **names;
 
 	//gather desktop entries
 	apps_data = xdg_apps_gather();
@@ -192,6 +185,17 @@ xdg_app_module_init(struct console_module *module)
 
 	//I can actually directly do it here
 	xdg_app_module_update_icons(module);
+
+	//build the search index once, apps do not change during the run
+	names = calloc(apps->len ? apps->len : 1, sizeof(char *));
+	for (int i = 0; names && i < apps->len; i++) {
+		app = vector_at(apps, i);
+		names[i] = app->name;
+	}
+	if (!names || !console_fuzzy_index_init(&userdata->index, names,
+	                                        apps->len))
+		console_fuzzy_index_init(&userdata->index, NULL, 0);
+	free(names);
 }
 
 static void
@@ -201,6 +205,7 @@ xdg_app_module_destroy(struct console_module *module)
 
 	vector_destroy(&userdata->xdg_app_vector);
 	vector_destroy(&userdata->icons);
+	console_fuzzy_index_fini(&userdata->index);
 }
 
 
@@ -210,8 +215,8 @@ struct console_module app_module = {
 	.search = xdg_app_module_search,
 	.init_hook = xdg_app_module_init,
 	.destroy_hook = xdg_app_module_destroy,
-	.filter_test = xdg_app_filter,
-	.support_cache = true,
+	//the index is cheap enough, caching would break the ranking
+	.support_cache = false,
 	.supported_icons = CONSOLE_ICON_APP | CONSOLE_ICON_MIME,
 	.user_data = &module_data,
 };
@@ -23,8 +23,9 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
 #include <semaphore.h>
-#include <dirent.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -32,7 +33,18 @@
 #include <ctypes/helpers.h>
 #include <ctypes/strops.h>
 #include "console.h"
-#include "ctypes/radix.h"
+#include "console_cmd_index.h"
+
+static struct cmd_module_data {
+	pthread_mutex_t mutex; /**< guards the index swap */
+	pthread_t rescan_thread;
+	bool rescanning;
+	char *path_env;
+	char file[PATH_MAX];
+	struct console_cmd_index index;
+} module_data = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
 
 
 /**
@@ -51,15 +63,19 @@ static int
 console_cmd_module_exec(struct console_module *module, const char *entry,
 			char **result)
 {
+	struct cmd_module_data *userdata = module->user_data;
 	vector_t buffer;
 	const char *ptr = entry;
 	int len = 0;
+	bool found;
 	*result = NULL;
 	//if the command is not known
 	while (*ptr && !isspace(*ptr))
 		ptr++;
-	if (radix_find(module->radix, (unsigned char *)entry,
-	               ptr-entry) == RADIX_NOT_FOUND)
+	pthread_mutex_lock(&userdata->mutex);
+	found = console_cmd_index_find(&userdata->index, entry, ptr-entry);
+	pthread_mutex_unlock(&userdata->mutex);
+	if (!found)
 		return -1;
 
 	FILE *pipe = popen(entry, "re");//closeonexec
@@ -91,70 +107,96 @@ static int
 console_cmd_module_search(struct console_module *module, const char *to_search,
 			  vector_t *result)
 {
-	struct radix_iterator iter;
+	struct cmd_module_data *userdata = module->user_data;
+	struct console_cmd_index *index = &userdata->index;
+	size_t len = strlen(to_search);
+	const char *cmd;
 
-	if (!module->radix)
-		return 0;
 	vector_init_zero(result, sizeof(console_search_entry_t),
 			 search_entry_free);
 
-	radix_start(&iter, module->radix);
-	//iterator behavior is not yet understood, maybe wrong
-	if (radix_seek(&iter, ">=", (unsigned char *)to_search,
-		    strlen(to_search)) == 0)
-		goto out;
-	while (radix_next(&iter)) {
-		if (strstr((char *)iter.key, to_search) != (char *)iter.key)
+	pthread_mutex_lock(&userdata->mutex);
+	for (uint32_t i = console_cmd_index_lower_bound(index, to_search, len);
+	     i < index->n_cmds; i++) {
+		size_t key_len;
+
+		cmd = console_cmd_index_at(index, i);
+		if (strncmp(cmd, to_search, len) ||
+		    console_module_search_cancelled(module))
 			break;
+		key_len = strlen(cmd);
 		console_search_entry_t *entry = vector_newelem(result);
 		memset(entry, 0, sizeof(console_search_entry_t));
-		if(iter.key_len < 32) {
-			strop_ncpy(entry->sstr, (char *)iter.key, iter.key_len+1);
+		if (key_len < 32) {
+			strop_ncpy(entry->sstr, cmd, key_len+1);
 			entry->pstr = NULL;
 		} else {
-			entry->pstr = calloc(1, iter.key_len+1);
-			strop_ncpy(entry->pstr, (char *)iter.key, iter.key_len+1);
+			entry->pstr = strdup(cmd);
 		}
 	}
-out:
-	radix_stop(&iter);
+	pthread_mutex_unlock(&userdata->mutex);
 	return 0;
 }
 
-static void
-gather_all_cmds(struct radix *radix)
+/* scan the $PATH in the background then swap in the fresh index, searches
+ * use the old one in the mean time. Results cached from the old index may miss
+ * commands, so the cache goes with it */
+static void *
+console_cmd_module_rescan(void *data)
 {
-	char *pathes = strdup(getenv("PATH"));
-	for (char *sv, *path = strtok_r(pathes, ":", &sv);
-	     path; path = strtok_r(NULL, ":", &sv)) {
-
-		DIR *dir = opendir(path);
-		if (!dir)
-			continue;
-		for (struct dirent *entry = readdir(dir); entry;
-		     entry = readdir(dir)) {
-			if (!strncmp(".", entry->d_name, 255) ||
-			    !strncmp("..", entry->d_name, 255))
-				continue;
-			radix_insert(radix, (unsigned char *)entry->d_name,
-			             strlen(entry->d_name), NULL, NULL);
-		}
-		closedir(dir);
-	}
-	free(pathes);
+	struct console_module *module = data;
+	struct cmd_module_data *userdata = module->user_data;
+	struct console_cmd_index fresh, stale;
+
+	if (!console_cmd_index_build(userdata->file, userdata->path_env) ||
+	    !console_cmd_index_load(&fresh, userdata->file,
+	                            userdata->path_env))
+		return NULL;
+
+	pthread_mutex_lock(&userdata->mutex);
+	stale = userdata->index;
+	userdata->index = fresh;
+	pthread_mutex_unlock(&userdata->mutex);
+	console_module_invalidate_cache(module);
+
+	console_cmd_index_unload(&stale);
+	return NULL;
 }
 
 static void
 console_cmd_module_init(struct console_module *module)
 {
-	module->radix = radix_new();
-	gather_all_cmds(module->radix);
+	struct cmd_module_data *userdata = module->user_data;
+	const char *path_env = getenv("PATH");
+	bool loaded;
+
+	userdata->path_env = strdup(path_env ? path_env : "");
+	tw_create_cache_dir();
+	tw_cache_dir(userdata->file);
+	strop_ncpy(userdata->file + strlen(userdata->file),
+	           "/" CONSOLE_CMD_INDEX_FILE,
+	           PATH_MAX - strlen(userdata->file));
+
+	//the index is used right away, even if it is stale
+	loaded = console_cmd_index_load(&userdata->index, userdata->file,
+	                                userdata->path_env);
+	if (!loaded || userdata->index.stale)
+		userdata->rescanning =
+			!pthread_create(&userdata->rescan_thread, NULL,
+			                console_cmd_module_rescan, module);
 }
 
 static void
 console_cmd_module_destroy(struct console_module *module)
 {
-	radix_free(module->radix);
+	struct cmd_module_data *userdata = module->user_data;
+
+	if (userdata->rescanning)
+		pthread_join(userdata->rescan_thread, NULL);
+	userdata->rescanning = false;
+	console_cmd_index_unload(&userdata->index);
+	free(userdata->path_env);
+	userdata->path_env = NULL;
 }
 
 struct console_module cmd_module = {
@@ -166,4 +208,5 @@ struct console_module cmd_module = {
 	.destroy_hook = console_cmd_module_destroy,
 	.supported_icons = CONSOLE_ICON_MIME,
 	.support_cache = true,
+	.user_data = &module_data,
 };
@@ -0,0 +1,318 @@
+/*
+ * console_cmd_index.c - taiwins client console command index
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "console_cmd_index.h"
+
+#define CMD_INDEX_MAGIC "TWCMDIX"
+#define CMD_INDEX_VERSION 1
+
+struct cmd_index_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t n_dirs;
+	uint32_t n_cmds;
+	uint32_t path_len; /**< including the terminator */
+	uint32_t strings_size;
+	uint32_t padding;
+};
+
+struct cmd_index_dir {
+	int64_t sec; /**< -1 for missing directory */
+	int64_t nsec;
+};
+
+static inline uint32_t
+cmd_index_count_dirs(const char *path_env)
+{
+	uint32_t n = 1;
+
+	for (const char *c = path_env; *c; c++)
+		n += (*c == ':');
+	return n;
+}
+
+/* get the mtime of every directory in path_env, empty components included */
+static void
+cmd_index_stat_dirs(const char *path_env, struct cmd_index_dir *dirs)
+{
+	char *paths = strdup(path_env), *path, *next;
+	struct stat st;
+	uint32_t i = 0;
+
+	for (path = paths; path; path = next, i++) {
+		if ((next = strchr(path, ':')))
+			*next++ = '\0';
+		if (!stat(path, &st)) {
+			dirs[i].sec = st.st_mtim.tv_sec;
+			dirs[i].nsec = st.st_mtim.tv_nsec;
+		} else {
+			dirs[i].sec = -1;
+			dirs[i].nsec = 0;
+		}
+	}
+	free(paths);
+}
+
+static int
+cmd_index_cmp_str(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static bool
+cmd_index_append(char ***names, size_t *n, size_t *alloc, const char *name)
+{
+	char **tmp;
+
+	if (*n == *alloc) {
+		*alloc = *alloc ? *alloc * 2 : 1024;
+		if (!(tmp = realloc(*names, *alloc * sizeof(char *))))
+			return false;
+		*names = tmp;
+	}
+	if (!((*names)[*n] = strdup(name)))
+		return false;
+	(*n)++;
+	return true;
+}
+
+static bool
+cmd_index_write(const char *file, const char *path_env,
+                const struct cmd_index_dir *dirs, uint32_t n_dirs,
+                char **names, size_t n)
+{
+	char tmp_file[PATH_MAX];
+	struct cmd_index_header header = {0};
+	uint32_t *offsets = NULL;
+	uint32_t offset = 0;
+	FILE *f;
+	int fd;
+	bool ret = true;
+
+	if (snprintf(tmp_file, sizeof(tmp_file), "%s.XXXXXX", file) >=
+	    (int)sizeof(tmp_file))
+		return false;
+	if ((fd = mkstemp(tmp_file)) < 0)
+		return false;
+	if (!(f = fdopen(fd, "w"))) {
+		close(fd);
+		unlink(tmp_file);
+		return false;
+	}
+	if (!(offsets = calloc(n ? n : 1, sizeof(uint32_t))))
+		goto err;
+	for (size_t i = 0; i < n; i++) {
+		offsets[i] = offset;
+		offset += strlen(names[i]) + 1;
+	}
+	memcpy(header.magic, CMD_INDEX_MAGIC, sizeof(header.magic));
+	header.version = CMD_INDEX_VERSION;
+	header.n_dirs = n_dirs;
+	header.n_cmds = n;
+	header.path_len = strlen(path_env) + 1;
+	header.strings_size = offset;
+
+	ret = ret && fwrite(&header, sizeof(header), 1, f) == 1;
+	ret = ret && fwrite(dirs, sizeof(*dirs), n_dirs, f) == n_dirs;
+	ret = ret && fwrite(offsets, sizeof(uint32_t), n, f) == n;
+	ret = ret && fwrite(path_env, header.path_len, 1, f) == 1;
+	for (size_t i = 0; ret && i < n; i++)
+		ret = fwrite(names[i], strlen(names[i]) + 1, 1, f) == 1;
+	free(offsets);
+	ret = !fclose(f) && ret;
+	//readers see either the old index or the new one
+	ret = ret && !rename(tmp_file, file);
+	if (!ret)
+		unlink(tmp_file);
+	return ret;
+err:
+	fclose(f);
+	unlink(tmp_file);
+	return false;
+}
+
+bool
+console_cmd_index_build(const char *file, const char *path_env)
+{
+	uint32_t n_dirs = cmd_index_count_dirs(path_env);
+	struct cmd_index_dir *dirs = calloc(n_dirs, sizeof(*dirs));
+	char *paths = strdup(path_env);
+	char **names = NULL;
+	size_t n = 0, alloc = 0, u = 0;
+	bool ret = dirs && paths;
+
+	if (!ret)
+		goto out;
+	//take mtimes before reading, so changes during the scan makes the
+	//index stale
+	cmd_index_stat_dirs(path_env, dirs);
+	for (char *sv, *path = strtok_r(paths, ":", &sv);
+	     ret && path; path = strtok_r(NULL, ":", &sv)) {
+		DIR *dir = opendir(path);
+		if (!dir)
+			continue;
+		for (struct dirent *entry = readdir(dir); ret && entry;
+		     entry = readdir(dir)) {
+			if (!strncmp(".", entry->d_name, 255) ||
+			    !strncmp("..", entry->d_name, 255))
+				continue;
+			ret = cmd_index_append(&names, &n, &alloc,
+			                       entry->d_name);
+		}
+		closedir(dir);
+	}
+	if (!ret)
+		goto out;
+	qsort(names, n, sizeof(char *), cmd_index_cmp_str);
+	for (size_t i = 0; i < n; i++) {
+		if (u && !strcmp(names[u-1], names[i])) {
+			free(names[i]);
+			continue;
+		}
+		names[u++] = names[i];
+	}
+	n = u;
+	ret = cmd_index_write(file, path_env, dirs, n_dirs, names, n);
+out:
+	for (size_t i = 0; i < n; i++)
+		free(names[i]);
+	free(names);
+	free(paths);
+	free(dirs);
+	return ret;
+}
+
+bool
+console_cmd_index_load(struct console_cmd_index *index, const char *file,
+                       const char *path_env)
+{
+	const struct cmd_index_header *header;
+	const struct cmd_index_dir *dirs;
+	struct cmd_index_dir *curr_dirs = NULL;
+	const char *path;
+	struct stat st;
+	size_t size;
+	void *map;
+	int fd;
+
+	memset(index, 0, sizeof(*index));
+	if ((fd = open(file, O_RDONLY | O_CLOEXEC)) < 0)
+		return false;
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(*header)) {
+		close(fd);
+		return false;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+
+	header = map;
+	size = sizeof(*header) +
+		(size_t)header->n_dirs * sizeof(struct cmd_index_dir) +
+		(size_t)header->n_cmds * sizeof(uint32_t) +
+		header->path_len + header->strings_size;
+	if (memcmp(header->magic, CMD_INDEX_MAGIC, sizeof(header->magic)) ||
+	    header->version != CMD_INDEX_VERSION ||
+	    size != (size_t)st.st_size || !header->path_len) {
+		munmap(map, st.st_size);
+		return false;
+	}
+	index->map = map;
+	index->size = st.st_size;
+	index->n_cmds = header->n_cmds;
+	dirs = (const struct cmd_index_dir *)(header + 1);
+	index->offsets = (const uint32_t *)(dirs + header->n_dirs);
+	path = (const char *)(index->offsets + header->n_cmds);
+	index->strings = path + header->path_len;
+
+	//validate, every directory has to be the same
+	index->stale = path[header->path_len-1] != '\0' ||
+		strcmp(path, path_env) ||
+		header->n_dirs != cmd_index_count_dirs(path_env);
+	if (!index->stale) {
+		curr_dirs = calloc(header->n_dirs, sizeof(*curr_dirs));
+		if (curr_dirs)
+			cmd_index_stat_dirs(path_env, curr_dirs);
+		index->stale = !curr_dirs ||
+			memcmp(curr_dirs, dirs,
+			       header->n_dirs * sizeof(*dirs));
+		free(curr_dirs);
+	}
+	//guard against corrupted offsets
+	if (header->strings_size == 0 ||
+	    index->strings[header->strings_size-1] != '\0')
+		index->n_cmds = 0;
+	for (uint32_t i = 0; i < index->n_cmds; i++)
+		if (index->offsets[i] >= header->strings_size) {
+			index->n_cmds = 0;
+			index->stale = true;
+		}
+	return true;
+}
+
+void
+console_cmd_index_unload(struct console_cmd_index *index)
+{
+	if (index->map)
+		munmap(index->map, index->size);
+	memset(index, 0, sizeof(*index));
+}
+
+uint32_t
+console_cmd_index_lower_bound(const struct console_cmd_index *index,
+                              const char *prefix, size_t len)
+{
+	uint32_t lo = 0, hi = index->n_cmds;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if (strncmp(console_cmd_index_at(index, mid), prefix, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+bool
+console_cmd_index_find(const struct console_cmd_index *index,
+                       const char *cmd, size_t len)
+{
+	uint32_t i = console_cmd_index_lower_bound(index, cmd, len);
+	const char *found;
+
+	if (i == index->n_cmds)
+		return false;
+	found = console_cmd_index_at(index, i);
+	return !strncmp(found, cmd, len) && found[len] == '\0';
+}
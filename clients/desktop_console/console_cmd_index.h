@@ -0,0 +1,89 @@
+/*
+ * console_cmd_index.h - taiwins client console command index
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef TW_CONSOLE_CMD_INDEX_H
+#define TW_CONSOLE_CMD_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONSOLE_CMD_INDEX_FILE "cmds.index"
+
+/**
+ * @brief a sorted list of commands in $PATH, loaded with mmap.
+ *
+ * The index file has the layout: header, mtimes of every $PATH directory,
+ * sorted string offsets, the $PATH string then the command strings. It is
+ * used in place without parsing. The index is stale if $PATH or any
+ * directory mtime changed since it was built.
+ */
+struct console_cmd_index {
+	void *map;
+	size_t size;
+	uint32_t n_cmds;
+	const uint32_t *offsets;
+	const char *strings;
+	bool stale;
+};
+
+/**
+ * @brief load an index file, returns false if the file is not an index.
+ *
+ * A stale index is still loaded, check the stale flag.
+ */
+bool
+console_cmd_index_load(struct console_cmd_index *index, const char *file,
+                       const char *path_env);
+void
+console_cmd_index_unload(struct console_cmd_index *index);
+
+/**
+ * @brief scan all the directories in path_env then atomically replace the
+ * index file.
+ */
+bool
+console_cmd_index_build(const char *file, const char *path_env);
+
+/** first command not smaller than the prefix, it could be n_cmds */
+uint32_t
+console_cmd_index_lower_bound(const struct console_cmd_index *index,
+                              const char *prefix, size_t len);
+bool
+console_cmd_index_find(const struct console_cmd_index *index,
+                       const char *cmd, size_t len);
+
+static inline const char *
+console_cmd_index_at(const struct console_cmd_index *index, uint32_t i)
+{
+	return index->strings + index->offsets[i];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* EOF */
@@ -0,0 +1,375 @@
+/*
+ * console_fuzzy.c - taiwins client console fuzzy search index
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "console_fuzzy.h"
+
+#define TRIGRAM(s) (((uint32_t)(unsigned char)(s)[0] << 16) | \
+                    ((uint32_t)(unsigned char)(s)[1] << 8) | \
+                    ((uint32_t)(unsigned char)(s)[2]))
+
+struct fuzzy_gram {
+	uint32_t key;
+	uint32_t id;
+};
+
+static inline void
+fuzzy_lower(char *dst, const char *src, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n-1 && src[i]; i++)
+		dst[i] = tolower((unsigned char)src[i]);
+	dst[i] = '\0';
+}
+
+static inline uint64_t
+fuzzy_char_bit(unsigned char c)
+{
+	if (c >= 'a' && c <= 'z')
+		return 1ull << (c - 'a');
+	else if (c >= '0' && c <= '9')
+		return 1ull << (26 + c - '0');
+	else if (isspace(c))
+		return 0;
+	return 1ull << 63;
+}
+
+static inline uint64_t
+fuzzy_char_mask(const char *s)
+{
+	uint64_t mask = 0;
+
+	for (; *s; s++)
+		mask |= fuzzy_char_bit(*s);
+	return mask;
+}
+
+static int
+fuzzy_cmp_gram(const void *a, const void *b)
+{
+	const struct fuzzy_gram *ga = a, *gb = b;
+
+	if (ga->key != gb->key)
+		return ga->key < gb->key ? -1 : 1;
+	return (ga->id > gb->id) - (ga->id < gb->id);
+}
+
+/* approximate substring edit distance, the name is free to skip its prefix
+ * and suffix, so the score is about how far the query is from the closest
+ * window of the name. Both strings are shorter than CONSOLE_FUZZY_MAX_LEN */
+static uint32_t
+fuzzy_edit_distance(const char *q, size_t lq, const char *name, size_t ln)
+{
+	uint8_t rows[2][CONSOLE_FUZZY_MAX_LEN+1];
+	uint8_t *prev = rows[0], *curr = rows[1], *tmp;
+	uint8_t best;
+
+	for (size_t j = 0; j <= ln; j++)
+		prev[j] = 0;
+	for (size_t i = 1; i <= lq; i++) {
+		curr[0] = i;
+		for (size_t j = 1; j <= ln; j++) {
+			uint8_t del = prev[j] + 1;
+			uint8_t ins = curr[j-1] + 1;
+			uint8_t sub = prev[j-1] + (q[i-1] != name[j-1]);
+
+			curr[j] = del < ins ? del : ins;
+			curr[j] = curr[j] < sub ? curr[j] : sub;
+		}
+		tmp = prev;
+		prev = curr;
+		curr = tmp;
+	}
+	best = prev[0];
+	for (size_t j = 1; j <= ln; j++)
+		best = prev[j] < best ? prev[j] : best;
+	return best;
+}
+
+static inline bool
+fuzzy_is_subseq(const char *q, const char *s)
+{
+	for (; *q && *s; s++)
+		if (*q == *s)
+			q++;
+	return *q == '\0';
+}
+
+/* score fits in CONSOLE_FUZZY_MAX_SCORE, so we can bucket sort it */
+static inline uint32_t
+fuzzy_score(enum console_fuzzy_match_type type, const char *q, size_t lq,
+            const char *name)
+{
+	size_t ln = strnlen(name, CONSOLE_FUZZY_MAX_LEN-1);
+	uint32_t dist = type < CONSOLE_FUZZY_SUBSEQ ?
+		0 : fuzzy_edit_distance(q, lq, name, ln);
+
+	return ((uint32_t)type << 12) | (dist << 6) | (uint32_t)ln;
+}
+
+static inline enum console_fuzzy_match_type
+fuzzy_substr_type(const char *name, const char *hit)
+{
+	if (hit == name)
+		return CONSOLE_FUZZY_PREFIX;
+	else if (!isalnum((unsigned char)hit[-1]))
+		return CONSOLE_FUZZY_WORD;
+	return CONSOLE_FUZZY_SUBSTR;
+}
+
+static inline void
+fuzzy_add_match(struct console_fuzzy_index *index, uint32_t *n, uint32_t id,
+                enum console_fuzzy_match_type type, const char *q, size_t lq)
+{
+	struct console_fuzzy_match *m = &index->matches[(*n)++];
+
+	m->index = id;
+	m->score = fuzzy_score(type, q, lq, index->names[id]);
+	index->seen[id] = index->stamp;
+}
+
+static const uint32_t *
+fuzzy_find_postings(const struct console_fuzzy_index *index, uint32_t key,
+                    uint32_t *len)
+{
+	uint32_t lo = 0, hi = index->n_grams;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if (index->grams[mid] < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == index->n_grams || index->grams[lo] != key) {
+		*len = 0;
+		return NULL;
+	}
+	*len = index->offsets[lo+1] - index->offsets[lo];
+	return &index->postings[index->offsets[lo]];
+}
+
+/* substring matches, through the trigram postings if the query is long
+ * enough, we pick the shortest postings list then verify the candidates */
+static uint32_t
+fuzzy_search_substr(struct console_fuzzy_index *index, const char *q,
+                    size_t lq, uint64_t qmask)
+{
+	uint32_t n = 0, len = 0, min_len = UINT32_MAX;
+	const uint32_t *list = NULL, *postings;
+	const char *hit;
+
+	if (lq < 3) {
+		for (uint32_t i = 0; i < index->n_entries; i++) {
+			if ((index->masks[i] & qmask) != qmask)
+				continue;
+			if ((hit = strstr(index->names[i], q)))
+				fuzzy_add_match(index, &n, i,
+				                fuzzy_substr_type(index->names[i],
+				                                  hit), q, lq);
+		}
+		return n;
+	}
+	for (size_t i = 0; i + 3 <= lq; i++) {
+		postings = fuzzy_find_postings(index, TRIGRAM(q+i), &len);
+		if (!postings)
+			return 0;
+		if (len < min_len) {
+			min_len = len;
+			list = postings;
+		}
+	}
+	for (uint32_t i = 0; i < min_len; i++) {
+		uint32_t id = list[i];
+
+		if ((hit = strstr(index->names[id], q)))
+			fuzzy_add_match(index, &n, id,
+			                fuzzy_substr_type(index->names[id], hit),
+			                q, lq);
+	}
+	return n;
+}
+
+static uint32_t
+fuzzy_search_subseq(struct console_fuzzy_index *index, const char *q,
+                    size_t lq, uint64_t qmask, uint32_t n)
+{
+	for (uint32_t i = 0; i < index->n_entries; i++) {
+		if (index->seen[i] == index->stamp ||
+		    (index->masks[i] & qmask) != qmask)
+			continue;
+		if (fuzzy_is_subseq(q, index->names[i]))
+			fuzzy_add_match(index, &n, i, CONSOLE_FUZZY_SUBSEQ,
+			                q, lq);
+	}
+	return n;
+}
+
+/* stable counting sort on the score, matches of the same score stay in
+ * the index order. It is much cheaper than qsort for thousands of matches */
+static void
+fuzzy_sort_matches(struct console_fuzzy_index *index, uint32_t n)
+{
+	uint32_t *counts = index->counts, sum = 0;
+
+	memset(counts, 0, sizeof(uint32_t) * CONSOLE_FUZZY_MAX_SCORE);
+	for (uint32_t i = 0; i < n; i++)
+		counts[index->matches[i].score]++;
+	for (uint32_t i = 0; i < CONSOLE_FUZZY_MAX_SCORE; i++) {
+		uint32_t c = counts[i];
+		counts[i] = sum;
+		sum += c;
+	}
+	for (uint32_t i = 0; i < n; i++)
+		index->sorted[counts[index->matches[i].score]++] =
+			index->matches[i];
+}
+
+uint32_t
+console_fuzzy_index_search(struct console_fuzzy_index *index,
+                           const char *query,
+                           const struct console_fuzzy_match **matches)
+{
+	char q[CONSOLE_FUZZY_MAX_LEN];
+	uint64_t qmask;
+	size_t lq;
+	uint32_t n;
+
+	*matches = index->sorted;
+	fuzzy_lower(q, query, sizeof(q));
+	if (!(lq = strlen(q)) || !index->n_entries)
+		return 0;
+	qmask = fuzzy_char_mask(q);
+	//stamp wraps, clear the seen marks then
+	if (++index->stamp == 0) {
+		memset(index->seen, 0, sizeof(uint32_t) * index->n_entries);
+		index->stamp = 1;
+	}
+
+	n = fuzzy_search_substr(index, q, lq, qmask);
+	n = fuzzy_search_subseq(index, q, lq, qmask, n);
+	fuzzy_sort_matches(index, n);
+	*matches = index->sorted;
+	return n;
+}
+
+static bool
+fuzzy_build_grams(struct console_fuzzy_index *index)
+{
+	struct fuzzy_gram *grams;
+	size_t n = 0, alloc = 0, u = 0;
+
+	for (uint32_t i = 0; i < index->n_entries; i++) {
+		size_t len = strlen(index->names[i]);
+		alloc += len > 2 ? len - 2 : 0;
+	}
+	if (!(grams = calloc(alloc ? alloc : 1, sizeof(*grams))))
+		return false;
+	for (uint32_t i = 0; i < index->n_entries; i++) {
+		const char *name = index->names[i];
+
+		for (size_t j = 0; name[j] && name[j+1] && name[j+2]; j++) {
+			grams[n].key = TRIGRAM(name+j);
+			grams[n].id = i;
+			n++;
+		}
+	}
+	qsort(grams, n, sizeof(*grams), fuzzy_cmp_gram);
+
+	index->postings = calloc(n ? n : 1, sizeof(uint32_t));
+	index->grams = calloc(n ? n : 1, sizeof(uint32_t));
+	index->offsets = calloc(n + 1, sizeof(uint32_t));
+	if (!index->postings || !index->grams || !index->offsets) {
+		free(grams);
+		return false;
+	}
+	//compact the sorted pairs, remove duplicates from the same entry
+	index->n_grams = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (i && grams[i].key == grams[i-1].key &&
+		    grams[i].id == grams[i-1].id)
+			continue;
+		if (!index->n_grams ||
+		    index->grams[index->n_grams-1] != grams[i].key) {
+			index->grams[index->n_grams] = grams[i].key;
+			index->offsets[index->n_grams] = u;
+			index->n_grams++;
+		}
+		index->postings[u++] = grams[i].id;
+	}
+	index->offsets[index->n_grams] = u;
+	free(grams);
+	return true;
+}
+
+bool
+console_fuzzy_index_init(struct console_fuzzy_index *index,
+                         const char *const *names, uint32_t n)
+{
+	memset(index, 0, sizeof(*index));
+	index->n_entries = n;
+	index->names = calloc(n ? n : 1, sizeof(char *));
+	index->masks = calloc(n ? n : 1, sizeof(uint64_t));
+	index->seen = calloc(n ? n : 1, sizeof(uint32_t));
+	index->matches = calloc(n ? n : 1, sizeof(struct console_fuzzy_match));
+	index->sorted = calloc(n ? n : 1, sizeof(struct console_fuzzy_match));
+	index->counts = calloc(CONSOLE_FUZZY_MAX_SCORE, sizeof(uint32_t));
+	if (!index->names || !index->masks || !index->seen ||
+	    !index->matches || !index->sorted || !index->counts)
+		goto err;
+
+	for (uint32_t i = 0; i < n; i++) {
+		if (!(index->names[i] = malloc(CONSOLE_FUZZY_MAX_LEN)))
+			goto err;
+		fuzzy_lower(index->names[i], names[i] ? names[i] : "",
+		            CONSOLE_FUZZY_MAX_LEN);
+		index->masks[i] = fuzzy_char_mask(index->names[i]);
+	}
+	if (!fuzzy_build_grams(index))
+		goto err;
+	return true;
+err:
+	console_fuzzy_index_fini(index);
+	return false;
+}
+
+void
+console_fuzzy_index_fini(struct console_fuzzy_index *index)
+{
+	for (uint32_t i = 0; index->names && i < index->n_entries; i++)
+		free(index->names[i]);
+	free(index->names);
+	free(index->masks);
+	free(index->seen);
+	free(index->matches);
+	free(index->sorted);
+	free(index->counts);
+	free(index->grams);
+	free(index->offsets);
+	free(index->postings);
+	memset(index, 0, sizeof(*index));
+}
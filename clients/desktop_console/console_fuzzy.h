@@ -0,0 +1,96 @@
+/*
+ * console_fuzzy.h - taiwins client console fuzzy search index
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef TW_CONSOLE_FUZZY_H
+#define TW_CONSOLE_FUZZY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONSOLE_FUZZY_MAX_LEN 64
+#define CONSOLE_FUZZY_MAX_SCORE (4 << 12)
+
+enum console_fuzzy_match_type {
+	CONSOLE_FUZZY_PREFIX = 0,
+	CONSOLE_FUZZY_WORD, /**< substring starting on a word boundary */
+	CONSOLE_FUZZY_SUBSTR,
+	CONSOLE_FUZZY_SUBSEQ,
+};
+
+struct console_fuzzy_match {
+	uint32_t index;
+	uint32_t score; /**< lower is better */
+};
+
+/**
+ * @brief an immutable search index over a list of names
+ *
+ * The index is built once, substring queries go through the trigram
+ * postings, the subsequence matching uses a per-entry character mask to skip
+ * entries quickly. Every match is ranked by the match type, then the edit
+ * distance from the query to the closest part of the name, then the length.
+ *
+ * The index is not thread-safe, search uses the internal scratch buffers.
+ */
+struct console_fuzzy_index {
+	uint32_t n_entries;
+	char **names; /**< lower case copies of names */
+	uint64_t *masks;
+
+	uint32_t n_grams;
+	uint32_t *grams; /**< sorted trigram keys */
+	uint32_t *offsets; /**< n_grams + 1 offsets into postings */
+	uint32_t *postings;
+
+	/* scratch */
+	uint32_t stamp;
+	uint32_t *seen;
+	uint32_t *counts;
+	struct console_fuzzy_match *matches, *sorted;
+};
+
+bool
+console_fuzzy_index_init(struct console_fuzzy_index *index,
+                         const char *const *names, uint32_t n);
+void
+console_fuzzy_index_fini(struct console_fuzzy_index *index);
+
+/**
+ * @brief search the index, returns number of matches sorted by score.
+ *
+ * The returned matches are valid until next search.
+ */
+uint32_t
+console_fuzzy_index_search(struct console_fuzzy_index *index,
+                           const char *query,
+                           const struct console_fuzzy_match **matches);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* EOF */
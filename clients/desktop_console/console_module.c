@@ -23,6 +23,7 @@
 #include <string.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdatomic.h>
 
 #include <ctypes/vector.h>
 #include "console.h"
@@ -118,7 +119,7 @@ cache_free(struct module_search_cache *cache)
 
 static void
 cache_filter(struct module_search_cache *cache,
-	     char *command, vector_t *v,
+	     const char *command, vector_t *v,
 	     bool (*filter_test)(const char *cmd, const char *candidate))
 {
 	console_search_entry_t *entry = NULL;
@@ -144,22 +145,117 @@ cache_filter(struct module_search_cache *cache,
 
 static inline bool
 cachable(const struct module_search_cache *cache,
-	 char *command)
+	 const char *command)
 {
 	return command != NULL && cache->last_command != NULL &&
 		strstr(command, cache->last_command) == command &&
 		strcmp(cache->last_command, command) <= 0;
 }
 
+static inline struct console_module_command *
+module_command_new(const char *command, unsigned int gen)
+{
+	size_t len = strlen(command);
+	struct console_module_command *cmd = malloc(sizeof(*cmd) + len + 1);
+
+	if (!cmd)
+		return NULL;
+	cmd->gen = gen;
+	memcpy(cmd->command, command, len + 1);
+	return cmd;
+}
+
+static inline struct console_module_result *
+module_result_new(unsigned int gen)
+{
+	struct console_module_result *res = calloc(1, sizeof(*res));
+
+	if (res)
+		res->gen = gen;
+	return res;
+}
+
+static void
+module_result_destroy(struct console_module_result *res)
+{
+	if (!res)
+		return;
+	if (res->search_results.elems)
+		vector_destroy(&res->search_results);
+	free(res->exec_res);
+	free(res);
+}
+
+/* swap the result in, a result not taken by now is outdated */
+static inline void
+module_result_publish(_Atomic(struct console_module_result *) *slot,
+                      struct console_module_result *res)
+{
+	module_result_destroy(atomic_exchange(slot, res));
+}
+
+static void
+module_run_exec(struct console_module *module)
+{
+	struct console_module_command *cmd =
+		atomic_exchange(&module->exec_command, NULL);
+	struct console_module_result *res;
+
+	if (!cmd)
+		return;
+	if ((res = module_result_new(cmd->gen))) {
+		res->ret = module->exec(module, cmd->command, &res->exec_res);
+		module_result_publish(&module->exec_result, res);
+	}
+	free(cmd);
+}
+
+static void
+module_run_search(struct console_module *module,
+                  struct module_search_cache *cache)
+{
+	struct console_module_command *cmd =
+		atomic_exchange(&module->search_command, NULL);
+	struct console_module_result *res;
+
+	if (!cmd)
+		return;
+	module->running_gen = cmd->gen;
+	//a newer search is issued already
+	if (console_module_search_cancelled(module) ||
+	    !(res = module_result_new(cmd->gen)))
+		goto out;
+
+	//deal with cache first
+	if (atomic_exchange(&module->cache_stale, false))
+		cache_free(cache);
+	if (module->support_cache && cachable(cache, cmd->command)) {
+		cache_filter(cache, cmd->command, &res->search_results,
+		             module->filter_test);
+	} else {
+		res->ret = module->search(module, cmd->command,
+		                          &res->search_results);
+		//partial results are neither cached nor published
+		if (console_module_search_cancelled(module)) {
+			module_result_destroy(res);
+			goto out;
+		}
+		cache_takes(cache, &res->search_results, cmd->command);
+	}
+	module_result_publish(&module->search_result, res);
+out:
+	free(cmd);
+}
+
 /**
  * @brief running thread for the module,
  *
- * module thread is a consumer for commands and producer for results. If the
- * results is not taken, it needs to clean up before do it again.
- *
- * Console thread does the reverse. It is the consumer of results and producer
- * of commands, if the commands it produced is not taken, it needs to reset it
- * manually.
+ * module thread is a consumer for commands and producer for results, console
+ * thread does the reverse. Commands and results are single pointer slots
+ * swapped atomically, so neither side blocks the other. Only the latest
+ * search command is kept, every search command bumps the search generation,
+ * running searches can check it through console_module_search_cancelled and
+ * quit early.
  *
  * We have a general cache method to reduce the uncessary module searching.
  */
@@ -167,74 +263,13 @@ void *
 thread_run_module(void *arg)
 {
 	struct console_module *module = arg;
-	char *exec_command = NULL, *search_command = NULL;
-	char *exec_res = NULL;
-	vector_t search_results = {0};
-	int exec_ret = 0, search_ret = 0;
 	struct module_search_cache cache;
 
 	cache_init(&cache);
 
-	while (!module->quit) {
-		//exec, enter critial
-		pthread_mutex_lock(&module->command_mutex);
-		if (module->exec_command) {
-			exec_command = module->exec_command;
-			module->exec_command = NULL;
-		}
-		pthread_mutex_unlock(&module->command_mutex);
-		if (exec_command) {
-			exec_ret = module->exec(module, exec_command,
-						&exec_res);
-			free(exec_command);
-			exec_command = NULL;
-		}
-
-		//again, if results are not taken, we need to free it.
-		pthread_mutex_lock(&module->results_mutex);
-		if (module->exec_res) {
-			free(module->exec_res);
-			module->exec_res = NULL;
-		}
-		if (exec_res)
-			module->exec_res = exec_res;
-		module->exec_ret = exec_ret;
-		exec_res = NULL;
-		pthread_mutex_unlock(&module->results_mutex);
-
-		//search
-		pthread_mutex_lock(&module->command_mutex);
-		if (module->search_command) {
-			search_command = module->search_command;
-			module->search_command = NULL;
-		}
-		pthread_mutex_unlock(&module->command_mutex);
-		//deal with cache first
-		if (module->support_cache && cachable(&cache, search_command))
-			cache_filter(&cache, search_command, &search_results,
-				module->filter_test);
-		else if (search_command) {
-			search_ret = module->search(module, search_command,
-						    &search_results);
-			//fprintf(stderr, "search for %s has %d results\n", search_command,
-			//	search_results.len);
-			cache_takes(&cache, &search_results, search_command);
-			free(search_command);
-			search_command = NULL;
-		}
-
-		pthread_mutex_lock(&module->results_mutex);
-		if (module->search_results.elems)
-			vector_destroy(&module->search_results);
-		module->search_results = search_results;
-		module->search_ret = search_ret;
-		search_results = (vector_t){0};
-		search_ret = 0;
-		pthread_mutex_unlock(&module->results_mutex);
-
-		/* int value; */
-		/* sem_getvalue(&module->semaphore, &value); */
-		/* fprintf(stderr, "sem value now : %d\n", value); */
+	while (!atomic_load(&module->quit)) {
+		module_run_exec(module);
+		module_run_search(module, &cache);
 		sem_wait(&module->semaphore);
 	}
 	cache_free(&cache);
@@ -254,25 +289,24 @@ console_module_init(struct console_module *module,
                     struct desktop_console *console)
 {
 	module->console = console;
-	pthread_mutex_init(&module->command_mutex, NULL);
-	pthread_mutex_init(&module->results_mutex, NULL);
-	sem_init(&module->semaphore, 0, 0);
-	pthread_create(&module->thread, NULL, thread_run_module,
-		       (void *)module);
-	if (module->init_hook)
-		module->init_hook(module);
+	//cleanup the module data before the thread runs
+	atomic_init(&module->quit, false);
+	atomic_init(&module->cache_stale, false);
+	atomic_init(&module->search_command, NULL);
+	atomic_init(&module->exec_command, NULL);
+	atomic_init(&module->search_gen, 0);
+	atomic_init(&module->search_result, NULL);
+	atomic_init(&module->exec_result, NULL);
+	module->running_gen = 0;
 	if (!module->filter_test)
 		module->filter_test = console_module_filter_test;
 
-	//cleanup the module data
-	module->exec_command = NULL;
-	module->search_command = NULL;
-	module->search_ret = 0;
-	module->exec_ret = 0;
-	vector_init_zero(&module->search_results,
-	                 sizeof(console_search_entry_t), search_entry_free);
-	module->exec_res = NULL;
-	module->quit = false;
+	//the module data is ready before the first search comes in
+	if (module->init_hook)
+		module->init_hook(module);
+	sem_init(&module->semaphore, 0, 0);
+	pthread_create(&module->thread, NULL, thread_run_module,
+		       (void *)module);
 }
 
 void
@@ -280,31 +314,20 @@ console_module_release(struct console_module *module)
 {
 	int lock_state = -1;
 
-	module->quit = true;
+	atomic_store(&module->quit, true);
 	//wake the threads
 	while (lock_state <= 0) {
 		sem_getvalue(&module->semaphore, &lock_state);
 		sem_post(&module->semaphore);
 	}
 	pthread_join(module->thread, NULL);
-
-	pthread_mutex_lock(&module->command_mutex);
-	if (module->search_command) {
-		free(module->search_command);
-		module->search_command = NULL;
-	}
-	if (module->exec_command) {
-		free(module->exec_command);
-		module->exec_command = NULL;
-	}
-	pthread_mutex_unlock(&module->command_mutex);
-
-	pthread_mutex_destroy(&module->command_mutex);
-	pthread_mutex_destroy(&module->results_mutex);
 	sem_destroy(&module->semaphore);
 
-	if (module->search_results.elems)
-		vector_destroy(&module->search_results);
+	free(atomic_exchange(&module->search_command, NULL));
+	free(atomic_exchange(&module->exec_command, NULL));
+	module_result_destroy(atomic_exchange(&module->search_result, NULL));
+	module_result_destroy(atomic_exchange(&module->exec_result, NULL));
+
 	if (module->destroy_hook)
 		module->destroy_hook(module);
 }
@@ -313,25 +336,21 @@ void
 console_module_command(struct console_module *module,
 		       const char *search, const char *exec)
 {
+	struct console_module_command *cmd;
+	unsigned int gen;
+
 	if (search && strlen(search)) {
-		pthread_mutex_lock(&module->command_mutex);
-		if (module->search_command)
-			free(module->search_command);
-		module->search_command = strdup(search);
-		pthread_mutex_unlock(&module->command_mutex);
+		//the generation goes first, so the running search stops
+		gen = atomic_fetch_add(&module->search_gen, 1) + 1;
+		if ((cmd = module_command_new(search, gen)))
+			free(atomic_exchange(&module->search_command, cmd));
 		sem_post(&module->semaphore);
 	}
 	if (exec && strlen(exec)) {
-		pthread_mutex_lock(&module->command_mutex);
-		if (module->exec_command)
-			free(module->exec_command);
-		module->exec_command = strdup(exec);
-		pthread_mutex_unlock(&module->command_mutex);
+		if ((cmd = module_command_new(exec, 0)))
+			free(atomic_exchange(&module->exec_command, cmd));
 		sem_post(&module->semaphore);
 	}
-	/* int value; */
-	/* sem_getvalue(&module->semaphore, &value); */
-	/* fprintf(stderr, "sem value now : %d\n", value); */
 }
 
 int
@@ -339,20 +358,21 @@ desktop_console_take_search_result(struct console_module *module,
 				  vector_t *ret)
 {
 	int retcode = 0;
+	struct console_module_result *res =
+		atomic_exchange(&module->search_result, NULL);
 
-	if (pthread_mutex_trylock(&module->results_mutex))
+	if (!res)
+		return 0;
+	//outdated, keep the current results until the new one arrives
+	if (res->gen != atomic_load(&module->search_gen)) {
+		module_result_destroy(res);
 		return 0;
-	if (module->search_results.len == -1) //taken
-		;
-	else {
-		vector_destroy(ret);
-		*ret = module->search_results;
-		module->search_results = (vector_t){0};
-		module->search_results.len = -1; //taken
-		retcode = module->search_ret;
-		module->search_ret = 0;
 	}
-	pthread_mutex_unlock(&module->results_mutex);
+	vector_destroy(ret);
+	*ret = res->search_results;
+	res->search_results = (vector_t){0};
+	retcode = res->ret;
+	module_result_destroy(res);
 	return retcode;
 }
 
@@ -361,17 +381,15 @@ desktop_console_take_exec_result(struct console_module *module,
 				char **result)
 {
 	int retcode = 0;
-	if (pthread_mutex_trylock(&module->results_mutex)) {
-		*result = NULL;
-		return 0;
-	}
-	//pthread_mutex_lock(&module->results_mutex);
-	if (module->exec_res)
-		*result = module->exec_res;
-	module->exec_res = NULL;
-	retcode = module->exec_ret;
-	module->exec_ret = 0;
-	pthread_mutex_unlock(&module->results_mutex);
+	struct console_module_result *res =
+		atomic_exchange(&module->exec_result, NULL);
 
+	*result = NULL;
+	if (!res)
+		return 0;
+	*result = res->exec_res;
+	res->exec_res = NULL;
+	retcode = res->ret;
+	module_result_destroy(res);
 	return retcode;
 }
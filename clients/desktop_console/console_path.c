@@ -74,7 +74,7 @@ console_path_module_search(struct console_module *module, const char *to_search,
 		size_t read, to_read = buffer.alloc_len - buffer.len;
 		read = fread(vector_at(&buffer, buffer.len),
 			     buffer.elemsize, to_read, pipe);
-		if (feof(pipe))
+		if (feof(pipe) || console_module_search_cancelled(module))
 			break;
 		if (read == to_read)
 			vector_resize(&buffer, buffer.len * 2);
@@ -25,9 +25,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <string.h>
+#include <inttypes.h>
 #include <wayland-util.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -35,6 +38,7 @@
 #include <fcntl.h>
 #include <cairo.h>
 
+#include <ctypes/helpers.h>
 #include <ctypes/strops.h>
 #include <ctypes/os/file.h>
 #include <ctypes/sequential.h>
@@ -48,6 +52,8 @@
 struct icon_cache_option {
 	bool update_all;
 	bool force_update;
+	bool dump_png;
+	int jobs; //number of worker threads
 	const char *update_theme;
 	int high_res; //highest resolution to search
 	int low_res; //lowest resolution to search
@@ -58,6 +64,22 @@ struct icon_cache_config {
 	char path[256];
 	int high_res;
 	int low_res;
+	struct icontheme_dir theme;
+};
+
+/* one cache file to generate, namely a (theme, icon type) pair */
+struct icon_cache_job {
+	const struct icon_cache_config *current;
+	unsigned int type;
+};
+
+struct icon_cache_pool {
+	const struct icon_cache_option *option;
+	const struct icontheme_dir *hicolor;
+	struct dhash_table *table;
+	vector_t jobs;
+	atomic_uint next_job;
+	atomic_uint updated, skipped;
 };
 
 static const char *usage =
@@ -68,6 +90,8 @@ static const char *usage =
 	"\n"
 	"Application options:\n"
 	"  -f, --force\t\t\tIgnore the existing cache\n"
+	"  -j, --jobs\t\t\tNumber of worker threads, default number of cpus\n"
+	"  -p, --dump-png\t\tWrite a PNG copy of the atlas for debugging\n"
 	"  -h, --hires\t\t\tSpecify the highest resolution to sample, maximum 256, default 128\n"
 	"  -l, --lowres\t\t\tSpecify the lowest resolution to sample, minimum 32, default 32\n"
 	"  -t, --theme\t\t\tSepcify the theme to update, default all\n"
@@ -119,16 +143,63 @@ name_from_icon_type(uint32_t type)
 	return NULL;
 }
 
+/* the manifest records the source images of a cache, the cache is only
+ * regenerated if any image is added, removed or modified. */
+static uint64_t
+manifest_digest(const struct wl_array *string_pool, uint32_t *count)
+{
+	//FNV-1a over the path and mtime of every source image
+	uint64_t hash = 0xcbf29ce484222325ull;
+	const char *str = string_pool->data;
+	const char *end = str + string_pool->size;
+	struct stat st;
+
+	*count = 0;
+	for (; str < end; str += strlen(str) + 1) {
+		int64_t stamps[3] = {-1, 0, 0};
+
+		if (!stat(str, &st)) {
+			stamps[0] = st.st_mtim.tv_sec;
+			stamps[1] = st.st_mtim.tv_nsec;
+			stamps[2] = st.st_size;
+		}
+		for (const char *c = str; *c; c++)
+			hash = (hash ^ (unsigned char)*c) * 0x100000001b3ull;
+		for (unsigned i = 0; i < sizeof(stamps); i++)
+			hash = (hash ^ ((unsigned char *)stamps)[i]) *
+				0x100000001b3ull;
+		(*count)++;
+	}
+	return hash;
+}
+
 static bool
-cache_needs_update(const char *cache_file, const char *theme_path)
+cache_needs_update(const char *cache_file, const char *manifest_file,
+                   uint64_t digest, uint32_t count)
 {
-	struct stat cache_stat, theme_stat;
-	if (!is_file_exist(cache_file))
+	uint64_t old_digest = 0;
+	uint32_t old_count = 0;
+	bool same = false;
+	FILE *f;
+
+	if (!is_file_exist(cache_file) || !(f = fopen(manifest_file, "r")))
 		return true;
-	stat(cache_file, &cache_stat);
-	stat(theme_path, &theme_stat);
-	return theme_stat.st_mtim.tv_sec >
-		cache_stat.st_mtim.tv_sec;
+	same = fscanf(f, "%" SCNu32 " %" SCNx64, &old_count, &old_digest)
+		== 2 && old_count == count && old_digest == digest;
+	fclose(f);
+	return !same;
+}
+
+static void
+cache_write_manifest(const char *manifest_file, uint64_t digest,
+                     uint32_t count)
+{
+	FILE *f = fopen(manifest_file, "w");
+
+	if (!f)
+		return;
+	fprintf(f, "%" PRIu32 " %016" PRIx64 "\n", count, digest);
+	fclose(f);
 }
 
 static bool
@@ -137,6 +208,8 @@ parse_arguments(int argc, char *argv[],
 {
 	//defaults
 	option->force_update = false;
+	option->dump_png = false;
+	option->jobs = sysconf(_SC_NPROCESSORS_ONLN);
 	option->update_all = true;
 	option->update_theme = NULL;
 	option->high_res = 128;
@@ -150,6 +223,13 @@ parse_arguments(int argc, char *argv[],
 			return false;
 		} else if (!strcmp(arg, "-f") || !strcmp(arg, "--force"))
 			option->force_update = true;
+		else if (!strcmp(arg, "-p") || !strcmp(arg, "--dump-png"))
+			option->dump_png = true;
+		else if ((!strcmp(arg, "-j") || !strcmp(arg, "--jobs")) &&
+		         (i+1) < argc) {
+			option->jobs = atoi(argv[i+1]);
+			i++;
+		}
 		else if (!strcmp(arg, "--theme") && (i+1) < argc) {
 			option->update_theme = argv[i+1];
 			option->update_all = false;
@@ -187,6 +267,8 @@ parse_arguments(int argc, char *argv[],
 	if (option->high_res <= option->low_res ||
 	    option->high_res > 256 || option->low_res < 32)
 		return false;
+	if (option->jobs <= 0)
+		option->jobs = 1;
 	return true;
 }
 
@@ -254,92 +336,149 @@ icon_is_app(const char *key, void *user_data)
 }
 
 static void
-update_theme(const struct icon_cache_config *current,
-             const struct icon_cache_option *option,
-             const struct icontheme_dir *hicolor,
-             struct dhash_table *table)
+dump_cache_png(const struct image_cache *cache, const char *cache_file)
+{
+	char png_file[PATH_MAX+4];
+	cairo_surface_t *surface =
+		cairo_image_surface_create_for_data(cache->atlas,
+		                                    CAIRO_FORMAT_ARGB32,
+		                                    cache->dimension.w,
+		                                    cache->dimension.h,
+		                                    cache->dimension.w * 4);
+	snprintf(png_file, sizeof(png_file), "%s.png", cache_file);
+	cairo_surface_write_to_png(surface, png_file);
+	cairo_surface_destroy(surface);
+}
+
+static bool
+write_cache(struct image_cache *cache, const char *cache_file)
+{
+	char tmp_file[PATH_MAX+8];
+	int fd;
+
+	//write then rename, so the console never reads a partial cache
+	snprintf(tmp_file, sizeof(tmp_file), "%s.XXXXXX", cache_file);
+	if ((fd = mkstemp(tmp_file)) < 0)
+		return false;
+	fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP);
+	image_cache_to_fd(cache, fd);
+	close(fd);
+	if (rename(tmp_file, cache_file)) {
+		unlink(tmp_file);
+		return false;
+	}
+	return true;
+}
+
+static void
+update_theme_cache(const struct icon_cache_job *job,
+                   struct icon_cache_pool *pool)
 {
-	char cache_file[PATH_MAX];
+	const struct icon_cache_option *option = pool->option;
+	const struct icon_cache_config *current = job->current;
+	const struct icontheme_dir *hicolor = pool->hicolor;
+	const unsigned int i = job->type;
+	char cache_file[PATH_MAX], manifest_file[PATH_MAX+16];
 	char path[256];
-	strcpy(path, current->path);
-	char *name = basename(path);
-	struct icontheme_dir theme;
+	char *name;
 	const struct wl_array *dirs[] = {
-		&theme.apps, &theme.mimes, &theme.places,
-		&theme.status, &theme.devices
+		&current->theme.apps, &current->theme.mimes,
+		&current->theme.places, &current->theme.status,
+		&current->theme.devices
 	};
 	const struct wl_array *hdirs[] = {
 		&hicolor->apps, &hicolor->mimes, &hicolor->places,
 		&hicolor->status, &hicolor->devices
 	};
-	icontheme_dir_init(&theme, current->path);
-	search_icon_dirs(&theme, current->low_res-1, current->high_res);
-
-	for (unsigned int i = 0; i < 5; i++) {
-		if (!(1 << i & option->update_list))
-			continue;
-		tw_cache_dir(cache_file);
-		strcat(cache_file, "/");
-		strcat(cache_file, name);
-		strcat(cache_file, name_from_icon_type(1 << i));
-
-		if (!cache_needs_update(cache_file, current->path) &&
-		    !option->force_update)
-			continue;
-		//retrieve image files
-		struct wl_array string_pool, handle_pool;
-
-		wl_array_init(&string_pool);
-		wl_array_init(&handle_pool);
-		// search on the dirs
-		search_icon_imgs(&handle_pool, &string_pool, current->path,
-		                 dirs[i]);
-		// search on the hicolor dir
-		search_icon_imgs(&handle_pool, &string_pool, hicolor_path,
-		                 hdirs[i]);
-		// this is special for apps, as they can take
-		// "/usr/share/pixmans" in the search range
-		if (i == 0)
-			search_icon_imgs_subdir(&handle_pool, &string_pool,
-			                        "/usr/share/pixmaps");
-		if (!handle_pool.size)
-			goto skip_writing;
-
-		//write cache
-		struct image_cache cache;
-		//TODO: later we may need other filters as well
-		if (i == 0)
-			cache = image_cache_from_arrays_filtered(&handle_pool,
-			                                         &string_pool,
-			                                         path_to_node,
-			                                         icon_is_app,
-			                                         table);
-		else
-			cache = image_cache_from_arrays(&handle_pool,
-			                                &string_pool,
-			                                path_to_node);
-
-		int flags = is_file_exist(cache_file) ? O_RDWR : O_RDWR | O_CREAT;
-		int fd = open(cache_file, flags, S_IRUSR | S_IWUSR | S_IRGRP);
-		image_cache_to_fd(&cache, fd);
-#if 0
-		cairo_surface_t *surface =
-			cairo_image_surface_create_for_data(cache.atlas,
-			                                    CAIRO_FORMAT_ARGB32,
-			                                    cache.dimension.w, cache.dimension.h,
-			                                    cache.dimension.w * 4);
-		strcat(cache_file, ".png");
-		cairo_surface_write_to_png(surface, cache_file);
-		cairo_surface_destroy(surface);
-#endif
+	struct wl_array string_pool, handle_pool;
+	struct image_cache cache;
+	uint64_t digest;
+	uint32_t count;
+
+	strcpy(path, current->path);
+	name = basename(path);
+	tw_cache_dir(cache_file);
+	strcat(cache_file, "/");
+	strcat(cache_file, name);
+	strcat(cache_file, name_from_icon_type(1 << i));
+	snprintf(manifest_file, sizeof(manifest_file), "%s.manifest",
+	         cache_file);
+
+	//retrieve image files
+	wl_array_init(&string_pool);
+	wl_array_init(&handle_pool);
+	// search on the dirs
+	search_icon_imgs(&handle_pool, &string_pool, current->path, dirs[i]);
+	// search on the hicolor dir
+	search_icon_imgs(&handle_pool, &string_pool, hicolor_path, hdirs[i]);
+	// this is special for apps, as they can take
+	// "/usr/share/pixmans" in the search range
+	if (i == 0)
+		search_icon_imgs_subdir(&handle_pool, &string_pool,
+		                        "/usr/share/pixmaps");
+	if (!handle_pool.size)
+		goto skip_writing;
+
+	//only rasterize the caches whose sources changed
+	digest = manifest_digest(&string_pool, &count);
+	if (!option->force_update &&
+	    !cache_needs_update(cache_file, manifest_file, digest, count)) {
+		atomic_fetch_add(&pool->skipped, 1);
+		goto skip_writing;
+	}
 
-		close(fd);
-		image_cache_release(&cache);
-	skip_writing:
-		wl_array_release(&handle_pool);
-		wl_array_release(&string_pool);
+	//write cache
+	//TODO: later we may need other filters as well
+	if (i == 0)
+		cache = image_cache_from_arrays_filtered(&handle_pool,
+		                                         &string_pool,
+		                                         path_to_node,
+		                                         icon_is_app,
+		                                         pool->table);
+	else
+		cache = image_cache_from_arrays(&handle_pool,
+		                                &string_pool,
+		                                path_to_node);
+	if (write_cache(&cache, cache_file)) {
+		cache_write_manifest(manifest_file, digest, count);
+		atomic_fetch_add(&pool->updated, 1);
 	}
-	icontheme_dir_release(&theme);
+	if (option->dump_png)
+		dump_cache_png(&cache, cache_file);
+	image_cache_release(&cache);
+skip_writing:
+	wl_array_release(&handle_pool);
+	wl_array_release(&string_pool);
+}
+
+static void *
+run_cache_worker(void *data)
+{
+	struct icon_cache_pool *pool = data;
+	unsigned int i;
+
+	while ((i = atomic_fetch_add(&pool->next_job, 1)) <
+	       (unsigned)pool->jobs.len)
+		update_theme_cache(vector_at(&pool->jobs, i), pool);
+	return NULL;
+}
+
+static void
+run_cache_jobs(struct icon_cache_pool *pool)
+{
+	int n = MIN(pool->option->jobs, pool->jobs.len);
+	pthread_t *threads = calloc(n > 0 ? n : 1, sizeof(pthread_t));
+	int started = 0;
+
+	for (int i = 0; threads && i < n; i++, started++)
+		if (pthread_create(&threads[i], NULL, run_cache_worker, pool))
+			break;
+	//run the jobs here if no thread could be started
+	if (!started)
+		run_cache_worker(pool);
+	for (int i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
 }
 
 int
@@ -348,6 +487,7 @@ main(int argc, char *argv[])
 	vector_t theme_lookups;
 	struct icon_cache_option option;
 	struct icon_cache_config *current = NULL;
+	struct icon_cache_pool pool = {0};
 	struct xdg_app_entry *app;
 	struct wl_array apps = {0};
 	struct dhash_table apps_cache;
@@ -372,10 +512,31 @@ main(int argc, char *argv[])
 	icontheme_dir_init(&hicolor_theme, hicolor_path);
 	search_icon_dirs(&hicolor_theme, option.low_res-1, option.high_res);
 
-	//now we just do the config
-	vector_for_each(current, &theme_lookups)
-		update_theme(current, &option, &hicolor_theme, &apps_cache);
+	//collect the jobs, the theme dirs are read-only for the workers
+	pool.option = &option;
+	pool.hicolor = &hicolor_theme;
+	pool.table = &apps_cache;
+	vector_init_zero(&pool.jobs, sizeof(struct icon_cache_job), NULL);
+	vector_for_each(current, &theme_lookups) {
+		icontheme_dir_init(&current->theme, current->path);
+		search_icon_dirs(&current->theme, current->low_res-1,
+		                 current->high_res);
+		for (unsigned int i = 0; i < 5; i++) {
+			struct icon_cache_job job = {
+				.current = current,
+				.type = i,
+			};
+			if (1 << i & option.update_list)
+				vector_append(&pool.jobs, &job);
+		}
+	}
+	run_cache_jobs(&pool);
+	fprintf(stderr, "icon caches: %u updated, %u up to date\n",
+	        atomic_load(&pool.updated), atomic_load(&pool.skipped));
 
+	vector_for_each(current, &theme_lookups)
+		icontheme_dir_release(&current->theme);
+	vector_destroy(&pool.jobs);
 	icontheme_dir_release(&hicolor_theme);
 	vector_destroy(&theme_lookups);
 	wl_array_release(&apps);
@@ -25,7 +25,10 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
+#include <sys/eventfd.h>
 #include <wayland-server.h>
 #include <wayland-util.h>
 #include <xkbcommon/xkbcommon.h>
@@ -42,11 +45,13 @@
 #include <taiwins/engine.h>
 #include <taiwins/backend.h>
 #include <taiwins/output_device.h>
+#include <taiwins/render_context.h>
 #include <taiwins/shell.h>
 
 #include "options.h"
 #include "bindings.h"
 #include "config.h"
+#include "render.h"
 
 #if _TW_HAS_XWAYLAND
 #include "xwayland.h"
@@ -143,6 +148,7 @@ tw_config_table_init(struct tw_config_table *table, struct tw_config *config,
 	vector_init_zero(&table->config_bindings, sizeof(struct tw_binding),
 	                 NULL);
 	vector_init_zero(&table->registry, sizeof(struct tw_config_obj), NULL);
+	vector_init_zero(&table->commands, sizeof(struct tw_config_cmd), NULL);
 	if (registry)
 		vector_copy(&table->registry, registry);
 	//TODO init xkb_rules, the rules right now is shared to the
@@ -158,6 +164,7 @@ tw_config_table_fini(struct tw_config_table *table)
 	table->dirty = false;
 	vector_destroy(&table->registry);
 	vector_destroy(&table->config_bindings);
+	vector_destroy(&table->commands);
 	if (table->user_data) {
 		config->fini(table);
 		table->user_data = NULL;
@@ -213,12 +220,16 @@ tw_config_table_flush(struct tw_config_table *t)
 	struct tw_engine *engine;
 	struct tw_engine_output *output;
 	struct tw_engine_seat *seat;
+	struct tw_render_context *ctx;
+	struct tw_render_pipeline *overlay;
 	struct tw_config *c = wl_container_of(t, c, config_table);
 
 	engine = c->engine;
 	desktop = tw_config_request_object(c, "desktop");
 	theme = tw_config_request_object(c, "theme");
 	shell = tw_config_request_object(c, "shell");
+	ctx = tw_config_request_object(c, TW_CONFIG_RENDER_CONTEXT);
+	overlay = tw_config_request_object(c, TW_CONFIG_RENDER_OVERLAY);
 	if (!t->dirty)
 		return;
 
@@ -257,6 +268,28 @@ tw_config_table_flush(struct tw_config_table *t)
 		t->theme.valid = false;
 	}
 
+	if (ctx && t->occluded_frame_interval.valid) {
+		tw_render_context_set_occluded_frame_interval(
+			ctx, t->occluded_frame_interval.uval);
+		t->occluded_frame_interval.valid = false;
+	}
+
+	if (ctx && t->client_budget.valid) {
+		struct tw_client_budget *budget = &c->client_budget;
+
+		*budget = t->client_budget.budget;
+		tw_render_context_set_client_policy(ctx,
+			(budget->commits || budget->damage || budget->upload) ?
+			tw_client_stats_over_budget : NULL, budget);
+		t->client_budget.valid = false;
+	}
+
+	if (overlay && t->debug_overlay.valid) {
+		tw_egl_render_pipeline_set_overlay(overlay,
+		                                   t->debug_overlay.uval);
+		t->debug_overlay.valid = false;
+	}
+
 	if (t->kb_repeat.valid && t->kb_repeat.val > 0 &&
 	    t->kb_delay.valid && t->kb_delay.val > 0) {
 		//TODO: set repeat info.
@@ -360,6 +393,7 @@ tw_config_apply_table(struct tw_config *config, struct tw_config_table *src)
 	purge_xkb_rules(&dst->xkb_rules);
 	vector_destroy(&dst->registry);
 	vector_destroy(&dst->config_bindings);
+	vector_destroy(&dst->commands);
 	tw_bindings_release(&dst->bindings);
 	config->fini(dst);
 	dst->user_data = NULL;
@@ -369,6 +403,18 @@ tw_config_apply_table(struct tw_config *config, struct tw_config_table *src)
 	tw_bindings_copy(&dst->bindings, &src->bindings);
 }
 
+static void
+tw_config_run_commands(struct tw_config *config)
+{
+	struct tw_config_cmd *cmd;
+	struct tw_config_table *t = &config->config_table;
+
+	vector_for_each(cmd, &t->commands)
+		cmd->run(config, cmd->data);
+	vector_destroy(&t->commands);
+	vector_init_zero(&t->commands, sizeof(struct tw_config_cmd), NULL);
+}
+
 static bool
 tw_try_config(struct tw_config_table *pending, char **err_msg)
 {
@@ -390,6 +436,36 @@ tw_try_config(struct tw_config_table *pending, char **err_msg)
 	return safe;
 }
 
+/**
+ * @brief second half of the config run, always on the main thread.
+ *
+ * The pending table is self-contained after the script evaluation. The
+ * registry is only copied here so objects registered while the script was
+ * running are not lost.
+ */
+static bool
+tw_config_run_finish(struct tw_config *config,
+                     struct tw_config_table *pending, bool safe)
+{
+	vector_copy(&pending->registry, &config->config_table.registry);
+	//we now use temporary config table
+	config->current = pending;
+	safe = safe && tw_config_install_bindings(pending);
+	safe = safe && tw_config_wake_compositor(config);
+
+	if (safe) {
+		tw_config_apply_table(config, pending);
+		tw_config_table_flush(&config->config_table);
+	} else {
+		tw_config_table_fini(pending);
+	}
+	//config table now points back
+	config->current = &config->config_table;
+	if (safe)
+		tw_config_run_commands(config);
+	return safe;
+}
+
 /**
  * @brief run/rerun the configurations.
  *
@@ -403,22 +479,71 @@ tw_config_run(struct tw_config *config, char **err_msg)
 	bool safe;
 	struct tw_config_table pending = {0};
 
-	tw_config_table_init(&pending, config, &config->config_table.registry);
-	//we now use temporary config table
-	config->current = &pending;
+	tw_config_table_init(&pending, config, NULL);
 	safe = tw_try_config(&pending, err_msg);
-	safe = safe && tw_config_install_bindings(&pending);
-	safe = safe && tw_config_wake_compositor(config);
+	return tw_config_run_finish(config, &pending, safe);
+}
 
-	if (safe) {
-		tw_config_apply_table(config, &pending);
-		tw_config_table_flush(&config->config_table);
-	} else {
-		tw_config_table_fini(&pending);
+static void *
+tw_config_worker_run(void *data)
+{
+	struct tw_config *config = data;
+	uint64_t done = 1;
+
+	config->worker.safe = tw_try_config(&config->worker.pending,
+	                                    &config->worker.err_msg);
+	if (write(config->worker.fd, &done, sizeof(done)) != sizeof(done))
+		tw_logl_level(TW_LOG_ERRO, "failed to notify config done");
+	return NULL;
+}
+
+static int
+notify_config_worker_done(int fd, uint32_t mask, void *data)
+{
+	struct tw_config *config = data;
+	struct tw_shell *shell = tw_config_request_object(config, "shell");
+	uint64_t count;
+	const char *msg;
+
+	if (read(fd, &count, sizeof(count)) != sizeof(count) ||
+	    !config->worker.running)
+		return 0;
+	pthread_join(config->worker.thread, NULL);
+	config->worker.running = false;
+
+	if (!tw_config_run_finish(config, &config->worker.pending,
+	                          config->worker.safe)) {
+		msg = config->worker.err_msg ? config->worker.err_msg :
+			"Config failed with Unknown reason";
+		tw_logl_level(TW_LOG_WARN, "config run failed: %s", msg);
+		if (shell)
+			tw_shell_post_message(shell,
+			                      TAIWINS_SHELL_MSG_TYPE_CONFIG_ERR,
+			                      msg);
 	}
-	//config table now points back
-	config->current = &config->config_table;
-	return safe;
+	SAFE_FREE(config->worker.err_msg);
+	return 0;
+}
+
+bool
+tw_config_run_async(struct tw_config *config)
+{
+	struct tw_config_table *pending = &config->worker.pending;
+
+	if (config->worker.running || !config->worker.source)
+		return false;
+	memset(pending, 0, sizeof(*pending));
+	tw_config_table_init(pending, config, NULL);
+	config->worker.err_msg = NULL;
+	config->worker.safe = false;
+
+	if (pthread_create(&config->worker.thread, NULL,
+	                   tw_config_worker_run, config)) {
+		tw_config_table_fini(pending);
+		return false;
+	}
+	config->worker.running = true;
+	return true;
 }
 
 bool
@@ -457,10 +582,20 @@ tw_config_init(struct tw_config *config, struct tw_engine *engine)
 {
 	//to change
 	struct tw_backend *backend = engine->backend;
+	struct wl_event_loop *loop = wl_display_get_event_loop(engine->display);
 
 	config->engine = engine;
 	tw_config_table_init(&config->config_table, config, NULL);
 	config->current = &config->config_table;
+
+	config->worker.running = false;
+	config->worker.source = NULL;
+	config->worker.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (config->worker.fd >= 0)
+		config->worker.source =
+			wl_event_loop_add_fd(loop, config->worker.fd,
+			                     WL_EVENT_READABLE,
+			                     notify_config_worker_done, config);
 	tw_signal_setup_listener(&backend->signals.new_output,
 	                         &config->output_created_listener,
 	                         notify_config_output_create);
@@ -472,6 +607,16 @@ tw_config_init(struct tw_config *config, struct tw_engine *engine)
 void
 tw_config_fini(struct tw_config *config)
 {
+	if (config->worker.running) {
+		pthread_join(config->worker.thread, NULL);
+		config->worker.running = false;
+		tw_config_table_fini(&config->worker.pending);
+		SAFE_FREE(config->worker.err_msg);
+	}
+	if (config->worker.source)
+		wl_event_source_remove(config->worker.source);
+	if (config->worker.fd >= 0)
+		close(config->worker.fd);
 	tw_config_table_fini(&config->config_table);
 	wl_list_remove(&config->output_created_listener.link);
 	wl_list_remove(&config->seat_created_listener.link);
@@ -484,3 +629,15 @@ tw_config_table_dirty(struct tw_config_table *t, bool dirty)
 		return;
 	t->dirty = true;
 }
+
+void
+tw_config_table_queue_cmd(struct tw_config_table *t,
+                          void (*run)(struct tw_config *, void *),
+                          void *data)
+{
+	struct tw_config_cmd cmd = {
+		.run = run,
+		.data = data,
+	};
+	vector_append(&t->commands, &cmd);
+}
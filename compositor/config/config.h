@@ -24,6 +24,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include <wayland-server.h>
 #include <xkbcommon/xkbcommon.h>
 #include <wayland-taiwins-shell-server-protocol.h>
@@ -43,6 +44,8 @@ extern "C" {
 //TODO: using enum instead of names
 #define TW_CONFIG_SHELL_PATH "shell_path"
 #define TW_CONFIG_CONSOLE_PATH "console_path"
+#define TW_CONFIG_RENDER_CONTEXT "render_context"
+#define TW_CONFIG_RENDER_OVERLAY "render_overlay"
 
 enum tw_config_type {
 	TW_CONFIG_TYPE_LUA,
@@ -65,6 +68,20 @@ enum tw_config_enable_global {
 	TW_CONFIG_GLOBAL_DESKTOP = (1 << 6),
 };
 
+struct tw_config;
+
+/**
+ * @brief a deferred operation recorded by the config script.
+ *
+ * Config scripts are evaluated away from the compositor thread, so anything
+ * requires touching the live objects has to be queued as a command, the
+ * commands run on the main thread after the table is applied.
+ */
+struct tw_config_cmd {
+	void (*run)(struct tw_config *config, void *data);
+	void *data;
+};
+
 struct tw_config_table {
 	bool dirty;
 	uint32_t enable_globals;
@@ -83,11 +100,15 @@ struct tw_config_table {
 
 	pending_intval_t kb_repeat; /**< invalid: -1 */
 	pending_intval_t kb_delay; /**< invalid: -1 */
+	pending_uintval_t occluded_frame_interval; /**< ms */
+	pending_uintval_t debug_overlay; /**< enum tw_egl_overlay_mode */
+	pending_budget_t client_budget;
 
 	//TODO New data here, what we archive? One config
 	struct xkb_rule_names xkb_rules;
 	vector_t registry;
 	vector_t config_bindings;
+	vector_t commands; /**< queued tw_config_cmd */
 	struct tw_binding builtin_bindings[TW_BUILTIN_BINDING_SIZE];
 	struct tw_bindings bindings;
 	struct tw_config *config;
@@ -111,6 +132,20 @@ struct tw_config {
          */
 	struct tw_config_table config_table, *current;
 
+	/**< background config evaluation, the worker thread only touches the
+	 * pending table, the result is applied by the main loop */
+	struct {
+		pthread_t thread;
+		bool running;
+		bool safe;
+		int fd;
+		char *err_msg;
+		struct wl_event_source *source;
+		struct tw_config_table pending;
+	} worker;
+
+	/**< the budget the render context throttles clients with */
+	struct tw_client_budget client_budget;
 
 	/**< lua code may use this */
 	struct wl_listener output_created_listener;
@@ -131,6 +166,15 @@ tw_config_fini(struct tw_config *c);
 bool
 tw_config_run(struct tw_config *config, char **err_msg);
 
+/**
+ * @brief run the config script on a worker thread.
+ *
+ * The result is applied by the main loop once the evaluation is done, errors
+ * are posted to the shell. Returns false if a run is already in flight.
+ */
+bool
+tw_config_run_async(struct tw_config *config);
+
 bool
 tw_config_run_default(struct tw_config *c);
 
@@ -157,6 +201,11 @@ tw_bus_create_global(struct wl_display *display);
 void
 tw_config_table_dirty(struct tw_config_table *table, bool dirty);
 
+void
+tw_config_table_queue_cmd(struct tw_config_table *table,
+                          void (*run)(struct tw_config *, void *),
+                          void *data);
+
 
 
 #ifdef __cplusplus
@@ -20,11 +20,15 @@
  */
 
 #include <assert.h>
+#include <inttypes.h>
+#include <time.h>
 #include <ctypes/helpers.h>
 #include <linux/input-event-codes.h>
 #include <linux/input.h>
 #include <taiwins/objects/seat.h>
 #include <taiwins/objects/surface.h>
+#include <taiwins/objects/client_stats.h>
+#include <taiwins/objects/utils.h>
 #include <taiwins/objects/desktop.h>
 #include <taiwins/objects/logger.h>
 #include <taiwins/shell.h>
@@ -32,6 +36,7 @@
 
 #include "bindings.h"
 #include "config.h"
+#include "render.h"
 
 static bool
 quit_compositor(struct tw_keyboard *keyboard, uint32_t time,
@@ -67,18 +72,10 @@ reload_config(struct tw_keyboard *keyboard, uint32_t time,
               uint32_t key, uint32_t mods, uint32_t option, void *data)
 {
 	struct tw_config *config = data;
-	struct tw_shell *shell = tw_config_request_object(config, "shell");
-	char *err_msg = NULL;
 
-	if (!tw_config_run(config, &err_msg)) {
-		const char *send_msg = err_msg ?
-			err_msg : "Config failed with Unknown reason";
-
-		tw_shell_post_message(shell, TAIWINS_SHELL_MSG_TYPE_CONFIG_ERR,
-		                      send_msg);
-		if (err_msg)
-			free(err_msg);
-	}
+	//the result is applied by the main loop once the script is evaluated
+	if (!tw_config_run_async(config))
+		tw_logl_level(TW_LOG_WARN, "config is already running");
 	return true;
 }
 
@@ -94,6 +91,56 @@ should_start_console(struct tw_keyboard *keyboard, uint32_t time,
 	return true;
 }
 
+/* TW_TOGGLE_OVERLAY_BINDING */
+static bool
+toggle_debug_overlay(struct tw_keyboard *keyboard, uint32_t time,
+                     uint32_t key, uint32_t mods, uint32_t option, void *data)
+{
+	struct tw_config *config = data;
+	struct tw_render_pipeline *overlay =
+		tw_config_request_object(config, TW_CONFIG_RENDER_OVERLAY);
+	uint32_t modes = config->config_table.debug_overlay.uval;
+
+	if (!overlay)
+		return false;
+	//back to the configured overlays, or all of them
+	if (tw_egl_render_pipeline_get_overlay(overlay))
+		modes = TW_EGL_OVERLAY_NONE;
+	else if (!modes)
+		modes = TW_EGL_OVERLAY_ALL;
+	tw_egl_render_pipeline_set_overlay(overlay, modes);
+	return true;
+}
+
+/* TW_REPORT_CLIENTS_BINDING */
+static bool
+report_client_stats(struct tw_keyboard *keyboard, uint32_t time,
+                    uint32_t key, uint32_t mods, uint32_t option, void *data)
+{
+	struct tw_config *config = data;
+	struct wl_list *clients =
+		wl_display_get_client_list(config->engine->display);
+	uint32_t now = tw_get_time_ms(CLOCK_MONOTONIC);
+	struct tw_client_stats *stats;
+	struct wl_client *client;
+	pid_t pid;
+
+	wl_client_for_each(client, clients) {
+		if (!(stats = tw_client_stats_get(client)))
+			continue;
+		tw_client_stats_sample(stats, now);
+		wl_client_get_credentials(client, &pid, NULL, NULL);
+		tw_logl_level(TW_LOG_INFO, "client %d: %"PRIu64" commits/s, "
+		              "%"PRIu64" pixels/s damaged, "
+		              "%"PRIu64" bytes/s uploaded, "
+		              "%"PRIu64" frames/s, %"PRIu64" frames held back",
+		              pid, stats->rate.commits, stats->rate.damage,
+		              stats->rate.upload, stats->rate.frames,
+		              stats->throttled);
+	}
+	return true;
+}
+
 /* TW_ZOOM_AXIS_BINDING */
 static bool
 zoom_axis(struct tw_pointer *pointer, uint32_t time, double delta,
@@ -475,6 +522,22 @@ tw_config_default_bindings(struct tw_binding *bindings)
 			.type = TW_BINDING_key,
 			.name = "TW_NEXT_VIEW",
 		},
+		[TW_TOGGLE_OVERLAY_BINDING] = {
+			.keypress = {{KEY_D, TW_MODIFIER_CTRL |
+			              TW_MODIFIER_ALT | TW_MODIFIER_SHIFT},
+			             {0}, {0}, {0}, {0}},
+			.key_func = toggle_debug_overlay,
+			.type = TW_BINDING_key,
+			.name = "TW_TOGGLE_DEBUG_OVERLAY",
+		},
+		[TW_REPORT_CLIENTS_BINDING] = {
+			.keypress = {{KEY_S, TW_MODIFIER_CTRL |
+			              TW_MODIFIER_ALT | TW_MODIFIER_SHIFT},
+			             {0}, {0}, {0}, {0}},
+			.key_func = report_client_stats,
+			.type = TW_BINDING_key,
+			.name = "TW_REPORT_CLIENTS",
+		},
 	};
 
 	memcpy(bindings, default_bindings, sizeof(default_bindings));
@@ -60,6 +60,9 @@ enum tw_builtin_binding_t {
 	TW_MERGE_BINDING,
 	//view cycling
 	TW_NEXT_VIEW_BINDING,
+	//debug
+	TW_TOGGLE_OVERLAY_BINDING,
+	TW_REPORT_CLIENTS_BINDING,
 	//sizeof
 	TW_BUILTIN_BINDING_SIZE
 };
@@ -27,6 +27,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 #include <wayland-server.h>
 #include <wayland-util.h>
 
@@ -36,12 +37,15 @@
 #include <ctypes/helpers.h>
 #include <taiwins/objects/seat.h>
 #include <taiwins/objects/logger.h>
+#include <taiwins/objects/utils.h>
+#include <taiwins/objects/client_stats.h>
 #include <twclient/theme.h>
 
 #include "desktop/xdg.h"
 #include "lua_helper.h"
 #include "bindings.h"
 #include "config.h"
+#include "render.h"
 
 #define REGISTRY_CONFIG "__config"
 #define REGISTRY_CONFIG_TABLE "__config_table"
@@ -51,6 +55,17 @@
 #define METATABLE_COMPOSITOR "metatable_compositor"
 #define METATABLE_WORKSPACE "metatable_workspace"
 
+static inline struct tw_config *
+_lua_to_config(lua_State *L)
+{
+	struct tw_config *config;
+
+	lua_getfield(L, LUA_REGISTRYINDEX, REGISTRY_CONFIG);
+	config = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	return config;
+}
+
 static inline struct tw_config_table *
 _lua_to_config_table(lua_State *L)
 {
@@ -728,6 +743,124 @@ _lua_set_panel_position(lua_State *L)
 	return 0;
 }
 
+static int
+_lua_set_occluded_frame_interval(lua_State *L)
+{
+	int32_t msec;
+	struct tw_config_table *t = _lua_to_config_table(L);
+
+	tw_lua_stackcheck(L, 2);
+	msec = luaL_checknumber(L, 2);
+	if (msec < 0)
+		return luaL_error(L, "%s: interval is negative.",
+		                  "compositor.occluded_frame_interval");
+	SET_PENDING(&t->occluded_frame_interval, uval, msec);
+	tw_config_table_dirty(t, true);
+	return 0;
+}
+
+/* compositor:client_budget(commits, damage_mpixels, upload_mbytes) per second,
+ * 0 is no limit */
+static int
+_lua_set_client_budget(lua_State *L)
+{
+	struct tw_config_table *t = _lua_to_config_table(L);
+	struct tw_client_budget budget;
+	lua_Number commits, damage, upload;
+
+	tw_lua_stackcheck(L, 4);
+	commits = luaL_checknumber(L, 2);
+	damage = luaL_checknumber(L, 3);
+	upload = luaL_checknumber(L, 4);
+	if (commits < 0 || damage < 0 || upload < 0)
+		return luaL_error(L, "%s: budget is negative.",
+		                  "compositor.client_budget");
+	budget.commits = commits;
+	budget.damage = damage * 1000000;
+	budget.upload = upload * (1 << 20);
+	SET_PENDING(&t->client_budget, budget, budget);
+	tw_config_table_dirty(t, true);
+	return 0;
+}
+
+static inline void
+_lua_set_stats_field(lua_State *L, const char *name, uint64_t value)
+{
+	lua_pushinteger(L, value);
+	lua_setfield(L, -2, name);
+}
+
+/* compositor:client_stats() lists the clients with their pid and per second
+ * rates. The script itself is evaluated off the compositor thread, so it is
+ * only available in the bindings */
+static int
+_lua_client_stats(lua_State *L)
+{
+	struct tw_config *config = _lua_to_config(L);
+	uint32_t now = tw_get_time_ms(CLOCK_MONOTONIC);
+	struct tw_client_stats *stats;
+	struct wl_client *client;
+	struct wl_list *clients;
+	int n = 0;
+	pid_t pid;
+
+	if (L != config->config_table.user_data)
+		return luaL_error(L, "%s: only available in bindings.",
+		                  "compositor.client_stats");
+	clients = wl_display_get_client_list(config->engine->display);
+	lua_newtable(L);
+	wl_client_for_each(client, clients) {
+		if (!(stats = tw_client_stats_get(client)))
+			continue;
+		//an idle client has not sampled for a while
+		tw_client_stats_sample(stats, now);
+		wl_client_get_credentials(client, &pid, NULL, NULL);
+		lua_newtable(L);
+		_lua_set_stats_field(L, "pid", pid);
+		_lua_set_stats_field(L, "commits", stats->rate.commits);
+		_lua_set_stats_field(L, "damage", stats->rate.damage);
+		_lua_set_stats_field(L, "upload", stats->rate.upload);
+		_lua_set_stats_field(L, "frames", stats->rate.frames);
+		_lua_set_stats_field(L, "throttled", stats->throttled);
+		lua_rawseti(L, -2, ++n);
+	}
+	return 1;
+}
+
+/* compositor:debug_overlay("damage", "clip", "commits"), "all" or "none" */
+static int
+_lua_set_debug_overlay(lua_State *L)
+{
+	static const struct {
+		const char *name;
+		uint32_t mode;
+	} modes[] = {
+		{"none", TW_EGL_OVERLAY_NONE},
+		{"damage", TW_EGL_OVERLAY_DAMAGE},
+		{"clip", TW_EGL_OVERLAY_CLIP},
+		{"commits", TW_EGL_OVERLAY_COMMITS},
+		{"all", TW_EGL_OVERLAY_ALL},
+	};
+	struct tw_config_table *t = _lua_to_config_table(L);
+	uint32_t overlay = TW_EGL_OVERLAY_NONE;
+
+	for (int i = 2; i <= lua_gettop(L); i++) {
+		const char *name = luaL_checkstring(L, i);
+		unsigned j;
+
+		for (j = 0; j < sizeof(modes) / sizeof(modes[0]); j++)
+			if (strcmp(name, modes[j].name) == 0)
+				break;
+		if (j == sizeof(modes) / sizeof(modes[0]))
+			return luaL_error(L, "%s: invalid overlay %s.",
+			                  "compositor.debug_overlay", name);
+		overlay |= modes[j].mode;
+	}
+	SET_PENDING(&t->debug_overlay, uval, overlay);
+	tw_config_table_dirty(t, true);
+	return 0;
+}
+
 static int
 _lua_set_sleep_timer(lua_State *L)
 {
@@ -796,6 +929,11 @@ luaopen_taiwins(lua_State *L)
 	REGISTER_METHOD(L, "keyboard_options", _lua_set_keyboard_options);
 	REGISTER_METHOD(L, "keyboard_variant", _lua_set_keyboard_variant);
 	REGISTER_METHOD(L, "repeat_info", _lua_set_repeat_info);
+	REGISTER_METHOD(L, "occluded_frame_interval",
+	                _lua_set_occluded_frame_interval);
+	REGISTER_METHOD(L, "debug_overlay", _lua_set_debug_overlay);
+	REGISTER_METHOD(L, "client_budget", _lua_set_client_budget);
+	REGISTER_METHOD(L, "client_stats", _lua_client_stats);
 	//objects
 	REGISTER_METHOD(L, "enable_xwayland", _lua_enable_xwayland);
 	REGISTER_METHOD(L, "enable_bus", _lua_enable_bus);
@@ -25,6 +25,7 @@
 #include <stdbool.h>
 #include <wayland-server.h>
 #include <ctypes/helpers.h>
+#include <taiwins/objects/client_stats.h>
 #include <wayland-taiwins-shell-server-protocol.h>
 #include "desktop/xdg.h"
 
@@ -46,6 +47,7 @@ typedef OPTION(enum taiwins_shell_panel_pos, pos) pending_panel_pos_t;
 typedef OPTION(int32_t, val) pending_intval_t;
 typedef OPTION(uint32_t, uval) pending_uintval_t;
 typedef OPTION(struct tw_theme *, theme) pending_theme_t;
+typedef OPTION(struct tw_client_budget, budget) pending_budget_t;
 
 #define SET_PENDING(ptr, name, value)                                   \
 	do { \
@@ -35,10 +35,13 @@
 #include <taiwins/objects/matrix.h>
 #include <taiwins/objects/plane.h>
 #include <taiwins/objects/surface.h>
+#include <taiwins/objects/utils.h>
 #include <taiwins/output_device.h>
 #include <taiwins/render_context_egl.h>
+#include <taiwins/render_output.h>
 #include <taiwins/render_surface.h>
 #include <taiwins/render_pipeline.h>
+#include "render.h"
 #include "utils.h"
 
 struct tw_egl_layer_render_pipeline {
@@ -47,12 +50,41 @@ struct tw_egl_layer_render_pipeline {
 	struct tw_plane main_plane;
 
 	struct tw_egl_quad_shader quad_shader;
-	/* for debug rendering */
-	struct tw_egl_quad_shader color_quad_shader;
 	/* for external sampler */
 	struct tw_egl_quad_shader ext_quad_shader;
 
 	struct tw_layers_manager *manager;
+	/* state bound during the repaint, surfaces in the same atlas share
+	 * the texture */
+	GLuint bound_tex;
+	struct tw_egl_quad_shader *bound_shader;
+
+	struct wl_list caches; /**< tw_egl_scene_cache:link */
+	struct wl_array dead_caches; /**< GLuint, deleted on next repaint */
+};
+
+/**
+ * @brief the output without the cursor, for frames where only the cursor
+ * changes.
+ *
+ * While the cursor moves, full repaints copy the framebuffer into the cache
+ * before the cursor layer is drawn. When the next frame finds the rest of the
+ * scene unchanged, the whole output is restored from the cache in one quad and
+ * only the cursor is blended over it, no other surface is drawn. The restore
+ * does not depend on the buffer age, the damage history is not trusted.
+ */
+struct tw_egl_scene_cache {
+	struct wl_list link; /**< tw_egl_layer_render_pipeline:caches */
+	struct tw_egl_layer_render_pipeline *pipeline;
+	struct tw_render_output *output;
+	GLuint tex; /**< same size as the output buffer, 0 if unusable */
+	unsigned width, height;
+	bool valid;
+	bool cursor_frame; /**< the last frame took the cursor path */
+	/** the views below the cursor layer when the cache was taken */
+	uint64_t signature;
+
+	struct wl_listener destroy;
 };
 
 /******************************************************************************
@@ -61,89 +93,107 @@ struct tw_egl_layer_render_pipeline {
 
 static void
 surface_accumulate_damage(struct tw_surface *surface,
-                          pixman_region32_t *clipped)
+                          pixman_region32_t *clipped,
+                          struct tw_region_pool *pool)
 {
-	pixman_region32_t damage, bbox, opaque;
 	struct tw_view *current = surface->current;
 	struct tw_render_surface *render_surface =
 		wl_container_of(surface, render_surface, surface);
-
-	pixman_region32_init(&damage);
-	pixman_region32_init_rect(&bbox,
-	                          surface->geometry.xywh.x,
-	                          surface->geometry.xywh.y,
-	                          surface->geometry.xywh.width,
-	                          surface->geometry.xywh.height);
-	pixman_region32_init(&opaque);
-
+	unsigned mark = tw_region_pool_mark(pool);
+	pixman_region32_t *damage = tw_region_pool_get(pool);
+	pixman_region32_t *opaque = tw_region_pool_get(pool);
+	pixman_region32_t *bbox =
+		tw_region_pool_get_rect(pool,
+		                        surface->geometry.xywh.x,
+		                        surface->geometry.xywh.y,
+		                        surface->geometry.xywh.width,
+		                        surface->geometry.xywh.height);
+
+	if (!damage || !opaque || !bbox)
+		goto out;
 	if (pixman_region32_not_empty(&surface->geometry.dirty)) {
-		pixman_region32_copy(&damage, &surface->geometry.dirty);
+		pixman_region32_copy(damage, &surface->geometry.dirty);
 	} else {
-		pixman_region32_intersect_rect(&damage,
+		pixman_region32_intersect_rect(damage,
 		                               &current->surface_damage,
 		                               0, 0,
 		                               surface->geometry.xywh.width,
 		                               surface->geometry.xywh.height);
-		pixman_region32_translate(&damage, surface->geometry.xywh.x,
+		pixman_region32_translate(damage, surface->geometry.xywh.x,
 		                          surface->geometry.xywh.y);
-		pixman_region32_intersect(&damage, &damage, &bbox);
+		pixman_region32_intersect(damage, damage, bbox);
 	}
-	pixman_region32_subtract(&damage, &damage, clipped);
+	pixman_region32_subtract(damage, damage, clipped);
 	pixman_region32_union(&current->plane->damage,
-	                      &current->plane->damage, &damage);
+	                      &current->plane->damage, damage);
 	//update the clip region here. but yeah, our surface region is not
 	//correct at all.
-	pixman_region32_subtract(&render_surface->clip, &bbox, clipped);
-	pixman_region32_copy(&opaque, &current->opaque_region);
-	pixman_region32_translate(&opaque, surface->geometry.x,
+	pixman_region32_subtract(&render_surface->clip, bbox, clipped);
+	//fully covered by the opaque surfaces above
+	render_surface->occluded = pixman_region32_not_empty(bbox) &&
+		!pixman_region32_not_empty(&render_surface->clip);
+	pixman_region32_copy(opaque, &current->opaque_region->region);
+	pixman_region32_translate(opaque, surface->geometry.x,
 	                          surface->geometry.y);
-	pixman_region32_intersect(&opaque, &opaque, &bbox);
-	pixman_region32_union(clipped, clipped, &opaque);
+	pixman_region32_intersect(opaque, opaque, bbox);
+	pixman_region32_union(clipped, clipped, opaque);
+out:
+	tw_region_pool_release(pool, mark);
+}
+
+static inline bool
+surface_is_cursor(struct tw_layers_manager *manager,
+                  struct tw_surface *surface)
+{
+	struct tw_surface *cursor;
 
-	pixman_region32_fini(&damage);
-	pixman_region32_fini(&bbox);
-	pixman_region32_fini(&opaque);
+	wl_list_for_each(cursor, &manager->cursor_layer.views, layer_link)
+		if (cursor == surface)
+			return true;
+	return false;
 }
 
+/* stack the damage of the views, of the cursor layer only if cursor_only */
 static void
 pipeline_stack_damage(struct tw_egl_layer_render_pipeline *pipeline,
-                      struct tw_plane *plane)
+                      struct tw_plane *plane, bool cursor_only)
 {
 	struct tw_surface *surface;
 	struct tw_render_output *output;
 	struct tw_render_context *ctx = pipeline->base.ctx;
 	struct tw_layers_manager *layers = pipeline->manager;
+	struct tw_region_pool *pool = &ctx->scratch_regions;
+	unsigned mark = tw_region_pool_mark(pool);
 
 	//the clip the total coverred region, opaque is the per-plane covered
 	//region. For now we have only one plane
-	pixman_region32_t opaque;
+	pixman_region32_t *opaque = tw_region_pool_get(pool);
 
+	if (!opaque)
+		return;
 	SCOPE_PROFILE_BEG();
-	pixman_region32_init(&opaque);
 	wl_list_for_each(surface, &layers->views,
 	                 links[TW_VIEW_GLOBAL_LINK]) {
-
-		surface_accumulate_damage(surface, &opaque);
+		if (cursor_only && !surface_is_cursor(layers, surface))
+			continue;
+		surface_accumulate_damage(surface, opaque, pool);
 	}
 
-	pixman_region32_fini(&opaque);
-
 	wl_list_for_each(output, &ctx->outputs, link) {
-		pixman_region32_t output_damage;
+		pixman_region32_t *output_damage = opaque;
 		pixman_rectangle32_t rect =
 			tw_output_device_geometry(&output->device);
 
-		pixman_region32_init(&output_damage);
-		pixman_region32_intersect_rect(&output_damage, &plane->damage,
+		pixman_region32_intersect_rect(output_damage, &plane->damage,
 		                               rect.x, rect.y,
 		                               rect.width, rect.height);
 		pixman_region32_subtract(&plane->damage, &plane->damage,
-		                         &output_damage);
-		pixman_region32_translate(&output_damage, -rect.x, -rect.y);
+		                         output_damage);
+		pixman_region32_translate(output_damage, -rect.x, -rect.y);
 		pixman_region32_copy(output->state.pending_damage,
-		                     &output_damage);
-		pixman_region32_fini(&output_damage);
+		                     output_damage);
 	}
+	tw_region_pool_release(pool, mark);
 
 	SCOPE_PROFILE_END();
 }
@@ -168,29 +218,32 @@ pipeline_compose_output_buffer_damage(struct tw_render_output *output,
  * repaints
  *****************************************************************************/
 
+/* the boxes are in output space, see pipeline_scissor_region */
 static void
-pipeline_scissor_surface(struct tw_render_output *output,
-                         pixman_box32_t *box)
+pipeline_scissor_surface(const pixman_box32_t *box)
 {
-	//the box are in global space, we would need to convert them into
-	//output_space
-	pixman_box32_t scr_box;
-
 	if (box != NULL) {
 		glEnable(GL_SCISSOR_TEST);
-		//since the surface is y-down
-		tw_mat3_box_transform(&output->state.view_2d,
-		                      &scr_box, box);
-
-		glScissor(scr_box.x1, scr_box.y1,
-		          scr_box.x2-scr_box.x1, scr_box.y2-scr_box.y1);
+		glScissor(box->x1, box->y1, box->x2-box->x1, box->y2-box->y1);
 	} else {
 		glDisable(GL_SCISSOR_TEST);
 	}
 }
 
+/* convert a global space region into output space scissor boxes, all the
+ * boxes are transformed in one batch */
+static pixman_box32_t *
+pipeline_scissor_region(struct tw_render_output *output,
+                        pixman_region32_t *scissor,
+                        pixman_region32_t *region, int *nrects)
+{
+	//since the surface is y-down
+	tw_mat3_region_transform(&output->state.view_2d, scissor, region);
+	return pixman_region32_rectangles(scissor, nrects);
+}
+
 static void
-pipeline_draw_quad(bool y_inverted)
+pipeline_draw_texcoords(const GLfloat texcoords[8])
 {
 	////////////////////////////////
 	//
@@ -208,28 +261,53 @@ pipeline_draw_quad(bool y_inverted)
 		1, 1,
 		-1, 1,
 	};
+
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, verts);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, texcoords);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+static void
+pipeline_draw_quad(bool y_inverted)
+{
 	// tex coordinates, OpenGL stores texture upside down, y_inverted here
 	// means the texture follows OpenGL
-	GLfloat texcoords_y_inverted[] = {
+	static const GLfloat texcoords_y_inverted[] = {
 		1, 1,
 		0, 1,
 		1, 0,
 		0, 0
 	};
-	GLfloat texcoords[] = {
+	static const GLfloat texcoords[] = {
 		1, 0,
 		0, 0,
 		1, 1,
 		0, 1
 	};
 
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, verts);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0,
-	                      y_inverted ? texcoords_y_inverted : texcoords);
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
+	pipeline_draw_texcoords(y_inverted ? texcoords_y_inverted : texcoords);
+}
 
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+/* same as pipeline_draw_quad, for the part of gltex holding the buffer */
+static void
+pipeline_draw_texture(const struct tw_egl_render_texture *texture)
+{
+	GLfloat x1 = texture->uv.x1, x2 = texture->uv.x2;
+	GLfloat y1 = texture->base.inverted_y ?
+		texture->uv.y2 : texture->uv.y1;
+	GLfloat y2 = texture->base.inverted_y ?
+		texture->uv.y1 : texture->uv.y2;
+	GLfloat texcoords[] = {
+		x2, y1,
+		x1, y1,
+		x2, y2,
+		x1, y2,
+	};
+
+	pipeline_draw_texcoords(texcoords);
 }
 
 static void
@@ -249,47 +327,15 @@ pipeline_cleanup_buffer(struct tw_render_output *output)
 	glViewport(0, 0, width, height);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-
-#if defined( _TW_DEBUG_DAMAGE ) || defined( _TW_DEBUG_CLIP )
-	glClear(GL_COLOR_BUFFER_BIT);
-	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
-#endif
 }
 
-#if defined ( _TW_DEBUG_CLIP )
-
-static void
-pipeline_paint_surface_clip(struct tw_render_surface *surface,
-                            struct tw_egl_layer_render_pipeline *pipeline,
-                            struct tw_render_output *o,
-                            const struct tw_mat3 *proj)
-{
-	int nrects;
-	pixman_box32_t *boxes;
-	//purple color for clip
-	GLfloat debug_colors[4] = {1.0, 0.0, 1.0, 1.0};
-	struct tw_egl_quad_shader *shader = &pipeline->color_quad_shader;
-
-	glUseProgram(shader->prog);
-	glUniformMatrix3fv(shader->uniform.proj, 1, GL_FALSE, proj->d);
-	glUniform4f(shader->uniform.target, debug_colors[0], debug_colors[1],
-	            debug_colors[2], debug_colors[3]);
-	glUniform1f(shader->uniform.alpha, 0.5);
-
-	boxes = pixman_region32_rectangles(&surface->clip, &nrects);
-	for (int i = 0; i < nrects; i++) {
-		pipeline_scissor_surface(o, &boxes[i]);
-		pipeline_draw_quad(false);
-	}
-}
-
-#endif
-
+/* paint the clip of the surface, only the part in the global space region if
+ * there is one */
 static void
 pipeline_paint_surface(struct tw_surface *surface,
                        struct tw_egl_layer_render_pipeline *pipeline,
                        struct tw_render_output *o,
-                       pixman_region32_t *output_damage)
+                       pixman_region32_t *region)
 {
 	int nrects;
 	pixman_box32_t *boxes;
@@ -299,7 +345,9 @@ pipeline_paint_surface(struct tw_surface *surface,
 		wl_container_of(surface->buffer.handle.ptr, texture, base);
 	struct tw_render_surface *render_surface =
 		wl_container_of(surface, render_surface, surface);
-	pixman_region32_t damage;
+	struct tw_region_pool *pool = &pipeline->base.ctx->scratch_regions;
+	unsigned mark = tw_region_pool_mark(pool);
+	pixman_region32_t *paint, *scissor;
 	unsigned int w, h;
 
 	if (!texture)
@@ -327,42 +375,283 @@ pipeline_paint_surface(struct tw_surface *surface,
 	tw_mat3_ortho_proj(&proj, w, h);
 	tw_mat3_multiply(&proj, &proj, &tmp);
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(texture->target, texture->gltex);
-	glTexParameteri(texture->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(texture->target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	glUseProgram(shader->prog);
+	//skip the switches when the last surface used the same atlas
+	if (pipeline->bound_tex != texture->gltex) {
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(texture->target, texture->gltex);
+		glTexParameteri(texture->target, GL_TEXTURE_MIN_FILTER,
+		                GL_LINEAR);
+		glTexParameteri(texture->target, GL_TEXTURE_MAG_FILTER,
+		                GL_LINEAR);
+		pipeline->bound_tex = texture->gltex;
+	}
+	if (pipeline->bound_shader != shader) {
+		glUseProgram(shader->prog);
+		pipeline->bound_shader = shader;
+	}
 	glUniformMatrix3fv(shader->uniform.proj, 1, GL_FALSE, proj.d);
 	glUniform1i(shader->uniform.target, 0);
 	glUniform1f(shader->uniform.alpha, 1.0f);
 
-	//extracting damages
-	pixman_region32_init(&damage);
-	pixman_region32_intersect(&damage, &render_surface->clip,
-	                          output_damage);
-
-#if defined( _TW_DEBUG_CLIP )
-	boxes = pixman_region32_rectangles(&render_surface->clip, &nrects);
-#else
-	//TODO this is clearly not right, we should use damage but we keep
-	//drawing on the wrong buffer
-	boxes = pixman_region32_rectangles(&render_surface->clip, &nrects);
-#endif
+	//TODO full repaints draw the whole clip, we should use damage but we
+	//keep drawing on the wrong buffer
+	paint = &render_surface->clip;
+	if (region) {
+		if (!(paint = tw_region_pool_get(pool)))
+			goto out;
+		pixman_region32_intersect(paint, &render_surface->clip,
+		                          region);
+	}
+	if (!(scissor = tw_region_pool_get(pool)))
+		goto out;
+	boxes = pipeline_scissor_region(o, scissor, paint, &nrects);
 
 	for (int i = 0; i < nrects; i++) {
-		pipeline_scissor_surface(o, &boxes[i]);
-		pipeline_draw_quad(texture->base.inverted_y);
+		pipeline_scissor_surface(&boxes[i]);
+		pipeline_draw_texture(texture);
 	}
+out:
+	tw_region_pool_release(pool, mark);
+	SCOPE_PROFILE_END();
+}
 
-	pixman_region32_fini(&damage);
+/******************************************************************************
+ * cursor fast path
+ *****************************************************************************/
+
+static inline uint64_t
+scene_hash(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = data;
+
+	//FNV-1a
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	return hash;
+}
+
+/* everything below the cursor layer that changes the picture changes the
+ * signature, the commit count catches the updates damaged on other outputs */
+static uint64_t
+scene_cache_signature(struct tw_egl_layer_render_pipeline *pipeline,
+                      struct tw_render_output *output)
+{
+	struct tw_layers_manager *manager = pipeline->manager;
+	struct tw_surface *surface;
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	hash = scene_hash(hash, &output->state.view_2d,
+	                  sizeof(output->state.view_2d));
+	wl_list_for_each(surface, &manager->views,
+	                 links[TW_VIEW_GLOBAL_LINK]) {
+		if (surface_is_cursor(manager, surface))
+			continue;
+		hash = scene_hash(hash, &surface, sizeof(surface));
+		hash = scene_hash(hash, &surface->geometry.xywh,
+		                  sizeof(surface->geometry.xywh));
+		hash = scene_hash(hash, &surface->buffer.handle.ptr,
+		                  sizeof(surface->buffer.handle.ptr));
+		hash = scene_hash(hash, &surface->commits,
+		                  sizeof(surface->commits));
+	}
+	return hash;
+}
+
+static void
+scene_cache_destroy(struct tw_egl_scene_cache *cache)
+{
+	GLuint *slot;
+
+	//the context may not be current, the pipeline deletes it later
+	if (cache->tex && (slot = wl_array_add(&cache->pipeline->dead_caches,
+	                                       sizeof(*slot))))
+		*slot = cache->tex;
+	wl_list_remove(&cache->link);
+	wl_list_remove(&cache->destroy.link);
+	free(cache);
+}
+
+static void
+notify_scene_cache_output_destroy(struct wl_listener *listener, void *data)
+{
+	struct tw_egl_scene_cache *cache =
+		wl_container_of(listener, cache, destroy);
+	scene_cache_destroy(cache);
+}
+
+static struct tw_egl_scene_cache *
+scene_cache_get(struct tw_egl_layer_render_pipeline *pipeline,
+                struct tw_render_output *output)
+{
+	struct tw_egl_scene_cache *cache;
+
+	wl_list_for_each(cache, &pipeline->caches, link)
+		if (cache->output == output)
+			return cache;
+	if (!(cache = calloc(1, sizeof(*cache))))
+		return NULL;
+	cache->pipeline = pipeline;
+	cache->output = output;
+	wl_list_insert(pipeline->caches.prev, &cache->link);
+	tw_signal_setup_listener(&output->device.signals.destroy,
+	                         &cache->destroy,
+	                         notify_scene_cache_output_destroy);
+	return cache;
+}
+
+/* make the cache as large as the output buffer, false if it is unusable */
+static bool
+scene_cache_resize(struct tw_egl_scene_cache *cache)
+{
+	unsigned int width, height;
+
+	tw_output_device_raw_resolution(&cache->output->device,
+	                                &width, &height);
+	if (cache->width == width && cache->height == height)
+		return cache->tex != 0;
+	cache->valid = false;
+	cache->width = width;
+	cache->height = height;
+	cache->pipeline->bound_tex = 0;
+	while (glGetError() != GL_NO_ERROR);
+
+	if (!cache->tex)
+		glGenTextures(1, &cache->tex);
+	glBindTexture(GL_TEXTURE_2D, cache->tex);
+	//window surfaces may have no alpha, RGB copies from all of them
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
+	             GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (glGetError() != GL_NO_ERROR) {
+		tw_logl_level(TW_LOG_WARN, "no scene cache for %ux%u output",
+		              width, height);
+		glDeleteTextures(1, &cache->tex);
+		cache->tex = 0;
+	}
+	return cache->tex != 0;
+}
+
+/* copy the framebuffer, called before the cursor layer is drawn */
+static void
+scene_cache_update(struct tw_egl_scene_cache *cache, uint64_t signature)
+{
+	if (!cache || !scene_cache_resize(cache))
+		return;
+	glBindTexture(GL_TEXTURE_2D, cache->tex);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0,
+	                    cache->width, cache->height);
+	cache->pipeline->bound_tex = cache->tex;
+	cache->signature = signature;
+	cache->valid = true;
+}
+
+/* copying the framebuffer costs a full screen blit, it is only worth it if the
+ * next frame is likely to take the cursor path */
+static bool
+scene_cache_wanted(struct tw_egl_scene_cache *cache)
+{
+	struct tw_layers_manager *manager = cache->pipeline->manager;
+	struct tw_surface *surface;
+
+	if (cache->cursor_frame)
+		return true;
+	wl_list_for_each(surface, &manager->views,
+	                 links[TW_VIEW_GLOBAL_LINK]) {
+		if (!surface_is_cursor(manager, surface))
+			continue;
+		if (pixman_region32_not_empty(&surface->geometry.dirty) ||
+		    pixman_region32_not_empty(&surface->current->surface_damage))
+			return true;
+	}
+	return false;
+}
+
+static bool
+scene_cache_usable(struct tw_egl_scene_cache *cache, uint64_t signature)
+{
+	struct tw_egl_layer_render_pipeline *pipeline = cache->pipeline;
+	struct tw_layers_manager *manager = pipeline->manager;
+	struct wl_list *pipelines = &pipeline->base.ctx->pipelines;
+	struct tw_surface *surface;
+	unsigned int width, height;
+
+	//other pipelines expect to draw over a full repaint
+	if (pipelines->next != &pipeline->base.link ||
+	    pipelines->prev != &pipeline->base.link)
+		return false;
+	tw_output_device_raw_resolution(&cache->output->device,
+	                                &width, &height);
+	if (!cache->valid || !cache->tex || cache->signature != signature ||
+	    cache->width != width || cache->height != height)
+		return false;
+	wl_list_for_each(surface, &manager->views,
+	                 links[TW_VIEW_GLOBAL_LINK]) {
+		if (surface_is_cursor(manager, surface))
+			continue;
+		if (pixman_region32_not_empty(&surface->geometry.dirty) ||
+		    pixman_region32_not_empty(&surface->current->surface_damage))
+			return false;
+	}
+	return true;
+}
+
+/* restore the output from the cache then blend the cursor over it */
+static void
+pipeline_repaint_cursor(struct tw_egl_layer_render_pipeline *pipeline,
+                        struct tw_egl_scene_cache *cache,
+                        struct tw_render_output *output)
+{
+	struct tw_layers_manager *manager = pipeline->manager;
+	struct tw_egl_quad_shader *shader = &pipeline->quad_shader;
+	struct tw_surface *surface;
+	struct tw_mat3 proj;
+
+	SCOPE_PROFILE_BEG();
+
+	//consume the cursor damage, the whole output is drawn anyway
+	pipeline_stack_damage(pipeline, &pipeline->main_plane, true);
+
+	pipeline_cleanup_buffer(output);
+	//the cache is in buffer space, the quad covers the whole output
+	tw_mat3_init(&proj);
+	glDisable(GL_BLEND);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, cache->tex);
+	glUseProgram(shader->prog);
+	glUniformMatrix3fv(shader->uniform.proj, 1, GL_FALSE, proj.d);
+	glUniform1i(shader->uniform.target, 0);
+	glUniform1f(shader->uniform.alpha, 1.0f);
+	pipeline->bound_tex = cache->tex;
+	pipeline->bound_shader = shader;
+	pipeline_draw_quad(false);
+	glEnable(GL_BLEND);
+
+	wl_list_for_each_reverse(surface, &manager->views,
+	                         links[TW_VIEW_GLOBAL_LINK])
+		if (surface_is_cursor(manager, surface))
+			pipeline_paint_surface(surface, pipeline, output,
+			                       NULL);
+	cache->cursor_frame = true;
 
-#if defined ( _TW_DEBUG_CLIP )
-	pipeline_paint_surface_clip(render_surface, pipeline, o, &proj);
-#endif
 	SCOPE_PROFILE_END();
 }
 
+static void
+pipeline_delete_dead_caches(struct tw_egl_layer_render_pipeline *pipeline)
+{
+	struct wl_array *dead = &pipeline->dead_caches;
+
+	if (!dead->size)
+		return;
+	glDeleteTextures(dead->size / sizeof(GLuint), dead->data);
+	dead->size = 0;
+}
+
 /******************************************************************************
  * pipeline implementation
  *****************************************************************************/
@@ -375,12 +664,18 @@ pipeline_repaint_output(struct tw_render_pipeline *base,
 	struct tw_egl_layer_render_pipeline *pipeline =
 		wl_container_of(base, pipeline, base);
         struct tw_layers_manager *manager = pipeline->manager;
-	pixman_region32_t output_damage;
+	struct tw_region_pool *pool = &base->ctx->scratch_regions;
+	unsigned mark = tw_region_pool_mark(pool);
+	pixman_region32_t *output_damage;
+	struct tw_egl_scene_cache *cache;
+	uint64_t signature;
+	bool cached = false, copy;
 
 	SCOPE_PROFILE_BEG();
 
 	tw_render_context_build_view_list(base->ctx, pipeline->manager);
-	pixman_region32_init(&output_damage);
+	if (!(output_damage = tw_region_pool_get(pool)))
+		goto out;
 
 	//move to plane
 	wl_list_for_each(surface, &manager->views,
@@ -388,8 +683,23 @@ pipeline_repaint_output(struct tw_render_pipeline *base,
 		surface->current->plane = &pipeline->main_plane;
 	}
 
-	pipeline_stack_damage(pipeline, &pipeline->main_plane);
-	pipeline_compose_output_buffer_damage(output, &output_damage,
+	pipeline_delete_dead_caches(pipeline);
+	pipeline->bound_tex = 0;
+	pipeline->bound_shader = NULL;
+	cache = scene_cache_get(pipeline, output);
+	signature = scene_cache_signature(pipeline, output);
+	if (cache && scene_cache_usable(cache, signature)) {
+		pipeline_repaint_cursor(pipeline, cache, output);
+		goto out;
+	}
+	copy = cache && scene_cache_wanted(cache);
+	if (cache) {
+		cache->valid = false;
+		cache->cursor_frame = false;
+	}
+
+	pipeline_stack_damage(pipeline, &pipeline->main_plane, false);
+	pipeline_compose_output_buffer_damage(output, output_damage,
 	                                      buffer_age);
 
 	pipeline_cleanup_buffer(output);
@@ -397,11 +707,18 @@ pipeline_repaint_output(struct tw_render_pipeline *base,
 	//for non-opaque surface to work, you really have to draw in reverse
 	//order
 	wl_list_for_each_reverse(surface, &manager->views,
-	                         links[TW_VIEW_GLOBAL_LINK])
-		pipeline_paint_surface(surface, pipeline, output,
-		                       &output_damage);
-
-	pixman_region32_fini(&output_damage);
+	                         links[TW_VIEW_GLOBAL_LINK]) {
+		//the cursor layer is on top, keep what is under it
+		if (copy && !cached && surface_is_cursor(manager, surface)) {
+			scene_cache_update(cache, signature);
+			cached = true;
+		}
+		pipeline_paint_surface(surface, pipeline, output, NULL);
+	}
+	if (copy && !cached)
+		scene_cache_update(cache, signature);
+out:
+	tw_region_pool_release(pool, mark);
 
 	SCOPE_PROFILE_END();
 }
@@ -411,11 +728,15 @@ pipeline_destroy(struct tw_render_pipeline *base)
 {
 	struct tw_egl_layer_render_pipeline *pipeline =
 		wl_container_of(base, pipeline, base);
+	struct tw_egl_scene_cache *cache, *tmp;
 
+	//the context is gone with the textures by now
+	wl_list_for_each_safe(cache, tmp, &pipeline->caches, link)
+		scene_cache_destroy(cache);
+	wl_array_release(&pipeline->dead_caches);
 	tw_plane_fini(&pipeline->main_plane);
 	tw_render_pipeline_fini(base);
 
-	tw_egl_quad_color_shader_fini(&pipeline->color_quad_shader);
 	tw_egl_quad_tex_shader_fini(&pipeline->quad_shader);
 	tw_egl_quad_texext_shader_fini(&pipeline->ext_quad_shader);
         free(pipeline);
@@ -431,12 +752,421 @@ tw_egl_render_pipeline_create_default(struct tw_render_context *ctx,
         pipeline->manager = manager;
         tw_render_pipeline_init(&pipeline->base, "EGL Sample", ctx);
 
-	tw_egl_quad_color_shader_init(&pipeline->color_quad_shader);
 	tw_egl_quad_tex_shader_init(&pipeline->quad_shader);
 	tw_egl_quad_texext_shader_init(&pipeline->ext_quad_shader);
 	tw_plane_init(&pipeline->main_plane);
+	wl_list_init(&pipeline->caches);
+	wl_array_init(&pipeline->dead_caches);
 	pipeline->base.impl.destroy = pipeline_destroy;
 	pipeline->base.impl.repaint_output = pipeline_repaint_output;
 
 	return &pipeline->base;
 }
+
+/******************************************************************************
+ * debug overlay
+ *****************************************************************************/
+
+/* frames of output damage kept for tinting */
+#define TW_EGL_OVERLAY_HISTORY 8
+/* ms between two samples of the commit rates */
+#define TW_EGL_OVERLAY_SAMPLE 1000
+/* commit rate drawn as a full bar */
+#define TW_EGL_OVERLAY_MAX_RATE 60
+
+struct tw_egl_overlay_output {
+	struct wl_list link; /**< tw_egl_overlay_pipeline:outputs */
+	struct tw_render_output *output;
+	/** output damage of the last frames in output space, newest at head */
+	pixman_region32_t damages[TW_EGL_OVERLAY_HISTORY];
+	unsigned head;
+	/** something on the overlay fades, the output needs another frame */
+	bool animating;
+
+	struct wl_listener post_frame;
+	struct wl_listener destroy;
+};
+
+struct tw_egl_overlay_rate {
+	const struct tw_surface *surface; /**< only compared, never accessed */
+	uint32_t commits;
+	uint32_t rate; /**< commits per second */
+};
+
+/**
+ * @brief the overlay pipeline runs after the default pipeline.
+ *
+ * It is only linked in ctx->pipelines when some mode is on, so a disabled
+ * overlay costs nothing at all.
+ */
+struct tw_egl_overlay_pipeline {
+	struct tw_render_pipeline base;
+	struct tw_egl_quad_shader color_quad_shader;
+	struct tw_layers_manager *manager;
+	uint32_t modes; /**< enum tw_egl_overlay_mode */
+	struct wl_list outputs; /**< tw_egl_overlay_output:link */
+
+	struct {
+		struct wl_array rates, swap; /**< tw_egl_overlay_rate */
+		uint32_t time; /**< ms of the last sample */
+	} commits;
+};
+
+static inline struct tw_egl_overlay_pipeline *
+overlay_from_pipeline(struct tw_render_pipeline *base)
+{
+	struct tw_egl_overlay_pipeline *overlay =
+		wl_container_of(base, overlay, base);
+	return overlay;
+}
+
+static void
+overlay_output_destroy(struct tw_egl_overlay_output *record)
+{
+	for (int i = 0; i < TW_EGL_OVERLAY_HISTORY; i++)
+		pixman_region32_fini(&record->damages[i]);
+	wl_list_remove(&record->link);
+	wl_list_remove(&record->post_frame.link);
+	wl_list_remove(&record->destroy.link);
+	free(record);
+}
+
+static void
+notify_overlay_output_post_frame(struct wl_listener *listener, void *data)
+{
+	struct tw_egl_overlay_output *record =
+		wl_container_of(listener, record, post_frame);
+
+	//output is committed now, dirty bit survives to the next present
+	if (record->animating)
+		tw_render_output_dirty(record->output);
+}
+
+static void
+notify_overlay_output_destroy(struct wl_listener *listener, void *data)
+{
+	struct tw_egl_overlay_output *record =
+		wl_container_of(listener, record, destroy);
+	overlay_output_destroy(record);
+}
+
+static struct tw_egl_overlay_output *
+overlay_get_output(struct tw_egl_overlay_pipeline *overlay,
+                   struct tw_render_output *output)
+{
+	struct tw_egl_overlay_output *record;
+
+	wl_list_for_each(record, &overlay->outputs, link)
+		if (record->output == output)
+			return record;
+	if (!(record = calloc(1, sizeof(*record))))
+		return NULL;
+	record->output = output;
+	for (int i = 0; i < TW_EGL_OVERLAY_HISTORY; i++)
+		pixman_region32_init(&record->damages[i]);
+	wl_list_insert(overlay->outputs.prev, &record->link);
+	tw_signal_setup_listener(&output->signals.post_frame,
+	                         &record->post_frame,
+	                         notify_overlay_output_post_frame);
+	tw_signal_setup_listener(&output->device.signals.destroy,
+	                         &record->destroy,
+	                         notify_overlay_output_destroy);
+	return record;
+}
+
+static const struct tw_egl_overlay_rate *
+overlay_find_rate(const struct wl_array *rates, const struct tw_surface *surface)
+{
+	const struct tw_egl_overlay_rate *rate;
+
+	wl_array_for_each(rate, rates)
+		if (rate->surface == surface)
+			return rate;
+	return NULL;
+}
+
+static void
+overlay_sample_commits(struct tw_egl_overlay_pipeline *overlay)
+{
+	struct tw_surface *surface;
+	struct tw_egl_overlay_rate *rate;
+	const struct tw_egl_overlay_rate *last;
+	struct wl_array tmp;
+	uint32_t now = tw_get_time_ms(CLOCK_MONOTONIC);
+	uint32_t elapsed = now - overlay->commits.time;
+
+	if (elapsed < TW_EGL_OVERLAY_SAMPLE)
+		return;
+	overlay->commits.swap.size = 0;
+	wl_list_for_each(surface, &overlay->manager->views,
+	                 links[TW_VIEW_GLOBAL_LINK]) {
+		last = overlay_find_rate(&overlay->commits.rates, surface);
+		if (!(rate = wl_array_add(&overlay->commits.swap,
+		                          sizeof(*rate))))
+			break;
+		rate->surface = surface;
+		rate->commits = surface->commits;
+		rate->rate = last ?
+			(surface->commits - last->commits) * 1000 / elapsed : 0;
+	}
+	tmp = overlay->commits.rates;
+	overlay->commits.rates = overlay->commits.swap;
+	overlay->commits.swap = tmp;
+	overlay->commits.time = now;
+}
+
+static void
+overlay_fill_region(struct tw_egl_overlay_pipeline *overlay,
+                    struct tw_render_output *output,
+                    pixman_region32_t *region,
+                    const GLfloat color[4], GLfloat alpha)
+{
+	int nrects;
+	pixman_box32_t *boxes;
+	struct tw_egl_quad_shader *shader = &overlay->color_quad_shader;
+	struct tw_region_pool *pool = &overlay->base.ctx->scratch_regions;
+	unsigned mark = tw_region_pool_mark(pool);
+	pixman_region32_t *scissor = tw_region_pool_get(pool);
+
+	if (!scissor)
+		return;
+	glUniform4fv(shader->uniform.target, 1, color);
+	glUniform1f(shader->uniform.alpha, alpha);
+	boxes = pipeline_scissor_region(output, scissor, region, &nrects);
+	for (int i = 0; i < nrects; i++) {
+		pipeline_scissor_surface(&boxes[i]);
+		pipeline_draw_quad(false);
+	}
+	tw_region_pool_release(pool, mark);
+}
+
+static void
+overlay_paint_damage(struct tw_egl_overlay_pipeline *overlay,
+                     struct tw_egl_overlay_output *record)
+{
+	//yellow, fading out with the age of the damage
+	static const GLfloat color[4] = {1.0, 1.0, 0.0, 1.0};
+	struct tw_region_pool *pool = &overlay->base.ctx->scratch_regions;
+	unsigned mark = tw_region_pool_mark(pool);
+	pixman_region32_t *damage = tw_region_pool_get(pool);
+	pixman_rectangle32_t rect =
+		tw_output_device_geometry(&record->output->device);
+
+	if (!damage)
+		return;
+	for (int age = TW_EGL_OVERLAY_HISTORY-1; age >= 0; age--) {
+		unsigned i = (record->head + TW_EGL_OVERLAY_HISTORY - age) %
+			TW_EGL_OVERLAY_HISTORY;
+
+		if (!pixman_region32_not_empty(&record->damages[i]))
+			continue;
+		//back to global space for the view matrix
+		pixman_region32_copy(damage, &record->damages[i]);
+		pixman_region32_translate(damage, rect.x, rect.y);
+		overlay_fill_region(overlay, record->output, damage, color,
+		                    0.5f * (TW_EGL_OVERLAY_HISTORY - age) /
+		                    TW_EGL_OVERLAY_HISTORY);
+		record->animating = true;
+	}
+	tw_region_pool_release(pool, mark);
+}
+
+static void
+overlay_paint_clips(struct tw_egl_overlay_pipeline *overlay,
+                    struct tw_render_output *output)
+{
+	//purple outlines for clip
+	static const GLfloat color[4] = {1.0, 0.0, 1.0, 1.0};
+	struct tw_egl_quad_shader *shader = &overlay->color_quad_shader;
+	struct tw_region_pool *pool = &overlay->base.ctx->scratch_regions;
+	unsigned mark = tw_region_pool_mark(pool);
+	pixman_region32_t *scissor = tw_region_pool_get(pool);
+	struct tw_render_surface *render_surface;
+	struct tw_surface *surface;
+	pixman_box32_t *boxes;
+	int nrects;
+
+	if (!scissor)
+		return;
+	glUniform4fv(shader->uniform.target, 1, color);
+	glUniform1f(shader->uniform.alpha, 0.8f);
+
+	wl_list_for_each(surface, &overlay->manager->views,
+	                 links[TW_VIEW_GLOBAL_LINK]) {
+		render_surface = wl_container_of(surface, render_surface,
+		                                 surface);
+		boxes = pipeline_scissor_region(output, scissor,
+		                                &render_surface->clip,
+		                                &nrects);
+		for (int i = 0; i < nrects; i++) {
+			const pixman_box32_t *b = &boxes[i];
+			int bw = (b->x2 - b->x1) < 2 ? (b->x2 - b->x1) : 2;
+			int bh = (b->y2 - b->y1) < 2 ? (b->y2 - b->y1) : 2;
+			pixman_box32_t edges[4] = {
+				{b->x1, b->y1, b->x2, b->y1 + bh},
+				{b->x1, b->y2 - bh, b->x2, b->y2},
+				{b->x1, b->y1, b->x1 + bw, b->y2},
+				{b->x2 - bw, b->y1, b->x2, b->y2},
+			};
+
+			for (int j = 0; j < 4; j++) {
+				pipeline_scissor_surface(&edges[j]);
+				pipeline_draw_quad(false);
+			}
+		}
+	}
+	tw_region_pool_release(pool, mark);
+}
+
+static void
+overlay_paint_commits(struct tw_egl_overlay_pipeline *overlay,
+                      struct tw_egl_overlay_output *record)
+{
+	struct tw_region_pool *pool = &overlay->base.ctx->scratch_regions;
+	const struct tw_egl_overlay_rate *rate;
+	struct tw_surface *surface;
+
+	//a bar on top of the surface, from green to red as it gets busier
+	wl_list_for_each(surface, &overlay->manager->views,
+	                 links[TW_VIEW_GLOBAL_LINK]) {
+		const pixman_rectangle32_t *box = &surface->geometry.xywh;
+		unsigned mark = tw_region_pool_mark(pool);
+		pixman_region32_t *bar;
+		unsigned r;
+		GLfloat t;
+
+		if (!(rate = overlay_find_rate(&overlay->commits.rates,
+		                               surface)) || !rate->rate)
+			continue;
+		r = rate->rate < TW_EGL_OVERLAY_MAX_RATE ?
+			rate->rate : TW_EGL_OVERLAY_MAX_RATE;
+		t = (GLfloat)r / TW_EGL_OVERLAY_MAX_RATE;
+		record->animating = true;
+		if ((bar = tw_region_pool_get_rect(pool, box->x, box->y,
+		                                   box->width * t, 4)))
+			overlay_fill_region(overlay, record->output, bar,
+			                    (GLfloat[4]){t, 1.0f - t, 0, 1.0f},
+			                    0.8f);
+		tw_region_pool_release(pool, mark);
+	}
+}
+
+static void
+overlay_repaint_output(struct tw_render_pipeline *base,
+                       struct tw_render_output *output, int buffer_age)
+{
+	struct tw_egl_overlay_pipeline *overlay = overlay_from_pipeline(base);
+	struct tw_egl_overlay_output *record =
+		overlay_get_output(overlay, output);
+	struct tw_egl_quad_shader *shader = &overlay->color_quad_shader;
+	struct tw_mat3 proj;
+
+	if (!record)
+		return;
+	SCOPE_PROFILE_BEG();
+
+	//the default pipeline stacked the damage of this frame
+	record->head = (record->head + 1) % TW_EGL_OVERLAY_HISTORY;
+	pixman_region32_copy(&record->damages[record->head],
+	                     output->state.pending_damage);
+	record->animating = false;
+
+	//the quad covers the whole output, scissors cut out the shapes
+	tw_mat3_init(&proj);
+	glUseProgram(shader->prog);
+	glUniformMatrix3fv(shader->uniform.proj, 1, GL_FALSE, proj.d);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	if (overlay->modes & TW_EGL_OVERLAY_DAMAGE)
+		overlay_paint_damage(overlay, record);
+	if (overlay->modes & TW_EGL_OVERLAY_CLIP)
+		overlay_paint_clips(overlay, output);
+	if (overlay->modes & TW_EGL_OVERLAY_COMMITS) {
+		overlay_sample_commits(overlay);
+		overlay_paint_commits(overlay, record);
+	}
+	pipeline_scissor_surface(NULL);
+
+	SCOPE_PROFILE_END();
+}
+
+static void
+overlay_destroy(struct tw_render_pipeline *base)
+{
+	struct tw_egl_overlay_pipeline *overlay = overlay_from_pipeline(base);
+	struct tw_egl_overlay_output *record, *tmp;
+
+	wl_list_for_each_safe(record, tmp, &overlay->outputs, link)
+		overlay_output_destroy(record);
+	wl_array_release(&overlay->commits.rates);
+	wl_array_release(&overlay->commits.swap);
+	tw_render_pipeline_fini(base);
+	tw_egl_quad_color_shader_fini(&overlay->color_quad_shader);
+	free(overlay);
+}
+
+static void
+notify_overlay_ctx_destroy(struct wl_listener *listener, void *data)
+{
+	struct tw_render_pipeline *base =
+		wl_container_of(listener, base, ctx_destroy);
+	//we are not in ctx->pipelines while disabled, clean up ourselves
+	overlay_destroy(base);
+}
+
+struct tw_render_pipeline *
+tw_egl_render_pipeline_create_overlay(struct tw_render_context *ctx,
+                                      struct tw_layers_manager *manager)
+{
+	struct tw_egl_overlay_pipeline *overlay =
+		calloc(1, sizeof(*overlay));
+
+	if (!overlay)
+		return NULL;
+	overlay->manager = manager;
+	tw_render_pipeline_init(&overlay->base, "EGL Overlay", ctx);
+	tw_egl_quad_color_shader_init(&overlay->color_quad_shader);
+	wl_list_init(&overlay->outputs);
+	wl_array_init(&overlay->commits.rates);
+	wl_array_init(&overlay->commits.swap);
+	overlay->base.impl.destroy = overlay_destroy;
+	overlay->base.impl.repaint_output = overlay_repaint_output;
+	tw_signal_setup_listener(&ctx->signals.destroy,
+	                         &overlay->base.ctx_destroy,
+	                         notify_overlay_ctx_destroy);
+	return &overlay->base;
+}
+
+void
+tw_egl_render_pipeline_set_overlay(struct tw_render_pipeline *base,
+                                   uint32_t modes)
+{
+	struct tw_egl_overlay_pipeline *overlay = overlay_from_pipeline(base);
+	struct tw_egl_overlay_output *record, *tmp;
+	struct tw_render_output *output;
+
+	modes &= TW_EGL_OVERLAY_ALL;
+	if (modes == overlay->modes)
+		return;
+	if (modes && !overlay->modes) {
+		//draw on top of everything else
+		wl_list_insert(base->ctx->pipelines.prev, &base->link);
+		overlay->commits.rates.size = 0;
+		overlay->commits.time = tw_get_time_ms(CLOCK_MONOTONIC);
+	} else if (!modes) {
+		tw_reset_wl_list(&base->link);
+		wl_list_for_each_safe(record, tmp, &overlay->outputs, link)
+			overlay_output_destroy(record);
+	}
+	overlay->modes = modes;
+	//the default pipeline paints over the old overlay
+	wl_list_for_each(output, &base->ctx->outputs, link)
+		tw_render_output_dirty(output);
+}
+
+uint32_t
+tw_egl_render_pipeline_get_overlay(struct tw_render_pipeline *base)
+{
+	return overlay_from_pipeline(base)->modes;
+}
@@ -130,6 +130,14 @@ bind_render(struct tw_server *server)
 		return false;
 
 	wl_list_insert(server->ctx->pipelines.prev, &pipeline->link);
+	tw_config_register_object(&server->config, TW_CONFIG_RENDER_CONTEXT,
+	                          server->ctx);
+	//disabled until the config or the binding turns it on
+	pipeline = tw_egl_render_pipeline_create_overlay(
+		server->ctx, &server->engine->layers_manager);
+	if (pipeline)
+		tw_config_register_object(&server->config,
+		                          TW_CONFIG_RENDER_OVERLAY, pipeline);
 	return true;
 }
 
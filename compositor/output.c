@@ -110,37 +110,43 @@ reassign_surface_outputs(struct tw_render_surface *render_surface,
 {
 	uint32_t area = 0, max = 0, mask = 0;
 	struct tw_render_output *output, *major = NULL;
-	pixman_region32_t surface_region;
 	pixman_box32_t *e;
 	struct tw_surface *surface = &render_surface->surface;
-
-	pixman_region32_init_rect(&surface_region,
-	                          surface->geometry.xywh.x,
-	                          surface->geometry.xywh.y,
-	                          surface->geometry.xywh.width,
-	                          surface->geometry.xywh.height);
+	struct tw_region_pool *pool = &ctx->scratch_regions;
+	unsigned mark = tw_region_pool_mark(pool);
+	pixman_region32_t *clip = tw_region_pool_get(pool);
+	pixman_region32_t *surface_region =
+		tw_region_pool_get_rect(pool,
+		                        surface->geometry.xywh.x,
+		                        surface->geometry.xywh.y,
+		                        surface->geometry.xywh.width,
+		                        surface->geometry.xywh.height);
+
+	//keep the outputs we had
+	if (!clip || !surface_region) {
+		tw_region_pool_release(pool, mark);
+		return;
+	}
 	wl_list_for_each(output, &ctx->outputs, link) {
-		pixman_region32_t clip;
 		struct tw_output_device *device = &output->device;
 		pixman_rectangle32_t rect =
 			tw_output_device_geometry(device);
 		//TODO dealing with cloning output
 		// if (output->cloning >= 0)
 		//	continue;
-		pixman_region32_init_rect(&clip, rect.x, rect.y,
-		                          rect.width, rect.height);
-		pixman_region32_intersect(&clip, &clip, &surface_region);
-		e = pixman_region32_extents(&clip);
+		pixman_region32_intersect_rect(clip, surface_region,
+		                               rect.x, rect.y,
+		                               rect.width, rect.height);
+		e = pixman_region32_extents(clip);
 		area = (e->x2 - e->x1) * (e->y2 - e->y1);
-		if (pixman_region32_not_empty(&clip))
+		if (pixman_region32_not_empty(clip))
 			mask |= (1u << device->id);
 		if (area >= max) {
 			major = output;
 			max = area;
 		}
-		pixman_region32_fini(&clip);
 	}
-	pixman_region32_fini(&surface_region);
+	tw_region_pool_release(pool, mark);
 
 	update_surface_mask(surface, engine, major, mask);
 }
@@ -176,7 +182,7 @@ notify_output_reshedule_frame(struct wl_listener *listener, void *data)
 	if (frametime) { //becomes max_render_time
 		struct timespec now;
 		//get current time as soon as possible
-		clock_gettime(device->clk_id, &now);
+		tw_output_device_read_clock(device, &now);
 
 		struct timespec predict_refresh = output->state.last_present;
 		unsigned mhz = device->current.current_mode.refresh;
@@ -217,7 +223,7 @@ notify_output_pre_frame(struct wl_listener *listener, void *data)
 		wl_container_of(listener, output, listeners.pre_frame);
 	struct tw_output_device *device = output->device;
 
-	clock_gettime(device->clk_id, &output->state.ts);
+	tw_output_device_read_clock(device, &output->state.ts);
 	PROFILE_BEG("notify_output_repaint");
 }
 
@@ -230,7 +236,7 @@ notify_output_post_frame(struct wl_listener *listener, void *data)
 	struct tw_render_output *render_output =
 		wl_container_of(output->device, render_output, device);
 
-	clock_gettime(output->device->clk_id, &now);
+	tw_output_device_read_clock(output->device, &now);
 	update_output_frame_time(output, &output->state.ts, &now);
 	tw_render_output_flush_frame(render_output, &now);
 	PROFILE_END("notify_output_repaint");
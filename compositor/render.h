@@ -22,6 +22,7 @@
 #ifndef TW_PIPELINE_EGL_H
 #define TW_PIPELINE_EGL_H
 
+#include <stdint.h>
 #include <taiwins/objects/layers.h>
 #include <taiwins/render_context_egl.h>
 
@@ -29,4 +30,27 @@ struct tw_render_pipeline *
 tw_egl_render_pipeline_create_default(struct tw_render_context *ctx,
                                       struct tw_layers_manager *manager);
 
+enum tw_egl_overlay_mode {
+	TW_EGL_OVERLAY_NONE = 0,
+	TW_EGL_OVERLAY_DAMAGE = (1 << 0), /**< tint the recent output damage */
+	TW_EGL_OVERLAY_CLIP = (1 << 1), /**< outline the surface clips */
+	TW_EGL_OVERLAY_COMMITS = (1 << 2), /**< bars of surface commit rates */
+	TW_EGL_OVERLAY_ALL = (1 << 3) - 1,
+};
+
+/**
+ * @brief create the debug overlay pipeline, it is disabled at creation.
+ *
+ * The overlay is owned by the render context, it links itself at the end of
+ * ctx->pipelines only when some mode is enabled.
+ */
+struct tw_render_pipeline *
+tw_egl_render_pipeline_create_overlay(struct tw_render_context *ctx,
+                                      struct tw_layers_manager *manager);
+void
+tw_egl_render_pipeline_set_overlay(struct tw_render_pipeline *overlay,
+                                   uint32_t modes);
+uint32_t
+tw_egl_render_pipeline_get_overlay(struct tw_render_pipeline *overlay);
+
 #endif /* EOF */
@@ -7,6 +7,15 @@ local compositor = taiwins.compositor()
 compositor:panel_pos("bottom")
 compositor:set_gaps(20, 20)
 compositor:repeat_info(20, 500)
+-- windows hidden behind others redraw once a second, 0 disables it
+compositor:occluded_frame_interval(1000)
+-- overlays for "damage", "clip" and "commits" rates, toggled with
+-- ctrl+alt+shift+d, "none" turns them off
+compositor:debug_overlay("none")
+-- clients over commits/s, damaged megapixels/s or uploaded megabytes/s redraw
+-- at the occluded frame interval, 0 is no limit. ctrl+alt+shift+s logs the
+-- rates of every client
+compositor:client_budget(0, 0, 0)
 
 -- matching display add setting mode
 compositor:config_display("X11-0", {
@@ -27,6 +36,15 @@ function random_function()
 end
 compositor:bind_key(random_function, "C-M-enter")
 
+-- compositor:client_stats() gives the pid and the per second rates of every
+-- client, it only works in bindings
+function log_clients()
+   for _,c in ipairs(compositor:client_stats()) do
+      print(c.pid, c.commits, c.damage, c.upload, c.frames, c.throttled)
+   end
+end
+compositor:bind_key(log_clients, "C-M-c")
+
 for _,ws in ipairs(compositor:workspaces()) do
    ws:set_layout('floating')
 end
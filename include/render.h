@@ -48,6 +48,14 @@ tw_render_context_init(struct tw_render_context *ctx,
                        struct wl_display *display,
                        enum tw_renderer_type type,
                        const struct tw_render_context_impl *impl);
+void
+tw_render_context_fini(struct tw_render_context *ctx);
+
+/**
+ * @brief give back the scratch regions of the frame
+ */
+void
+tw_render_context_end_frame(struct tw_render_context *ctx);
 
 /******************************************************************************
  * render_presentable
@@ -95,6 +103,16 @@ tw_render_presentable_make_current(struct tw_render_presentable *surf,
 	return surf->impl->make_current(surf, ctx);
 }
 
+/* has to be called in the commit signal, the caller owns the returned fd */
+static inline int
+tw_render_presentable_export_fence(struct tw_render_presentable *surf,
+                                   struct tw_render_context *ctx)
+{
+	if (!surf->impl->export_fence)
+		return -1;
+	return surf->impl->export_fence(surf, ctx);
+}
+
 /******************************************************************************
  * render_pipeline
  *****************************************************************************/
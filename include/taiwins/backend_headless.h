@@ -35,10 +35,36 @@ tw_headless_backend_create(struct wl_display *display);
 bool
 tw_headless_backend_add_output(struct tw_backend *backend,
                                unsigned int width, unsigned int height);
+/**
+ * @brief add an output refreshing at the given rate in mHz, the
+ * tw_headless_backend_add_output uses 60Hz
+ */
+bool
+tw_headless_backend_add_output_with_refresh(struct tw_backend *backend,
+                                            unsigned int width,
+                                            unsigned int height,
+                                            int refresh);
 bool
 tw_headless_backend_add_input_device(struct tw_backend *backend,
                                      enum tw_input_device_type type);
 
+/**
+ * @brief drive the outputs with a virtual clock, starting at start in ns.
+ *
+ * The vblanks, present timestamps and the output clocks then only advance in
+ * tw_headless_backend_advance_clock. The event loop still needs to be
+ * dispatched for the timers of the scheduler.
+ */
+void
+tw_headless_backend_use_virtual_clock(struct tw_backend *backend,
+                                      uint64_t start);
+/**
+ * @brief advance the virtual clock by ns, vblanks on the way are fired in
+ * order.
+ */
+void
+tw_headless_backend_advance_clock(struct tw_backend *backend, uint64_t ns);
+
 #ifdef  __cplusplus
 }
 #endif
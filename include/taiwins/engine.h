@@ -40,6 +40,7 @@
 #include <taiwins/objects/presentation_feedback.h>
 #include <taiwins/objects/viewporter.h>
 #include <taiwins/objects/gestures.h>
+#include <taiwins/objects/screencopy.h>
 #include <xkbcommon/xkbcommon.h>
 
 #include "input_device.h"
@@ -136,6 +137,7 @@ struct tw_engine {
 	struct tw_viewporter viewporter;
 	struct tw_gestures_manager gestures_manager;
 	struct tw_xdg_output_manager output_manager;
+	struct tw_screencopy_manager screencopy_manager;
 
 	/* listeners */
 	struct {
@@ -0,0 +1,84 @@
+/*
+ * client_data.h - taiwins per client index
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef TW_CLIENT_DATA_H
+#define TW_CLIENT_DATA_H
+
+#include <stdbool.h>
+#include <wayland-server-core.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief the objects a wl_client has on the globals, indexed by the global.
+ *
+ * Finding the wl_seat client, the wl_output or the wl_data_device of a client
+ * by walking the resources of the global costs as much as the number of
+ * clients. The globals record them here instead, on a record attached to the
+ * wl_client, it lives until the client is destroyed.
+ *
+ * A client only has a handful of entries, one per global it binds, so lookups
+ * do not grow with the clients connected. Values the record does not own can
+ * be released on the destroy signal.
+ */
+struct tw_client_data {
+	struct wl_client *client;
+	struct wl_listener client_destroy;
+	struct wl_array entries; /**< struct tw_client_data_entry */
+	struct wl_signal destroy; /**< emitted before the entries go */
+};
+
+struct tw_client_data_entry {
+	const void *key;
+	void *value;
+};
+
+/**
+ * @brief get the record of the client, it is created if create is true.
+ */
+struct tw_client_data *
+tw_client_data_get(struct wl_client *client, bool create);
+
+/**
+ * @brief get the value the key has for the client, NULL if none.
+ */
+void *
+tw_client_data_find(struct wl_client *client, const void *key);
+
+/**
+ * @brief set the value of key for the client, setting NULL removes it.
+ */
+bool
+tw_client_data_set(struct wl_client *client, const void *key, void *value);
+
+static inline void
+tw_client_data_unset(struct wl_client *client, const void *key)
+{
+	tw_client_data_set(client, key, NULL);
+}
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* EOF */
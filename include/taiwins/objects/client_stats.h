@@ -0,0 +1,111 @@
+/*
+ * client_stats.h - taiwins per client work accounting
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef TW_CLIENT_STATS_H
+#define TW_CLIENT_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <wayland-server-core.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/* ms a rate is averaged over */
+#define TW_CLIENT_STATS_WINDOW 1000
+
+struct tw_client_counters {
+	uint64_t commits;
+	uint64_t damage; /**< damaged surface pixels committed */
+	uint64_t upload; /**< bytes copied into textures */
+	uint64_t frames; /**< frame callbacks done */
+};
+
+/**
+ * @brief the work a client may cause per second, 0 is no limit.
+ */
+struct tw_client_budget {
+	uint64_t commits;
+	uint64_t damage;
+	uint64_t upload;
+};
+
+/**
+ * @brief how much work a wl_client causes the compositor.
+ *
+ * The record is kept in the tw_client_data of the client and shared by its
+ * surfaces, the surfaces keep a reference since libwayland destroys the client
+ * before the resources. The counters are updated by the surface commits, the
+ * frame callbacks and the texture importers.
+ */
+struct tw_client_stats {
+	struct wl_client *client; /**< NULL once the client is gone */
+	struct wl_listener client_destroy; /**< on tw_client_data.destroy */
+	unsigned refs;
+
+	struct tw_client_counters total; /**< since the client connected */
+	struct tw_client_counters rate; /**< per second, of the last window */
+	uint64_t throttled; /**< frame callbacks held back */
+
+	/* private */
+	struct tw_client_counters window; /**< total at the window start */
+	uint32_t window_start; /**< ms */
+};
+
+/**
+ * @brief get the record of the client, NULL if the client has none.
+ */
+struct tw_client_stats *
+tw_client_stats_get(struct wl_client *client);
+
+/**
+ * @brief get a reference of the record of the client, created if needed.
+ */
+struct tw_client_stats *
+tw_client_stats_ref(struct wl_client *client);
+
+void
+tw_client_stats_unref(struct tw_client_stats *stats);
+
+/**
+ * @brief update the rates if a window has passed since the last sample.
+ *
+ * The surfaces sample on commits and frame callbacks, the rates are the ones
+ * of the last full window by then.
+ */
+void
+tw_client_stats_sample(struct tw_client_stats *stats, uint32_t now);
+
+/**
+ * @brief a client policy, true if the client goes over the budget.
+ *
+ * Budget is a struct tw_client_budget, the rates are only read.
+ */
+bool
+tw_client_stats_over_budget(const struct tw_client_stats *stats,
+                            void *budget);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* EOF */
@@ -106,6 +106,8 @@ struct tw_data_device {
 	struct wl_list link;
 	struct tw_seat *seat;
 	struct wl_list clients;
+	/** data devices got by a client which already had one */
+	unsigned duplicate_binds;
 	struct tw_data_source *source_set;
 	/**< the drag for this device, since a seat has one drag at a time  */
 	struct tw_data_drag drag;
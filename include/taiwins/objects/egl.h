@@ -56,6 +56,7 @@ struct tw_egl {
 	EGLConfig config;
 	bool query_buffer_age, image_base_khr;
 	bool import_dmabuf, import_dmabuf_modifiers;
+	bool fence_sync, native_fence_sync;
 	unsigned int internal_format;
 	struct tw_drm_formats drm_formats;
 };
@@ -82,6 +83,30 @@ tw_egl_unset_current(struct tw_egl *egl);
 int
 tw_egl_buffer_age(struct tw_egl *egl, EGLSurface surface);
 
+/**
+ * @brief export a sync_file fence which signals when all the rendering
+ * commands issued so far are done.
+ *
+ * The context has to be current, returns -1 if EGL_ANDROID_native_fence_sync
+ * is not supported. The caller owns the returned fd.
+ */
+int
+tw_egl_create_fence_fd(struct tw_egl *egl);
+
+/**
+ * @brief wait until all the commands issued so far in the current context are
+ * done, with a fence if EGL_KHR_fence_sync is supported, glFinish otherwise.
+ */
+bool
+tw_egl_wait_fence(struct tw_egl *egl);
+
+/**
+ * @brief create a context sharing the objects of the main context, for
+ * another thread. It has no surface and is made current by that thread.
+ */
+EGLContext
+tw_egl_create_shared_context(struct tw_egl *egl);
+
 bool
 tw_egl_bind_wl_display(struct tw_egl *egl, struct wl_display *display);
 
@@ -36,6 +36,26 @@ enum TW_LOG_LEVEL {
 	TW_LOG_ERRO = 3,
 };
 
+/**
+ * @brief messages a call site can log per second, the rest are suppressed and
+ * counted.
+ */
+#define TW_LOG_RATE_BURST 20
+
+struct tw_logger_stats {
+	unsigned long long logged; /**< messages written out */
+	unsigned long long rate_limited; /**< suppressed by rate limiting */
+	unsigned long long queue_full; /**< dropped on a full queue */
+};
+
+/**
+ * @brief logging to a file.
+ *
+ * Messages are formatted and timestamped by the caller then written out by a
+ * logger thread, so a slow log file never stalls the compositor. When the
+ * thread cannot keep up, messages are dropped and counted rather than
+ * blocking. Closing the logger or exiting flushes the pending messages.
+ */
 void
 tw_logger_open(const char *path);
 
@@ -45,6 +65,9 @@ tw_logger_use_file(FILE *file);
 void
 tw_logger_close(void);
 
+void
+tw_logger_get_stats(struct tw_logger_stats *stats);
+
 int
 tw_logv_level(enum TW_LOG_LEVEL level, const char *format, va_list ap);
 
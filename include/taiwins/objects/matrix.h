@@ -56,6 +56,15 @@ tw_mat3_vec_transform(const struct tw_mat3 *mat, float x, float y,
 void
 tw_mat3_box_transform(const struct tw_mat3 *mat,
                       pixman_box32_t *dst, const pixman_box32_t *src);
+/**
+ * @brief transform n boxes at once, dst can be src.
+ *
+ * Every box becomes the bounding box of its transformed corners, the same as
+ * tw_mat3_box_transform. Translations and scales take a faster path.
+ */
+void
+tw_mat3_boxes_transform(const struct tw_mat3 *mat, pixman_box32_t *dst,
+                        const pixman_box32_t *src, unsigned n);
 void
 tw_mat3_region_transform(const struct tw_mat3 *mat,
                          pixman_region32_t *dst, pixman_region32_t *src);
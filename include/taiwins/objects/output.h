@@ -33,6 +33,8 @@ struct tw_output {
 	struct wl_display *display;
 	struct wl_global *global;
 	struct wl_list resources;
+	/** wl_outputs bound by a client which already had one */
+	unsigned duplicate_binds;
 	uint32_t scale;
 	int32_t x, y;
 
@@ -82,6 +84,14 @@ tw_output_set_mode(struct tw_output *output, uint32_t mode_flags,
 void
 tw_output_send_clients(struct tw_output *output);
 
+/**
+ * @brief the first wl_output the client has for this output, NULL if not
+ * bound. Unless duplicate_binds is set, it is the only one.
+ */
+struct wl_resource *
+tw_output_get_client_resource(struct tw_output *output,
+                              struct wl_client *client);
+
 #ifdef  __cplusplus
 }
 #endif
@@ -29,19 +29,43 @@
 extern "C" {
 #endif
 
+#define TW_PRESENTATION_MAX_OUTPUTS 32
+#define TW_PRESENTATION_POOL_SIZE 64
+
+struct tw_surface;
+
+/**
+ * @brief presentation-time global
+ *
+ * Feedbacks wait in the feedbacks list for the surface commit. On commit they
+ * are filed into the bucket of the primary output of the surface, given by
+ * surface_output, so presenting an output only touches its own feedbacks.
+ * Feedbacks on surfaces without an output go to the unassigned list.
+ */
 struct tw_presentation {
 	struct wl_display *display;
 	struct wl_global *global;
 	struct wl_listener display_destroy;
 	uint32_t clock_id;
 
-	struct wl_list feedbacks;
+	struct wl_list feedbacks; /**< not committed yet */
+	struct wl_list unassigned;
+	struct wl_list outputs[TW_PRESENTATION_MAX_OUTPUTS];
+
+	/** released feedbacks for reuse */
+	struct wl_list pool;
+	unsigned pool_size;
+
+	/** optional, returns the primary output of the surface or -1 */
+	int (*surface_output)(struct tw_surface *surface, void *user_data);
+	void *user_data;
 };
 
 struct tw_presentation_feedback {
 	struct tw_presentation *presentation;
 	struct tw_surface *surface;
 	bool committed, presented;
+	int output;
 	struct wl_list link;
 	struct wl_list resources;
 
@@ -68,6 +92,20 @@ tw_presentation_feeback_sync(struct tw_presentation_feedback *feedback,
 void
 tw_presentation_feedback_discard(struct tw_presentation_feedback *feedback);
 
+/** the committed feedbacks for the output, feedbacks not on any output are
+ * in the unassigned list */
+static inline struct wl_list *
+tw_presentation_output_feedbacks(struct tw_presentation *presentation,
+                                 int output)
+{
+	return (output >= 0 && output < TW_PRESENTATION_MAX_OUTPUTS) ?
+		&presentation->outputs[output] : &presentation->unassigned;
+}
+
+void
+tw_presentation_discard_output(struct tw_presentation *presentation,
+                               int output);
+
 #ifdef  __cplusplus
 }
 #endif
@@ -44,6 +44,12 @@ tw_profiler_stop_timer(const char *name);
 void
 tw_profiler_timestamp(const char *name);
 
+/**
+ * @brief record the value of a counter, shown as a graph in the trace
+ */
+void
+tw_profiler_counter(const char *name, long long value);
+
 #ifdef  __cplusplus
 }
 #endif
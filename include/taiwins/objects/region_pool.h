@@ -0,0 +1,102 @@
+/*
+ * region_pool.h - taiwins scratch pixman regions
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef TW_REGION_POOL_H
+#define TW_REGION_POOL_H
+
+#include <stdint.h>
+#include <pixman.h>
+#include <wayland-util.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/* regions holding more rectangles than this are freed on release */
+#define TW_REGION_POOL_MAX_RECTS 256
+
+/**
+ * @brief a stack of scratch regions for the per-frame damage math.
+ *
+ * Regions handed out keep their rectangle storage when released, so the next
+ * user with a similar region does not go to the heap again. Regions are
+ * handed out in stack order, a user takes a mark, gets the regions it needs
+ * and releases back to the mark. Released regions are empty.
+ *
+ * Do not pixman_region32_init or pixman_region32_fini the regions, the pool
+ * owns them.
+ */
+struct tw_region_pool {
+	struct wl_array nodes; /**< struct tw_region_pool_node * */
+	unsigned used;
+
+	/* stats */
+	unsigned allocs; /**< rectangle storage allocated on the heap */
+	unsigned reuses; /**< regions returned with storage to reuse */
+};
+
+void
+tw_region_pool_init(struct tw_region_pool *pool);
+
+void
+tw_region_pool_fini(struct tw_region_pool *pool);
+
+/**
+ * @brief get an empty region, valid until released.
+ *
+ * Returns NULL if the pool has to grow and the allocation fails.
+ */
+pixman_region32_t *
+tw_region_pool_get(struct tw_region_pool *pool);
+
+/**
+ * @brief get a region of the rectangle, it may fail like tw_region_pool_get.
+ */
+pixman_region32_t *
+tw_region_pool_get_rect(struct tw_region_pool *pool, int x, int y,
+                        unsigned width, unsigned height);
+
+static inline unsigned
+tw_region_pool_mark(struct tw_region_pool *pool)
+{
+	return pool->used;
+}
+
+/**
+ * @brief release all the regions got after the mark
+ */
+void
+tw_region_pool_release(struct tw_region_pool *pool, unsigned mark);
+
+/**
+ * @brief release every region, called at the end of the frame
+ */
+static inline void
+tw_region_pool_reset(struct tw_region_pool *pool)
+{
+	tw_region_pool_release(pool, 0);
+}
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* EOF */
@@ -0,0 +1,121 @@
+/*
+ * screencopy.h - taiwins wlr_screencopy header
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef TW_SCREENCOPY_H
+#define TW_SCREENCOPY_H
+
+#include <time.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pixman.h>
+#include <wayland-server.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+struct tw_screencopy_frame;
+struct tw_screencopy_client;
+
+/**
+ * @brief the compositor side of screencopy
+ *
+ * The protocol object does not read any pixels, it validates the client
+ * buffers then asks the compositor to copy the frame through these hooks.
+ */
+struct tw_screencopy_impl {
+	/** fill the buffer parameters of a new frame, return false if the
+	 * output cannot be captured */
+	bool (*frame_init)(struct tw_screencopy_frame *frame, void *user_data);
+	/** start copying into frame->buffer, the compositor replies later
+	 * with tw_screencopy_frame_ready() or tw_screencopy_frame_failed() */
+	void (*frame_copy)(struct tw_screencopy_frame *frame, void *user_data);
+	/** the frame is going away, stop copying */
+	void (*frame_destroy)(struct tw_screencopy_frame *frame,
+	                      void *user_data);
+};
+
+struct tw_screencopy_manager {
+	struct wl_global *global;
+	struct wl_listener display_destroy;
+	struct wl_list frames;
+
+	const struct tw_screencopy_impl *impl;
+	void *user_data;
+};
+
+struct tw_screencopy_frame {
+	struct wl_resource *resource;
+	struct tw_screencopy_manager *manager;
+	struct wl_list link; /**< tw_screencopy_manager:frames */
+
+	struct wl_resource *output; /**< the captured wl_output, or NULL */
+	bool overlay_cursor;
+	bool with_damage; /**< copy_with_damage, wait for a change */
+	/** requested region in output logical coordinates */
+	bool has_region;
+	pixman_rectangle32_t region;
+
+	/* set by frame_init */
+	struct {
+		int32_t x, y; /**< captured rectangle in the output buffer */
+		uint32_t width, height, stride;
+		uint32_t shm_format;
+		uint32_t dmabuf_format; /**< drm fourcc, 0 if not supported */
+	} params;
+
+	struct wl_resource *buffer;
+	/** the frame the buffer already holds, 0 if unknown. The compositor
+	 * sets the sequence of the copied frame before ready */
+	uint64_t seq;
+	void *user_data; /**< compositor copy state */
+
+	/* private */
+	bool copying;
+	struct wl_listener buffer_destroy;
+	struct wl_listener output_destroy;
+	struct tw_screencopy_client *client; /**< NULL if manager is gone */
+};
+
+bool
+tw_screencopy_manager_init(struct tw_screencopy_manager *manager,
+                           struct wl_display *display,
+                           const struct tw_screencopy_impl *impl,
+                           void *user_data);
+struct tw_screencopy_manager *
+tw_screencopy_manager_create_global(struct wl_display *display,
+                                    const struct tw_screencopy_impl *impl,
+                                    void *user_data);
+/**
+ * @brief the frame is copied, damage is in buffer coordinates.
+ */
+void
+tw_screencopy_frame_ready(struct tw_screencopy_frame *frame,
+                          const struct timespec *time,
+                          const pixman_region32_t *damage);
+void
+tw_screencopy_frame_failed(struct tw_screencopy_frame *frame);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* EOF */
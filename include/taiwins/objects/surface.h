@@ -29,6 +29,7 @@
 #include <wayland-server.h>
 #include <pixman.h>
 
+#include "client_stats.h"
 #include "matrix.h"
 #include "plane.h"
 #include "utils.h"
@@ -60,6 +61,10 @@ struct tw_event_buffer_uploading {
 	pixman_region32_t *damages;
 	struct wl_resource *wl_buffer;
 	bool new_upload;
+	size_t uploaded; /**< bytes the importer copied, for the stats */
+	/** the importer keeps the wl_buffer for a later upload and releases
+	 * it itself */
+	bool deferred;
 };
 
 typedef void (*tw_surface_commit_cb_t)(struct tw_surface *surface);
@@ -109,6 +114,18 @@ struct tw_event_surface_frame {
 	uint32_t frame_time;
 };
 
+/**
+ * @brief a region shared by the surface states.
+ *
+ * Committing a surface passes the opaque and input regions from the state to
+ * the next, they are shared until the client sets a new one instead of being
+ * copied at every commit. Do not modify it.
+ */
+struct tw_surface_region {
+	unsigned refs;
+	pixman_region32_t region;
+};
+
 struct tw_view {
 	struct tw_surface *surface;
 	uint32_t commit_state;
@@ -128,7 +145,7 @@ struct tw_view {
 	struct wl_resource *buffer_resource;
 
 	pixman_region32_t surface_damage, buffer_damage;
-	pixman_region32_t opaque_region, input_region;
+	struct tw_surface_region *opaque_region, *input_region;
 };
 
 struct tw_surface {
@@ -161,6 +178,8 @@ struct tw_surface {
 	struct wl_list subsurfaces_pending;
 
 	bool is_mapped;
+	uint32_t commits; /**< states applied, for sampling commit rates */
+	struct tw_client_stats *stats; /**< of the client, may be NULL */
 
 	/** transform of the view */
 	struct {
@@ -254,6 +273,18 @@ tw_surface_dirty_geometry(struct tw_surface *surface);
 void
 tw_surface_flush_frame(struct tw_surface *surface, uint32_t time_msec);
 
+/**
+ * @brief clean up the damage of the view state, leaving the frame callbacks.
+ */
+void
+tw_surface_flush_damage(struct tw_surface *surface);
+
+/**
+ * @brief send wl_callback::done to the frame callbacks of the surface.
+ */
+void
+tw_surface_send_frame_done(struct tw_surface *surface, uint32_t time_msec);
+
 struct tw_region *
 tw_region_create(struct wl_client *client, uint32_t version, uint32_t id,
                  const struct tw_allocator *alloc);
@@ -56,6 +56,10 @@ struct tw_output_device_state {
 
 struct tw_output_device_impl {
 	bool (*commit_state) (struct tw_output_device *device);
+	/** optional, read the clock driving the output, backends with a
+	 * virtual clock implement this instead of relying on clk_id */
+	void (*read_clock) (const struct tw_output_device *device,
+	                    struct timespec *now);
 };
 
 /**
@@ -128,6 +132,19 @@ tw_output_device_commit_state(struct tw_output_device *device);
 pixman_rectangle32_t
 tw_output_device_geometry(const struct tw_output_device *device);
 
+/**
+ * @brief get the current time of the clock driving the output
+ */
+static inline void
+tw_output_device_read_clock(const struct tw_output_device *device,
+                            struct timespec *now)
+{
+	if (device->impl && device->impl->read_clock)
+		device->impl->read_clock(device, now);
+	else
+		clock_gettime(device->clk_id, now);
+}
+
 /**
  * @brief get raw resolution, without scale or transform
  */
@@ -31,16 +31,21 @@
 #include <taiwins/objects/compositor.h>
 #include <taiwins/objects/surface.h>
 #include <taiwins/objects/layers.h>
+#include <taiwins/objects/region_pool.h>
 
 #ifdef  __cplusplus
 extern "C" {
 #endif
 
 struct tw_egl_options;
+/* occluded surfaces get their frame callbacks once a second by default */
+#define TW_RENDER_OCCLUDED_FRAME_INTERVAL 1000
+
 struct tw_render_context;
 struct tw_render_surface;
 struct tw_render_presentable;
 struct tw_render_texture;
+struct tw_render_capture;
 
 enum tw_renderer_type {
 	TW_RENDERER_EGL,
@@ -54,6 +59,9 @@ struct tw_render_presentable_impl {
 	               struct tw_render_context *ctx);
         int (*make_current)(struct tw_render_presentable *surf,
 	                    struct tw_render_context *ctx);
+	/** optional, a fence fd for the last commit, or -1 */
+	int (*export_fence)(struct tw_render_presentable *surf,
+	                    struct tw_render_context *ctx);
 };
 
 struct tw_render_presentable {
@@ -84,6 +92,26 @@ struct tw_render_context_impl {
 	bool (*new_window_surface)(struct tw_render_presentable *surf,
 	                           struct tw_render_context *ctx,
 	                           void *native_window, uint32_t format);
+	/** optional, start reading back the capture region of the current
+	 * draw surface. Return < 0 on failure, 0 if the pixels are not ready
+	 * yet and 1 if they are already copied */
+	int (*capture_begin)(struct tw_render_context *ctx,
+	                     struct tw_render_capture *capture);
+	/** check a started readback, blocks on the GPU if wait is true */
+	int (*capture_poll)(struct tw_render_context *ctx,
+	                    struct tw_render_capture *capture, bool wait);
+	void (*capture_release)(struct tw_render_context *ctx,
+	                        struct tw_render_capture *capture);
+	/** the wl_shm_format of the captured pixels */
+	uint32_t (*capture_format)(struct tw_render_context *ctx);
+	/** optional, the drm format of dmabuf the context can blit into */
+	uint32_t (*capture_dmabuf_format)(struct tw_render_context *ctx);
+	/** optional, free the GPU resources put aside since last frame. It
+	 * is called at every frame with the context current */
+	void (*collect_garbage)(struct tw_render_context *ctx);
+	/** optional, upload the client content committed since last frame.
+	 * It is called before the pipelines with the context current */
+	void (*flush_uploads)(struct tw_render_context *ctx);
 };
 
 /* we create this render context from scratch so we don't break everything, the
@@ -113,6 +141,25 @@ struct tw_render_context {
 	struct tw_compositor compositor_manager;
 
 	struct wl_list pipelines;
+	/** scratch regions for the damage math, reset at every frame end */
+	struct tw_region_pool scratch_regions;
+	uint32_t view_seq; /**< bumped every time the view list is built */
+
+	/** occluded surfaces get their frame callbacks at a low rate */
+	struct {
+		uint32_t interval; /**< ms between the callbacks, 0 disables */
+		struct wl_list surfaces; /**< tw_render_surface:throttle_link */
+		struct wl_event_source *timer;
+		/** optional, clients it returns true for are throttled like
+		 * the occluded surfaces */
+		bool (*client_policy)(const struct tw_client_stats *stats,
+		                      void *data);
+		void *client_policy_data;
+
+		/* stats */
+		uint64_t occluded; /**< frames held back, occlusion or policy */
+		uint64_t hidden; /**< frame requests of surfaces not shown */
+	} frame_throttle;
 };
 
 struct tw_render_context *
@@ -124,6 +171,23 @@ tw_render_context_destroy(struct tw_render_context *ctx);
 void
 tw_render_context_build_view_list(struct tw_render_context *ctx,
                                   struct tw_layers_manager *manager);
+/**
+ * @brief set how often fully occluded surfaces get their frame callbacks, 0
+ * sends them on every repaint like the visible surfaces.
+ */
+void
+tw_render_context_set_occluded_frame_interval(struct tw_render_context *ctx,
+                                              uint32_t msec);
+/**
+ * @brief hold back the frame callbacks of the clients the policy picks, like
+ * tw_client_stats_over_budget. They are released at the occluded interval.
+ */
+void
+tw_render_context_set_client_policy(struct tw_render_context *ctx,
+                                    bool (*policy)(const struct
+                                                   tw_client_stats *,
+                                                   void *),
+                                    void *data);
 #ifdef  __cplusplus
 }
 #endif
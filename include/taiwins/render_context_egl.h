@@ -35,6 +35,8 @@ extern "C" {
 #endif
 
 struct tw_egl_options;
+struct tw_egl_atlas;
+struct tw_egl_upload_job;
 
 struct tw_egl_quad_shader {
 	GLuint prog;
@@ -51,6 +53,34 @@ struct tw_egl_render_texture {
 	GLenum target;  /**< GL_TEXTURE_2D or GL_TEXTURE_EXTERNAL_OES */
 	EGLImageKHR image;
 	GLuint gltex;
+	/** texture coordinates of the buffer in gltex, (0, 0, 1, 1) unless
+	 * the buffer is in an atlas */
+	struct {
+		GLfloat x1, y1, x2, y2;
+	} uv;
+
+	/* small shm buffers share the gltex of an atlas */
+	struct tw_egl_atlas *atlas;
+	unsigned shelf;
+	uint32_t x, y; /**< position in the atlas */
+
+	/* shm content committed but not uploaded yet, the buffer is held
+	 * until the upload */
+	struct {
+		struct wl_list link; /**< tw_egl_render_context:uploads */
+		struct wl_resource *buffer;
+		struct wl_listener buffer_destroy;
+		pixman_region32_t damage; /**< in buffer coordinates */
+	} pending;
+
+	/* large shm buffers are written by the upload thread into a back
+	 * texture, swapped with gltex once the upload is done */
+	struct {
+		GLuint gltex;
+		pixman_region32_t stale; /**< what gltex has and back misses */
+		struct tw_egl_upload_job *job; /**< in flight, or NULL */
+	} back;
+	struct tw_surface *surface; /**< damaged when an upload is done */
 };
 
 struct tw_render_context *
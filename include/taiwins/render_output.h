@@ -54,6 +54,49 @@ struct tw_event_output_present {
 	int refresh;
 };
 
+enum tw_render_capture_flag {
+	/** only copy the damage of the captured frame */
+	TW_RENDER_CAPTURE_DAMAGE_ONLY = 1,
+};
+
+/**
+ * @brief reads back one frame of a render output.
+ *
+ * The frame is read right after the repaint. If the renderer supports
+ * asynchronous readback, the pixels are copied on a later present of the
+ * output so the render loop never waits for the GPU. Pixels are stored top
+ * down in the format given by tw_render_output_capture_format().
+ *
+ * Instead of pixels, a dmabuf of the format given by
+ * tw_render_output_capture_dmabuf_format() can be the target, the frame is
+ * then blitted on the GPU.
+ */
+struct tw_render_capture {
+	uint32_t flags;
+	int32_t x, y; /**< captured rectangle in the output buffer */
+	uint32_t width, height, stride;
+	void *pixels; /**< at least stride * height bytes */
+	struct tw_dmabuf_attributes *dmabuf; /**< used if pixels is NULL */
+	/** with TW_RENDER_CAPTURE_DAMAGE_ONLY, the frame the target already
+	 * holds, 0 if unknown. Set to the captured frame before done */
+	uint64_t seq;
+
+	/** damage is the copied region in capture coordinates, the capture is
+	 * not used by the output anymore */
+	void (*done)(struct tw_render_capture *capture,
+	             const pixman_region32_t *damage, bool success);
+	/** optional, wraps the writes to pixels */
+	void (*access)(struct tw_render_capture *capture, bool begin);
+	void *user_data;
+
+	/* private */
+	struct wl_list link; /**< tw_render_output:captures */
+	struct tw_render_context *ctx;
+	uint32_t output_height;
+	pixman_region32_t region;
+	intptr_t handle; /**< readback state of the renderer */
+};
+
 struct tw_render_output {
 	struct tw_output_device device;
 	struct tw_render_presentable surface;
@@ -72,8 +115,12 @@ struct tw_render_output {
 		struct tw_mat3 view_2d; /* global to output space */
 
 		uint32_t repaint_state;
+		uint64_t frames; /**< number of frames repainted */
 	} state;
 
+	struct wl_list captures; /**< waiting for the next repaint */
+	struct wl_list readbacks; /**< read, waiting for the pixels */
+
 	struct {
 		struct wl_listener set_mode; /* device::set_mode */
 		struct wl_listener destroy; /* device::destroy */
@@ -110,6 +157,35 @@ tw_render_output_flush_frame(struct tw_render_output *output,
 void
 tw_render_output_post_frame(struct tw_render_output *output);
 
+/**
+ * @brief capture the next frame of the output.
+ *
+ * Without TW_RENDER_CAPTURE_DAMAGE_ONLY, the output is scheduled to repaint
+ * so the capture does not wait for a change on screen.
+ */
+bool
+tw_render_output_capture(struct tw_render_output *output,
+                         struct tw_render_capture *capture);
+void
+tw_render_capture_cancel(struct tw_render_capture *capture);
+
+/**
+ * @brief map a box in output coordinates to the output buffer, where the
+ * captures are. The box is scaled, rounded out and transformed.
+ */
+void
+tw_render_output_buffer_box(struct tw_render_output *output,
+                            pixman_box32_t *dst, const pixman_box32_t *src);
+
+uint32_t
+tw_render_output_capture_format(struct tw_render_output *output);
+
+/**
+ * @brief the drm fourcc of dmabuf capture targets, 0 if not supported
+ */
+uint32_t
+tw_render_output_capture_dmabuf_format(struct tw_render_output *output);
+
 #ifdef  __cplusplus
 }
 #endif
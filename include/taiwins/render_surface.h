@@ -49,6 +49,12 @@ struct tw_render_surface {
 	int32_t output; /**< the primary output for this surface */
 	uint32_t output_mask; /**< the output it touches */
 
+	/** set by the pipeline, nothing of the surface was visible on the last
+	 * repaint */
+	bool occluded;
+	uint32_t view_seq; /**< the view list the surface was last in */
+	struct wl_list throttle_link; /**< tw_render_context:frame_throttle */
+
 #ifdef TW_OVERLAY_PLANE
 	pixman_region32_t output_damage[32];
 #endif
@@ -72,6 +78,30 @@ tw_render_surface_fini(struct tw_render_surface *surface);
 struct tw_render_surface *
 tw_render_surface_from_resource(struct wl_resource *resource);
 
+/**
+ * @brief true if the frame callbacks of the surface should be held back.
+ */
+static inline bool
+tw_render_surface_frame_throttled(const struct tw_render_surface *surface)
+{
+	const struct tw_render_context *ctx = surface->ctx;
+	const struct tw_client_stats *stats = surface->surface.stats;
+
+	if (!ctx->frame_throttle.interval)
+		return false;
+	return surface->occluded ||
+		(ctx->frame_throttle.client_policy && stats &&
+		 ctx->frame_throttle.client_policy(
+			 stats, ctx->frame_throttle.client_policy_data));
+}
+
+/**
+ * @brief hold the frame callbacks of the surface back, they are sent when
+ * the throttle interval passes or the surface becomes visible.
+ */
+void
+tw_render_surface_throttle_frame(struct tw_render_surface *surface);
+
 
 #ifdef  __cplusplus
 }
@@ -40,6 +40,7 @@ extern "C" {
 #define PROFILE_BEG(name) tw_profiler_start_timer(name)
 #define PROFILE_END(name) tw_profiler_stop_timer(name)
 #define SCOPE_PROFILE_TS() tw_profiler_timestamp(__func__)
+#define PROFILE_COUNTER(name, value) tw_profiler_counter(name, value)
 
 #else
 
@@ -48,6 +49,7 @@ extern "C" {
 #define PROFILE_BEG(name)
 #define PROFILE_END(name)
 #define SCOPE_PROFILE_TS()
+#define PROFILE_COUNTER(name, value)
 #endif
 
 struct wl_event_source *
@@ -86,6 +86,13 @@ tw_xsurface_map_tw_surface(struct tw_xsurface *surface,
 int
 tw_xsurface_handle_event(struct tw_xwm *xwm, xcb_generic_event_t *ge);
 
+/**
+ * @brief the window an event is about, XCB_WINDOW_NONE if it is not a window
+ * event for xsurfaces.
+ */
+xcb_window_t
+tw_xsurface_event_window(xcb_generic_event_t *ge);
+
 void
 tw_xsurface_set_focus(struct tw_xsurface *surface, struct tw_xwm *xwm);
 
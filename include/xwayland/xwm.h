@@ -116,6 +116,29 @@ struct tw_xmotif_wm_hints {
 #define _NET_WM_MOVERESIZE_CANCEL 11  /* cancel operation */
 
 #define XCB_EVENT_TYPE_MASK (0x7f)
+/* events read from xcb in one go before applying them */
+#define TW_XWM_BATCH_MAX 256
+/* the index of a batch, at most two slots per event, power of two */
+#define TW_XWM_BATCH_SLOTS (TW_XWM_BATCH_MAX * 4)
+
+/**
+ * @brief the batch indexed by window, the slot of a window or of a property
+ * of it.
+ *
+ * The batch is walked backwards. The epoch of the window is bumped at a map,
+ * unmap or client message of it, the events seen are recorded with epoch + 1,
+ * so an event is only redundant with the later events up to that point.
+ */
+struct tw_xwm_batch_slot {
+	xcb_window_t window; /**< XCB_WINDOW_NONE if the slot is free */
+	xcb_atom_t atom; /**< XCB_ATOM_NONE for the slot of the window */
+	bool managed; /**< the window is an xsurface */
+	unsigned epoch;
+	unsigned configure; /**< epoch + 1 of the later ConfigureNotify */
+	unsigned request; /**< epoch + 1 of the later ConfigureRequest */
+	unsigned request_index;
+	unsigned property; /**< for property slots, epoch + 1 if seen */
+};
 
 
 /** @brief the window manager for xwayland.
@@ -159,8 +182,27 @@ struct tw_xwm {
 	xcb_render_pictformat_t format_rgba;
 
 	struct tw_xwm_atoms atoms;
+
+	/** events are read in batch, the ones a later event in the batch
+	 * makes redundant are dropped */
+	struct {
+		xcb_generic_event_t *events[TW_XWM_BATCH_MAX];
+		struct tw_xwm_batch_slot slots[TW_XWM_BATCH_SLOTS];
+		unsigned mask; /**< of the slots used by the current batch */
+		uint64_t received; /**< events read from xcb */
+		uint64_t applied; /**< events handled after coalescing */
+	} batch;
 };
 
+/**
+ * @brief drop the events of the batch a later event makes redundant.
+ *
+ * The dropped events are freed and set to NULL, ConfigureRequests are folded
+ * into the later one of the window. Returns the number of events left.
+ */
+unsigned
+tw_xwm_coalesce_events(struct tw_xwm *xwm, xcb_generic_event_t **events,
+                       unsigned n);
 
 #ifdef  __cplusplus
 }
@@ -120,6 +120,7 @@ drm_backend_init_gpu(struct tw_drm_gpu *gpu, struct tw_login_gpu *login_gpu,
 	gpu->devnum = login_gpu->devnum;
 	gpu->boot_vga = login_gpu->boot_vga;
 	gpu->crtc_mask = 0;
+	gpu->kms = &tw_kms_drm_device;
 	wl_list_init(&gpu->link);
 	wl_list_init(&gpu->crtc_list);
 	wl_list_init(&gpu->plane_list);
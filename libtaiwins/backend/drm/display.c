@@ -24,6 +24,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <unistd.h>
 #include <taiwins/objects/logger.h>
 #include <taiwins/objects/utils.h>
 #include <wayland-server.h>
@@ -309,6 +310,16 @@ submit_kms_state(struct tw_drm_display *output, uint32_t flags)
 
 }
 
+static inline bool
+display_explicit_fence(struct tw_drm_display *output)
+{
+	const struct tw_drm_plane_props *props =
+		output->status.next.props_main_plane;
+
+	return (output->gpu->feats & TW_DRM_CAP_ATOMIC) &&
+		props && props->in_fence_fd;
+}
+
 static void
 notify_display_presentable_commit(struct wl_listener *listener, void *data)
 {
@@ -317,6 +328,14 @@ notify_display_presentable_commit(struct wl_listener *listener, void *data)
 	struct tw_kms_state *pending_state =  &output->status.next;
 
 	assert(data == &output->output.surface);
+	//right after the swap, the render context is still current
+	if (pending_state->in_fence_fd >= 0)
+		close(pending_state->in_fence_fd);
+	pending_state->in_fence_fd = -1;
+	if (display_explicit_fence(output))
+		pending_state->in_fence_fd =
+			tw_render_presentable_export_fence(data,
+			                                   output->output.ctx);
 	if (output->gpu->impl->acquire_fb(output, pending_state)) {
 		submit_kms_state(output, DRM_MODE_PAGE_FLIP_EVENT);
 	}
@@ -474,6 +493,8 @@ tw_drm_display_find_create(struct tw_drm_gpu *gpu, drmModeConnector *conn,
 			return NULL;
 		dpy->drm = drm;
 		dpy->gpu = gpu;
+		dpy->status.now.in_fence_fd = -1;
+		dpy->status.next.in_fence_fd = -1;
 		tw_render_output_init(&dpy->output, &output_dev_impl,
 		                      drm->display);
 		read_display_info(dpy, conn);
@@ -611,7 +632,7 @@ tw_drm_display_handle_page_flipped(struct tw_drm_display *output, int crtc_id)
 	if (curr->fb.fb != pend->fb.fb &&
 	    curr->fb.handle != pend->fb.handle)
 		gpu->impl->release_fb(output, &curr->fb);
-	tw_kms_state_move(curr, pend, gpu->gpu_fd);
+	tw_kms_state_move(curr, pend, gpu);
 	output->status.pending = 0;
 
 	tw_render_output_clean_maybe(&output->output);
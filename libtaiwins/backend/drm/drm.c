@@ -211,16 +211,10 @@ handle_page_flip2(int fd, unsigned seq, unsigned tv_sec, unsigned tv_usec,
 int
 tw_drm_handle_drm_event(int fd, uint32_t mask, void *data)
 {
-	drmEventContext event = {
-		.version = 3,
-		.vblank_handler = NULL,
-		.page_flip_handler2 = handle_page_flip2,
-		.sequence_handler = NULL,
-	};
 	struct tw_drm_gpu *gpu = data;
 
 	if (gpu->activated)
-		drmHandleEvent(fd, &event);
+		gpu->kms->impl->dispatch(gpu, handle_page_flip2);
         return 1;
 }
 
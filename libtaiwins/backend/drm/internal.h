@@ -53,6 +53,9 @@ struct tw_drm_backend;
 #define TW_DRM_CONN_ID_INVLAID 0
 #define TW_DRM_PLANE_ID_INVALID 0
 #define TW_DRM_MAX_SWAP_IMGS 3
+#define TW_KMS_MAX_PROPS 64
+#define TW_KMS_FAKE_MAX_OBJS 8
+#define TW_KMS_FAKE_MAX_BLOBS 16
 
 enum tw_drm_platform {
 	TW_DRM_PLATFORM_GBM,
@@ -130,6 +133,7 @@ struct tw_drm_plane_props {
 	uint32_t crtc_h;
 	uint32_t crtc_id;
 	uint32_t fb_id;
+	uint32_t in_fence_fd; /**< 0 if explicit fencing not supported */
 };
 
 struct tw_drm_fb {
@@ -175,6 +179,7 @@ struct tw_kms_state {
 	bool active;
 	int crtc_id;
 	struct tw_drm_fb fb;
+	int in_fence_fd; /**< render fence for fb, consumed by submit */
 
 	//TODO gamma lut
 	//TODO list of planes
@@ -204,6 +209,55 @@ struct tw_drm_display {
 	struct wl_listener presentable_commit;
 };
 
+/**
+ * a flattened atomic request, the KMS device translates it into its own
+ * request
+ */
+struct tw_kms_request {
+	unsigned len;
+	bool overflow;
+	struct {
+		uint32_t obj_id, prop_id;
+		uint64_t value;
+	} props[TW_KMS_MAX_PROPS];
+};
+
+/* same as the page_flip_handler2 of drmEventContext */
+typedef void (*tw_kms_page_flip_handler_t)(int fd, unsigned seq,
+                                           unsigned tv_sec, unsigned tv_usec,
+                                           unsigned crtc_id, void *data);
+
+/**
+ * the KMS calls used by the commit path, implemented by libdrm or by a fake
+ * device for testing the backend without hardware.
+ *
+ * Returns follow libdrm, 0 on success or a negative errno.
+ */
+struct tw_kms_device_impl {
+	int (*atomic_commit)(struct tw_drm_gpu *gpu,
+	                     const struct tw_kms_request *req, uint32_t flags,
+	                     void *data);
+	int (*create_blob)(struct tw_drm_gpu *gpu, const void *data,
+	                   size_t size, uint32_t *id);
+	void (*destroy_blob)(struct tw_drm_gpu *gpu, uint32_t id);
+	/* legacy */
+	int (*set_connector_prop)(struct tw_drm_gpu *gpu, uint32_t conn_id,
+	                          uint32_t prop_id, uint64_t value);
+	int (*set_crtc)(struct tw_drm_gpu *gpu, uint32_t crtc_id,
+	                uint32_t fb_id, int x, int y, uint32_t *conns,
+	                int n_conns, drmModeModeInfo *mode);
+	int (*disable_cursor)(struct tw_drm_gpu *gpu, uint32_t crtc_id);
+	int (*page_flip)(struct tw_drm_gpu *gpu, uint32_t crtc_id,
+	                 uint32_t fb_id, uint32_t flags, void *data);
+	/** read the pending events, page flips are delivered to handler */
+	int (*dispatch)(struct tw_drm_gpu *gpu,
+	                tw_kms_page_flip_handler_t handler);
+};
+
+struct tw_kms_device {
+	const struct tw_kms_device_impl *impl;
+};
+
 struct tw_drm_gpu_impl {
 	enum tw_drm_platform type;
 	/** get different device handles (gbm or egl_device) */
@@ -237,6 +291,7 @@ struct tw_drm_gpu {
 	struct wl_list link; /* backend:gpu_list */
 
 	const struct tw_drm_gpu_impl *impl;
+	struct tw_kms_device *kms; /**< tw_kms_drm_device unless faked */
 	enum tw_drm_features feats;
 	struct tw_drm_backend *drm;
 	struct wl_event_source *event;
@@ -349,6 +404,8 @@ tw_drm_display_handle_page_flipped(struct tw_drm_display *output, int crtc_id);
 
 /********************************** KMS API **********************************/
 
+extern struct tw_kms_device tw_kms_drm_device;
+
 void
 tw_kms_state_deactivate(struct tw_kms_state *state);
 
@@ -357,7 +414,7 @@ tw_kms_state_duplicate(struct tw_kms_state *dst, struct tw_kms_state *src);
 
 void
 tw_kms_state_move(struct tw_kms_state *dst, struct tw_kms_state *src,
-                  int drm_fd);
+                  struct tw_drm_gpu *gpu);
 bool
 tw_kms_state_submit_atomic(struct tw_kms_state *state,
                            struct tw_drm_display *output, uint32_t flags);
@@ -365,6 +422,116 @@ bool
 tw_kms_state_submit_legacy(struct tw_kms_state *state,
                            struct tw_drm_display *output, uint32_t flags);
 
+/******************************* fake KMS device ******************************/
+
+/* kms-fake.c is not part of libtaiwins, it is built into the tests using it */
+
+enum tw_kms_fake_prop {
+	TW_KMS_FAKE_CRTC_ACTIVE,
+	TW_KMS_FAKE_CRTC_MODE_ID,
+	TW_KMS_FAKE_CONN_CRTC_ID,
+	TW_KMS_FAKE_CONN_DPMS,
+	TW_KMS_FAKE_CONN_EDID,
+	TW_KMS_FAKE_PLANE_TYPE,
+	TW_KMS_FAKE_PLANE_IN_FORMATS,
+	TW_KMS_FAKE_PLANE_SRC_X,
+	TW_KMS_FAKE_PLANE_SRC_Y,
+	TW_KMS_FAKE_PLANE_SRC_W,
+	TW_KMS_FAKE_PLANE_SRC_H,
+	TW_KMS_FAKE_PLANE_CRTC_X,
+	TW_KMS_FAKE_PLANE_CRTC_Y,
+	TW_KMS_FAKE_PLANE_CRTC_W,
+	TW_KMS_FAKE_PLANE_CRTC_H,
+	TW_KMS_FAKE_PLANE_CRTC_ID,
+	TW_KMS_FAKE_PLANE_FB_ID,
+	TW_KMS_FAKE_PLANE_IN_FENCE_FD,
+	TW_KMS_FAKE_PROP_COUNT,
+};
+
+struct tw_kms_fake_object {
+	uint32_t id;
+	uint32_t type; /**< DRM_MODE_OBJECT_* */
+	uint32_t possible_crtcs; /**< for planes and connectors */
+	uint64_t values[TW_KMS_FAKE_PROP_COUNT];
+};
+
+struct tw_kms_fake_crtc {
+	struct tw_kms_fake_object obj;
+	drmModeModeInfo mode;
+	uint64_t vblank_base; /**< vblank phase, reset on modeset */
+	uint64_t period; /**< 0 if crtc inactive */
+	unsigned seq;
+
+	bool flip_pending;
+	uint64_t flip_time;
+	void *flip_data;
+};
+
+/**
+ * @brief an in-process KMS device for testing the commit path.
+ *
+ * The device models CRTCs, planes and connectors with their properties. An
+ * atomic commit is validated like the kernel would: unknown or immutable
+ * properties, planes on an impossible or inactive CRTC, scaling on the
+ * primary plane, modeset without ALLOW_MODESET and flipping while a flip is
+ * pending are rejected. TEST_ONLY commits are validated and dropped.
+ *
+ * Time is virtual, page flips complete on the first vblank after the commit
+ * and are delivered by dispatch once the clock passed that vblank.
+ */
+struct tw_kms_fake_device {
+	struct tw_kms_device base;
+	uint64_t now; /**< virtual clock in nanoseconds */
+	uint32_t next_id;
+
+	unsigned n_crtcs, n_planes, n_connectors;
+	struct tw_kms_fake_crtc crtcs[TW_KMS_FAKE_MAX_OBJS];
+	struct tw_kms_fake_object planes[TW_KMS_FAKE_MAX_OBJS];
+	struct tw_kms_fake_object connectors[TW_KMS_FAKE_MAX_OBJS];
+
+	unsigned n_blobs;
+	struct {
+		uint32_t id;
+		drmModeModeInfo mode;
+	} blobs[TW_KMS_FAKE_MAX_BLOBS];
+
+	struct {
+		unsigned commits, test_commits, rejected;
+		unsigned modesets, flips, fences;
+	} stats;
+};
+
+void
+tw_kms_fake_device_init(struct tw_kms_fake_device *dev);
+
+uint32_t
+tw_kms_fake_device_add_crtc(struct tw_kms_fake_device *dev);
+
+uint32_t
+tw_kms_fake_device_add_plane(struct tw_kms_fake_device *dev,
+                             enum tw_drm_plane_type type,
+                             uint32_t possible_crtcs);
+uint32_t
+tw_kms_fake_device_add_connector(struct tw_kms_fake_device *dev,
+                                 uint32_t possible_crtcs);
+/**
+ * fill the crtcs and planes of gpu with the fake objects and use the fake
+ * device for KMS calls, the gpu has to be zeroed.
+ */
+void
+tw_kms_fake_device_setup_gpu(struct tw_kms_fake_device *dev,
+                             struct tw_drm_gpu *gpu);
+bool
+tw_kms_fake_device_read_connector(struct tw_kms_fake_device *dev,
+                                  uint32_t id,
+                                  struct tw_drm_connector_props *props);
+/** advance the virtual clock, pending flips are delivered on dispatch */
+void
+tw_kms_fake_device_advance(struct tw_kms_fake_device *dev, uint64_t ns);
+
+struct tw_kms_fake_crtc *
+tw_kms_fake_device_get_crtc(struct tw_kms_fake_device *dev, uint32_t id);
+
 #ifdef  __cplusplus
 }
 #endif
@@ -0,0 +1,745 @@
+/*
+ * kms-fake.c - taiwins server fake KMS device
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <drm_fourcc.h>
+#include <wayland-util.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include <taiwins/objects/drm_formats.h>
+#include <taiwins/objects/plane.h>
+
+#include "internal.h"
+
+#define FAKE_PROP_ID_BASE 0x1000
+#define FAKE_DEFAULT_PERIOD 16666667
+
+static const struct {
+	uint32_t type;
+	bool immutable;
+} fake_props[TW_KMS_FAKE_PROP_COUNT] = {
+	[TW_KMS_FAKE_CRTC_ACTIVE] = {DRM_MODE_OBJECT_CRTC, false},
+	[TW_KMS_FAKE_CRTC_MODE_ID] = {DRM_MODE_OBJECT_CRTC, false},
+	[TW_KMS_FAKE_CONN_CRTC_ID] = {DRM_MODE_OBJECT_CONNECTOR, false},
+	[TW_KMS_FAKE_CONN_DPMS] = {DRM_MODE_OBJECT_CONNECTOR, false},
+	[TW_KMS_FAKE_CONN_EDID] = {DRM_MODE_OBJECT_CONNECTOR, true},
+	[TW_KMS_FAKE_PLANE_TYPE] = {DRM_MODE_OBJECT_PLANE, true},
+	[TW_KMS_FAKE_PLANE_IN_FORMATS] = {DRM_MODE_OBJECT_PLANE, true},
+	[TW_KMS_FAKE_PLANE_SRC_X] = {DRM_MODE_OBJECT_PLANE, false},
+	[TW_KMS_FAKE_PLANE_SRC_Y] = {DRM_MODE_OBJECT_PLANE, false},
+	[TW_KMS_FAKE_PLANE_SRC_W] = {DRM_MODE_OBJECT_PLANE, false},
+	[TW_KMS_FAKE_PLANE_SRC_H] = {DRM_MODE_OBJECT_PLANE, false},
+	[TW_KMS_FAKE_PLANE_CRTC_X] = {DRM_MODE_OBJECT_PLANE, false},
+	[TW_KMS_FAKE_PLANE_CRTC_Y] = {DRM_MODE_OBJECT_PLANE, false},
+	[TW_KMS_FAKE_PLANE_CRTC_W] = {DRM_MODE_OBJECT_PLANE, false},
+	[TW_KMS_FAKE_PLANE_CRTC_H] = {DRM_MODE_OBJECT_PLANE, false},
+	[TW_KMS_FAKE_PLANE_CRTC_ID] = {DRM_MODE_OBJECT_PLANE, false},
+	[TW_KMS_FAKE_PLANE_FB_ID] = {DRM_MODE_OBJECT_PLANE, false},
+	[TW_KMS_FAKE_PLANE_IN_FENCE_FD] = {DRM_MODE_OBJECT_PLANE, false},
+};
+
+struct fake_state {
+	struct tw_kms_fake_crtc crtcs[TW_KMS_FAKE_MAX_OBJS];
+	struct tw_kms_fake_object planes[TW_KMS_FAKE_MAX_OBJS];
+	struct tw_kms_fake_object connectors[TW_KMS_FAKE_MAX_OBJS];
+};
+
+static inline uint32_t
+fake_prop_id(enum tw_kms_fake_prop prop)
+{
+	return FAKE_PROP_ID_BASE + prop;
+}
+
+static inline struct tw_kms_fake_device *
+fake_device_from_gpu(struct tw_drm_gpu *gpu)
+{
+	struct tw_kms_fake_device *dev =
+		wl_container_of(gpu->kms, dev, base);
+	return dev;
+}
+
+static inline uint64_t
+fake_mode_period(const drmModeModeInfo *mode)
+{
+	if (mode->clock && mode->htotal && mode->vtotal)
+		return (uint64_t)mode->htotal * mode->vtotal * 1000000 /
+			mode->clock;
+	else if (mode->vrefresh)
+		return 1000000000 / mode->vrefresh;
+	return FAKE_DEFAULT_PERIOD;
+}
+
+/* the first vblank strictly after t */
+static inline uint64_t
+fake_crtc_next_vblank(const struct tw_kms_fake_crtc *crtc, uint64_t t)
+{
+	uint64_t period = crtc->period ? crtc->period : FAKE_DEFAULT_PERIOD;
+
+	if (t < crtc->vblank_base)
+		return crtc->vblank_base;
+	return crtc->vblank_base +
+		((t - crtc->vblank_base) / period + 1) * period;
+}
+
+static inline void
+fake_state_save(struct fake_state *state,
+                const struct tw_kms_fake_device *dev)
+{
+	memcpy(state->crtcs, dev->crtcs, sizeof(state->crtcs));
+	memcpy(state->planes, dev->planes, sizeof(state->planes));
+	memcpy(state->connectors, dev->connectors, sizeof(state->connectors));
+}
+
+static inline void
+fake_state_apply(struct tw_kms_fake_device *dev,
+                 const struct fake_state *state)
+{
+	memcpy(dev->crtcs, state->crtcs, sizeof(dev->crtcs));
+	memcpy(dev->planes, state->planes, sizeof(dev->planes));
+	memcpy(dev->connectors, state->connectors, sizeof(dev->connectors));
+}
+
+static int
+fake_crtc_index(const struct tw_kms_fake_device *dev, uint64_t id)
+{
+	for (unsigned i = 0; i < dev->n_crtcs; i++)
+		if (dev->crtcs[i].obj.id == id)
+			return i;
+	return -1;
+}
+
+static const drmModeModeInfo *
+fake_find_blob(const struct tw_kms_fake_device *dev, uint64_t id)
+{
+	for (unsigned i = 0; i < dev->n_blobs; i++)
+		if (dev->blobs[i].id == id)
+			return &dev->blobs[i].mode;
+	return NULL;
+}
+
+static struct tw_kms_fake_object *
+fake_find_object(const struct tw_kms_fake_device *dev,
+                 struct fake_state *state, uint32_t id)
+{
+	int crtc = fake_crtc_index(dev, id);
+
+	if (crtc >= 0)
+		return &state->crtcs[crtc].obj;
+	for (unsigned i = 0; i < dev->n_planes; i++)
+		if (state->planes[i].id == id)
+			return &state->planes[i];
+	for (unsigned i = 0; i < dev->n_connectors; i++)
+		if (state->connectors[i].id == id)
+			return &state->connectors[i];
+	return NULL;
+}
+
+static inline uint32_t
+fake_object_crtc_mask(const struct tw_kms_fake_device *dev,
+                      const struct tw_kms_fake_object *obj)
+{
+	int idx = -1;
+
+	if (obj->type == DRM_MODE_OBJECT_CRTC)
+		idx = fake_crtc_index(dev, obj->id);
+	else if (obj->type == DRM_MODE_OBJECT_PLANE)
+		idx = fake_crtc_index(dev,
+		                      obj->values[TW_KMS_FAKE_PLANE_CRTC_ID]);
+	else if (obj->type == DRM_MODE_OBJECT_CONNECTOR)
+		idx = fake_crtc_index(dev,
+		                      obj->values[TW_KMS_FAKE_CONN_CRTC_ID]);
+	return idx >= 0 ? (1u << idx) : 0;
+}
+
+/******************************************************************************
+ * validation
+ *****************************************************************************/
+
+static int
+fake_set_prop(struct tw_kms_fake_device *dev, struct fake_state *state,
+              uint32_t obj_id, uint32_t prop_id, uint64_t value,
+              uint32_t *touched)
+{
+	struct tw_kms_fake_object *obj = fake_find_object(dev, state, obj_id);
+	uint32_t prop = prop_id - FAKE_PROP_ID_BASE;
+
+	if (!obj || prop_id < FAKE_PROP_ID_BASE ||
+	    prop >= TW_KMS_FAKE_PROP_COUNT)
+		return -ENOENT;
+	if (fake_props[prop].type != obj->type || fake_props[prop].immutable)
+		return -EINVAL;
+	//both old and new crtc are affected
+	*touched |= fake_object_crtc_mask(dev, obj);
+	obj->values[prop] = value;
+	*touched |= fake_object_crtc_mask(dev, obj);
+
+	if (prop == TW_KMS_FAKE_CRTC_MODE_ID) {
+		struct tw_kms_fake_crtc *crtc =
+			wl_container_of(obj, crtc, obj);
+		const drmModeModeInfo *mode = fake_find_blob(dev, value);
+
+		if (value && !mode)
+			return -EINVAL;
+		if (mode)
+			crtc->mode = *mode;
+		else
+			memset(&crtc->mode, 0, sizeof(crtc->mode));
+	}
+	return 0;
+}
+
+static int
+fake_check_crtcs(struct tw_kms_fake_device *dev, struct fake_state *state,
+                 uint32_t *modeset)
+{
+	for (unsigned i = 0; i < dev->n_crtcs; i++) {
+		struct tw_kms_fake_crtc *next = &state->crtcs[i];
+		struct tw_kms_fake_crtc *curr = &dev->crtcs[i];
+		bool active = next->obj.values[TW_KMS_FAKE_CRTC_ACTIVE];
+		bool connected = false;
+
+		if (active && !next->mode.hdisplay)
+			return -EINVAL;
+		for (unsigned j = 0; j < dev->n_connectors; j++)
+			connected = connected ||
+				state->connectors[j].values[
+					TW_KMS_FAKE_CONN_CRTC_ID] ==
+				next->obj.id;
+		if (active && !connected)
+			return -EINVAL;
+		if (active != !!curr->obj.values[TW_KMS_FAKE_CRTC_ACTIVE] ||
+		    memcmp(&next->mode, &curr->mode, sizeof(next->mode)))
+			*modeset |= 1u << i;
+	}
+	return 0;
+}
+
+static int
+fake_check_connectors(struct tw_kms_fake_device *dev,
+                      struct fake_state *state, uint32_t *modeset)
+{
+	for (unsigned i = 0; i < dev->n_connectors; i++) {
+		struct tw_kms_fake_object *next = &state->connectors[i];
+		uint64_t crtc_id = next->values[TW_KMS_FAKE_CONN_CRTC_ID];
+		uint64_t curr_id =
+			dev->connectors[i].values[TW_KMS_FAKE_CONN_CRTC_ID];
+		int idx = fake_crtc_index(dev, crtc_id);
+
+		if (crtc_id && (idx < 0 ||
+		                !(next->possible_crtcs & (1u << idx))))
+			return -EINVAL;
+		//routing change requires modeset on both crtcs
+		if (crtc_id != curr_id)
+			*modeset |= fake_object_crtc_mask(dev, next) |
+				fake_object_crtc_mask(dev, &dev->connectors[i]);
+	}
+	return 0;
+}
+
+static int
+fake_check_planes(struct tw_kms_fake_device *dev, struct fake_state *state)
+{
+	for (unsigned i = 0; i < dev->n_planes; i++) {
+		struct tw_kms_fake_object *p = &state->planes[i];
+		uint64_t *v = p->values;
+		int idx = fake_crtc_index(dev, v[TW_KMS_FAKE_PLANE_CRTC_ID]);
+		int64_t fence = (int64_t)v[TW_KMS_FAKE_PLANE_IN_FENCE_FD];
+		struct tw_kms_fake_crtc *crtc;
+
+		if (fence != -1 && fcntl((int)fence, F_GETFD) < 0)
+			return -EINVAL;
+		if (!v[TW_KMS_FAKE_PLANE_CRTC_ID] &&
+		    !v[TW_KMS_FAKE_PLANE_FB_ID])
+			continue;
+		if (!v[TW_KMS_FAKE_PLANE_CRTC_ID] ||
+		    !v[TW_KMS_FAKE_PLANE_FB_ID])
+			return -EINVAL;
+		if (idx < 0 || !(p->possible_crtcs & (1u << idx)))
+			return -EINVAL;
+		crtc = &state->crtcs[idx];
+		if (!crtc->obj.values[TW_KMS_FAKE_CRTC_ACTIVE])
+			return -EINVAL;
+		if (v[TW_KMS_FAKE_PLANE_TYPE] == DRM_PLANE_TYPE_OVERLAY)
+			continue;
+		//only overlays scale, primary has to cover the crtc
+		if ((v[TW_KMS_FAKE_PLANE_SRC_W] >> 16) !=
+		    v[TW_KMS_FAKE_PLANE_CRTC_W] ||
+		    (v[TW_KMS_FAKE_PLANE_SRC_H] >> 16) !=
+		    v[TW_KMS_FAKE_PLANE_CRTC_H])
+			return -EINVAL;
+		if (v[TW_KMS_FAKE_PLANE_TYPE] == DRM_PLANE_TYPE_PRIMARY &&
+		    (v[TW_KMS_FAKE_PLANE_CRTC_X] || v[TW_KMS_FAKE_PLANE_CRTC_Y] ||
+		     v[TW_KMS_FAKE_PLANE_CRTC_W] != crtc->mode.hdisplay ||
+		     v[TW_KMS_FAKE_PLANE_CRTC_H] != crtc->mode.vdisplay))
+			return -EINVAL;
+	}
+	return 0;
+}
+
+static int
+fake_check_flips(struct tw_kms_fake_device *dev, struct fake_state *state,
+                 uint32_t touched, uint32_t flags)
+{
+	for (unsigned i = 0; i < dev->n_crtcs; i++) {
+		if (!(touched & (1u << i)))
+			continue;
+		if ((flags & DRM_MODE_PAGE_FLIP_EVENT) &&
+		    !state->crtcs[i].obj.values[TW_KMS_FAKE_CRTC_ACTIVE])
+			return -EINVAL;
+		if ((flags & DRM_MODE_ATOMIC_NONBLOCK) &&
+		    dev->crtcs[i].flip_pending)
+			return -EBUSY;
+	}
+	return 0;
+}
+
+/******************************************************************************
+ * commit
+ *****************************************************************************/
+
+/* a blocking commit waits for the pending flips */
+static void
+fake_wait_flips(struct tw_kms_fake_device *dev, uint32_t crtcs)
+{
+	for (unsigned i = 0; i < dev->n_crtcs; i++)
+		if ((crtcs & (1u << i)) && dev->crtcs[i].flip_pending &&
+		    dev->crtcs[i].flip_time > dev->now)
+			dev->now = dev->crtcs[i].flip_time;
+}
+
+static void
+fake_apply(struct tw_kms_fake_device *dev, struct fake_state *state,
+           uint32_t touched, uint32_t modeset, uint32_t flags, void *data)
+{
+	fake_state_apply(dev, state);
+	for (unsigned i = 0; i < dev->n_planes; i++) {
+		uint64_t *fence =
+			&dev->planes[i].values[TW_KMS_FAKE_PLANE_IN_FENCE_FD];
+		dev->stats.fences += (*fence != (uint64_t)-1);
+		*fence = (uint64_t)-1;
+	}
+	for (unsigned i = 0; i < dev->n_crtcs; i++) {
+		struct tw_kms_fake_crtc *crtc = &dev->crtcs[i];
+		bool active = crtc->obj.values[TW_KMS_FAKE_CRTC_ACTIVE];
+
+		if (modeset & (1u << i)) {
+			crtc->vblank_base = dev->now;
+			crtc->period = active ? fake_mode_period(&crtc->mode) :
+				0;
+			crtc->seq = 0;
+			dev->stats.modesets++;
+		}
+		if (!(touched & (1u << i)) || !active)
+			continue;
+		if (flags & DRM_MODE_PAGE_FLIP_EVENT) {
+			crtc->flip_pending = true;
+			crtc->flip_time = fake_crtc_next_vblank(crtc,
+			                                        dev->now);
+			crtc->flip_data = data;
+		} else if (!(flags & DRM_MODE_ATOMIC_NONBLOCK) &&
+		           !(modeset & (1u << i))) {
+			dev->now = fake_crtc_next_vblank(crtc, dev->now);
+		}
+	}
+}
+
+static int
+fake_atomic_commit(struct tw_drm_gpu *gpu, const struct tw_kms_request *req,
+                   uint32_t flags, void *data)
+{
+	struct tw_kms_fake_device *dev = fake_device_from_gpu(gpu);
+	struct fake_state state;
+	uint32_t touched = 0, modeset = 0;
+	int ret = 0;
+
+	if ((flags & DRM_MODE_ATOMIC_TEST_ONLY) &&
+	    (flags & DRM_MODE_PAGE_FLIP_EVENT))
+		return -EINVAL;
+
+	fake_state_save(&state, dev);
+	for (unsigned i = 0; i < req->len && !ret; i++)
+		ret = fake_set_prop(dev, &state, req->props[i].obj_id,
+		                    req->props[i].prop_id,
+		                    req->props[i].value, &touched);
+	if (!ret)
+		ret = fake_check_connectors(dev, &state, &modeset);
+	if (!ret)
+		ret = fake_check_crtcs(dev, &state, &modeset);
+	if (!ret)
+		ret = fake_check_planes(dev, &state);
+	if (!ret && modeset && !(flags & DRM_MODE_ATOMIC_ALLOW_MODESET))
+		ret = -EINVAL;
+	if (!ret)
+		ret = fake_check_flips(dev, &state, touched | modeset, flags);
+	if (ret) {
+		dev->stats.rejected++;
+		return ret;
+	}
+	if (flags & DRM_MODE_ATOMIC_TEST_ONLY) {
+		dev->stats.test_commits++;
+		return 0;
+	}
+	if (!(flags & DRM_MODE_ATOMIC_NONBLOCK))
+		fake_wait_flips(dev, touched | modeset);
+	fake_apply(dev, &state, touched | modeset, modeset, flags, data);
+	dev->stats.commits++;
+	return 0;
+}
+
+static int
+fake_create_blob(struct tw_drm_gpu *gpu, const void *data, size_t size,
+                 uint32_t *id)
+{
+	struct tw_kms_fake_device *dev = fake_device_from_gpu(gpu);
+
+	//only mode blobs are supported
+	if (size != sizeof(drmModeModeInfo))
+		return -EINVAL;
+	if (dev->n_blobs == TW_KMS_FAKE_MAX_BLOBS)
+		return -ENOMEM;
+	dev->blobs[dev->n_blobs].id = dev->next_id++;
+	memcpy(&dev->blobs[dev->n_blobs].mode, data, size);
+	*id = dev->blobs[dev->n_blobs++].id;
+	return 0;
+}
+
+static void
+fake_destroy_blob(struct tw_drm_gpu *gpu, uint32_t id)
+{
+	struct tw_kms_fake_device *dev = fake_device_from_gpu(gpu);
+
+	for (unsigned i = 0; i < dev->n_blobs; i++) {
+		if (dev->blobs[i].id != id)
+			continue;
+		dev->blobs[i] = dev->blobs[--dev->n_blobs];
+		return;
+	}
+}
+
+static int
+fake_set_connector_prop(struct tw_drm_gpu *gpu, uint32_t conn_id,
+                        uint32_t prop_id, uint64_t value)
+{
+	struct tw_kms_fake_device *dev = fake_device_from_gpu(gpu);
+
+	if (prop_id != fake_prop_id(TW_KMS_FAKE_CONN_DPMS))
+		return -EINVAL;
+	for (unsigned i = 0; i < dev->n_connectors; i++) {
+		if (dev->connectors[i].id != conn_id)
+			continue;
+		dev->connectors[i].values[TW_KMS_FAKE_CONN_DPMS] = value;
+		return 0;
+	}
+	return -ENOENT;
+}
+
+static struct tw_kms_fake_object *
+fake_crtc_primary(struct tw_kms_fake_device *dev, int crtc_idx)
+{
+	for (unsigned i = 0; i < dev->n_planes; i++) {
+		struct tw_kms_fake_object *p = &dev->planes[i];
+
+		if (p->values[TW_KMS_FAKE_PLANE_TYPE] == DRM_PLANE_TYPE_PRIMARY
+		    && (p->possible_crtcs & (1u << crtc_idx)))
+			return p;
+	}
+	return NULL;
+}
+
+static int
+fake_set_crtc(struct tw_drm_gpu *gpu, uint32_t crtc_id, uint32_t fb_id,
+              int x, int y, uint32_t *conns, int n_conns,
+              drmModeModeInfo *mode)
+{
+	struct tw_kms_fake_device *dev = fake_device_from_gpu(gpu);
+	int idx = fake_crtc_index(dev, crtc_id);
+	struct tw_kms_fake_crtc *crtc = idx >= 0 ? &dev->crtcs[idx] : NULL;
+	struct tw_kms_fake_object *primary = crtc ?
+		fake_crtc_primary(dev, idx) : NULL;
+	bool enable = mode && fb_id;
+
+	if (!crtc || !primary)
+		return -EINVAL;
+	fake_wait_flips(dev, 1u << idx);
+	for (unsigned i = 0; i < dev->n_connectors; i++) {
+		uint64_t *v = dev->connectors[i].values;
+
+		if (v[TW_KMS_FAKE_CONN_CRTC_ID] == crtc_id)
+			v[TW_KMS_FAKE_CONN_CRTC_ID] = 0;
+		for (int j = 0; enable && j < n_conns; j++)
+			if (dev->connectors[i].id == conns[j])
+				v[TW_KMS_FAKE_CONN_CRTC_ID] = crtc_id;
+	}
+	primary->values[TW_KMS_FAKE_PLANE_FB_ID] = enable ? fb_id : 0;
+	primary->values[TW_KMS_FAKE_PLANE_CRTC_ID] = enable ? crtc_id : 0;
+	primary->values[TW_KMS_FAKE_PLANE_SRC_X] = (uint64_t)x << 16;
+	primary->values[TW_KMS_FAKE_PLANE_SRC_Y] = (uint64_t)y << 16;
+	crtc->obj.values[TW_KMS_FAKE_CRTC_ACTIVE] = enable;
+	if (enable)
+		crtc->mode = *mode;
+	else
+		memset(&crtc->mode, 0, sizeof(crtc->mode));
+	crtc->vblank_base = dev->now;
+	crtc->period = enable ? fake_mode_period(&crtc->mode) : 0;
+	crtc->seq = 0;
+	dev->stats.modesets++;
+	dev->stats.commits++;
+	return 0;
+}
+
+static int
+fake_disable_cursor(struct tw_drm_gpu *gpu, uint32_t crtc_id)
+{
+	struct tw_kms_fake_device *dev = fake_device_from_gpu(gpu);
+
+	return fake_crtc_index(dev, crtc_id) >= 0 ? 0 : -EINVAL;
+}
+
+static int
+fake_page_flip(struct tw_drm_gpu *gpu, uint32_t crtc_id, uint32_t fb_id,
+               uint32_t flags, void *data)
+{
+	struct tw_kms_fake_device *dev = fake_device_from_gpu(gpu);
+	int idx = fake_crtc_index(dev, crtc_id);
+	struct tw_kms_fake_crtc *crtc = idx >= 0 ? &dev->crtcs[idx] : NULL;
+	struct tw_kms_fake_object *primary = crtc ?
+		fake_crtc_primary(dev, idx) : NULL;
+
+	if (!crtc || !primary || !fb_id ||
+	    !crtc->obj.values[TW_KMS_FAKE_CRTC_ACTIVE])
+		return -EINVAL;
+	if (crtc->flip_pending)
+		return -EBUSY;
+	primary->values[TW_KMS_FAKE_PLANE_FB_ID] = fb_id;
+	if (flags & DRM_MODE_PAGE_FLIP_EVENT) {
+		crtc->flip_pending = true;
+		crtc->flip_time = fake_crtc_next_vblank(crtc, dev->now);
+		crtc->flip_data = data;
+	}
+	dev->stats.commits++;
+	return 0;
+}
+
+static int
+fake_dispatch(struct tw_drm_gpu *gpu, tw_kms_page_flip_handler_t handler)
+{
+	struct tw_kms_fake_device *dev = fake_device_from_gpu(gpu);
+
+	for (unsigned i = 0; i < dev->n_crtcs; i++) {
+		struct tw_kms_fake_crtc *crtc = &dev->crtcs[i];
+		uint64_t period = crtc->period ?
+			crtc->period : FAKE_DEFAULT_PERIOD;
+
+		if (!crtc->flip_pending || crtc->flip_time > dev->now)
+			continue;
+		crtc->flip_pending = false;
+		crtc->seq = (crtc->flip_time - crtc->vblank_base) / period;
+		dev->stats.flips++;
+		if (handler)
+			handler(gpu->gpu_fd, crtc->seq,
+			        crtc->flip_time / 1000000000,
+			        (crtc->flip_time % 1000000000) / 1000,
+			        crtc->obj.id, crtc->flip_data);
+	}
+	return 0;
+}
+
+static const struct tw_kms_device_impl fake_kms_impl = {
+	.atomic_commit = fake_atomic_commit,
+	.create_blob = fake_create_blob,
+	.destroy_blob = fake_destroy_blob,
+	.set_connector_prop = fake_set_connector_prop,
+	.set_crtc = fake_set_crtc,
+	.disable_cursor = fake_disable_cursor,
+	.page_flip = fake_page_flip,
+	.dispatch = fake_dispatch,
+};
+
+/******************************************************************************
+ * API
+ *****************************************************************************/
+
+void
+tw_kms_fake_device_init(struct tw_kms_fake_device *dev)
+{
+	memset(dev, 0, sizeof(*dev));
+	dev->base.impl = &fake_kms_impl;
+	dev->next_id = 1;
+}
+
+uint32_t
+tw_kms_fake_device_add_crtc(struct tw_kms_fake_device *dev)
+{
+	struct tw_kms_fake_crtc *crtc;
+
+	if (dev->n_crtcs == TW_KMS_FAKE_MAX_OBJS)
+		return 0;
+	crtc = &dev->crtcs[dev->n_crtcs++];
+	crtc->obj.id = dev->next_id++;
+	crtc->obj.type = DRM_MODE_OBJECT_CRTC;
+	return crtc->obj.id;
+}
+
+uint32_t
+tw_kms_fake_device_add_plane(struct tw_kms_fake_device *dev,
+                             enum tw_drm_plane_type type,
+                             uint32_t possible_crtcs)
+{
+	struct tw_kms_fake_object *plane;
+
+	if (dev->n_planes == TW_KMS_FAKE_MAX_OBJS)
+		return 0;
+	plane = &dev->planes[dev->n_planes++];
+	plane->id = dev->next_id++;
+	plane->type = DRM_MODE_OBJECT_PLANE;
+	plane->possible_crtcs = possible_crtcs;
+	plane->values[TW_KMS_FAKE_PLANE_IN_FENCE_FD] = (uint64_t)-1;
+	switch (type) {
+	case TW_DRM_PLANE_MAJOR:
+		plane->values[TW_KMS_FAKE_PLANE_TYPE] = DRM_PLANE_TYPE_PRIMARY;
+		break;
+	case TW_DRM_PLANE_OVERLAY:
+		plane->values[TW_KMS_FAKE_PLANE_TYPE] = DRM_PLANE_TYPE_OVERLAY;
+		break;
+	case TW_DRM_PLANE_CURSOR:
+		plane->values[TW_KMS_FAKE_PLANE_TYPE] = DRM_PLANE_TYPE_CURSOR;
+		break;
+	}
+	return plane->id;
+}
+
+uint32_t
+tw_kms_fake_device_add_connector(struct tw_kms_fake_device *dev,
+                                 uint32_t possible_crtcs)
+{
+	struct tw_kms_fake_object *conn;
+
+	if (dev->n_connectors == TW_KMS_FAKE_MAX_OBJS)
+		return 0;
+	conn = &dev->connectors[dev->n_connectors++];
+	conn->id = dev->next_id++;
+	conn->type = DRM_MODE_OBJECT_CONNECTOR;
+	conn->possible_crtcs = possible_crtcs;
+	conn->values[TW_KMS_FAKE_CONN_DPMS] = DRM_MODE_DPMS_ON;
+	return conn->id;
+}
+
+static inline void
+fake_setup_plane_props(struct tw_drm_plane_props *p, uint32_t id)
+{
+	p->id = id;
+	p->type = fake_prop_id(TW_KMS_FAKE_PLANE_TYPE);
+	p->in_formats = fake_prop_id(TW_KMS_FAKE_PLANE_IN_FORMATS);
+	p->src_x = fake_prop_id(TW_KMS_FAKE_PLANE_SRC_X);
+	p->src_y = fake_prop_id(TW_KMS_FAKE_PLANE_SRC_Y);
+	p->src_w = fake_prop_id(TW_KMS_FAKE_PLANE_SRC_W);
+	p->src_h = fake_prop_id(TW_KMS_FAKE_PLANE_SRC_H);
+	p->crtc_x = fake_prop_id(TW_KMS_FAKE_PLANE_CRTC_X);
+	p->crtc_y = fake_prop_id(TW_KMS_FAKE_PLANE_CRTC_Y);
+	p->crtc_w = fake_prop_id(TW_KMS_FAKE_PLANE_CRTC_W);
+	p->crtc_h = fake_prop_id(TW_KMS_FAKE_PLANE_CRTC_H);
+	p->crtc_id = fake_prop_id(TW_KMS_FAKE_PLANE_CRTC_ID);
+	p->fb_id = fake_prop_id(TW_KMS_FAKE_PLANE_FB_ID);
+	p->in_fence_fd = fake_prop_id(TW_KMS_FAKE_PLANE_IN_FENCE_FD);
+}
+
+void
+tw_kms_fake_device_setup_gpu(struct tw_kms_fake_device *dev,
+                             struct tw_drm_gpu *gpu)
+{
+	uint32_t formats[] = {DRM_FORMAT_ARGB8888, DRM_FORMAT_XRGB8888};
+	uint64_t mod = DRM_FORMAT_MOD_LINEAR;
+	bool external = false;
+
+	gpu->kms = &dev->base;
+	gpu->gpu_fd = -1;
+	gpu->feats |= TW_DRM_CAP_ATOMIC;
+	gpu->clk_id = CLOCK_MONOTONIC;
+	gpu->activated = true;
+	wl_list_init(&gpu->crtc_list);
+	wl_list_init(&gpu->plane_list);
+
+	for (unsigned i = 0; i < dev->n_crtcs; i++) {
+		struct tw_drm_crtc *crtc = &gpu->crtcs[i];
+
+		crtc->idx = i;
+		crtc->props.id = dev->crtcs[i].obj.id;
+		crtc->props.active = fake_prop_id(TW_KMS_FAKE_CRTC_ACTIVE);
+		crtc->props.mode_id = fake_prop_id(TW_KMS_FAKE_CRTC_MODE_ID);
+		wl_list_insert(gpu->crtc_list.prev, &crtc->link);
+		gpu->crtc_mask |= 1u << i;
+	}
+	for (unsigned i = 0; i < dev->n_planes; i++) {
+		struct tw_drm_plane *plane = &gpu->planes[i];
+		uint64_t type = dev->planes[i].values[TW_KMS_FAKE_PLANE_TYPE];
+
+		if (type == DRM_PLANE_TYPE_CURSOR)
+			plane->type = TW_DRM_PLANE_CURSOR;
+		else if (type == DRM_PLANE_TYPE_OVERLAY)
+			plane->type = TW_DRM_PLANE_OVERLAY;
+		else
+			plane->type = TW_DRM_PLANE_MAJOR;
+		tw_plane_init(&plane->base);
+		tw_drm_formats_init(&plane->formats);
+		for (unsigned j = 0; j < 2; j++)
+			tw_drm_formats_add_format(&plane->formats, formats[j],
+			                          1, &mod, &external);
+		plane->crtc_mask = dev->planes[i].possible_crtcs;
+		fake_setup_plane_props(&plane->props, dev->planes[i].id);
+		wl_list_insert(gpu->plane_list.prev, &plane->base.link);
+		gpu->plane_mask |= 1u << i;
+	}
+}
+
+bool
+tw_kms_fake_device_read_connector(struct tw_kms_fake_device *dev,
+                                  uint32_t id,
+                                  struct tw_drm_connector_props *props)
+{
+	for (unsigned i = 0; i < dev->n_connectors; i++) {
+		if (dev->connectors[i].id != id)
+			continue;
+		props->id = id;
+		props->edid = fake_prop_id(TW_KMS_FAKE_CONN_EDID);
+		props->dpms = fake_prop_id(TW_KMS_FAKE_CONN_DPMS);
+		props->crtc_id = fake_prop_id(TW_KMS_FAKE_CONN_CRTC_ID);
+		return true;
+	}
+	return false;
+}
+
+void
+tw_kms_fake_device_advance(struct tw_kms_fake_device *dev, uint64_t ns)
+{
+	dev->now += ns;
+}
+
+struct tw_kms_fake_crtc *
+tw_kms_fake_device_get_crtc(struct tw_kms_fake_device *dev, uint32_t id)
+{
+	int idx = fake_crtc_index(dev, id);
+	return idx >= 0 ? &dev->crtcs[idx] : NULL;
+}
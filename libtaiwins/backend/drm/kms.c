@@ -21,8 +21,11 @@
 
 #include <gbm.h>
 #include <assert.h>
+#include <errno.h>
 #include <stdint.h>
+#include <unistd.h>
 #include <wayland-server-core.h>
+#include <xf86drm.h>
 #include <xf86drmMode.h>
 #include <taiwins/objects/logger.h>
 
@@ -37,27 +40,41 @@ plane_fb_init(struct tw_drm_fb *fb)
 }
 
 static inline void
-atomic_commit_prop_blob(int drm_fd, uint32_t *dst, uint32_t src)
+kms_state_close_fence(struct tw_kms_state *state)
+{
+	if (state->in_fence_fd >= 0)
+		close(state->in_fence_fd);
+	state->in_fence_fd = -1;
+}
+
+static inline void
+atomic_commit_prop_blob(struct tw_drm_gpu *gpu, uint32_t *dst, uint32_t src)
 {
 	if (*dst == src)
 		return;
 	if (*dst != 0)
-		drmModeDestroyPropertyBlob(drm_fd, *dst);
+		gpu->kms->impl->destroy_blob(gpu, *dst);
 	*dst = src;
 }
 
 static inline void
-atomic_add(drmModeAtomicReq *req, bool *pass, uint32_t id, uint32_t prop,
+atomic_add(struct tw_kms_request *req, bool *pass, uint32_t id, uint32_t prop,
            uint64_t val)
 {
-	if (pass) {
-		int ret = drmModeAtomicAddProperty(req, id, prop, val);
-		*pass = *pass && (ret >= 0);
+	if (req->len == TW_KMS_MAX_PROPS)
+		req->overflow = true;
+	if (pass && !req->overflow) {
+		req->props[req->len].obj_id = id;
+		req->props[req->len].prop_id = prop;
+		req->props[req->len].value = val;
+		req->len++;
 	}
+	if (pass)
+		*pass = *pass && !req->overflow;
 }
 
 static inline void
-atomic_plane_disable(drmModeAtomicReq *req, bool *pass,
+atomic_plane_disable(struct tw_kms_request *req, bool *pass,
                      const struct tw_drm_plane_props *props)
 {
 	if (props) {
@@ -67,7 +84,7 @@ atomic_plane_disable(drmModeAtomicReq *req, bool *pass,
 }
 
 static bool
-tw_kms_atomic_set_plane_fb(drmModeAtomicReq *req, bool pass,
+tw_kms_atomic_set_plane_fb(struct tw_kms_request *req, bool pass,
                            struct tw_kms_state *state)
 {
 	const struct tw_drm_plane_props *prop = state->props_main_plane;
@@ -90,12 +107,16 @@ tw_kms_atomic_set_plane_fb(drmModeAtomicReq *req, bool pass,
 		atomic_add(req, &pass, id, prop->crtc_h, fb->h);
 		atomic_add(req, &pass, id, prop->crtc_id, state->crtc_id);
 		atomic_add(req, &pass, id, prop->fb_id, fb->fb);
+		//kernel waits for the fence instead of blocking us
+		if (prop->in_fence_fd && state->in_fence_fd >= 0)
+			atomic_add(req, &pass, id, prop->in_fence_fd,
+			           state->in_fence_fd);
 	}
 	return pass;
 }
 
 static bool
-tw_kms_atomic_set_connector_crtc(drmModeAtomicReq *req, bool pass,
+tw_kms_atomic_set_connector_crtc(struct tw_kms_request *req, bool pass,
                                  struct tw_kms_state *state)
 {
 	const struct tw_drm_connector_props *prop = state->props_connector;
@@ -112,7 +133,7 @@ tw_kms_atomic_set_connector_crtc(drmModeAtomicReq *req, bool pass,
 }
 
 static bool
-tw_kms_atomic_set_crtc_active(drmModeAtomicReq *reg, bool pass,
+tw_kms_atomic_set_crtc_active(struct tw_kms_request *reg, bool pass,
                               struct tw_kms_state *state)
 {
 	const struct tw_drm_crtc_props *prop = state->props_crtc;
@@ -125,9 +146,10 @@ tw_kms_atomic_set_crtc_active(drmModeAtomicReq *reg, bool pass,
 }
 
 static bool
-tw_kms_atomic_set_crtc_modeid(drmModeAtomicReq *req, bool pass,
+tw_kms_atomic_set_crtc_modeid(struct tw_kms_request *req, bool pass,
                               struct tw_kms_state *state,
-                              uint32_t pending_flags, int gpu_fd)
+                              uint32_t pending_flags,
+                              struct tw_drm_gpu *gpu)
 {
 	const struct tw_drm_crtc_props *prop = state->props_crtc;
 	const size_t mode_size = sizeof(drmModeModeInfo);
@@ -141,11 +163,11 @@ tw_kms_atomic_set_crtc_modeid(drmModeAtomicReq *req, bool pass,
 	if (pending_mode && !state->active)
 		return false;
 
-	pass = pass && (drmModeCreatePropertyBlob(gpu_fd, &state->mode,
-	                                          mode_size, &mode_id) == 0);
+	pass = pass && (gpu->kms->impl->create_blob(gpu, &state->mode,
+	                                            mode_size, &mode_id) == 0);
 	atomic_add(req, &pass, prop->id, prop->mode_id, mode_id);
-	if (!pass)
-		drmModeDestroyPropertyBlob(gpu_fd, mode_id);
+	if (!pass && mode_id)
+		gpu->kms->impl->destroy_blob(gpu, mode_id);
 	state->mode_id = pass ? mode_id : 0;
 	return pass;
 }
@@ -155,26 +177,35 @@ tw_kms_state_submit_atomic(struct tw_kms_state *state,
                            struct tw_drm_display *output, uint32_t flags)
 {
 	bool pass = true;
-	drmModeAtomicReq *req = NULL;
-	int gpu_fd = output->gpu->gpu_fd;
+	struct tw_kms_request req = {0};
+	struct tw_drm_gpu *gpu = output->gpu;
 	uint32_t pending_flags = output->status.pending;
+	bool test_only = flags & DRM_MODE_ATOMIC_TEST_ONLY;
+	uint32_t mode_id = state->mode_id;
 
-	if (pending_flags & TW_DRM_PENDING_MODE)
+	//enabling, disabling or routing the crtc is also a modeset
+	if (pending_flags & (TW_DRM_PENDING_MODE | TW_DRM_PENDING_ACTIVE |
+	                     TW_DRM_PENDING_CRTC))
 		flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
-	else
+	else if (!test_only)
 		flags |= DRM_MODE_ATOMIC_NONBLOCK;
 
-	if (!(req = drmModeAtomicAlloc()))
-		return pass;
 	//TODO cursor plane and various other properties
-	pass = tw_kms_atomic_set_plane_fb(req, pass, state);
-	pass = tw_kms_atomic_set_connector_crtc(req, pass, state);
-	pass = tw_kms_atomic_set_crtc_active(req, pass, state);
-	pass = tw_kms_atomic_set_crtc_modeid(req, pass, state, pending_flags,
-	                                     gpu_fd);
-
-	pass = pass && (drmModeAtomicCommit(gpu_fd, req, flags, output) == 0);
-	drmModeAtomicFree(req);
+	pass = tw_kms_atomic_set_plane_fb(&req, pass, state);
+	pass = tw_kms_atomic_set_connector_crtc(&req, pass, state);
+	pass = tw_kms_atomic_set_crtc_active(&req, pass, state);
+	pass = tw_kms_atomic_set_crtc_modeid(&req, pass, state, pending_flags,
+	                                     gpu);
+
+	pass = pass && (gpu->kms->impl->atomic_commit(gpu, &req, flags,
+	                                              output) == 0);
+	//a test commit leaves the state as it was
+	if (test_only) {
+		atomic_commit_prop_blob(gpu, &state->mode_id, mode_id);
+		return pass;
+	}
+	//kernel holds its own reference of the fence
+	kms_state_close_fence(state);
 	output->status.pending = 0;
 	return pass;
 }
@@ -183,25 +214,28 @@ bool
 tw_kms_state_submit_legacy(struct tw_kms_state *state,
                            struct tw_drm_display *output, uint32_t flags)
 {
-	int fd = output->gpu->gpu_fd;
+	struct tw_drm_gpu *gpu = output->gpu;
+	const struct tw_kms_device_impl *kms = gpu->kms->impl;
 	uint32_t crtc_id = state->props_crtc->id;
 	const char *name = output->output.device.name;
 	uint32_t pending_flags = output->status.pending;
 
+	//legacy API relies on implicit sync
+	kms_state_close_fence(state);
 	if (pending_flags & TW_DRM_PENDING_MODE) {
 		uint32_t on = state->active ?
 			DRM_MODE_DPMS_ON : DRM_MODE_DPMS_OFF;
 		uint32_t conn_id = output->props.id;
 
-		if (drmModeConnectorSetProperty(fd, output->props.id,
-		                                output->props.dpms, on) != 0) {
+		if (kms->set_connector_prop(gpu, output->props.id,
+		                            output->props.dpms, on) != 0) {
 			tw_logl_level(TW_LOG_ERRO, "Failed to set %s DPMS "
 			              "property", name);
 			return false;
 		}
-		if (drmModeSetCrtc(fd, crtc_id,
-		                   state->fb.fb, state->fb.x, state->fb.y,
-		                   &conn_id, 1, &state->mode) != 0) {
+		if (kms->set_crtc(gpu, crtc_id,
+		                  state->fb.fb, state->fb.x, state->fb.y,
+		                  &conn_id, 1, &state->mode) != 0) {
 			tw_logl_level(TW_LOG_ERRO, "Failed to set %s CRTC",
 			              name);
 			return false;
@@ -210,10 +244,10 @@ tw_kms_state_submit_legacy(struct tw_kms_state *state,
 
 	//TODO NO support for gamma and VRR yet.
 	//TODO NO support for cursor plane yet.
-	drmModeSetCursor(fd, crtc_id, 0, 0, 0);
+	kms->disable_cursor(gpu, crtc_id);
 	if (flags & DRM_MODE_PAGE_FLIP_EVENT) {
-		if (drmModePageFlip(fd, crtc_id, state->fb.fb,
-		                    DRM_MODE_PAGE_FLIP_EVENT, output) != 0) {
+		if (kms->page_flip(gpu, crtc_id, state->fb.fb,
+		                   DRM_MODE_PAGE_FLIP_EVENT, output) != 0) {
 			tw_logl_level(TW_LOG_ERRO, "Failed to pageflip on %s",
 			              name);
 			return false;
@@ -225,7 +259,7 @@ tw_kms_state_submit_legacy(struct tw_kms_state *state,
 
 void
 tw_kms_state_move(struct tw_kms_state *dst, struct tw_kms_state *src,
-                  int drm_fd)
+                  struct tw_drm_gpu *gpu)
 {
 	dst->fb = src->fb;
 	dst->props_connector = src->props_connector;
@@ -234,7 +268,7 @@ tw_kms_state_move(struct tw_kms_state *dst, struct tw_kms_state *src,
 
 	dst->active = src->active;
 	dst->mode = src->mode;
-	atomic_commit_prop_blob(0, &dst->mode_id, src->mode_id);
+	atomic_commit_prop_blob(gpu, &dst->mode_id, src->mode_id);
 }
 
 //how do we do a noop page_flip
@@ -258,4 +292,98 @@ tw_kms_state_deactivate(struct tw_kms_state *state)
 	state->mode = none_mode;
 	state->active = false;
 	state->mode_id = 0;
+	kms_state_close_fence(state);
+}
+
+/******************************************************************************
+ * libdrm KMS device
+ *****************************************************************************/
+
+static int
+drm_atomic_commit(struct tw_drm_gpu *gpu, const struct tw_kms_request *req,
+                  uint32_t flags, void *data)
+{
+	int ret = 0;
+	drmModeAtomicReq *atomic = drmModeAtomicAlloc();
+
+	if (!atomic)
+		return -ENOMEM;
+	for (unsigned i = 0; i < req->len && ret >= 0; i++)
+		ret = drmModeAtomicAddProperty(atomic, req->props[i].obj_id,
+		                               req->props[i].prop_id,
+		                               req->props[i].value);
+	if (ret >= 0)
+		ret = drmModeAtomicCommit(gpu->gpu_fd, atomic, flags, data);
+	drmModeAtomicFree(atomic);
+	return ret < 0 ? ret : 0;
+}
+
+static int
+drm_create_blob(struct tw_drm_gpu *gpu, const void *data, size_t size,
+                uint32_t *id)
+{
+	return drmModeCreatePropertyBlob(gpu->gpu_fd, data, size, id);
+}
+
+static void
+drm_destroy_blob(struct tw_drm_gpu *gpu, uint32_t id)
+{
+	drmModeDestroyPropertyBlob(gpu->gpu_fd, id);
+}
+
+static int
+drm_set_connector_prop(struct tw_drm_gpu *gpu, uint32_t conn_id,
+                       uint32_t prop_id, uint64_t value)
+{
+	return drmModeConnectorSetProperty(gpu->gpu_fd, conn_id, prop_id,
+	                                   value);
+}
+
+static int
+drm_set_crtc(struct tw_drm_gpu *gpu, uint32_t crtc_id, uint32_t fb_id,
+             int x, int y, uint32_t *conns, int n_conns,
+             drmModeModeInfo *mode)
+{
+	return drmModeSetCrtc(gpu->gpu_fd, crtc_id, fb_id, x, y, conns,
+	                      n_conns, mode);
+}
+
+static int
+drm_disable_cursor(struct tw_drm_gpu *gpu, uint32_t crtc_id)
+{
+	return drmModeSetCursor(gpu->gpu_fd, crtc_id, 0, 0, 0);
 }
+
+static int
+drm_page_flip(struct tw_drm_gpu *gpu, uint32_t crtc_id, uint32_t fb_id,
+              uint32_t flags, void *data)
+{
+	return drmModePageFlip(gpu->gpu_fd, crtc_id, fb_id, flags, data);
+}
+
+static int
+drm_dispatch(struct tw_drm_gpu *gpu, tw_kms_page_flip_handler_t handler)
+{
+	drmEventContext event = {
+		.version = 3,
+		.vblank_handler = NULL,
+		.page_flip_handler2 = handler,
+		.sequence_handler = NULL,
+	};
+	return drmHandleEvent(gpu->gpu_fd, &event);
+}
+
+static const struct tw_kms_device_impl drm_kms_impl = {
+	.atomic_commit = drm_atomic_commit,
+	.create_blob = drm_create_blob,
+	.destroy_blob = drm_destroy_blob,
+	.set_connector_prop = drm_set_connector_prop,
+	.set_crtc = drm_set_crtc,
+	.disable_cursor = drm_disable_cursor,
+	.page_flip = drm_page_flip,
+	.dispatch = drm_dispatch,
+};
+
+struct tw_kms_device tw_kms_drm_device = {
+	.impl = &drm_kms_impl,
+};
@@ -123,6 +123,7 @@ read_plane_properties(int fd, int plane_id, struct tw_drm_plane_props *p)
 		{"CRTC_X", &p->crtc_x},
 		{"CRTC_Y", &p->crtc_y},
 		{"FB_ID", &p->fb_id},
+		{"IN_FENCE_FD", &p->in_fence_fd},
 		{"IN_FORMATS", &p->in_formats},
 		{"SRC_H", &p->src_h},
 		{"SRC_W", &p->src_w},
@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include <wayland-server.h>
 #include <taiwins/objects/utils.h>
 #include <taiwins/objects/logger.h>
@@ -36,6 +37,8 @@
 
 #include "render.h"
 
+#define HEADLESS_DEFAULT_REFRESH 60000
+
 /******************************************************************************
  * headless backend implementation
  *****************************************************************************/
@@ -56,12 +59,26 @@ struct tw_headless_backend {
 	unsigned int internal_format;
 	struct wl_listener display_destroy;
 
+	/** the virtual clock only advances on
+	 * tw_headless_backend_advance_clock, in nanoseconds */
+	bool virtual_clock;
+	uint64_t now;
 };
 
+/**
+ * @brief headless output emulates vblanks at the refresh rate of its mode.
+ *
+ * A swapped frame is presented on the next vblank, then the output can take
+ * another frame, like a page flip.
+ */
 struct tw_headless_output {
 	struct tw_render_output output;
+	struct tw_headless_backend *headless;
 	struct wl_event_source *timer;
 	struct wl_listener present_listener;
+
+	uint64_t next_vblank, seq;
+	bool frame_pending; /**< swapped, waiting for vblank */
 };
 
 static const struct tw_egl_options *
@@ -75,14 +92,82 @@ headless_gen_egl_params(struct tw_backend *backend)
 	return &egl_opts;
 }
 
-static int
-headless_frame(void *data)
+static inline uint64_t
+headless_now(const struct tw_headless_backend *headless)
 {
-	struct tw_headless_output *output = data;
+	struct timespec now;
+
+	if (headless->virtual_clock)
+		return headless->now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * TW_NS_PER_S + now.tv_nsec;
+}
+
+static inline void
+headless_ns_to_timespec(uint64_t ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / TW_NS_PER_S;
+	ts->tv_nsec = ns % TW_NS_PER_S;
+}
+
+static inline uint64_t
+headless_output_period(const struct tw_headless_output *output)
+{
+	int mhz = output->output.device.current.current_mode.refresh;
+
+	return tw_millihertz_to_ns(mhz > 0 ? mhz : HEADLESS_DEFAULT_REFRESH);
+}
+
+static void
+headless_output_vblank(struct tw_headless_output *output)
+{
+	struct tw_event_output_present present = {
+		.output = &output->output,
+		.seq = ++output->seq,
+		.flags = 1, /* vsync */
+	};
 
+	headless_ns_to_timespec(output->next_vblank, &present.time);
+	output->next_vblank += headless_output_period(output);
+	if (output->frame_pending) {
+		output->frame_pending = false;
+		tw_render_output_present(&output->output, &present);
+		tw_render_output_clean_maybe(&output->output);
+	}
 	wl_signal_emit(&output->output.signals.need_frame,
 	               &output->output.device);
-	wl_event_source_timer_update(output->timer, 1000000 / (60 * 1000));
+}
+
+static void
+headless_output_arm_timer(struct tw_headless_output *output)
+{
+	uint64_t now = headless_now(output->headless);
+	uint64_t delay = output->next_vblank > now ?
+		output->next_vblank - now : 0;
+	//round up so we never wake up before the vblank, 0 would disarm
+	int ms = (delay + 999999) / 1000000;
+
+	wl_event_source_timer_update(output->timer, ms > 0 ? ms : 1);
+}
+
+static int
+headless_frame(void *data)
+{
+	struct tw_headless_output *output = data;
+	uint64_t now = headless_now(output->headless);
+	uint64_t period = headless_output_period(output);
+
+	if (output->headless->virtual_clock)
+		return 0;
+	//skip the missed vblanks if we were stalled
+	if (output->next_vblank <= now) {
+		uint64_t missed = (now - output->next_vblank) / period;
+
+		output->next_vblank += missed * period;
+		output->seq += missed;
+		headless_output_vblank(output);
+	}
+	headless_output_arm_timer(output);
 	return 0;
 }
 
@@ -91,8 +176,7 @@ notify_output_commit(struct wl_listener *listener, void *data)
 {
 	struct tw_headless_output *output =
 		wl_container_of(listener, output, present_listener);
-	tw_render_output_present(&output->output, NULL);
-	tw_render_output_clean_maybe(&output->output);
+	output->frame_pending = true;
 }
 
 static bool
@@ -119,10 +203,11 @@ headless_output_start(struct tw_headless_output *output,
 	                                     headless->base.ctx,
 	                                     width, height);
 
-        output->timer = wl_event_loop_add_timer(loop, headless_frame,
-                                                  headless);
-	wl_event_source_timer_update(output->timer, 1000000 / (60 * 1000));
-
+	output->next_vblank = headless_now(headless) +
+		headless_output_period(output);
+	output->timer = wl_event_loop_add_timer(loop, headless_frame, output);
+	if (!headless->virtual_clock)
+		headless_output_arm_timer(output);
 
 	return false;
 }
@@ -167,8 +252,19 @@ headless_commit_output_state(struct tw_output_device *device)
 	return true;
 }
 
+static void
+headless_read_clock(const struct tw_output_device *device,
+                    struct timespec *now)
+{
+	const struct tw_headless_output *output =
+		wl_container_of(device, output, output.device);
+
+	headless_ns_to_timespec(headless_now(output->headless), now);
+}
+
 static const struct tw_output_device_impl headless_output_impl = {
 	.commit_state = headless_commit_output_state,
+	.read_clock = headless_read_clock,
 };
 
 static void
@@ -181,7 +277,8 @@ headless_destroy(struct tw_headless_backend *headless)
 	wl_list_for_each_safe(output, otmp, &headless->base.outputs,
 	                      output.device.link) {
 		tw_render_output_fini(&output->output);
-		wl_event_source_remove(output->timer);
+		if (output->timer)
+			wl_event_source_remove(output->timer);
 		free(output);
 	}
 
@@ -189,6 +286,9 @@ headless_destroy(struct tw_headless_backend *headless)
 		tw_input_device_fini(input);
 		free(input);
 	}
+	//destroyed by whichever comes first
+	wl_list_remove(&headless->display_destroy.link);
+	wl_list_remove(&headless->base.render_context_destroy.link);
 	free(headless);
 }
 
@@ -238,9 +338,19 @@ tw_headless_backend_create(struct wl_display *display)
 WL_EXPORT bool
 tw_headless_backend_add_output(struct tw_backend *backend,
                                unsigned int width, unsigned int height)
+{
+	return tw_headless_backend_add_output_with_refresh(
+		backend, width, height, HEADLESS_DEFAULT_REFRESH);
+}
+
+WL_EXPORT bool
+tw_headless_backend_add_output_with_refresh(struct tw_backend *backend,
+                                            unsigned int width,
+                                            unsigned int height,
+                                            int refresh)
 {
 	struct tw_headless_backend *headless =
-		wl_container_of(backend->impl, headless, base);
+		wl_container_of(backend, headless, base);
 	struct tw_headless_output *output = calloc(1, sizeof(*output));
 	struct tw_output_device *device;
 
@@ -249,11 +359,14 @@ tw_headless_backend_add_output(struct tw_backend *backend,
 		return false;
 	}
         device = &output->output.device;
+        output->headless = headless;
         tw_render_output_init(&output->output, &headless_output_impl,
                               headless->display);
 
         tw_output_device_set_custom_mode(&output->output.device,
-                                         width, height, 0);
+                                         width, height,
+                                         refresh > 0 ? refresh :
+                                         HEADLESS_DEFAULT_REFRESH);
         snprintf(device->name, sizeof(device->name),
                  "headless-output%u", wl_list_length(&headless->base.outputs));
         strncpy(device->make, "headless", sizeof(device->make));
@@ -271,7 +384,7 @@ tw_headless_backend_add_input_device(struct tw_backend *backend,
                                      enum tw_input_device_type type)
 {
 	struct tw_headless_backend *headless =
-		wl_container_of(backend->impl, headless, base);
+		wl_container_of(backend, headless, base);
 	struct tw_input_device *device = calloc(1, sizeof(*device));
 	if (!device)
 		return false;
@@ -287,3 +400,56 @@ tw_headless_backend_add_input_device(struct tw_backend *backend,
 
 	return false;
 }
+
+WL_EXPORT void
+tw_headless_backend_use_virtual_clock(struct tw_backend *backend,
+                                      uint64_t start)
+{
+	struct tw_headless_backend *headless =
+		wl_container_of(backend, headless, base);
+	struct tw_headless_output *output;
+
+	headless->virtual_clock = true;
+	headless->now = start;
+	//started outputs restart their vblanks from the virtual clock
+	wl_list_for_each(output, &headless->base.outputs, output.device.link) {
+		if (!output->timer)
+			continue;
+		wl_event_source_timer_update(output->timer, 0);
+		output->next_vblank = start + headless_output_period(output);
+	}
+}
+
+static struct tw_headless_output *
+headless_next_vblank_output(struct tw_headless_backend *headless,
+                            uint64_t until)
+{
+	struct tw_headless_output *output, *next = NULL;
+
+	wl_list_for_each(output, &headless->base.outputs, output.device.link) {
+		if (!output->timer || output->next_vblank > until)
+			continue;
+		if (!next || output->next_vblank < next->next_vblank)
+			next = output;
+	}
+	return next;
+}
+
+WL_EXPORT void
+tw_headless_backend_advance_clock(struct tw_backend *backend, uint64_t ns)
+{
+	struct tw_headless_backend *headless =
+		wl_container_of(backend, headless, base);
+	struct tw_headless_output *output;
+	uint64_t until = headless->now + ns;
+
+	if (!headless->virtual_clock)
+		return;
+	//fire the vblanks in time order, outputs with different refresh rates
+	//interleave the same way on every run
+	while ((output = headless_next_vblank_output(headless, until))) {
+		headless->now = output->next_vblank;
+		headless_output_vblank(output);
+	}
+	headless->now = until;
+}
@@ -48,6 +48,7 @@
 #include <taiwins/input_device.h>
 #include <taiwins/output_device.h>
 #include <taiwins/render_context.h>
+#include <taiwins/render_surface.h>
 #include <taiwins/backend.h>
 #include <taiwins/engine.h>
 #include "utils.h"
@@ -106,6 +107,15 @@ notify_engine_release(struct wl_listener *listener, void *data)
  * listeners
  *****************************************************************************/
 
+static int
+engine_surface_output(struct tw_surface *surface, void *data)
+{
+	struct tw_render_surface *render_surface =
+		tw_render_surface_from_resource(surface->resource);
+
+	return render_surface ? render_surface->output : -1;
+}
+
 static bool
 engine_init_globals(struct tw_engine *engine)
 {
@@ -114,6 +124,8 @@ engine_init_globals(struct tw_engine *engine)
 		return false;
 	if (!tw_presentation_init(&engine->presentation, engine->display))
 		return false;
+	engine->presentation.surface_output = engine_surface_output;
+	engine->presentation.user_data = engine;
 	if (!tw_viewporter_init(&engine->viewporter, engine->display))
 		return false;
 	if (!tw_gestures_manager_init(&engine->gestures_manager,
@@ -122,6 +134,8 @@ engine_init_globals(struct tw_engine *engine)
 	if (!tw_xdg_output_manager_init(&engine->output_manager,
 	                                engine->display))
 		return false;
+	if (!tw_engine_init_screencopy(engine))
+		return false;
 
 	tw_layers_manager_init(&engine->layers_manager, engine->display);
 
@@ -53,6 +53,9 @@ tw_engine_pick_surface_from_layers(struct tw_engine *backend,
 void
 tw_engine_set_render(struct tw_engine *engine, struct tw_render_context *ctx);
 
+bool
+tw_engine_init_screencopy(struct tw_engine *engine);
+
 #ifdef  __cplusplus
 }
 #endif
@@ -75,12 +75,8 @@ static struct wl_resource *
 engine_output_get_wl_output(struct tw_engine_output *output,
                             struct wl_resource *resource)
 {
-	struct wl_resource *wl_output;
-	wl_resource_for_each(wl_output, &output->tw_output->resources)
-		if (wl_resource_get_client(wl_output) ==
-		    wl_resource_get_client(resource))
-			return wl_output;
-	return NULL;
+	return tw_output_get_client_resource(output->tw_output,
+	                                     wl_resource_get_client(resource));
 }
 
 static void
@@ -146,6 +142,8 @@ notify_output_destroy(struct wl_listener *listener, void *data)
 
 	//emit signal only on primary output
 	emit_output_signal(output, &engine->signals.output_remove);
+	//feedbacks waiting on this output will never be presented
+	tw_presentation_discard_output(&engine->presentation, output->id);
 
 	output->id = -1;
 	wl_list_remove(&output->link);
@@ -193,16 +191,13 @@ notify_output_new_mode(struct wl_listener *listener, void *data)
 }
 
 static void
-notify_output_present(struct wl_listener *listener, void *data)
+engine_output_present_feedbacks(struct tw_engine_output *output,
+                                struct wl_list *feedbacks,
+                                struct tw_event_output_present *event)
 {
 	struct tw_presentation_feedback *feedback, *tmp;
-	struct tw_engine_output *output =
-		wl_container_of(listener, output, listeners.present);
-	struct tw_engine *engine = output->engine;
-	struct tw_event_output_present *event = data;
 
-	wl_list_for_each_safe(feedback, tmp, &engine->presentation.feedbacks,
-	                      link) {
+	wl_list_for_each_safe(feedback, tmp, feedbacks, link) {
 		struct wl_resource *wl_surface =
 			feedback->surface->resource;
 		struct wl_resource *wl_output =
@@ -219,6 +214,23 @@ notify_output_present(struct wl_listener *listener, void *data)
 	}
 }
 
+static void
+notify_output_present(struct wl_listener *listener, void *data)
+{
+	struct tw_engine_output *output =
+		wl_container_of(listener, output, listeners.present);
+	struct tw_presentation *presentation = &output->engine->presentation;
+	struct tw_event_output_present *event = data;
+
+	//only the feedbacks committed on this output, surfaces not on any
+	//output are presented by whichever output comes first
+	engine_output_present_feedbacks(
+		output, tw_presentation_output_feedbacks(presentation,
+		                                         output->id), event);
+	engine_output_present_feedbacks(output, &presentation->unassigned,
+	                                event);
+}
+
 /******************************************************************************
  * APIs
  *****************************************************************************/
@@ -359,9 +371,19 @@ WL_EXPORT void
 tw_engine_output_notify_surface_enter(struct tw_engine_output *output,
                                       struct tw_surface *surface)
 {
-	struct wl_resource *wl_output;
+	struct tw_output *tw_output = output->tw_output;
+	struct wl_client *client = wl_resource_get_client(surface->resource);
+	struct wl_resource *wl_output =
+		tw_output_get_client_resource(tw_output, client);
 
-	wl_resource_for_each(wl_output, &output->tw_output->resources) {
+	if (!wl_output)
+		return;
+	if (!tw_output->duplicate_binds) {
+		wl_surface_send_enter(surface->resource, wl_output);
+		return;
+	}
+	//some client bound the output more than once
+	wl_resource_for_each(wl_output, &tw_output->resources) {
 		if (tw_match_wl_resource_client(wl_output, surface->resource))
 			wl_surface_send_enter(surface->resource, wl_output);
 	}
@@ -371,9 +393,19 @@ WL_EXPORT void
 tw_engine_output_notify_surface_leave(struct tw_engine_output *output,
                                       struct tw_surface *surface)
 {
-	struct wl_resource *wl_output;
+	struct tw_output *tw_output = output->tw_output;
+	struct wl_client *client = wl_resource_get_client(surface->resource);
+	struct wl_resource *wl_output =
+		tw_output_get_client_resource(tw_output, client);
 
-	wl_resource_for_each(wl_output, &output->tw_output->resources) {
+	if (!wl_output)
+		return;
+	if (!tw_output->duplicate_binds) {
+		wl_surface_send_leave(surface->resource, wl_output);
+		return;
+	}
+	//some client bound the output more than once
+	wl_resource_for_each(wl_output, &tw_output->resources) {
 		if (tw_match_wl_resource_client(wl_output, surface->resource))
 			wl_surface_send_leave(surface->resource, wl_output);
 	}
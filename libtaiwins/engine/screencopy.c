@@ -0,0 +1,224 @@
+/*
+ * screencopy.c - taiwins engine screencopy implementation
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <pixman.h>
+#include <wayland-server.h>
+#include <taiwins/objects/dmabuf.h>
+#include <taiwins/objects/screencopy.h>
+#include <taiwins/objects/utils.h>
+
+#include <taiwins/engine.h>
+#include <taiwins/output_device.h>
+#include <taiwins/render_output.h>
+
+#include "internal.h"
+
+/**
+ * @brief a screencopy frame in flight, it is a capture of the render output
+ * of the frame.
+ *
+ * The capture is done on the next repaint of the output and the client gets
+ * its ready event on the present, so a recording client never gets more than
+ * one frame per present and outputs nobody records do no extra work.
+ */
+struct engine_screencopy {
+	struct tw_render_capture capture;
+	struct tw_screencopy_frame *frame;
+	struct tw_render_output *output;
+	struct wl_shm_buffer *shm_buffer;
+	struct wl_shm_pool *shm_pool;
+};
+
+static struct tw_render_output *
+engine_screencopy_output(struct tw_engine *engine,
+                         struct tw_screencopy_frame *frame)
+{
+	struct tw_engine_output *output = frame->output ?
+		tw_engine_output_from_resource(engine, frame->output) : NULL;
+	struct tw_render_output *render_output;
+
+	if (!output)
+		return NULL;
+	render_output = wl_container_of(output->device, render_output, device);
+	return render_output;
+}
+
+static void
+engine_screencopy_destroy(struct engine_screencopy *copy)
+{
+	copy->frame->user_data = NULL;
+	if (copy->shm_pool)
+		wl_shm_pool_unref(copy->shm_pool);
+	free(copy);
+}
+
+static void
+engine_screencopy_access(struct tw_render_capture *capture, bool begin)
+{
+	struct engine_screencopy *copy = capture->user_data;
+
+	if (begin)
+		wl_shm_buffer_begin_access(copy->shm_buffer);
+	else
+		wl_shm_buffer_end_access(copy->shm_buffer);
+}
+
+static void
+engine_screencopy_done(struct tw_render_capture *capture,
+                       const pixman_region32_t *damage, bool success)
+{
+	struct engine_screencopy *copy = capture->user_data;
+	struct tw_screencopy_frame *frame = copy->frame;
+	struct tw_output_device *device = &copy->output->device;
+	struct timespec now;
+
+	//the frame has nothing new, copy_with_damage waits for a change
+	if (success && (capture->flags & TW_RENDER_CAPTURE_DAMAGE_ONLY) &&
+	    !pixman_region32_not_empty((pixman_region32_t *)damage)) {
+		if (tw_render_output_capture(copy->output, capture))
+			return;
+		success = false;
+	}
+	frame->seq = capture->seq;
+	engine_screencopy_destroy(copy);
+
+	if (success) {
+		tw_output_device_read_clock(device, &now);
+		tw_screencopy_frame_ready(frame, &now, damage);
+	} else {
+		tw_screencopy_frame_failed(frame);
+	}
+}
+
+static bool
+engine_screencopy_frame_init(struct tw_screencopy_frame *frame, void *data)
+{
+	struct tw_engine *engine = data;
+	struct tw_render_output *output =
+		engine_screencopy_output(engine, frame);
+	unsigned width, height;
+	pixman_box32_t box;
+
+	if (!output)
+		return false;
+	tw_output_device_raw_resolution(&output->device, &width, &height);
+	box = (pixman_box32_t){0, 0, width, height};
+
+	if (frame->has_region) {
+		const pixman_rectangle32_t *r = &frame->region;
+		pixman_box32_t area = {
+			r->x, r->y, r->x + (int)r->width, r->y + (int)r->height,
+		};
+		pixman_region32_t region;
+
+		//the region is in output coordinates, the buffer is not
+		tw_render_output_buffer_box(output, &box, &area);
+		pixman_region32_init_rect(&region, box.x1, box.y1,
+		                          box.x2 - box.x1, box.y2 - box.y1);
+		pixman_region32_intersect_rect(&region, &region, 0, 0,
+		                               width, height);
+		box = *pixman_region32_extents(&region);
+		pixman_region32_fini(&region);
+		if (box.x2 <= box.x1 || box.y2 <= box.y1)
+			return false;
+	}
+	frame->params.x = box.x1;
+	frame->params.y = box.y1;
+	frame->params.width = box.x2 - box.x1;
+	frame->params.height = box.y2 - box.y1;
+	frame->params.stride = frame->params.width * 4;
+	frame->params.shm_format = tw_render_output_capture_format(output);
+	frame->params.dmabuf_format =
+		tw_render_output_capture_dmabuf_format(output);
+	return true;
+}
+
+static void
+engine_screencopy_frame_copy(struct tw_screencopy_frame *frame, void *data)
+{
+	struct tw_engine *engine = data;
+	struct tw_render_output *output =
+		engine_screencopy_output(engine, frame);
+	struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(frame->buffer);
+	struct engine_screencopy *copy;
+
+	if (!output || !(copy = calloc(1, sizeof(*copy)))) {
+		tw_screencopy_frame_failed(frame);
+		return;
+	}
+	copy->frame = frame;
+	copy->output = output;
+	copy->capture.flags = frame->with_damage ?
+		TW_RENDER_CAPTURE_DAMAGE_ONLY : 0;
+	copy->capture.x = frame->params.x;
+	copy->capture.y = frame->params.y;
+	copy->capture.width = frame->params.width;
+	copy->capture.height = frame->params.height;
+	copy->capture.stride = frame->params.stride;
+	copy->capture.seq = frame->seq;
+	copy->capture.done = engine_screencopy_done;
+	copy->capture.user_data = copy;
+	if (shm_buffer) {
+		//keep the memory around even if client destroys the pool
+		copy->shm_buffer = shm_buffer;
+		copy->shm_pool = wl_shm_buffer_ref_pool(shm_buffer);
+		copy->capture.pixels = wl_shm_buffer_get_data(shm_buffer);
+		copy->capture.access = engine_screencopy_access;
+	} else {
+		struct tw_dmabuf_buffer *dmabuf =
+			tw_dmabuf_buffer_from_resource(frame->buffer);
+		copy->capture.dmabuf = &dmabuf->attributes;
+	}
+	frame->user_data = copy;
+
+	if (!tw_render_output_capture(output, &copy->capture)) {
+		engine_screencopy_destroy(copy);
+		tw_screencopy_frame_failed(frame);
+	}
+}
+
+static void
+engine_screencopy_frame_destroy(struct tw_screencopy_frame *frame,
+                                void *data)
+{
+	struct engine_screencopy *copy = frame->user_data;
+
+	if (!copy)
+		return;
+	tw_render_capture_cancel(&copy->capture);
+	pixman_region32_fini(&copy->capture.region);
+	engine_screencopy_destroy(copy);
+}
+
+static const struct tw_screencopy_impl engine_screencopy_impl = {
+	.frame_init = engine_screencopy_frame_init,
+	.frame_copy = engine_screencopy_frame_copy,
+	.frame_destroy = engine_screencopy_frame_destroy,
+};
+
+bool
+tw_engine_init_screencopy(struct tw_engine *engine)
+{
+	return tw_screencopy_manager_init(&engine->screencopy_manager,
+	                                  engine->display,
+	                                  &engine_screencopy_impl, engine);
+}
@@ -36,7 +36,7 @@ tw_surface_buffer_update(struct tw_surface_buffer *buffer,
                          struct wl_resource *resource,
                          pixman_region32_t *damage)
 {
-	struct tw_event_buffer_uploading event;
+	struct tw_event_buffer_uploading event = {0};
 	//compare if resource is a wl_buffer
 	struct tw_surface *surface = wl_container_of(buffer, surface, buffer);
 	void *user_data;
@@ -50,8 +50,10 @@ tw_surface_buffer_update(struct tw_surface_buffer *buffer,
 		user_data = buffer->buffer_import.callback;
 		ret = buffer->buffer_import.buffer_import(&event, user_data);
 	}
+	if (surface->stats)
+		surface->stats->total.upload += event.uploaded;
 	//if updating failed, nothing changes.
-	if (ret)
+	if (ret && !event.deferred)
 		buffer->resource = resource;
 	return ret;
 }
@@ -72,8 +74,11 @@ tw_surface_buffer_new(struct tw_surface_buffer *buffer,
 		user_data = buffer->buffer_import.callback;
 		buffer->buffer_import.buffer_import(&event, user_data);
 	}
+	if (surface->stats)
+		surface->stats->total.upload += event.uploaded;
+	//a deferred upload holds the buffer and releases it itself
 	if (tw_surface_has_texture(surface))
-		buffer->resource = resource;
+		buffer->resource = event.deferred ? NULL : resource;
 }
 
 WL_EXPORT void
@@ -0,0 +1,107 @@
+/*
+ * client_data.c - taiwins per client index
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <wayland-server-core.h>
+
+#include <taiwins/objects/client_data.h>
+
+static void
+notify_client_data_destroy(struct wl_listener *listener, void *data)
+{
+	struct tw_client_data *client_data =
+		wl_container_of(listener, client_data, client_destroy);
+
+	wl_signal_emit(&client_data->destroy, client_data);
+	wl_list_remove(&client_data->client_destroy.link);
+	wl_array_release(&client_data->entries);
+	free(client_data);
+}
+
+static struct tw_client_data_entry *
+client_data_entry(struct tw_client_data *client_data, const void *key)
+{
+	struct tw_client_data_entry *entry;
+
+	wl_array_for_each(entry, &client_data->entries)
+		if (entry->key == key)
+			return entry;
+	return NULL;
+}
+
+WL_EXPORT struct tw_client_data *
+tw_client_data_get(struct wl_client *client, bool create)
+{
+	struct tw_client_data *client_data;
+	struct wl_listener *listener =
+		wl_client_get_destroy_listener(client,
+		                               notify_client_data_destroy);
+	if (listener)
+		return wl_container_of(listener, client_data, client_destroy);
+	if (!create || !(client_data = calloc(1, sizeof(*client_data))))
+		return NULL;
+	client_data->client = client;
+	wl_array_init(&client_data->entries);
+	wl_signal_init(&client_data->destroy);
+	client_data->client_destroy.notify = notify_client_data_destroy;
+	wl_client_add_destroy_listener(client, &client_data->client_destroy);
+	return client_data;
+}
+
+WL_EXPORT void *
+tw_client_data_find(struct wl_client *client, const void *key)
+{
+	struct tw_client_data *client_data = tw_client_data_get(client, false);
+	struct tw_client_data_entry *entry = client_data ?
+		client_data_entry(client_data, key) : NULL;
+
+	return entry ? entry->value : NULL;
+}
+
+WL_EXPORT bool
+tw_client_data_set(struct wl_client *client, const void *key, void *value)
+{
+	struct tw_client_data *client_data =
+		tw_client_data_get(client, value != NULL);
+	struct tw_client_data_entry *entry, *last;
+
+	//the client is gone or never had it
+	if (!client_data)
+		return value == NULL;
+	entry = client_data_entry(client_data, key);
+
+	if (!value) {
+		if (entry) {
+			last = (struct tw_client_data_entry *)
+				((char *)client_data->entries.data +
+				 client_data->entries.size) - 1;
+			*entry = *last;
+			client_data->entries.size -= sizeof(*entry);
+		}
+		return true;
+	}
+	if (!entry &&
+	    !(entry = wl_array_add(&client_data->entries, sizeof(*entry))))
+		return false;
+	entry->key = key;
+	entry->value = value;
+	return true;
+}
@@ -0,0 +1,129 @@
+/*
+ * client_stats.c - taiwins per client work accounting
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <wayland-server-core.h>
+
+#include <taiwins/objects/utils.h>
+#include <taiwins/objects/client_data.h>
+#include <taiwins/objects/client_stats.h>
+
+/* the key of the record in tw_client_data */
+static const char client_stats_key;
+
+static void
+client_stats_release(struct tw_client_stats *stats)
+{
+	if (--stats->refs)
+		return;
+	free(stats);
+}
+
+static void
+notify_client_stats_destroy(struct wl_listener *listener, void *data)
+{
+	struct tw_client_stats *stats =
+		wl_container_of(listener, stats, client_destroy);
+
+	//the surfaces of the client still hold the record
+	tw_reset_wl_list(&stats->client_destroy.link);
+	stats->client = NULL;
+	client_stats_release(stats);
+}
+
+WL_EXPORT struct tw_client_stats *
+tw_client_stats_get(struct wl_client *client)
+{
+	return tw_client_data_find(client, &client_stats_key);
+}
+
+WL_EXPORT struct tw_client_stats *
+tw_client_stats_ref(struct wl_client *client)
+{
+	struct tw_client_stats *stats = tw_client_stats_get(client);
+	struct tw_client_data *client_data;
+
+	if (stats) {
+		stats->refs++;
+		return stats;
+	}
+	if (!(client_data = tw_client_data_get(client, true)) ||
+	    !(stats = calloc(1, sizeof(*stats))))
+		return NULL;
+	if (!tw_client_data_set(client, &client_stats_key, stats)) {
+		free(stats);
+		return NULL;
+	}
+	//one for the client, one for the caller
+	stats->refs = 2;
+	stats->client = client;
+	stats->window_start = tw_get_time_ms(CLOCK_MONOTONIC);
+	stats->client_destroy.notify = notify_client_stats_destroy;
+	wl_signal_add(&client_data->destroy, &stats->client_destroy);
+	return stats;
+}
+
+WL_EXPORT void
+tw_client_stats_unref(struct tw_client_stats *stats)
+{
+	if (stats)
+		client_stats_release(stats);
+}
+
+static inline uint64_t
+client_stats_rate(uint64_t total, uint64_t start, uint32_t elapsed)
+{
+	return (total - start) * 1000 / elapsed;
+}
+
+WL_EXPORT void
+tw_client_stats_sample(struct tw_client_stats *stats, uint32_t now)
+{
+	uint32_t elapsed = now - stats->window_start;
+
+	if (elapsed < TW_CLIENT_STATS_WINDOW)
+		return;
+	stats->rate.commits = client_stats_rate(stats->total.commits,
+	                                        stats->window.commits,
+	                                        elapsed);
+	stats->rate.damage = client_stats_rate(stats->total.damage,
+	                                       stats->window.damage,
+	                                       elapsed);
+	stats->rate.upload = client_stats_rate(stats->total.upload,
+	                                       stats->window.upload,
+	                                       elapsed);
+	stats->rate.frames = client_stats_rate(stats->total.frames,
+	                                       stats->window.frames,
+	                                       elapsed);
+	stats->window = stats->total;
+	stats->window_start = now;
+}
+
+WL_EXPORT bool
+tw_client_stats_over_budget(const struct tw_client_stats *stats, void *data)
+{
+	const struct tw_client_budget *budget = data;
+
+	return (budget->commits && stats->rate.commits > budget->commits) ||
+		(budget->damage && stats->rate.damage > budget->damage) ||
+		(budget->upload && stats->rate.upload > budget->upload);
+}
@@ -34,6 +34,7 @@
 #include <taiwins/objects/seat.h>
 #include <taiwins/objects/cursor.h>
 #include <taiwins/objects/surface.h>
+#include <taiwins/objects/client_data.h>
 
 #include "data_internal.h"
 
@@ -46,12 +47,7 @@ struct wl_resource *
 tw_data_device_find_client(struct tw_data_device *device,
                            struct wl_resource *r)
 {
-	struct wl_resource *dev_res;
-	wl_resource_for_each(dev_res, &device->clients)
-		if (wl_resource_get_client(dev_res) ==
-		    wl_resource_get_client(r))
-			return dev_res;
-	return NULL;
+	return tw_client_data_find(wl_resource_get_client(r), device);
 }
 
 static struct tw_data_device *
@@ -103,7 +99,16 @@ notify_device_selection_data_offer(struct wl_listener *listener, void *data)
 
 	if (!device->source_set || !device->source_set->selection_source)
 		return;
+	if (!surface || !(resource = tw_data_device_find_client(device,
+	                                                        surface)))
+		return;
 	//send the data offers
+	if (!device->duplicate_binds) {
+		offer = tw_data_device_create_data_offer(resource,
+		                                         device->source_set);
+		wl_data_device_send_selection(resource, offer);
+		return;
+	}
 	wl_resource_for_each(resource, &device->clients) {
 		if (!tw_match_wl_resource_client(surface, resource))
 			continue;
@@ -191,7 +196,28 @@ tw_data_device_from_source(struct wl_resource *resource)
 static void
 destroy_data_device_resource(struct wl_resource *resource)
 {
+	struct tw_data_device *device = wl_resource_get_user_data(resource);
+	struct wl_client *client = wl_resource_get_client(resource);
+	struct wl_resource *r, *first = tw_client_data_find(client, device);
+
 	wl_list_remove(wl_resource_get_link(resource));
+	if (first && first != resource) {
+		device->duplicate_binds--;
+		return;
+	}
+	//the client may have more than one data device on the seat, first is
+	//NULL if the client is going away
+	if (device->duplicate_binds) {
+		wl_resource_for_each(r, &device->clients) {
+			if (wl_resource_get_client(r) == client) {
+				if (first)
+					tw_client_data_set(client, device, r);
+				device->duplicate_binds--;
+				return;
+			}
+		}
+	}
+	tw_client_data_unset(client, device);
 }
 
 static void
@@ -257,6 +283,13 @@ get_data_device(struct wl_client *client,
 		wl_resource_post_no_memory(manager_resource);
 		return;
 	}
+	if (tw_client_data_find(client, device)) {
+		device->duplicate_binds++;
+	} else if (!tw_client_data_set(client, device, device_resource)) {
+		wl_resource_destroy(device_resource);
+		wl_resource_post_no_memory(manager_resource);
+		return;
+	}
 	wl_list_insert(device->clients.prev,
 	               wl_resource_get_link(device_resource));
 
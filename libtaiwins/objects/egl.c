@@ -60,6 +60,10 @@ static PFNEGLQUERYDMABUFFORMATSEXTPROC _query_dmabuf_formats = NULL;
 static PFNEGLQUERYDMABUFMODIFIERSEXTPROC _query_dmabuf_modifiers = NULL;
 static PFNEGLEXPORTDMABUFIMAGEQUERYMESAPROC _export_dmabuf_image_query = NULL;
 static PFNEGLEXPORTDMABUFIMAGEMESAPROC _export_dmabuf_image = NULL;
+static PFNEGLCREATESYNCKHRPROC _create_sync = NULL;
+static PFNEGLDESTROYSYNCKHRPROC _destroy_sync = NULL;
+static PFNEGLCLIENTWAITSYNCKHRPROC _client_wait_sync = NULL;
+static PFNEGLDUPNATIVEFENCEFDANDROIDPROC _dup_native_fence_fd = NULL;
 
 const char *
 platform_to_extension(EGLenum platform)
@@ -202,6 +206,23 @@ setup_egl_client_extensions(struct tw_egl *egl)
 		                  "eglExportDMABUFImageMESA"))
 			return false;
 	}
+	//fences and explicit sync
+	if (check_egl_ext(exts_str, "EGL_KHR_fence_sync", false)) {
+		egl->fence_sync = true;
+		if (!get_egl_proc(&_create_sync, "eglCreateSyncKHR"))
+			return false;
+		if (!get_egl_proc(&_destroy_sync, "eglDestroySyncKHR"))
+			return false;
+		if (!get_egl_proc(&_client_wait_sync, "eglClientWaitSyncKHR"))
+			return false;
+	}
+	if (egl->fence_sync &&
+	    check_egl_ext(exts_str, "EGL_ANDROID_native_fence_sync", false)) {
+		egl->native_fence_sync = true;
+		if (!get_egl_proc(&_dup_native_fence_fd,
+		                  "eglDupNativeFenceFDANDROID"))
+			return false;
+	}
 	//bind wayland display
 	if (check_egl_ext(exts_str, "EGL_WL_bind_wayland_display", false)) {
 		if (!get_egl_proc(&_bind_wl_display,
@@ -521,6 +542,76 @@ tw_egl_buffer_age(struct tw_egl *egl, EGLSurface surface)
 	return (int)buffer_age;
 }
 
+WL_EXPORT int
+tw_egl_create_fence_fd(struct tw_egl *egl)
+{
+	EGLSyncKHR sync;
+	int fd;
+	const EGLint attribs[] = {
+		EGL_SYNC_NATIVE_FENCE_FD_ANDROID, EGL_NO_NATIVE_FENCE_FD_ANDROID,
+		EGL_NONE,
+	};
+
+	if (!egl->native_fence_sync)
+		return -1;
+	sync = _create_sync(egl->display, EGL_SYNC_NATIVE_FENCE_ANDROID,
+	                    attribs);
+	if (sync == EGL_NO_SYNC_KHR) {
+		tw_logl_level(TW_LOG_WARN, "Failed to create native fence");
+		return -1;
+	}
+	//the fence fd is only available after the sync is flushed
+	glFlush();
+	fd = _dup_native_fence_fd(egl->display, sync);
+	_destroy_sync(egl->display, sync);
+	if (fd == EGL_NO_NATIVE_FENCE_FD_ANDROID) {
+		tw_logl_level(TW_LOG_WARN, "Failed to export native fence");
+		return -1;
+	}
+	return fd;
+}
+
+WL_EXPORT bool
+tw_egl_wait_fence(struct tw_egl *egl)
+{
+	EGLSyncKHR sync;
+	EGLint ret;
+
+	if (!egl->fence_sync) {
+		glFinish();
+		return true;
+	}
+	sync = _create_sync(egl->display, EGL_SYNC_FENCE_KHR, NULL);
+	if (sync == EGL_NO_SYNC_KHR) {
+		tw_logl_level(TW_LOG_WARN, "Failed to create fence");
+		glFinish();
+		return true;
+	}
+	ret = _client_wait_sync(egl->display, sync,
+	                        EGL_SYNC_FLUSH_COMMANDS_BIT_KHR,
+	                        EGL_FOREVER_KHR);
+	_destroy_sync(egl->display, sync);
+	return ret == EGL_CONDITION_SATISFIED_KHR;
+}
+
+WL_EXPORT EGLContext
+tw_egl_create_shared_context(struct tw_egl *egl)
+{
+	EGLint version = 2;
+	EGLint attrs[] = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
+	EGLContext context;
+
+	//same GLES version as the main context, without its priority
+	eglQueryContext(egl->display, egl->context,
+	                EGL_CONTEXT_CLIENT_VERSION, &version);
+	attrs[1] = version;
+	context = eglCreateContext(egl->display, egl->config, egl->context,
+	                           attrs);
+	if (context == EGL_NO_CONTEXT)
+		tw_logl_level(TW_LOG_WARN, "failed to create shared context");
+	return context;
+}
+
 WL_EXPORT bool
 tw_egl_check_egl_ext(struct tw_egl *egl, const char *ext)
 {
@@ -20,13 +20,68 @@
  */
 
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <taiwins/objects/logger.h>
 #include <wayland-util.h>
 
-static FILE *tw_logfile = NULL;
+#define LOG_QUEUE_SIZE 256 /* power of two */
+#define LOG_MSG_SIZE 512
+#define LOG_SITES 256
+#define LOG_SITE_PROBES 8
+
+/**
+ * @brief a log message waiting to be written.
+ *
+ * Messages are formatted and timestamped by the caller, the logger thread only
+ * does the writing. The slots form a bounded lock-free queue, seq tells whose
+ * turn it is on the slot, either a producer at position seq or the consumer at
+ * position seq - 1.
+ */
+struct log_record {
+	atomic_size_t seq;
+	enum TW_LOG_LEVEL level;
+	struct timespec time;
+	unsigned suppressed; /**< messages of the call site rate limited */
+	char msg[LOG_MSG_SIZE];
+};
+
+/* a call site is the format string of the message */
+struct log_site {
+	_Atomic(const char *) format;
+	atomic_llong window; /**< start of the window in ns, 0 if none yet */
+	atomic_uint count;
+	atomic_uint suppressed;
+};
+
+static struct {
+	FILE *file;
+	bool color;
+
+	struct log_record queue[LOG_QUEUE_SIZE];
+	atomic_size_t head;
+	size_t tail;
+	sem_t pending;
+
+	pthread_t thread;
+	bool running;
+	atomic_bool quit;
+	pid_t pid;
+
+	struct log_site sites[LOG_SITES];
+	atomic_ullong logged, rate_limited, queue_full;
+	atomic_uint unreported;
+} s_logger;
 
 static const char *log_headers[] = {
 	[TW_LOG_INFO] = "INFO: ",
@@ -42,19 +97,230 @@ static const char *log_colors[] = {
 	[TW_LOG_ERRO] = "\x1B[1;31m",
 };
 
+/******************************************************************************
+ * rate limiting
+ *****************************************************************************/
+
+static struct log_site *
+log_site_find(const char *format)
+{
+	size_t hash = ((uintptr_t)format >> 3) * 2654435761u;
+
+	for (unsigned i = 0; i < LOG_SITE_PROBES; i++) {
+		struct log_site *site =
+			&s_logger.sites[(hash + i) % LOG_SITES];
+		const char *expected = NULL;
+
+		if (atomic_load_explicit(&site->format,
+		                         memory_order_acquire) == format)
+			return site;
+		if (atomic_compare_exchange_strong(&site->format, &expected,
+		                                   format) ||
+		    expected == format)
+			return site;
+	}
+	//too many call sites, they go without limits
+	return NULL;
+}
+
+/* every call site gets TW_LOG_RATE_BURST messages per second, the window
+ * starts at the first message of the site rather than on a second boundary, so
+ * a burst is never split in two windows */
+static bool
+log_site_admit(const char *format, const struct timespec *now,
+               unsigned *suppressed)
+{
+	struct log_site *site = log_site_find(format);
+	long long ns = now->tv_sec * 1000000000ll + now->tv_nsec;
+	long long start;
+
+	*suppressed = 0;
+	if (!site)
+		return true;
+	start = atomic_load_explicit(&site->window, memory_order_relaxed);
+	if ((!start || ns - start >= 1000000000ll) &&
+	    atomic_compare_exchange_strong(&site->window, &start, ns)) {
+		atomic_store(&site->count, 0);
+		*suppressed = atomic_exchange(&site->suppressed, 0);
+	}
+	if (atomic_fetch_add(&site->count, 1) < TW_LOG_RATE_BURST)
+		return true;
+	atomic_fetch_add(&site->suppressed, 1);
+	atomic_fetch_add(&s_logger.rate_limited, 1);
+	return false;
+}
+
+/******************************************************************************
+ * writing
+ *****************************************************************************/
+
+static void
+log_write(const struct log_record *record)
+{
+	FILE *file = s_logger.file;
+	enum TW_LOG_LEVEL level = record->level;
+
+	fprintf(file, "%s[%5lld.%06ld] %s", s_logger.color ?
+	        log_colors[level] : log_headers[level],
+	        (long long)record->time.tv_sec, record->time.tv_nsec / 1000,
+	        record->msg);
+	if (record->suppressed)
+		fprintf(file, " (%u similar messages suppressed)",
+		        record->suppressed);
+	fprintf(file, "%s\n",  s_logger.color ? "\x1B[0m" : "");
+	atomic_fetch_add_explicit(&s_logger.logged, 1, memory_order_relaxed);
+}
+
+static struct log_record *
+log_queue_reserve(size_t *pos)
+{
+	struct log_record *record;
+	size_t p = atomic_load_explicit(&s_logger.head, memory_order_relaxed);
+
+	for (;;) {
+		size_t seq;
+		intptr_t diff;
+
+		record = &s_logger.queue[p & (LOG_QUEUE_SIZE - 1)];
+		seq = atomic_load_explicit(&record->seq, memory_order_acquire);
+		diff = (intptr_t)seq - (intptr_t)p;
+		if (diff == 0 &&
+		    atomic_compare_exchange_weak_explicit(&s_logger.head,
+		                                          &p, p + 1,
+		                                          memory_order_relaxed,
+		                                          memory_order_relaxed))
+			break;
+		else if (diff < 0)
+			return NULL;
+		else if (diff > 0)
+			p = atomic_load_explicit(&s_logger.head,
+			                         memory_order_relaxed);
+	}
+	*pos = p;
+	return record;
+}
+
+static inline void
+log_queue_commit(struct log_record *record, size_t pos)
+{
+	atomic_store_explicit(&record->seq, pos + 1, memory_order_release);
+	sem_post(&s_logger.pending);
+}
+
+static bool
+log_queue_drain(void)
+{
+	bool drained = false;
+	unsigned dropped;
+
+	for (;;) {
+		size_t pos = s_logger.tail;
+		struct log_record *record =
+			&s_logger.queue[pos & (LOG_QUEUE_SIZE - 1)];
+
+		if (atomic_load_explicit(&record->seq, memory_order_acquire) !=
+		    pos + 1)
+			break;
+		log_write(record);
+		atomic_store_explicit(&record->seq, pos + LOG_QUEUE_SIZE,
+		                      memory_order_release);
+		s_logger.tail = pos + 1;
+		drained = true;
+	}
+	if ((dropped = atomic_exchange(&s_logger.unreported, 0)))
+		fprintf(s_logger.file, "%slogger queue full, %u messages "
+		        "dropped%s\n", s_logger.color ?
+		        log_colors[TW_LOG_WARN] : log_headers[TW_LOG_WARN],
+		        dropped, s_logger.color ? "\x1B[0m" : "");
+	if (drained || dropped)
+		fflush(s_logger.file);
+	return drained;
+}
+
+static void *
+log_thread(void *data)
+{
+	for (;;) {
+		while (sem_wait(&s_logger.pending) && errno == EINTR);
+		log_queue_drain();
+		if (atomic_load(&s_logger.quit))
+			break;
+	}
+	log_queue_drain();
+	return NULL;
+}
+
+/******************************************************************************
+ * logger thread
+ *****************************************************************************/
+
+static void
+logger_stop(void)
+{
+	if (!s_logger.running)
+		return;
+	if (s_logger.pid == getpid()) {
+		atomic_store(&s_logger.quit, true);
+		sem_post(&s_logger.pending);
+		pthread_join(s_logger.thread, NULL);
+	}
+	sem_destroy(&s_logger.pending);
+	s_logger.running = false;
+}
+
+static void
+logger_start(void)
+{
+	static bool registered = false;
+	sigset_t all, old;
+
+	if (s_logger.running || !s_logger.file)
+		return;
+	for (unsigned i = 0; i < LOG_QUEUE_SIZE; i++)
+		atomic_init(&s_logger.queue[i].seq, i);
+	atomic_init(&s_logger.head, 0);
+	s_logger.tail = 0;
+	atomic_init(&s_logger.quit, false);
+	if (sem_init(&s_logger.pending, 0, 0))
+		return;
+	//the thread should never take the signals the event loop waits on
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	s_logger.running =
+		pthread_create(&s_logger.thread, NULL, log_thread, NULL) == 0;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (!s_logger.running) {
+		sem_destroy(&s_logger.pending);
+		return;
+	}
+	pthread_setname_np(s_logger.thread, "tw-logger");
+	s_logger.pid = getpid();
+	if (!registered)
+		registered = atexit(logger_stop) == 0;
+}
+
+static void
+logger_set_file(FILE *file)
+{
+	logger_stop();
+	if (s_logger.file && s_logger.file != stdout &&
+	    s_logger.file != stderr)
+		fclose(s_logger.file);
+	s_logger.file = file;
+	s_logger.color = file && isatty(fileno(file));
+	logger_start();
+}
+
 WL_EXPORT void
 tw_logger_open(const char *path)
 {
-	if (tw_logfile && tw_logfile != stdout && tw_logfile != stderr)
-		fclose(tw_logfile);
-	tw_logfile = fopen(path, "w");
+	logger_set_file(fopen(path, "w"));
 }
 
 WL_EXPORT void
 tw_logger_close(void)
 {
-	if (tw_logfile && tw_logfile != stdout && tw_logfile != stderr)
-		fclose(tw_logfile);
+	logger_set_file(NULL);
 }
 
 WL_EXPORT void
@@ -62,26 +328,51 @@ tw_logger_use_file(FILE *file)
 {
 	if (!file)
 		return;
-	if (tw_logfile && tw_logfile != stdout && tw_logfile != stderr)
-		fclose(tw_logfile);
-	tw_logfile = file;
+	logger_set_file(file);
+}
+
+WL_EXPORT void
+tw_logger_get_stats(struct tw_logger_stats *stats)
+{
+	stats->logged = atomic_load(&s_logger.logged);
+	stats->rate_limited = atomic_load(&s_logger.rate_limited);
+	stats->queue_full = atomic_load(&s_logger.queue_full);
 }
 
 WL_EXPORT int
 tw_logv_level(enum TW_LOG_LEVEL level, const char *format, va_list ap)
 {
-	int ret = -1;
-
-	assert(level < TW_LOG_ERRO);
-	if (tw_logfile) {
-		bool color_log = isatty(fileno(tw_logfile));
+	struct log_record *record, local;
+	struct timespec now;
+	unsigned suppressed;
+	size_t pos;
+	int ret;
 
-		fprintf(tw_logfile, "%s", color_log ?
-		        log_colors[level] : log_headers[level]);
-
-		ret = vfprintf(tw_logfile, format, ap);
-		fprintf(tw_logfile, "%s\n",  color_log ? "\x1B[0m" : "");
+	assert(level <= TW_LOG_ERRO);
+	if (!s_logger.file)
+		return -1;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!log_site_admit(format, &now, &suppressed))
+		return -1;
 
+	//the thread is gone in forked children, write directly
+	if (!s_logger.running || s_logger.pid != getpid())
+		record = &local;
+	else if (!(record = log_queue_reserve(&pos))) {
+		atomic_fetch_add(&s_logger.queue_full, 1);
+		atomic_fetch_add(&s_logger.unreported, 1);
+		return -1;
 	}
+	record->level = level;
+	record->time = now;
+	record->suppressed = suppressed;
+	ret = vsnprintf(record->msg, sizeof(record->msg), format, ap);
+	if (ret >= (int)sizeof(record->msg))
+		strcpy(record->msg + sizeof(record->msg) - 4, "...");
+
+	if (record == &local)
+		log_write(record);
+	else
+		log_queue_commit(record, pos);
 	return ret;
 }
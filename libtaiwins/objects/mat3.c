@@ -29,6 +29,14 @@
 
 #include <taiwins/objects/matrix.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define MAT3_HAS_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MAT3_HAS_NEON
+#endif
+
 #define MAX(a, b) \
 	({ __typeof__ (a) _a = (a); \
 		__typeof__ (b) _b = (b); \
@@ -167,25 +175,174 @@ tw_mat3_vec_transform(const struct tw_mat3 *mat, float x, float y,
 	*ry = mat->d[1] * x + mat->d[4] * y + mat->d[7];
 }
 
+/******************************************************************************
+ * box kernels
+ *
+ * All the kernels give the same result as transforming the four corners one
+ * by one and truncating them to integers. Truncation does not change the
+ * order of numbers, so we can take min/max before truncating.
+ *****************************************************************************/
+
+/* boxes moved by an integer offset */
+static void
+boxes_translate(pixman_box32_t *dst, const pixman_box32_t *src, unsigned n,
+                int32_t tx, int32_t ty)
+{
+	unsigned i = 0;
+#if defined(MAT3_HAS_SSE2)
+	__m128i t = _mm_setr_epi32(tx, ty, tx, ty);
+
+	for (; i < n; i++) {
+		__m128i b = _mm_loadu_si128((const __m128i *)&src[i]);
+		_mm_storeu_si128((__m128i *)&dst[i], _mm_add_epi32(b, t));
+	}
+#elif defined(MAT3_HAS_NEON)
+	const int32_t tv[4] = {tx, ty, tx, ty};
+	int32x4_t t = vld1q_s32(tv);
+
+	for (; i < n; i++) {
+		int32x4_t b = vld1q_s32((const int32_t *)&src[i]);
+		vst1q_s32((int32_t *)&dst[i], vaddq_s32(b, t));
+	}
+#endif
+	for (; i < n; i++) {
+		dst[i].x1 = src[i].x1 + tx;
+		dst[i].y1 = src[i].y1 + ty;
+		dst[i].x2 = src[i].x2 + tx;
+		dst[i].y2 = src[i].y2 + ty;
+	}
+}
+
+/* boxes stays axis aligned, the corners may swap if scale is negative */
+static void
+boxes_scale_translate(pixman_box32_t *dst, const pixman_box32_t *src,
+                      unsigned n, float sx, float sy, float tx, float ty)
+{
+	unsigned i = 0;
+#if defined(MAT3_HAS_SSE2)
+	__m128 s = _mm_setr_ps(sx, sy, sx, sy);
+	__m128 t = _mm_setr_ps(tx, ty, tx, ty);
+
+	for (; i < n; i++) {
+		__m128i b = _mm_loadu_si128((const __m128i *)&src[i]);
+		__m128 f = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(b), s), t);
+		//(x1, y1, x2, y2) -> (x2, y2, x1, y1)
+		__m128 w = _mm_shuffle_ps(f, f, _MM_SHUFFLE(1, 0, 3, 2));
+		__m128 r = _mm_shuffle_ps(_mm_min_ps(f, w), _mm_max_ps(f, w),
+		                          _MM_SHUFFLE(3, 2, 1, 0));
+		_mm_storeu_si128((__m128i *)&dst[i], _mm_cvttps_epi32(r));
+	}
+#elif defined(MAT3_HAS_NEON)
+	const float sv[4] = {sx, sy, sx, sy};
+	const float tv[4] = {tx, ty, tx, ty};
+	float32x4_t s = vld1q_f32(sv), t = vld1q_f32(tv);
+
+	for (; i < n; i++) {
+		int32x4_t b = vld1q_s32((const int32_t *)&src[i]);
+		float32x4_t f = vaddq_f32(vmulq_f32(vcvtq_f32_s32(b), s), t);
+		float32x4_t w = vextq_f32(f, f, 2);
+		float32x4_t r = vcombine_f32(vget_low_f32(vminq_f32(f, w)),
+		                             vget_high_f32(vmaxq_f32(f, w)));
+		vst1q_s32((int32_t *)&dst[i], vcvtq_s32_f32(r));
+	}
+#endif
+	for (; i < n; i++) {
+		float x1 = sx * src[i].x1 + tx, x2 = sx * src[i].x2 + tx;
+		float y1 = sy * src[i].y1 + ty, y2 = sy * src[i].y2 + ty;
+
+		dst[i].x1 = (int32_t)MIN(x1, x2);
+		dst[i].y1 = (int32_t)MIN(y1, y2);
+		dst[i].x2 = (int32_t)MAX(x1, x2);
+		dst[i].y2 = (int32_t)MAX(y1, y2);
+	}
+}
+
+/* rotation or shear, bounding box of all four corners */
+static void
+boxes_transform(pixman_box32_t *dst, const pixman_box32_t *src, unsigned n,
+                const struct tw_mat3 *mat)
+{
+	unsigned i = 0;
+#if defined(MAT3_HAS_SSE2)
+	const float *d = mat->d;
+	__m128 d0 = _mm_set1_ps(d[0]), d1 = _mm_set1_ps(d[1]);
+	__m128 d3 = _mm_set1_ps(d[3]), d4 = _mm_set1_ps(d[4]);
+	__m128 d6 = _mm_set1_ps(d[6]), d7 = _mm_set1_ps(d[7]);
+
+	for (; i < n; i++) {
+		__m128i b = _mm_loadu_si128((const __m128i *)&src[i]);
+		__m128 f = _mm_cvtepi32_ps(b);
+		//corners (x1, y1), (x1, y2), (x2, y1), (x2, y2)
+		__m128 xs = _mm_shuffle_ps(f, f, _MM_SHUFFLE(2, 2, 0, 0));
+		__m128 ys = _mm_shuffle_ps(f, f, _MM_SHUFFLE(3, 1, 3, 1));
+		__m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d0, xs),
+		                                  _mm_mul_ps(d3, ys)), d6);
+		__m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d1, xs),
+		                                  _mm_mul_ps(d4, ys)), d7);
+		//reduce the corners, lane 0 ends up with the min and max
+		__m128 x0 = _mm_shuffle_ps(rx, rx, _MM_SHUFFLE(1, 0, 3, 2));
+		__m128 y0 = _mm_shuffle_ps(ry, ry, _MM_SHUFFLE(1, 0, 3, 2));
+		__m128 minx = _mm_min_ps(rx, x0), maxx = _mm_max_ps(rx, x0);
+		__m128 miny = _mm_min_ps(ry, y0), maxy = _mm_max_ps(ry, y0);
+		__m128 lo, hi;
+
+		minx = _mm_min_ps(minx, _mm_shuffle_ps(minx, minx, 1));
+		maxx = _mm_max_ps(maxx, _mm_shuffle_ps(maxx, maxx, 1));
+		miny = _mm_min_ps(miny, _mm_shuffle_ps(miny, miny, 1));
+		maxy = _mm_max_ps(maxy, _mm_shuffle_ps(maxy, maxy, 1));
+		lo = _mm_unpacklo_ps(minx, miny);
+		hi = _mm_unpacklo_ps(maxx, maxy);
+		_mm_storeu_si128((__m128i *)&dst[i],
+		                 _mm_cvttps_epi32(_mm_movelh_ps(lo, hi)));
+	}
+#endif
+	for (; i < n; i++) {
+		float corners[4][2] = {
+			{src[i].x1, src[i].y1}, {src[i].x1, src[i].y2},
+			{src[i].x2, src[i].y1}, {src[i].x2, src[i].y2},
+		};
+		pixman_box32_t box = {INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+
+		for (int j = 0; j < 4; j++) {
+			tw_mat3_vec_transform(mat, corners[j][0], corners[j][1],
+			                      &corners[j][0], &corners[j][1]);
+			box.x1 = MIN(box.x1, (int32_t)corners[j][0]);
+			box.y1 = MIN(box.y1, (int32_t)corners[j][1]);
+			box.x2 = MAX(box.x2, (int32_t)corners[j][0]);
+			box.y2 = MAX(box.y2, (int32_t)corners[j][1]);
+		}
+		dst[i] = box;
+	}
+}
+
+static inline bool
+mat3_is_int_translate(const struct tw_mat3 *mat)
+{
+	const float *d = mat->d;
+
+	return d[0] == 1.0f && d[1] == 0.0f && d[3] == 0.0f && d[4] == 1.0f &&
+		d[6] == truncf(d[6]) && d[7] == truncf(d[7]);
+}
+
+WL_EXPORT void
+tw_mat3_boxes_transform(const struct tw_mat3 *mat, pixman_box32_t *dst,
+                        const pixman_box32_t *src, unsigned n)
+{
+	const float *d = mat->d;
+
+	if (mat3_is_int_translate(mat))
+		boxes_translate(dst, src, n, (int32_t)d[6], (int32_t)d[7]);
+	else if (d[1] == 0.0f && d[3] == 0.0f)
+		boxes_scale_translate(dst, src, n, d[0], d[4], d[6], d[7]);
+	else
+		boxes_transform(dst, src, n, mat);
+}
+
 WL_EXPORT void
 tw_mat3_box_transform(const struct tw_mat3 *mat,
                       pixman_box32_t *dst, const pixman_box32_t *src)
 {
-	float corners[4][2] = {
-		{src->x1, src->y1}, {src->x1, src->y2},
-		{src->x2, src->y1}, {src->x2, src->y2},
-	};
-	pixman_box32_t box = {INT_MAX, INT_MAX, INT_MIN, INT_MIN};
-
-	for (int i = 0; i < 4; i++) {
-		tw_mat3_vec_transform(mat, corners[i][0], corners[i][1],
-		                      &corners[i][0], &corners[i][1]);
-		box.x1 = MIN(box.x1, (int32_t)corners[i][0]);
-		box.y1 = MIN(box.y1, (int32_t)corners[i][1]);
-		box.x2 = MAX(box.x2, (int32_t)corners[i][0]);
-		box.y2 = MAX(box.y2, (int32_t)corners[i][1]);
-	}
-	*dst = box;
+	tw_mat3_boxes_transform(mat, dst, src, 1);
 }
 
 WL_EXPORT void
@@ -195,17 +352,26 @@ tw_mat3_region_transform(const struct tw_mat3 *mat,
 	int n = 0;
 	pixman_box32_t *src_rects = NULL;
 	pixman_box32_t *dst_rects = NULL;
+	pixman_box32_t stack_rects[64];
 
+	//translated regions stay banded, pixman can move them in place
+	if (mat3_is_int_translate(mat)) {
+		pixman_region32_copy(dst, src);
+		pixman_region32_translate(dst, (int)mat->d[6],
+		                          (int)mat->d[7]);
+		return;
+	}
 	src_rects = pixman_region32_rectangles(src, &n);
-	dst_rects = malloc(n * sizeof(pixman_box32_t));
+	dst_rects = (n <= 64) ? stack_rects :
+		malloc(n * sizeof(pixman_box32_t));
 	if (!dst_rects)
 		return;
 
-	for (int i = 0; i < n; i++)
-		tw_mat3_box_transform(mat, &dst_rects[i], &src_rects[i]);
+	tw_mat3_boxes_transform(mat, dst_rects, src_rects, n);
 	pixman_region32_fini(dst);
 	pixman_region32_init_rects(dst, dst_rects, n);
-	free(dst_rects);
+	if (dst_rects != stack_rects)
+		free(dst_rects);
 }
 
 WL_EXPORT void
@@ -28,6 +28,7 @@
 #include <taiwins/objects/utils.h>
 #include <taiwins/objects/output.h>
 #include <taiwins/objects/logger.h>
+#include <taiwins/objects/client_data.h>
 #include <wayland-util.h>
 
 static const struct wl_output_interface output_impl;
@@ -124,6 +125,13 @@ tw_output_set_mode(struct tw_output *output, uint32_t mode_flags,
 
 }
 
+WL_EXPORT struct wl_resource *
+tw_output_get_client_resource(struct tw_output *output,
+                              struct wl_client *client)
+{
+	return tw_client_data_find(client, output);
+}
+
 WL_EXPORT void
 tw_output_send_clients(struct tw_output *output)
 {
@@ -137,9 +145,53 @@ static const struct wl_output_interface output_impl = {
 	.release = tw_resource_destroy_common,
 };
 
+static void
+output_unindex_resource(struct tw_output *output,
+                        struct wl_resource *resource)
+{
+	struct wl_client *client = wl_resource_get_client(resource);
+	struct wl_resource *r, *first = tw_client_data_find(client, output);
+
+	if (first && first != resource) {
+		output->duplicate_binds--;
+		return;
+	}
+	//the client may have bound the output more than once, first is NULL
+	//if the client is going away
+	if (output->duplicate_binds) {
+		wl_resource_for_each(r, &output->resources) {
+			if (r != resource &&
+			    wl_resource_get_client(r) == client) {
+				if (first)
+					tw_client_data_set(client, output, r);
+				output->duplicate_binds--;
+				return;
+			}
+		}
+	}
+	tw_client_data_unset(client, output);
+}
+
+static void
+output_release_resources(struct tw_output *output)
+{
+	struct wl_resource *res, *tmp;
+
+	wl_resource_for_each_safe(res, tmp, &output->resources) {
+		tw_client_data_unset(wl_resource_get_client(res), output);
+		wl_resource_set_user_data(res, NULL);
+		tw_reset_wl_list(wl_resource_get_link(res));
+	}
+	output->duplicate_binds = 0;
+}
+
 static void
 destroy_output_resource(struct wl_resource *resource)
 {
+	struct tw_output *output = wl_resource_get_user_data(resource);
+
+	if (output)
+		output_unindex_resource(output, resource);
 	wl_resource_set_user_data(resource, NULL);
 	tw_reset_wl_list(wl_resource_get_link(resource));
 }
@@ -159,6 +211,13 @@ bind_output(struct wl_client *client, void *data, uint32_t version,
 	wl_resource_set_implementation(resource, &output_impl, data,
 	                               destroy_output_resource);
 	wl_list_insert(output->resources.prev, wl_resource_get_link(resource));
+	if (tw_client_data_find(client, output)) {
+		output->duplicate_binds++;
+	} else if (!tw_client_data_set(client, output, resource)) {
+		wl_resource_destroy(resource);
+		wl_client_post_no_memory(client);
+		return;
+	}
 	if (tw_output_has_config(output))
 		tw_output_send_config(resource);
 }
@@ -166,12 +225,10 @@ bind_output(struct wl_client *client, void *data, uint32_t version,
 static void
 notify_output_display_destroy(struct wl_listener *listener, void *data)
 {
-	struct wl_resource *res;
 	struct tw_output *output =
 		wl_container_of(listener, output, display_destroy_listener);
 
-        wl_resource_for_each(res, &output->resources)
-		wl_resource_set_user_data(res, NULL);
+	output_release_resources(output);
 	wl_global_destroy(output->global);
 	wl_list_remove(&output->display_destroy_listener.link);
 	free(output);
@@ -208,6 +265,7 @@ tw_output_destroy(struct tw_output *output)
 {
 	free(output->geometry.make);
 	free(output->geometry.model);
+	output_release_resources(output);
 	wl_list_remove(&output->display_destroy_listener.link);
 	wl_global_destroy(output->global);
 	free(output);
@@ -45,6 +45,34 @@ presentation_from_resource(struct wl_resource *resource)
 	return wl_resource_get_user_data(resource);
 }
 
+static struct tw_presentation_feedback *
+presentation_feedback_alloc(struct tw_presentation *presentation)
+{
+	struct tw_presentation_feedback *feedback;
+
+	if (wl_list_empty(&presentation->pool))
+		return calloc(1, sizeof(struct tw_presentation_feedback));
+	feedback = wl_container_of(presentation->pool.next, feedback, link);
+	wl_list_remove(&feedback->link);
+	presentation->pool_size--;
+	memset(feedback, 0, sizeof(*feedback));
+	return feedback;
+}
+
+static void
+presentation_feedback_release(struct tw_presentation *presentation,
+                              struct tw_presentation_feedback *feedback)
+{
+	//pool is not used after display destroy
+	if (presentation->display &&
+	    presentation->pool_size < TW_PRESENTATION_POOL_SIZE) {
+		wl_list_insert(&presentation->pool, &feedback->link);
+		presentation->pool_size++;
+	} else {
+		free(feedback);
+	}
+}
+
 static void
 tw_presentation_feedback_destroy(struct tw_presentation_feedback *feedback)
 {
@@ -58,7 +86,7 @@ tw_presentation_feedback_destroy(struct tw_presentation_feedback *feedback)
 	wl_list_remove(&feedback->surface_destroy.link);
 	wl_list_remove(&feedback->surface_commit.link);
 	wl_list_remove(&feedback->link);
-	free(feedback);
+	presentation_feedback_release(feedback->presentation, feedback);
 }
 
 static void
@@ -80,7 +108,16 @@ notify_feedback_surface_commit(struct wl_listener *listener, void *user_data)
 {
 	struct tw_presentation_feedback *feedback =
 		wl_container_of(listener, feedback, surface_commit);
+	struct tw_presentation *presentation = feedback->presentation;
+
 	feedback->committed = true;
+	feedback->output = presentation->surface_output ?
+		presentation->surface_output(feedback->surface,
+		                             presentation->user_data) : -1;
+	wl_list_remove(&feedback->link);
+	wl_list_insert(tw_presentation_output_feedbacks(presentation,
+	                                                feedback->output)->prev,
+	               &feedback->link);
 }
 
 static struct tw_presentation_feedback *
@@ -101,13 +138,14 @@ presentation_feedback_find_create(struct tw_presentation *presentation,
 	}
 	//create feedback.
 	if (!found) {
-		feedback = calloc(1, sizeof(struct tw_presentation_feedback));
+		feedback = presentation_feedback_alloc(presentation);
 		if (!feedback)
 			return NULL;
 		feedback->surface = surface;
 		feedback->presentation = presentation;
 		feedback->committed = false;
 		feedback->presented = false;
+		feedback->output = -1;
 		wl_list_init(&feedback->resources);
 		wl_list_init(&feedback->link);
 		wl_list_insert(presentation->feedbacks.prev, &feedback->link);
@@ -180,7 +218,12 @@ handle_display_destroy(struct wl_listener *listener, void *data)
 {
 	struct tw_presentation *presentation =
 		wl_container_of(listener, presentation, display_destroy);
+	struct tw_presentation_feedback *feedback, *tmp;
 
+	wl_list_for_each_safe(feedback, tmp, &presentation->pool, link)
+		free(feedback);
+	wl_list_init(&presentation->pool);
+	presentation->pool_size = 0;
 	wl_global_destroy(presentation->global);
 	presentation->global = NULL;
 	presentation->display = NULL;
@@ -203,6 +246,11 @@ tw_presentation_init(struct tw_presentation *presentation,
 	                                &presentation->display_destroy,
 	                                handle_display_destroy);
 	wl_list_init(&presentation->feedbacks);
+	wl_list_init(&presentation->unassigned);
+	for (int i = 0; i < TW_PRESENTATION_MAX_OUTPUTS; i++)
+		wl_list_init(&presentation->outputs[i]);
+	wl_list_init(&presentation->pool);
+	presentation->pool_size = 0;
 	return true;
 }
 
@@ -252,3 +300,15 @@ tw_presentation_feedback_discard(struct tw_presentation_feedback *feedback)
 	feedback->presented = false;
 	tw_presentation_feedback_destroy(feedback);
 }
+
+WL_EXPORT void
+tw_presentation_discard_output(struct tw_presentation *presentation,
+                               int output)
+{
+	struct tw_presentation_feedback *feedback, *tmp;
+	struct wl_list *feedbacks =
+		tw_presentation_output_feedbacks(presentation, output);
+
+	wl_list_for_each_safe(feedback, tmp, feedbacks, link)
+		tw_presentation_feedback_discard(feedback);
+}
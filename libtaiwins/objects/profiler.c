@@ -102,6 +102,23 @@ write_end(const struct tw_profiler_scope *scope, FILE *file, bool comma)
 	fprintf(file, "}\n");
 }
 
+static void
+write_counter(const char *name, long long value, long long time, FILE *file,
+              bool comma)
+{
+	if (comma)
+		fprintf(file, ",");
+	fprintf(file, "{");
+	fprintf(file, "\"cat\":\"counter\",");
+	fprintf(file, "\"name\":\"%s\",", name);
+	fprintf(file, "\"ph\":\"C\",");
+	fprintf(file, "\"pid\":0,");
+	fprintf(file, "\"tid\":%2u,", THREAD_ID());
+	fprintf(file, "\"ts\":%lld,", time);
+	fprintf(file, "\"args\":{\"value\":%lld}", value);
+	fprintf(file, "}\n");
+}
+
 WL_EXPORT void
 tw_profiler_close()
 {
@@ -185,3 +202,16 @@ tw_profiler_timestamp(const char *name)
 	tw_profiler_start_timer(name);
 	tw_profiler_stop_timer(name);
 }
+
+WL_EXPORT void
+tw_profiler_counter(const char *name, long long value)
+{
+	struct timespec spec;
+
+	if (!s_profiler.file)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &spec);
+	write_counter(name, value, spec.tv_sec*1000000 + spec.tv_nsec/1000,
+	              s_profiler.file, !s_profiler.empty);
+	s_profiler.empty = false;
+}
@@ -0,0 +1,155 @@
+/*
+ * region_pool.c - taiwins scratch pixman regions
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pixman.h>
+#include <wayland-server-core.h>
+
+#include <taiwins/objects/region_pool.h>
+
+struct tw_region_pool_node {
+	pixman_region32_t region;
+	/* the storage the region had when handed out */
+	pixman_region32_data_t *data;
+};
+
+static inline struct tw_region_pool_node **
+region_pool_nodes(struct tw_region_pool *pool, unsigned *n)
+{
+	*n = pool->nodes.size / sizeof(struct tw_region_pool_node *);
+	return pool->nodes.data;
+}
+
+/* empty the region, but keep the rectangle storage */
+static inline void
+region_pool_empty(pixman_region32_t *region)
+{
+	//a region with storage but no rectangles is empty for pixman
+	if (region->data && region->data->size &&
+	    region->data->size <= TW_REGION_POOL_MAX_RECTS) {
+		region->data->numRects = 0;
+		memset(&region->extents, 0, sizeof(region->extents));
+	} else {
+		pixman_region32_fini(region);
+		pixman_region32_init(region);
+	}
+}
+
+static inline bool
+region_pool_has_storage(const pixman_region32_t *region)
+{
+	return region->data && region->data->size;
+}
+
+WL_EXPORT void
+tw_region_pool_init(struct tw_region_pool *pool)
+{
+	wl_array_init(&pool->nodes);
+	pool->used = 0;
+	pool->allocs = 0;
+	pool->reuses = 0;
+}
+
+WL_EXPORT void
+tw_region_pool_fini(struct tw_region_pool *pool)
+{
+	unsigned n;
+	struct tw_region_pool_node **nodes = region_pool_nodes(pool, &n);
+
+	for (unsigned i = 0; i < n; i++) {
+		pixman_region32_fini(&nodes[i]->region);
+		free(nodes[i]);
+	}
+	wl_array_release(&pool->nodes);
+	pool->used = 0;
+}
+
+static struct tw_region_pool_node *
+region_pool_next(struct tw_region_pool *pool)
+{
+	unsigned n;
+	struct tw_region_pool_node **nodes = region_pool_nodes(pool, &n);
+	struct tw_region_pool_node *node, **slot;
+
+	if (pool->used < n)
+		return nodes[pool->used];
+	//nodes are allocated one by one so the regions never move
+	if (!(node = calloc(1, sizeof(*node))))
+		return NULL;
+	if (!(slot = wl_array_add(&pool->nodes, sizeof(node)))) {
+		free(node);
+		return NULL;
+	}
+	*slot = node;
+	pixman_region32_init(&node->region);
+	return node;
+}
+
+WL_EXPORT pixman_region32_t *
+tw_region_pool_get(struct tw_region_pool *pool)
+{
+	struct tw_region_pool_node *node = region_pool_next(pool);
+
+	if (!node)
+		return NULL;
+	if (region_pool_has_storage(&node->region))
+		pool->reuses++;
+	node->data = node->region.data;
+	pool->used++;
+	return &node->region;
+}
+
+WL_EXPORT pixman_region32_t *
+tw_region_pool_get_rect(struct tw_region_pool *pool, int x, int y,
+                        unsigned width, unsigned height)
+{
+	struct tw_region_pool_node *node = region_pool_next(pool);
+
+	if (!node)
+		return NULL;
+	//pixman keeps no storage for a single rectangle, nothing is reused
+	pixman_region32_fini(&node->region);
+	pixman_region32_init_rect(&node->region, x, y, width, height);
+	node->data = node->region.data;
+	pool->used++;
+	return &node->region;
+}
+
+WL_EXPORT void
+tw_region_pool_release(struct tw_region_pool *pool, unsigned mark)
+{
+	unsigned n;
+	struct tw_region_pool_node **nodes = region_pool_nodes(pool, &n);
+
+	assert(mark <= pool->used);
+	for (unsigned i = mark; i < pool->used; i++) {
+		pixman_region32_t *region = &nodes[i]->region;
+
+		if (region_pool_has_storage(region) &&
+		    region->data != nodes[i]->data)
+			pool->allocs++;
+		region_pool_empty(region);
+	}
+	pool->used = mark;
+}
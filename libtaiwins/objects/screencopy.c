@@ -0,0 +1,471 @@
+/*
+ * screencopy.c - taiwins wlr_screencopy implementation
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-server.h>
+#include <taiwins/objects/utils.h>
+#include <taiwins/objects/dmabuf.h>
+#include <taiwins/objects/screencopy.h>
+#include <wayland-wlr-screencopy-server-protocol.h>
+
+#define SCREENCOPY_VERSION 3
+
+/**
+ * @brief state of a manager resource, damage is reported since the last copy
+ * of the same manager. If the client hands back the buffer of that copy, only
+ * the damage has to be copied.
+ */
+struct tw_screencopy_client {
+	struct tw_screencopy_manager *manager;
+	struct wl_resource *resource;
+
+	struct wl_resource *output, *buffer;
+	uint64_t seq;
+	struct wl_listener buffer_destroy;
+	struct wl_listener output_destroy;
+};
+
+static const struct zwlr_screencopy_frame_v1_interface frame_impl;
+static const struct zwlr_screencopy_manager_v1_interface manager_impl;
+
+static struct tw_screencopy_frame *
+frame_from_resource(struct wl_resource *resource)
+{
+	assert(wl_resource_instance_of(resource,
+	                               &zwlr_screencopy_frame_v1_interface,
+	                               &frame_impl));
+	return wl_resource_get_user_data(resource);
+}
+
+static struct tw_screencopy_client *
+client_from_resource(struct wl_resource *resource)
+{
+	assert(wl_resource_instance_of(resource,
+	                               &zwlr_screencopy_manager_v1_interface,
+	                               &manager_impl));
+	return wl_resource_get_user_data(resource);
+}
+
+/******************************************************************************
+ * client
+ *****************************************************************************/
+
+static void
+client_forget_buffer(struct tw_screencopy_client *client)
+{
+	tw_reset_wl_list(&client->buffer_destroy.link);
+	tw_reset_wl_list(&client->output_destroy.link);
+	client->buffer = NULL;
+	client->output = NULL;
+	client->seq = 0;
+}
+
+static void
+notify_client_buffer_destroy(struct wl_listener *listener, void *data)
+{
+	struct tw_screencopy_client *client =
+		wl_container_of(listener, client, buffer_destroy);
+	client_forget_buffer(client);
+}
+
+static void
+notify_client_output_destroy(struct wl_listener *listener, void *data)
+{
+	struct tw_screencopy_client *client =
+		wl_container_of(listener, client, output_destroy);
+	client_forget_buffer(client);
+}
+
+static void
+client_remember_buffer(struct tw_screencopy_client *client,
+                       struct tw_screencopy_frame *frame)
+{
+	client_forget_buffer(client);
+	if (!frame->output || !frame->buffer)
+		return;
+	client->output = frame->output;
+	client->buffer = frame->buffer;
+	client->seq = frame->seq;
+	tw_set_resource_destroy_listener(client->buffer,
+	                                 &client->buffer_destroy,
+	                                 notify_client_buffer_destroy);
+	tw_set_resource_destroy_listener(client->output,
+	                                 &client->output_destroy,
+	                                 notify_client_output_destroy);
+}
+
+/******************************************************************************
+ * frame
+ *****************************************************************************/
+
+static void
+frame_stop_copy(struct tw_screencopy_frame *frame)
+{
+	struct tw_screencopy_manager *manager = frame->manager;
+
+	if (frame->copying && manager->impl && manager->impl->frame_destroy)
+		manager->impl->frame_destroy(frame, manager->user_data);
+	frame->copying = false;
+	frame->user_data = NULL;
+	tw_reset_wl_list(&frame->buffer_destroy.link);
+}
+
+static void
+notify_frame_buffer_destroy(struct wl_listener *listener, void *data)
+{
+	struct tw_screencopy_frame *frame =
+		wl_container_of(listener, frame, buffer_destroy);
+
+	frame_stop_copy(frame);
+	frame->buffer = NULL;
+	zwlr_screencopy_frame_v1_send_failed(frame->resource);
+}
+
+static void
+notify_frame_output_destroy(struct wl_listener *listener, void *data)
+{
+	struct tw_screencopy_frame *frame =
+		wl_container_of(listener, frame, output_destroy);
+
+	tw_reset_wl_list(&frame->output_destroy.link);
+	frame->output = NULL;
+}
+
+static bool
+frame_check_buffer(struct tw_screencopy_frame *frame,
+                   struct wl_resource *buffer)
+{
+	struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(buffer);
+
+	if (shm_buffer) {
+		return wl_shm_buffer_get_format(shm_buffer) ==
+			frame->params.shm_format &&
+			wl_shm_buffer_get_width(shm_buffer) ==
+			(int32_t)frame->params.width &&
+			wl_shm_buffer_get_height(shm_buffer) ==
+			(int32_t)frame->params.height &&
+			wl_shm_buffer_get_stride(shm_buffer) ==
+			(int32_t)frame->params.stride;
+	} else if (tw_is_wl_buffer_dmabuf(buffer)) {
+		struct tw_dmabuf_attributes *attrs =
+			&tw_dmabuf_buffer_from_resource(buffer)->attributes;
+
+		return frame->params.dmabuf_format &&
+			attrs->format == frame->params.dmabuf_format &&
+			attrs->width == (int32_t)frame->params.width &&
+			attrs->height == (int32_t)frame->params.height;
+	}
+	return false;
+}
+
+static void
+frame_copy(struct wl_resource *resource, struct wl_resource *buffer,
+           bool with_damage)
+{
+	struct tw_screencopy_frame *frame = frame_from_resource(resource);
+	struct tw_screencopy_manager *manager = frame->manager;
+	struct tw_screencopy_client *client = frame->client;
+
+	if (frame->buffer) {
+		wl_resource_post_error(resource,
+		                       ZWLR_SCREENCOPY_FRAME_V1_ERROR_ALREADY_USED,
+		                       "frame already used");
+		return;
+	}
+	if (!frame_check_buffer(frame, buffer)) {
+		wl_resource_post_error(resource,
+		                       ZWLR_SCREENCOPY_FRAME_V1_ERROR_INVALID_BUFFER,
+		                       "invalid buffer attributes");
+		return;
+	}
+	frame->buffer = buffer;
+	frame->with_damage = with_damage;
+	if (!frame->output || !manager->impl) {
+		zwlr_screencopy_frame_v1_send_failed(resource);
+		return;
+	}
+	//same buffer as last time, it holds the frame we copied before
+	frame->seq = (client && client->buffer == buffer &&
+	              client->output == frame->output) ? client->seq : 0;
+	frame->copying = true;
+	tw_set_resource_destroy_listener(buffer, &frame->buffer_destroy,
+	                                 notify_frame_buffer_destroy);
+	manager->impl->frame_copy(frame, manager->user_data);
+}
+
+static void
+handle_frame_copy(struct wl_client *client, struct wl_resource *resource,
+                  struct wl_resource *buffer)
+{
+	frame_copy(resource, buffer, false);
+}
+
+static void
+handle_frame_copy_with_damage(struct wl_client *client,
+                              struct wl_resource *resource,
+                              struct wl_resource *buffer)
+{
+	frame_copy(resource, buffer, true);
+}
+
+static const struct zwlr_screencopy_frame_v1_interface frame_impl = {
+	.copy = handle_frame_copy,
+	.copy_with_damage = handle_frame_copy_with_damage,
+	.destroy = tw_resource_destroy_common,
+};
+
+static void
+handle_destroy_frame_resource(struct wl_resource *resource)
+{
+	struct tw_screencopy_frame *frame = frame_from_resource(resource);
+
+	frame_stop_copy(frame);
+	tw_reset_wl_list(&frame->output_destroy.link);
+	wl_list_remove(&frame->link);
+	free(frame);
+}
+
+static void
+frame_send_params(struct tw_screencopy_frame *frame)
+{
+	struct wl_resource *resource = frame->resource;
+
+	zwlr_screencopy_frame_v1_send_buffer(resource,
+	                                     frame->params.shm_format,
+	                                     frame->params.width,
+	                                     frame->params.height,
+	                                     frame->params.stride);
+	if (wl_resource_get_version(resource) < 3)
+		return;
+	if (frame->params.dmabuf_format)
+		zwlr_screencopy_frame_v1_send_linux_dmabuf(
+			resource, frame->params.dmabuf_format,
+			frame->params.width, frame->params.height);
+	zwlr_screencopy_frame_v1_send_buffer_done(resource);
+}
+
+static void
+frame_create(struct wl_resource *manager_resource, uint32_t id,
+             int32_t overlay_cursor, struct wl_resource *output,
+             const pixman_rectangle32_t *region)
+{
+	struct wl_resource *resource = NULL;
+	struct tw_screencopy_frame *frame = NULL;
+	struct wl_client *wl_client = wl_resource_get_client(manager_resource);
+	struct tw_screencopy_client *client =
+		client_from_resource(manager_resource);
+	uint32_t version = wl_resource_get_version(manager_resource);
+
+	if (!tw_create_wl_resource_for_obj(resource, frame, wl_client, id,
+	                                   version,
+	                                   zwlr_screencopy_frame_v1_interface)) {
+		wl_resource_post_no_memory(manager_resource);
+		return;
+	}
+	wl_resource_set_implementation(resource, &frame_impl, frame,
+	                               handle_destroy_frame_resource);
+	frame->resource = resource;
+	frame->manager = client->manager;
+	frame->client = client;
+	frame->output = output;
+	frame->overlay_cursor = overlay_cursor;
+	frame->has_region = region != NULL;
+	if (region)
+		frame->region = *region;
+	wl_list_init(&frame->buffer_destroy.link);
+	wl_list_insert(&client->manager->frames, &frame->link);
+	tw_set_resource_destroy_listener(output, &frame->output_destroy,
+	                                 notify_frame_output_destroy);
+
+	if (!frame->manager->impl ||
+	    !frame->manager->impl->frame_init(frame,
+	                                      frame->manager->user_data)) {
+		//nothing can be copied, still let the client send copy
+		memset(&frame->params, 0, sizeof(frame->params));
+		frame->output = NULL;
+		tw_reset_wl_list(&frame->output_destroy.link);
+		zwlr_screencopy_frame_v1_send_failed(resource);
+		return;
+	}
+	frame_send_params(frame);
+}
+
+/******************************************************************************
+ * manager
+ *****************************************************************************/
+
+static void
+handle_capture_output(struct wl_client *client,
+                      struct wl_resource *resource, uint32_t frame,
+                      int32_t overlay_cursor, struct wl_resource *output)
+{
+	frame_create(resource, frame, overlay_cursor, output, NULL);
+}
+
+static void
+handle_capture_output_region(struct wl_client *client,
+                             struct wl_resource *resource, uint32_t frame,
+                             int32_t overlay_cursor,
+                             struct wl_resource *output,
+                             int32_t x, int32_t y,
+                             int32_t width, int32_t height)
+{
+	pixman_rectangle32_t region = {
+		.x = x, .y = y,
+		.width = width > 0 ? width : 0,
+		.height = height > 0 ? height : 0,
+	};
+	frame_create(resource, frame, overlay_cursor, output, &region);
+}
+
+static const struct zwlr_screencopy_manager_v1_interface manager_impl = {
+	.capture_output = handle_capture_output,
+	.capture_output_region = handle_capture_output_region,
+	.destroy = tw_resource_destroy_common,
+};
+
+static void
+handle_destroy_manager_resource(struct wl_resource *resource)
+{
+	struct tw_screencopy_client *client = client_from_resource(resource);
+	struct tw_screencopy_frame *frame;
+
+	if (!client)
+		return;
+	//frames live on after their manager
+	if (client->manager)
+		wl_list_for_each(frame, &client->manager->frames, link)
+			if (frame->client == client)
+				frame->client = NULL;
+	client_forget_buffer(client);
+	free(client);
+}
+
+static void
+bind_screencopy_manager(struct wl_client *wl_client, void *data,
+                        uint32_t version, uint32_t id)
+{
+	struct wl_resource *resource = NULL;
+	struct tw_screencopy_client *client = NULL;
+
+	if (!tw_create_wl_resource_for_obj(resource, client, wl_client, id,
+	                                   version,
+	                                   zwlr_screencopy_manager_v1_interface)) {
+		wl_client_post_no_memory(wl_client);
+		return;
+	}
+	client->manager = data;
+	client->resource = resource;
+	wl_list_init(&client->buffer_destroy.link);
+	wl_list_init(&client->output_destroy.link);
+	wl_resource_set_implementation(resource, &manager_impl, client,
+	                               handle_destroy_manager_resource);
+}
+
+static void
+notify_manager_display_destroy(struct wl_listener *listener, void *data)
+{
+	struct tw_screencopy_manager *manager =
+		wl_container_of(listener, manager, display_destroy);
+
+	wl_list_remove(&listener->link);
+	wl_global_destroy(manager->global);
+	manager->global = NULL;
+	manager->impl = NULL;
+}
+
+WL_EXPORT bool
+tw_screencopy_manager_init(struct tw_screencopy_manager *manager,
+                           struct wl_display *display,
+                           const struct tw_screencopy_impl *impl,
+                           void *user_data)
+{
+	if (!(manager->global =
+	      wl_global_create(display, &zwlr_screencopy_manager_v1_interface,
+	                       SCREENCOPY_VERSION, manager,
+	                       bind_screencopy_manager)))
+		return false;
+	manager->impl = impl;
+	manager->user_data = user_data;
+	wl_list_init(&manager->frames);
+	tw_set_display_destroy_listener(display, &manager->display_destroy,
+	                                notify_manager_display_destroy);
+	return true;
+}
+
+WL_EXPORT struct tw_screencopy_manager *
+tw_screencopy_manager_create_global(struct wl_display *display,
+                                    const struct tw_screencopy_impl *impl,
+                                    void *user_data)
+{
+	static struct tw_screencopy_manager manager = {0};
+
+	if (manager.global)
+		return &manager;
+	if (!tw_screencopy_manager_init(&manager, display, impl, user_data))
+		return NULL;
+	return &manager;
+}
+
+/******************************************************************************
+ * compositor APIs
+ *****************************************************************************/
+
+WL_EXPORT void
+tw_screencopy_frame_ready(struct tw_screencopy_frame *frame,
+                          const struct timespec *time,
+                          const pixman_region32_t *damage)
+{
+	struct wl_resource *resource = frame->resource;
+	uint64_t sec = time->tv_sec;
+
+	frame->copying = false;
+	frame_stop_copy(frame);
+	if (frame->client)
+		client_remember_buffer(frame->client, frame);
+
+	zwlr_screencopy_frame_v1_send_flags(resource, 0);
+	if (frame->with_damage &&
+	    wl_resource_get_version(resource) >= 2 && damage) {
+		int n;
+		const pixman_box32_t *boxes =
+			pixman_region32_rectangles(
+				(pixman_region32_t *)damage, &n);
+
+		for (int i = 0; i < n; i++)
+			zwlr_screencopy_frame_v1_send_damage(
+				resource, boxes[i].x1, boxes[i].y1,
+				boxes[i].x2 - boxes[i].x1,
+				boxes[i].y2 - boxes[i].y1);
+	}
+	zwlr_screencopy_frame_v1_send_ready(resource, sec >> 32,
+	                                    sec & 0xffffffff, time->tv_nsec);
+}
+
+WL_EXPORT void
+tw_screencopy_frame_failed(struct tw_screencopy_frame *frame)
+{
+	frame->copying = false;
+	frame_stop_copy(frame);
+	zwlr_screencopy_frame_v1_send_failed(frame->resource);
+}
@@ -32,6 +32,7 @@
 #include <taiwins/objects/utils.h>
 #include <taiwins/objects/seat.h>
 #include <taiwins/objects/cursor.h>
+#include <taiwins/objects/client_data.h>
 
 static const struct wl_seat_interface seat_impl;
 
@@ -48,6 +49,10 @@ tw_seat_client_new(struct tw_seat *seat, struct wl_client *client)
 	wl_list_init(&s->keyboards);
 	wl_list_init(&s->pointers);
 	wl_list_init(&s->touches);
+	if (!tw_client_data_set(client, seat, s)) {
+		free(s);
+		return NULL;
+	}
 	wl_list_insert(&seat->clients, &s->link);
 	return s;
 }
@@ -242,6 +247,7 @@ handle_client_resource_destroy(struct wl_resource *seat_resource)
 		return;
 
 	wl_list_remove(&sc->link);
+	tw_client_data_unset(sc->client, sc->seat);
 	wl_resource_for_each_safe(resource, tmp, &sc->keyboards)
 		wl_resource_destroy(resource);
 	wl_resource_for_each_safe(resource, tmp, &sc->pointers)
@@ -413,10 +419,5 @@ tw_seat_client_from_device(struct wl_resource *resource)
 WL_EXPORT struct tw_seat_client *
 tw_seat_client_find(struct tw_seat *seat, struct wl_client *client)
 {
-	struct tw_seat_client *seat_client = NULL;
-	wl_list_for_each(seat_client, &seat->clients, link) {
-		if (seat_client->client == client)
-			return seat_client;
-	}
-	return NULL;
+	return tw_client_data_find(client, seat);
 }
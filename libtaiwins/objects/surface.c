@@ -37,6 +37,63 @@
 #define CALLBACK_VERSION 1
 #define SURFACE_VERSION 4
 
+/******************************************************************************
+ * shared regions
+ *****************************************************************************/
+
+static struct tw_surface_region *
+surface_region_new(void)
+{
+	struct tw_surface_region *region = calloc(1, sizeof(*region));
+
+	if (!region)
+		return NULL;
+	region->refs = 1;
+	pixman_region32_init(&region->region);
+	return region;
+}
+
+static inline struct tw_surface_region *
+surface_region_ref(struct tw_surface_region *region)
+{
+	region->refs++;
+	return region;
+}
+
+static void
+surface_region_unref(struct tw_surface_region *region)
+{
+	if (region && --region->refs == 0) {
+		pixman_region32_fini(&region->region);
+		free(region);
+	}
+}
+
+/* the region to write, a shared region is replaced by a new one */
+static pixman_region32_t *
+surface_region_write(struct tw_surface_region **slot)
+{
+	struct tw_surface_region *region = *slot;
+
+	if (region->refs == 1)
+		return &region->region;
+	if (!(region = surface_region_new()))
+		return NULL;
+	surface_region_unref(*slot);
+	*slot = region;
+	return &region->region;
+}
+
+static inline void
+surface_region_share(struct tw_surface_region **dst,
+                     struct tw_surface_region *src)
+{
+	if (*dst != src) {
+		surface_region_unref(*dst);
+		*dst = surface_region_ref(src);
+	}
+}
+
 /******************************************************************************
  * wl_surface implementation
  *****************************************************************************/
@@ -108,12 +165,18 @@ surface_set_opaque_region(struct wl_client *client,
 {
 	struct tw_region *region;
 	struct tw_surface *surface = tw_surface_from_resource(res);
+	pixman_region32_t *opaque =
+		surface_region_write(&surface->pending->opaque_region);
+
+	if (!opaque) {
+		wl_resource_post_no_memory(res);
+		return;
+	}
 	if (!region_res) {
-		pixman_region32_clear(&surface->pending->opaque_region);
+		pixman_region32_clear(opaque);
 	} else {
 		region = tw_region_from_resource(region_res);
-		pixman_region32_copy(&surface->pending->opaque_region,
-		                     &region->region);
+		pixman_region32_copy(opaque, &region->region);
 	}
 	surface->pending->commit_state |= TW_SURFACE_OPAQUE_REGION;
 }
@@ -125,14 +188,20 @@ surface_set_input_region(struct wl_client *client,
 {
 	struct tw_region *region;
 	struct tw_surface *surface = tw_surface_from_resource(res);
+	pixman_region32_t *input =
+		surface_region_write(&surface->pending->input_region);
+
+	if (!input) {
+		wl_resource_post_no_memory(res);
+		return;
+	}
 	if (!region_res) {
-		pixman_region32_fini(&surface->pending->input_region);
-		pixman_region32_init_rect(&surface->pending->input_region,
-			INT32_MIN, INT32_MIN, UINT32_MAX, UINT32_MAX);
+		pixman_region32_fini(input);
+		pixman_region32_init_rect(input, INT32_MIN, INT32_MIN,
+		                          UINT32_MAX, UINT32_MAX);
 	} else {
 		region = tw_region_from_resource(region_res);
-		pixman_region32_copy(&surface->pending->input_region,
-		                     &region->region);
+		pixman_region32_copy(input, &region->region);
 	}
 	surface->pending->commit_state |= TW_SURFACE_INPUT_REGION;
 }
@@ -190,18 +259,6 @@ surface_damage_buffer(struct wl_client *client,
 }
 
 /************************** surface commit ***********************************/
-/* after transform, bbox could be inversed, fliped, in this case, we shall
- * rectify the box */
-static void
-bbox_rectify(float *x1, float *x2, float *y1, float *y2)
-{
-	float _x1 = *x1, _x2 = *x2, _y1 = *y1, _y2 = *y2;
-	*x1 = (_x1 <= _x2) ? _x1 : _x2;
-	*x2 = (_x1 <= _x2) ? _x2 : _x1;
-	*y1 = (_y1 <= _y2) ? _y1 : _y2;
-	*y2 = (_y1 <= _y2) ? _y2 : _y1;
-}
-
 static inline bool
 surface_has_crop(struct tw_view *current)
 {
@@ -226,10 +283,7 @@ surface_buffer_has_transform(struct tw_view *current)
 static void
 surface_to_buffer_damage(struct tw_surface *surface)
 {
-	int n;
-	pixman_box32_t *rects;
 	struct tw_view *view = surface->current;
-	float x1, y1, x2, y2;
 	//creating a copy so we avoid changing surface_damage itself.
 	pixman_region32_t surface_damage;
 
@@ -238,28 +292,15 @@ surface_to_buffer_damage(struct tw_surface *surface)
 	pixman_region32_init(&surface_damage);
 	pixman_region32_copy(&surface_damage, &view->surface_damage);
 
-	if (!surface_buffer_has_transform(surface->current)) {
+	if (!surface_buffer_has_transform(surface->current))
 		pixman_region32_translate(&surface_damage,
 		                          surface->current->dx,
 		                          surface->current->dy);
-		pixman_region32_union(&surface->current->buffer_damage,
-		                      &surface->current->buffer_damage,
-		                      &surface_damage);
-	} else {
-		rects = pixman_region32_rectangles(&surface_damage, &n);
-		for (int i = 0; i < n; i++) {
-			tw_mat3_vec_transform(&view->surface_to_buffer,
-			                      rects[i].x1, rects[i].y1,
-			                      &x1, &y1);
-			tw_mat3_vec_transform(&view->surface_to_buffer,
-			                      rects[i].x2, rects[i].y2,
-			                      &x2, &y2);
-			bbox_rectify(&x1, &x2, &y1, &y2);
-			pixman_region32_union_rect(&view->buffer_damage,
-			                           &view->buffer_damage,
-			                           x1, y1, x2 - x1, y2 - y1);
-		}
-	}
+	else
+		tw_mat3_region_transform(&view->surface_to_buffer,
+		                         &surface_damage, &surface_damage);
+	pixman_region32_union(&view->buffer_damage, &view->buffer_damage,
+	                      &surface_damage);
 	pixman_region32_fini(&surface_damage);
 }
 
@@ -347,6 +388,10 @@ surface_update_buffer(struct tw_surface *surface)
 	if (surface->buffer.resource) {
 		tw_surface_buffer_release(&surface->buffer);
 		surface->current->buffer_resource = NULL;
+	} else if (tw_surface_has_texture(surface)) {
+		//the renderer holds the buffer for a deferred upload and
+		//releases it itself
+		surface->current->buffer_resource = NULL;
 	}
 }
 
@@ -427,11 +472,8 @@ surface_update_geometry(struct tw_surface *surface)
 static void
 surface_update_damage(struct tw_surface *surface)
 {
-	int n;
-	pixman_box32_t *rects;
 	struct tw_mat3 inverse;
 	struct tw_view *view = surface->current;
-	float x1, y1, x2, y2;
 
 	if (!pixman_region32_not_empty(&view->buffer_damage))
 		return;
@@ -444,19 +486,8 @@ surface_update_damage(struct tw_surface *surface)
 		pixman_region32_copy(&view->surface_damage,
 		                     &view->buffer_damage);
 	} else {
-		rects = pixman_region32_rectangles(&view->buffer_damage,&n);
-		for (int i = 0; i < n; i++) {
-			tw_mat3_vec_transform(&inverse,
-			                      rects[i].x1, rects[i].y1,
-			                      &x1, &y1);
-			tw_mat3_vec_transform(&inverse,
-			                      rects[i].x2, rects[i].y2,
-			                      &x2, &y2);
-			bbox_rectify(&x1, &x2, &y1, &y2);
-			pixman_region32_union_rect(&view->surface_damage,
-			                           &view->surface_damage,
-			                           x1, y1, x2-x1, y2-y1);
-		}
+		tw_mat3_region_transform(&inverse, &view->surface_damage,
+		                         &view->buffer_damage);
 	}
 }
 
@@ -468,8 +499,34 @@ surface_copy_state(struct tw_view *dst, struct tw_view *src)
 	dst->crop = src->crop;
 	dst->surface_scale = src->surface_scale;
 
-	pixman_region32_copy(&dst->input_region, &src->input_region);
-	pixman_region32_copy(&dst->opaque_region, &src->opaque_region);
+	//unchanged regions are shared, not copied
+	surface_region_share(&dst->input_region, src->input_region);
+	surface_region_share(&dst->opaque_region, src->opaque_region);
+}
+
+/* damaged pixels of the committed state, in surface coordinates */
+static uint64_t
+surface_damage_area(struct tw_surface *surface)
+{
+	int n;
+	uint64_t area = 0;
+	int32_t w = surface->geometry.xywh.width;
+	int32_t h = surface->geometry.xywh.height;
+	pixman_box32_t *boxes =
+		pixman_region32_rectangles(&surface->current->surface_damage,
+		                           &n);
+
+	//clients damage INT32_MAX for everything, clip to the surface
+	for (int i = 0; i < n; i++) {
+		int32_t x1 = boxes[i].x1 > 0 ? boxes[i].x1 : 0;
+		int32_t y1 = boxes[i].y1 > 0 ? boxes[i].y1 : 0;
+		int32_t x2 = boxes[i].x2 < w ? boxes[i].x2 : w;
+		int32_t y2 = boxes[i].y2 < h ? boxes[i].y2 : h;
+
+		if (x2 > x1 && y2 > y1)
+			area += (uint64_t)(x2 - x1) * (y2 - y1);
+	}
+	return area;
 }
 
 static void
@@ -482,6 +539,7 @@ surface_commit_state(struct tw_surface *surface)
 	if (!surface->pending->commit_state)
 		return;
 
+	surface->commits++;
         surface->current = pending;
 	surface->previous = committed;
 	surface->pending = previous;
@@ -495,6 +553,13 @@ surface_commit_state(struct tw_surface *surface)
 	surface_update_geometry(surface);
 	surface_update_damage(surface);
 
+	if (surface->stats) {
+		surface->stats->total.commits++;
+		surface->stats->total.damage += surface_damage_area(surface);
+		tw_client_stats_sample(surface->stats,
+		                       tw_get_time_ms(CLOCK_MONOTONIC));
+	}
+
 	if (pixman_region32_not_empty(&surface->current->surface_damage))
 		wl_signal_emit(&surface->signals.dirty, surface);
 	//the surface is not dirty, but requested a frame, we should return the
@@ -675,8 +740,8 @@ tw_surface_has_input_point(struct tw_surface *surface, float x, float y)
 	                      x, y, &x, &y);
 
 	return on_surface &&
-		pixman_region32_contains_point(&surface->current->input_region,
-		                               x, y, NULL);
+		pixman_region32_contains_point(
+			&surface->current->input_region->region, x, y, NULL);
 }
 
 WL_EXPORT void
@@ -696,17 +761,37 @@ tw_surface_dirty_geometry(struct tw_surface *surface)
 }
 
 WL_EXPORT void
-tw_surface_flush_frame(struct tw_surface *surface, uint32_t time)
+tw_surface_flush_damage(struct tw_surface *surface)
 {
-	struct wl_resource *callback, *next;
-
 	pixman_region32_clear(&surface->current->surface_damage);
 	pixman_region32_clear(&surface->current->buffer_damage);
+	pixman_region32_clear(&surface->geometry.dirty);
+}
+
+WL_EXPORT void
+tw_surface_send_frame_done(struct tw_surface *surface, uint32_t time)
+{
+	struct wl_resource *callback, *next;
+	uint64_t frames = 0;
+
 	wl_resource_for_each_safe(callback, next, &surface->frame_callbacks) {
 		wl_callback_send_done(callback, time);
 		wl_resource_destroy(callback);
+		frames++;
 	}
-	pixman_region32_clear(&surface->geometry.dirty);
+	//a throttled client may not commit again before it gets the frames
+	if (surface->stats && frames) {
+		surface->stats->total.frames += frames;
+		tw_client_stats_sample(surface->stats,
+		                       tw_get_time_ms(CLOCK_MONOTONIC));
+	}
+}
+
+WL_EXPORT void
+tw_surface_flush_frame(struct tw_surface *surface, uint32_t time)
+{
+	tw_surface_flush_damage(surface);
+	tw_surface_send_frame_done(surface, time);
 }
 
 static void
@@ -725,8 +810,8 @@ surface_destroy_resource(struct wl_resource *resource)
 		view = &surface->surface_states[i];
 		pixman_region32_fini(&view->surface_damage);
 		pixman_region32_fini(&view->buffer_damage);
-		pixman_region32_fini(&view->input_region);
-		pixman_region32_fini(&view->opaque_region);
+		surface_region_unref(view->input_region);
+		surface_region_unref(view->opaque_region);
 	}
 
 #ifdef TW_OVERLAY_PLANE
@@ -737,6 +822,7 @@ surface_destroy_resource(struct wl_resource *resource)
 		tw_surface_buffer_release(&surface->buffer);
 
 	pixman_region32_fini(&surface->geometry.dirty);
+	tw_client_stats_unref(surface->stats);
 
 	assert(surface->alloc);
 	surface->alloc->free(surface, &wl_surface_interface);
@@ -749,12 +835,21 @@ tw_surface_create(struct wl_client *client, uint32_t ver, uint32_t id,
 	struct tw_view *view;
 	struct wl_resource *resource = NULL;
 	struct tw_surface *surface = NULL;
+	struct tw_surface_region *opaque = surface_region_new();
+	struct tw_surface_region *input = surface_region_new();
 
-	if (!tw_alloc_wl_resource_for_obj(resource, surface, client, id, ver,
+	if (!opaque || !input ||
+	    !tw_alloc_wl_resource_for_obj(resource, surface, client, id, ver,
 	                                  wl_surface_interface, alloc)) {
+		surface_region_unref(opaque);
+		surface_region_unref(input);
 		wl_client_post_no_memory(client);
 		return NULL;
 	}
+	//input region is as big as possible
+	pixman_region32_fini(&input->region);
+	pixman_region32_init_rect(&input->region, INT32_MIN, INT32_MIN,
+	                          UINT32_MAX, UINT32_MAX);
 	wl_resource_set_implementation(resource, &surface_impl, surface,
 	                               surface_destroy_resource);
 	//initializers
@@ -763,6 +858,7 @@ tw_surface_create(struct wl_client *client, uint32_t ver, uint32_t id,
 	surface->pending = &surface->surface_states[0];
 	surface->current = &surface->surface_states[1];
 	surface->previous = &surface->surface_states[2];
+	surface->stats = tw_client_stats_ref(client);
 	wl_signal_init(&surface->signals.commit);
 	wl_signal_init(&surface->signals.frame);
 	wl_signal_init(&surface->signals.dirty);
@@ -780,12 +876,12 @@ tw_surface_create(struct wl_client *client, uint32_t ver, uint32_t id,
 		view->plane = NULL;
 		pixman_region32_init(&view->surface_damage);
 		pixman_region32_init(&view->buffer_damage);
-		pixman_region32_init(&view->opaque_region);
-		//input region is as big as possible
-		pixman_region32_init_rect(&view->input_region,
-		                          INT32_MIN, INT32_MIN,
-		                          UINT32_MAX, UINT32_MAX);
+		//the states share the initial regions
+		view->opaque_region = surface_region_ref(opaque);
+		view->input_region = surface_region_ref(input);
 	}
+	surface_region_unref(opaque);
+	surface_region_unref(input);
 
 #ifdef TW_OVERLAY_PLANE
 	for (int i = 0; i < 32; i++)
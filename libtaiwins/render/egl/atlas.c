@@ -0,0 +1,222 @@
+/*
+ * atlas.c - taiwins egl texture atlas for small shm buffers
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <stdlib.h>
+#include <wayland-server.h>
+#include <taiwins/objects/logger.h>
+
+#include "internal.h"
+
+/**
+ * @brief shared textures for small shm buffers.
+ *
+ * Widgets, popups, tooltips and cursors are tiny, giving each of them a
+ * texture costs a texture object in the driver and a texture switch in every
+ * draw. They are packed into a few large textures instead, sorted by GL
+ * format. The space is handed out by a shelf allocator, each shelf is a row
+ * as tall as the first buffer that opened it. A shelf is reused from the
+ * start once everything in it is gone and trailing empty shelves are given
+ * back to the atlas.
+ */
+
+struct tw_egl_atlas_shelf {
+	uint32_t y, height;
+	uint32_t x; /**< the next free column */
+	unsigned used; /**< allocations alive in the shelf */
+};
+
+static inline struct tw_egl_atlas_shelf *
+atlas_shelves(struct tw_egl_atlas *atlas, unsigned *n)
+{
+	*n = atlas->shelves.size / sizeof(struct tw_egl_atlas_shelf);
+	return atlas->shelves.data;
+}
+
+static inline uint32_t
+atlas_shelves_bottom(struct tw_egl_atlas *atlas)
+{
+	unsigned n;
+	struct tw_egl_atlas_shelf *shelves = atlas_shelves(atlas, &n);
+
+	return n ? shelves[n-1].y + shelves[n-1].height : 0;
+}
+
+static struct tw_egl_atlas *
+atlas_create(struct tw_egl_render_context *ctx, GLenum glfmt)
+{
+	struct tw_egl_atlas *atlas = calloc(1, sizeof(*atlas));
+	GLint max_size = 0;
+
+	if (!atlas)
+		return NULL;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+	atlas->glfmt = glfmt;
+	atlas->size = max_size < TW_EGL_ATLAS_SIZE ?
+		max_size : TW_EGL_ATLAS_SIZE;
+	wl_array_init(&atlas->shelves);
+
+	TW_GLES_DEBUG_PUSH(ctx);
+	glGenTextures(1, &atlas->gltex);
+	glBindTexture(GL_TEXTURE_2D, atlas->gltex);
+	glTexImage2D(GL_TEXTURE_2D, 0, glfmt, atlas->size, atlas->size, 0,
+	             glfmt, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	TW_GLES_DEBUG_POP(ctx);
+
+	if (glGetError() != GL_NO_ERROR) {
+		tw_logl_level(TW_LOG_WARN, "failed to create texture atlas");
+		glDeleteTextures(1, &atlas->gltex);
+		wl_array_release(&atlas->shelves);
+		free(atlas);
+		return NULL;
+	}
+	wl_list_insert(ctx->atlases.prev, &atlas->link);
+	return atlas;
+}
+
+static void
+atlas_destroy(struct tw_egl_render_context *ctx, struct tw_egl_atlas *atlas)
+{
+	tw_egl_render_context_defer_delete(ctx, TW_EGL_GARBAGE_TEXTURE,
+	                                   atlas->gltex);
+	wl_list_remove(&atlas->link);
+	wl_array_release(&atlas->shelves);
+	free(atlas);
+}
+
+/* find the shortest shelf the rectangle fits, or open a new one */
+static struct tw_egl_atlas_shelf *
+atlas_find_shelf(struct tw_egl_atlas *atlas, uint32_t width, uint32_t height)
+{
+	unsigned n;
+	struct tw_egl_atlas_shelf *shelves = atlas_shelves(atlas, &n);
+	struct tw_egl_atlas_shelf *shelf, *best = NULL;
+	uint32_t bottom = atlas_shelves_bottom(atlas);
+
+	for (unsigned i = 0; i < n; i++) {
+		shelf = &shelves[i];
+		if (shelf->height < height || shelf->x + width > atlas->size)
+			continue;
+		//do not let a short buffer take most of a tall shelf
+		if (shelf->used && shelf->height > height * 2)
+			continue;
+		if (!best || shelf->height < best->height)
+			best = shelf;
+	}
+	if (best || bottom + height > atlas->size)
+		return best;
+	if (!(shelf = wl_array_add(&atlas->shelves, sizeof(*shelf))))
+		return NULL;
+	shelf->y = bottom;
+	shelf->height = height;
+	shelf->x = 0;
+	shelf->used = 0;
+	return shelf;
+}
+
+bool
+tw_egl_atlas_alloc(struct tw_egl_render_context *ctx,
+                   struct tw_egl_render_texture *texture, GLenum glfmt,
+                   uint32_t width, uint32_t height)
+{
+	struct tw_egl_atlas *atlas, *found = NULL;
+	struct tw_egl_atlas_shelf *shelf = NULL;
+	uint32_t w = width + 2 * TW_EGL_ATLAS_GUTTER;
+	uint32_t h = height + 2 * TW_EGL_ATLAS_GUTTER;
+
+	if (width > TW_EGL_ATLAS_MAX_SIZE || height > TW_EGL_ATLAS_MAX_SIZE)
+		return false;
+	wl_list_for_each(atlas, &ctx->atlases, link) {
+		if (atlas->glfmt != glfmt)
+			continue;
+		if ((shelf = atlas_find_shelf(atlas, w, h))) {
+			found = atlas;
+			break;
+		}
+	}
+	if (!found) {
+		if (!(found = atlas_create(ctx, glfmt)))
+			return false;
+		if (!(shelf = atlas_find_shelf(found, w, h))) {
+			if (!found->used)
+				atlas_destroy(ctx, found);
+			return false;
+		}
+	}
+	texture->atlas = found;
+	texture->shelf = shelf - (struct tw_egl_atlas_shelf *)
+		found->shelves.data;
+	texture->x = shelf->x + TW_EGL_ATLAS_GUTTER;
+	texture->y = shelf->y + TW_EGL_ATLAS_GUTTER;
+	texture->gltex = found->gltex;
+	texture->uv.x1 = (GLfloat)texture->x / found->size;
+	texture->uv.y1 = (GLfloat)texture->y / found->size;
+	texture->uv.x2 = (GLfloat)(texture->x + width) / found->size;
+	texture->uv.y2 = (GLfloat)(texture->y + height) / found->size;
+	shelf->x += w;
+	shelf->used++;
+	found->used++;
+	return true;
+}
+
+void
+tw_egl_atlas_free(struct tw_egl_render_context *ctx,
+                  struct tw_egl_render_texture *texture)
+{
+	struct tw_egl_atlas *atlas = texture->atlas, *other;
+	struct tw_egl_atlas_shelf *shelves, *shelf;
+	unsigned n;
+
+	if (!atlas)
+		return;
+	shelves = atlas_shelves(atlas, &n);
+	shelf = &shelves[texture->shelf];
+	texture->atlas = NULL;
+	texture->gltex = 0;
+
+	if (--shelf->used == 0)
+		shelf->x = 0;
+	//give the trailing empty shelves back for any height
+	while (n && !shelves[n-1].used)
+		n--;
+	atlas->shelves.size = n * sizeof(struct tw_egl_atlas_shelf);
+
+	//keep one empty atlas around for the next popup
+	if (--atlas->used)
+		return;
+	wl_list_for_each(other, &ctx->atlases, link) {
+		if (other != atlas && other->glfmt == atlas->glfmt) {
+			atlas_destroy(ctx, atlas);
+			return;
+		}
+	}
+}
+
+void
+tw_egl_render_context_fini_atlas(struct tw_egl_render_context *ctx)
+{
+	struct tw_egl_atlas *atlas, *tmp;
+
+	wl_list_for_each_safe(atlas, tmp, &ctx->atlases, link)
+		atlas_destroy(ctx, atlas);
+}
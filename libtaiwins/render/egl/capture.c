@@ -0,0 +1,325 @@
+/*
+ * capture.c - taiwins egl output readback
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <GLES3/gl3.h>
+#include <GLES2/gl2ext.h>
+#include <drm_fourcc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pixman.h>
+#include <wayland-server.h>
+#include <taiwins/objects/logger.h>
+#include <taiwins/render_output.h>
+
+#include "internal.h"
+
+/* beyond this many rectangles, we read the extents in one go */
+#define CAPTURE_MAX_RECTS 16
+
+/**
+ * @brief a readback in flight, the pixels are packed in a PBO bottom-up with
+ * the row length of the capture, so every rectangle lands at its place.
+ *
+ * For dmabuf targets, the frame is blitted into a renderbuffer wrapping the
+ * imported dmabuf, nothing comes back to the CPU.
+ */
+struct tw_egl_readback {
+	GLuint pbo;
+	GLsync fence;
+
+	EGLImageKHR image;
+	GLuint rbo, fbo;
+};
+
+static inline GLenum
+capture_gl_format(struct tw_egl_render_context *ctx)
+{
+	return ctx->read_bgra ? GL_BGRA_EXT : GL_RGBA;
+}
+
+static inline const pixman_box32_t *
+capture_boxes(struct tw_render_capture *capture, int *n)
+{
+	const pixman_box32_t *boxes =
+		pixman_region32_rectangles(&capture->region, n);
+
+	if (*n > CAPTURE_MAX_RECTS) {
+		*n = 1;
+		return pixman_region32_extents(&capture->region);
+	}
+	return boxes;
+}
+
+/* copy the rows of the boxes from a bottom-up image to capture */
+static void
+capture_copy_boxes(struct tw_render_capture *capture, const uint8_t *src,
+                   uint32_t src_stride)
+{
+	int n;
+	const pixman_box32_t *boxes = capture_boxes(capture, &n);
+	uint8_t *dst = capture->pixels;
+
+	for (int i = 0; i < n; i++) {
+		size_t len = (boxes[i].x2 - boxes[i].x1) * 4;
+
+		for (int y = boxes[i].y1; y < boxes[i].y2; y++)
+			memcpy(dst + (size_t)y * capture->stride +
+			       boxes[i].x1 * 4,
+			       src + (size_t)(capture->height - 1 - y) *
+			       src_stride + boxes[i].x1 * 4, len);
+	}
+}
+
+/* the GL row of the bottom of a capture row, the framebuffer is bottom-up */
+static inline GLint
+capture_gl_y(struct tw_render_capture *capture, int32_t y)
+{
+	return capture->output_height - (capture->y + y);
+}
+
+/* GLES2 fallback, read every box right away */
+static int
+capture_read_sync(struct tw_egl_render_context *ctx,
+                  struct tw_render_capture *capture)
+{
+	int n;
+	const pixman_box32_t *boxes = capture_boxes(capture, &n);
+	uint8_t *dst = capture->pixels;
+	uint8_t *row = malloc(capture->width * 4);
+
+	if (!row)
+		return -1;
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	for (int i = 0; i < n; i++) {
+		int w = boxes[i].x2 - boxes[i].x1;
+
+		//reading row by row flips the image for free
+		for (int y = boxes[i].y1; y < boxes[i].y2; y++) {
+			glReadPixels(capture->x + boxes[i].x1,
+			             capture_gl_y(capture, y + 1),
+			             w, 1, capture_gl_format(ctx),
+			             GL_UNSIGNED_BYTE, row);
+			memcpy(dst + (size_t)y * capture->stride +
+			       boxes[i].x1 * 4, row, w * 4);
+		}
+	}
+	free(row);
+	return glGetError() == GL_NO_ERROR ? 1 : -1;
+}
+
+/* blit the boxes into the dmabuf, flipping them to top-down */
+static bool
+capture_blit_dmabuf(struct tw_egl_render_context *ctx,
+                    struct tw_render_capture *capture,
+                    struct tw_egl_readback *readback)
+{
+	int n;
+	const pixman_box32_t *boxes;
+
+	readback->image = tw_egl_import_dmabuf_image(&ctx->egl,
+	                                             capture->dmabuf, NULL);
+	if (readback->image == EGL_NO_IMAGE_KHR)
+		return false;
+	glGenRenderbuffers(1, &readback->rbo);
+	glBindRenderbuffer(GL_RENDERBUFFER, readback->rbo);
+	ctx->funcs.image_target_renderbuffer(GL_RENDERBUFFER,
+	                                     readback->image);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glGenFramebuffers(1, &readback->fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, readback->fbo);
+	glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+	                          GL_RENDERBUFFER, readback->rbo);
+	if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) !=
+	    GL_FRAMEBUFFER_COMPLETE) {
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		return false;
+	}
+	boxes = capture_boxes(capture, &n);
+	for (int i = 0; i < n; i++)
+		glBlitFramebuffer(capture->x + boxes[i].x1,
+		                  capture_gl_y(capture, boxes[i].y2),
+		                  capture->x + boxes[i].x2,
+		                  capture_gl_y(capture, boxes[i].y1),
+		                  boxes[i].x1, boxes[i].y2,
+		                  boxes[i].x2, boxes[i].y1,
+		                  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	return true;
+}
+
+/* read the boxes into a PBO */
+static bool
+capture_read_pbo(struct tw_egl_render_context *ctx,
+                 struct tw_render_capture *capture,
+                 struct tw_egl_readback *readback)
+{
+	size_t size = (size_t)capture->width * capture->height * 4;
+	const pixman_box32_t *boxes;
+	int n;
+
+	glGenBuffers(1, &readback->pbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo);
+	glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glPixelStorei(GL_PACK_ROW_LENGTH, capture->width);
+
+	boxes = capture_boxes(capture, &n);
+	for (int i = 0; i < n; i++) {
+		GLint y = capture->height - boxes[i].y2;
+		size_t offset = ((size_t)y * capture->width + boxes[i].x1) * 4;
+
+		glReadPixels(capture->x + boxes[i].x1,
+		             capture_gl_y(capture, boxes[i].y2),
+		             boxes[i].x2 - boxes[i].x1,
+		             boxes[i].y2 - boxes[i].y1,
+		             capture_gl_format(ctx), GL_UNSIGNED_BYTE,
+		             (void *)offset);
+	}
+	glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return true;
+}
+
+int
+tw_egl_render_context_capture_begin(struct tw_render_context *base,
+                                    struct tw_render_capture *capture)
+{
+	struct tw_egl_render_context *ctx = wl_container_of(base, ctx, base);
+	struct tw_egl_readback *readback;
+	bool ret;
+
+	if (!pixman_region32_not_empty(&capture->region))
+		return 1;
+	if (!capture->pixels && !ctx->funcs.image_target_renderbuffer)
+		return -1;
+	if (!ctx->funcs.fence_sync)
+		return capture->pixels ? capture_read_sync(ctx, capture) : -1;
+	if (!(readback = calloc(1, sizeof(*readback))))
+		return -1;
+	capture->handle = (intptr_t)readback;
+
+	TW_GLES_DEBUG_PUSH(ctx);
+	ret = capture->pixels ? capture_read_pbo(ctx, capture, readback) :
+		capture_blit_dmabuf(ctx, capture, readback);
+	if (ret) {
+		readback->fence =
+			ctx->funcs.fence_sync(GL_SYNC_GPU_COMMANDS_COMPLETE,
+			                      0);
+		//make sure the fence gets to the GPU, otherwise polling
+		//never ends
+		glFlush();
+	}
+	TW_GLES_DEBUG_POP(ctx);
+
+	if (!readback->fence) {
+		tw_egl_render_context_capture_release(base, capture);
+		return -1;
+	}
+	return 0;
+}
+
+int
+tw_egl_render_context_capture_poll(struct tw_render_context *base,
+                                   struct tw_render_capture *capture,
+                                   bool wait)
+{
+	struct tw_egl_render_context *ctx = wl_container_of(base, ctx, base);
+	struct tw_egl_readback *readback = (void *)capture->handle;
+	size_t size = (size_t)capture->width * capture->height * 4;
+	GLenum status;
+	const void *data;
+
+	if (!readback)
+		return -1;
+	//we may come from a present without a current context
+	if (eglGetCurrentContext() != ctx->egl.context)
+		tw_egl_unset_current(&ctx->egl);
+
+	status = ctx->funcs.client_wait_sync(readback->fence,
+	                                     GL_SYNC_FLUSH_COMMANDS_BIT,
+	                                     wait ? GL_TIMEOUT_IGNORED : 0);
+	if (status == GL_TIMEOUT_EXPIRED)
+		return 0;
+	if (status == GL_WAIT_FAILED) {
+		tw_egl_render_context_capture_release(base, capture);
+		return -1;
+	}
+	//the blit is done, the dmabuf has it
+	if (!capture->pixels) {
+		tw_egl_render_context_capture_release(base, capture);
+		return 1;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo);
+	data = ctx->funcs.map_buffer_range(GL_PIXEL_PACK_BUFFER, 0, size,
+	                                   GL_MAP_READ_BIT);
+	if (data) {
+		capture_copy_boxes(capture, data, capture->width * 4);
+		ctx->funcs.unmap_buffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	tw_egl_render_context_capture_release(base, capture);
+	return data ? 1 : -1;
+}
+
+void
+tw_egl_render_context_capture_release(struct tw_render_context *base,
+                                      struct tw_render_capture *capture)
+{
+	struct tw_egl_render_context *ctx = wl_container_of(base, ctx, base);
+	struct tw_egl_readback *readback = (void *)capture->handle;
+
+	if (!readback)
+		return;
+	if (eglGetCurrentContext() != ctx->egl.context)
+		tw_egl_unset_current(&ctx->egl);
+	if (readback->fence)
+		ctx->funcs.delete_sync(readback->fence);
+	tw_egl_render_context_defer_delete(ctx, TW_EGL_GARBAGE_BUFFER,
+	                                   readback->pbo);
+	tw_egl_render_context_defer_delete(ctx, TW_EGL_GARBAGE_FRAMEBUFFER,
+	                                   readback->fbo);
+	tw_egl_render_context_defer_delete(ctx, TW_EGL_GARBAGE_RENDERBUFFER,
+	                                   readback->rbo);
+	tw_egl_render_context_defer_destroy_image(ctx, readback->image);
+	free(readback);
+	capture->handle = 0;
+}
+
+uint32_t
+tw_egl_render_context_capture_format(struct tw_render_context *base)
+{
+	struct tw_egl_render_context *ctx = wl_container_of(base, ctx, base);
+
+	return ctx->read_bgra ? WL_SHM_FORMAT_ARGB8888 :
+		WL_SHM_FORMAT_ABGR8888;
+}
+
+uint32_t
+tw_egl_render_context_capture_dmabuf_format(struct tw_render_context *base)
+{
+	struct tw_egl_render_context *ctx = wl_container_of(base, ctx, base);
+
+	//blitting needs GLES3 and renderbuffers from EGLImage
+	if (!ctx->funcs.fence_sync || !ctx->funcs.image_target_renderbuffer ||
+	    !ctx->egl.import_dmabuf)
+		return 0;
+	return DRM_FORMAT_XRGB8888;
+}
@@ -0,0 +1,201 @@
+/*
+ * garbage.c - taiwins egl deferred resource destruction
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <GLES3/gl3.h>
+#include <stdlib.h>
+#include <wayland-server.h>
+#include <taiwins/objects/logger.h>
+
+#include "internal.h"
+#include "utils.h"
+
+/**
+ * @brief GPU objects waiting to be deleted.
+ *
+ * Deleting a texture on its own costs a context switch in and out, doing it
+ * for every surface going away is expensive. The names are collected here
+ * and deleted with one call per kind on the next frame, when the context is
+ * current anyway. A timer bounds the latency if no frame comes, and a full
+ * queue is collected right away.
+ */
+
+static inline struct wl_array *
+garbage_array(struct tw_egl_render_context *ctx, enum tw_egl_garbage_type type)
+{
+	switch (type) {
+	case TW_EGL_GARBAGE_TEXTURE:
+		return &ctx->garbage.textures;
+	case TW_EGL_GARBAGE_BUFFER:
+		return &ctx->garbage.buffers;
+	case TW_EGL_GARBAGE_FRAMEBUFFER:
+		return &ctx->garbage.framebuffers;
+	case TW_EGL_GARBAGE_RENDERBUFFER:
+		return &ctx->garbage.renderbuffers;
+	}
+	return NULL;
+}
+
+static inline GLsizei
+garbage_count(struct wl_array *array, size_t size)
+{
+	return array->size / size;
+}
+
+static void
+garbage_flush(struct tw_egl_render_context *ctx)
+{
+	//a frame may be in progress, do not take the draw surface away
+	if (eglGetCurrentContext() != ctx->egl.context &&
+	    !tw_egl_unset_current(&ctx->egl))
+		return;
+	tw_egl_render_context_collect_garbage(ctx);
+}
+
+static int
+notify_garbage_timer(void *data)
+{
+	struct tw_egl_render_context *ctx = data;
+
+	garbage_flush(ctx);
+	return 0;
+}
+
+static void
+garbage_queued(struct tw_egl_render_context *ctx)
+{
+	if (++ctx->garbage.count >= TW_EGL_GARBAGE_MAX) {
+		garbage_flush(ctx);
+	} else if (ctx->garbage.count == 1 && ctx->garbage.timer) {
+		wl_event_source_timer_update(ctx->garbage.timer,
+		                             TW_EGL_GARBAGE_DELAY);
+	}
+}
+
+bool
+tw_egl_render_context_init_garbage(struct tw_egl_render_context *ctx,
+                                   struct wl_display *display)
+{
+	struct wl_event_loop *loop = wl_display_get_event_loop(display);
+
+	wl_array_init(&ctx->garbage.textures);
+	wl_array_init(&ctx->garbage.buffers);
+	wl_array_init(&ctx->garbage.framebuffers);
+	wl_array_init(&ctx->garbage.renderbuffers);
+	wl_array_init(&ctx->garbage.images);
+	ctx->garbage.count = 0;
+	ctx->garbage.timer = wl_event_loop_add_timer(loop, notify_garbage_timer,
+	                                             ctx);
+	return ctx->garbage.timer != NULL;
+}
+
+void
+tw_egl_render_context_fini_garbage(struct tw_egl_render_context *ctx)
+{
+	garbage_flush(ctx);
+	if (ctx->garbage.timer)
+		wl_event_source_remove(ctx->garbage.timer);
+	ctx->garbage.timer = NULL;
+	wl_array_release(&ctx->garbage.textures);
+	wl_array_release(&ctx->garbage.buffers);
+	wl_array_release(&ctx->garbage.framebuffers);
+	wl_array_release(&ctx->garbage.renderbuffers);
+	wl_array_release(&ctx->garbage.images);
+}
+
+void
+tw_egl_render_context_defer_delete(struct tw_egl_render_context *ctx,
+                                   enum tw_egl_garbage_type type, GLuint name)
+{
+	struct wl_array *array = garbage_array(ctx, type);
+	GLuint *slot;
+
+	if (!name)
+		return;
+	if (!(slot = wl_array_add(array, sizeof(name)))) {
+		tw_logl_level(TW_LOG_WARN, "failed to queue GL object %u", name);
+		return;
+	}
+	*slot = name;
+	garbage_queued(ctx);
+}
+
+void
+tw_egl_render_context_defer_destroy_image(struct tw_egl_render_context *ctx,
+                                          EGLImageKHR image)
+{
+	EGLImageKHR *slot;
+
+	if (image == EGL_NO_IMAGE_KHR)
+		return;
+	//images do not need a current context, we can always free it now
+	if (!(slot = wl_array_add(&ctx->garbage.images, sizeof(image)))) {
+		tw_egl_destroy_image(&ctx->egl, image);
+		return;
+	}
+	*slot = image;
+	garbage_queued(ctx);
+}
+
+void
+tw_egl_render_context_collect_garbage(struct tw_egl_render_context *ctx)
+{
+	struct wl_array *textures = &ctx->garbage.textures;
+	struct wl_array *buffers = &ctx->garbage.buffers;
+	struct wl_array *framebuffers = &ctx->garbage.framebuffers;
+	struct wl_array *renderbuffers = &ctx->garbage.renderbuffers;
+	EGLImageKHR *image;
+
+	if (!ctx->garbage.count)
+		return;
+	SCOPE_PROFILE_BEG();
+	TW_GLES_DEBUG_PUSH(ctx);
+
+	if (textures->size)
+		glDeleteTextures(garbage_count(textures, sizeof(GLuint)),
+		                 textures->data);
+	if (buffers->size)
+		glDeleteBuffers(garbage_count(buffers, sizeof(GLuint)),
+		                buffers->data);
+	if (framebuffers->size)
+		glDeleteFramebuffers(garbage_count(framebuffers,
+		                                   sizeof(GLuint)),
+		                     framebuffers->data);
+	if (renderbuffers->size)
+		glDeleteRenderbuffers(garbage_count(renderbuffers,
+		                                    sizeof(GLuint)),
+		                      renderbuffers->data);
+	//images go after the GL objects holding them
+	wl_array_for_each(image, &ctx->garbage.images)
+		tw_egl_destroy_image(&ctx->egl, *image);
+
+	TW_GLES_DEBUG_POP(ctx);
+	PROFILE_COUNTER("egl_garbage", ctx->garbage.count);
+
+	textures->size = 0;
+	buffers->size = 0;
+	framebuffers->size = 0;
+	renderbuffers->size = 0;
+	ctx->garbage.images.size = 0;
+	ctx->garbage.count = 0;
+	if (ctx->garbage.timer)
+		wl_event_source_timer_update(ctx->garbage.timer, 0);
+	SCOPE_PROFILE_END();
+}
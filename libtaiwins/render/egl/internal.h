@@ -25,8 +25,10 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <EGL/eglplatform.h>
+#include <GLES3/gl3.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
+#include <pthread.h>
 #include <taiwins/objects/egl.h>
 #include <taiwins/objects/surface.h>
 #include <taiwins/render_context_egl.h>
@@ -38,19 +40,113 @@
 extern "C" {
 #endif
 
+/* queued GL objects beyond this are deleted right away */
+#define TW_EGL_GARBAGE_MAX 128
+/* ms before queued GL objects are deleted if no frame comes */
+#define TW_EGL_GARBAGE_DELAY 200
+/* shm buffers up to this size on both sides go in an atlas */
+#define TW_EGL_ATLAS_MAX_SIZE 256
+/* size of an atlas texture, clamped to GL_MAX_TEXTURE_SIZE */
+#define TW_EGL_ATLAS_SIZE 1024
+/* pixels kept around every buffer in the atlas for linear filtering, the
+ * edges of the buffer are replicated into it */
+#define TW_EGL_ATLAS_GUTTER 1
+/* ms before committed shm content is uploaded if no frame comes */
+#define TW_EGL_UPLOAD_DELAY 16
+
+enum tw_egl_garbage_type {
+	TW_EGL_GARBAGE_TEXTURE,
+	TW_EGL_GARBAGE_BUFFER,
+	TW_EGL_GARBAGE_FRAMEBUFFER,
+	TW_EGL_GARBAGE_RENDERBUFFER,
+};
+
+/**
+ * @brief a texture shared by small shm buffers of the same format
+ */
+struct tw_egl_atlas {
+	struct wl_list link; /**< tw_egl_render_context:atlases */
+	GLuint gltex;
+	GLenum glfmt;
+	uint32_t size;
+	struct wl_array shelves; /**< struct tw_egl_atlas_shelf */
+	unsigned used; /**< buffers alive in the atlas */
+};
+
+/**
+ * @brief shm content written into a texture by the upload thread.
+ *
+ * The dispatch thread fills the job and hands it over in the queue, the
+ * upload thread only reads it and writes gltex, the texture itself is never
+ * touched outside the dispatch thread.
+ */
+struct tw_egl_upload_job {
+	struct wl_list link; /**< uploads.queue or uploads.done */
+	struct tw_egl_render_context *ctx;
+	struct tw_egl_render_texture *texture; /**< NULL once it is gone */
+	struct wl_resource *buffer; /**< NULL once it is gone */
+	struct wl_listener buffer_destroy;
+	struct wl_shm_buffer *shmbuf;
+	struct wl_shm_pool *pool; /**< held until the job is done */
+	GLuint gltex; /**< the back texture, created by the thread if 0 */
+	GLenum glfmt;
+	uint32_t width, height, stride;
+	pixman_region32_t region; /**< written, in buffer coordinates */
+	pixman_region32_t damage; /**< of the commits, the front misses it */
+	bool cancelled; /**< the buffer is gone, do not read it */
+	bool written; /**< the thread got to it before it was cancelled */
+	bool done; /**< gltex holds the content */
+};
+
 struct tw_egl_render_context {
 	struct tw_render_context base;
 	struct tw_egl egl;
 	struct wl_array pixel_formats;
 
 	struct wl_listener surface_created;
+	bool read_bgra; /**< glReadPixels supports GL_BGRA_EXT */
+
+	/** GPU objects waiting to be deleted in one batch */
+	struct {
+		struct wl_array textures, buffers; /**< GLuint */
+		struct wl_array framebuffers, renderbuffers; /**< GLuint */
+		struct wl_array images; /**< EGLImageKHR */
+		unsigned count;
+		struct wl_event_source *timer;
+	} garbage;
+	struct wl_list atlases; /**< struct tw_egl_atlas */
+
+	/** textures with shm content waiting for the next frame */
+	struct {
+		struct wl_list textures; /**< tw_egl_render_texture:pending */
+		struct wl_event_source *timer;
+
+		/* the upload thread, EGL_NO_CONTEXT if there is none */
+		EGLContext context;
+		pthread_t thread;
+		pthread_mutex_t lock;
+		pthread_cond_t queued, finished;
+		struct wl_list queue, done; /**< tw_egl_upload_job:link */
+		struct tw_egl_upload_job *active; /**< its buffer is read */
+		bool started, quit;
+		int fd; /**< eventfd, written for every finished job */
+		struct wl_event_source *source;
+	} uploads;
 
 	struct {
 		PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_get_texture2d_oes;
+		PFNGLEGLIMAGETARGETRENDERBUFFERSTORAGEOESPROC
+		image_target_renderbuffer;
 		PFNGLDEBUGMESSAGECALLBACKKHRPROC glDebugMessageCallbackKHR;
 		PFNGLDEBUGMESSAGECONTROLKHRPROC glDebugMessageControlKHR;
 		PFNGLPOPDEBUGGROUPKHRPROC glPopDebugGroupKHR;
 		PFNGLPUSHDEBUGGROUPKHRPROC glPushDebugGroupKHR;
+		/* GLES3 only, for asynchronous readback */
+		PFNGLFENCESYNCPROC fence_sync;
+		PFNGLCLIENTWAITSYNCPROC client_wait_sync;
+		PFNGLDELETESYNCPROC delete_sync;
+		PFNGLMAPBUFFERRANGEPROC map_buffer_range;
+		PFNGLUNMAPBUFFERPROC unmap_buffer;
 	} funcs;
 };
 
@@ -58,6 +154,101 @@ bool
 tw_egl_render_context_import_buffer(struct tw_event_buffer_uploading *event,
                                     void *callback);
 
+int
+tw_egl_render_context_capture_begin(struct tw_render_context *base,
+                                    struct tw_render_capture *capture);
+int
+tw_egl_render_context_capture_poll(struct tw_render_context *base,
+                                   struct tw_render_capture *capture,
+                                   bool wait);
+void
+tw_egl_render_context_capture_release(struct tw_render_context *base,
+                                      struct tw_render_capture *capture);
+uint32_t
+tw_egl_render_context_capture_format(struct tw_render_context *base);
+uint32_t
+tw_egl_render_context_capture_dmabuf_format(struct tw_render_context *base);
+
+bool
+tw_egl_render_context_init_garbage(struct tw_egl_render_context *ctx,
+                                   struct wl_display *display);
+void
+tw_egl_render_context_fini_garbage(struct tw_egl_render_context *ctx);
+
+/**
+ * @brief queue a GL object for deletion, it is deleted on the next frame or
+ * after TW_EGL_GARBAGE_DELAY at the latest.
+ */
+void
+tw_egl_render_context_defer_delete(struct tw_egl_render_context *ctx,
+                                   enum tw_egl_garbage_type type, GLuint name);
+void
+tw_egl_render_context_defer_destroy_image(struct tw_egl_render_context *ctx,
+                                          EGLImageKHR image);
+/**
+ * @brief delete every queued object, the context has to be current.
+ */
+void
+tw_egl_render_context_collect_garbage(struct tw_egl_render_context *ctx);
+
+/**
+ * @brief place the texture of a small buffer in an atlas, the context has to
+ * be current. Return false if the buffer does not fit in any atlas.
+ */
+bool
+tw_egl_atlas_alloc(struct tw_egl_render_context *ctx,
+                   struct tw_egl_render_texture *texture, GLenum glfmt,
+                   uint32_t width, uint32_t height);
+void
+tw_egl_atlas_free(struct tw_egl_render_context *ctx,
+                  struct tw_egl_render_texture *texture);
+void
+tw_egl_render_context_fini_atlas(struct tw_egl_render_context *ctx);
+
+bool
+tw_egl_render_context_init_uploads(struct tw_egl_render_context *ctx,
+                                   struct wl_display *display);
+void
+tw_egl_render_context_fini_uploads(struct tw_egl_render_context *ctx);
+
+/**
+ * @brief start the upload thread, false if there is none, then the textures
+ * are uploaded on the dispatch thread.
+ */
+bool
+tw_egl_render_context_init_upload_thread(struct tw_egl_render_context *ctx,
+                                         struct wl_display *display);
+void
+tw_egl_render_context_fini_upload_thread(struct tw_egl_render_context *ctx);
+
+static inline bool
+tw_egl_render_context_has_upload_thread(struct tw_egl_render_context *ctx)
+{
+	return ctx->uploads.context != EGL_NO_CONTEXT;
+}
+
+/**
+ * @brief queue the pending buffer of a dedicated shm texture on the upload
+ * thread, it is written into the back texture then swapped with gltex. The
+ * buffer stays pending while another upload of the texture is in flight.
+ */
+void
+tw_egl_upload_submit(struct tw_egl_render_context *ctx,
+                     struct tw_egl_render_texture *texture, GLenum glfmt);
+/**
+ * @brief the texture is going away, its upload in flight is dropped once it
+ * finishes.
+ */
+void
+tw_egl_upload_detach(struct tw_egl_render_context *ctx,
+                     struct tw_egl_render_texture *texture);
+/**
+ * @brief upload the shm content committed since last frame, the context has
+ * to be current.
+ */
+void
+tw_egl_render_context_flush_uploads(struct tw_egl_render_context *ctx);
+
 void
 tw_gles_debug_push(struct tw_egl_render_context *ctx, const char *func);
 
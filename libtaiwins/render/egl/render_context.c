@@ -27,6 +27,7 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pixman.h>
 #include <wayland-server.h>
 #include <taiwins/objects/utils.h>
@@ -81,10 +82,19 @@ make_egl_surface_current(struct tw_render_presentable *surf,
 	return tw_egl_buffer_age(&ctx->egl, (EGLSurface)surf->handle);
 }
 
+static int
+export_egl_surface_fence(struct tw_render_presentable *surf,
+                         struct tw_render_context *base)
+{
+	struct tw_egl_render_context *ctx = wl_container_of(base, ctx, base);
+	return tw_egl_create_fence_fd(&ctx->egl);
+}
+
 static const struct tw_render_presentable_impl eglsurface_impl = {
 	.destroy = handle_egl_surface_destroy,
 	.commit = commit_egl_surface,
 	.make_current = make_egl_surface_current,
+	.export_fence = export_egl_surface_fence,
 };
 
 /******************************************************************************
@@ -139,9 +149,32 @@ new_pbuffer_surface(struct tw_render_presentable *surf,
 }
 
 
+static void
+collect_garbage(struct tw_render_context *base)
+{
+	struct tw_egl_render_context *ctx = wl_container_of(base, ctx, base);
+
+	tw_egl_render_context_collect_garbage(ctx);
+}
+
+static void
+flush_uploads(struct tw_render_context *base)
+{
+	struct tw_egl_render_context *ctx = wl_container_of(base, ctx, base);
+
+	tw_egl_render_context_flush_uploads(ctx);
+}
+
 static const struct tw_render_context_impl egl_context_impl = {
 	.new_offscreen_surface = new_pbuffer_surface,
 	.new_window_surface = new_window_surface,
+	.capture_begin = tw_egl_render_context_capture_begin,
+	.capture_poll = tw_egl_render_context_capture_poll,
+	.capture_release = tw_egl_render_context_capture_release,
+	.capture_format = tw_egl_render_context_capture_format,
+	.capture_dmabuf_format = tw_egl_render_context_capture_dmabuf_format,
+	.collect_garbage = collect_garbage,
+	.flush_uploads = flush_uploads,
 };
 
 /******************************************************************************
@@ -174,14 +207,16 @@ notify_context_display_destroy(struct wl_listener *listener, void *display)
 
 	wl_signal_emit(&ctx->base.signals.destroy, &ctx->base);
 
+	tw_egl_render_context_fini_uploads(ctx);
+	tw_egl_render_context_fini_atlas(ctx);
+	tw_egl_render_context_fini_garbage(ctx);
 	tw_egl_fini(&ctx->egl);
 	wl_array_release(&ctx->pixel_formats);
 	wl_list_remove(&ctx->base.display_destroy.link);
 
 	wl_list_for_each_safe(pipeline, tmp, &ctx->base.pipelines, link)
 		tw_render_pipeline_destroy(pipeline);
-	tw_linux_dmabuf_fini(&ctx->base.dma_manager);
-	tw_compositor_fini(&ctx->base.compositor_manager);
+	tw_render_context_fini(&ctx->base);
 
 	free(ctx);
 }
@@ -287,7 +322,23 @@ init_gles_externsions(struct tw_egl_render_context *ctx)
 	} else {
 		ctx->funcs.image_get_texture2d_oes =
 			get_glproc("glEGLImageTargetTexture2DOES");
+		ctx->funcs.image_target_renderbuffer =
+			get_glproc("glEGLImageTargetRenderbufferStorageOES");
+	}
+	//PBO readback needs GLES3, otherwise we read synchronously
+	if (!strncmp((const char *)glGetString(GL_VERSION), "OpenGL ES 3",
+	             strlen("OpenGL ES 3"))) {
+		ctx->funcs.fence_sync = get_glproc("glFenceSync");
+		ctx->funcs.client_wait_sync = get_glproc("glClientWaitSync");
+		ctx->funcs.delete_sync = get_glproc("glDeleteSync");
+		ctx->funcs.map_buffer_range = get_glproc("glMapBufferRange");
+		ctx->funcs.unmap_buffer = get_glproc("glUnmapBuffer");
+		if (!ctx->funcs.client_wait_sync || !ctx->funcs.delete_sync ||
+		    !ctx->funcs.map_buffer_range || !ctx->funcs.unmap_buffer)
+			ctx->funcs.fence_sync = NULL;
 	}
+	ctx->read_bgra = tw_egl_check_gl_ext(&ctx->egl,
+	                                     "GL_EXT_read_format_bgra");
 	if (tw_egl_check_gl_ext(&ctx->egl, "GL_KHR_debug")) {
 		ctx->funcs.glDebugMessageCallbackKHR =
 			get_glproc("glDebugMessageCallbackKHR");
@@ -339,6 +390,11 @@ tw_render_context_create_egl(struct wl_display *display,
 	if (!tw_render_context_init(&ctx->base, display, TW_RENDERER_EGL,
 	                            &egl_context_impl))
 		goto err_init_base;
+	if (!tw_egl_render_context_init_garbage(ctx, display))
+		goto err_init_garbage;
+	if (!tw_egl_render_context_init_uploads(ctx, display))
+		goto err_init_uploads;
+	wl_list_init(&ctx->atlases);
 
 	init_context_formats(ctx);
 	tw_egl_bind_wl_display(&ctx->egl, display);
@@ -350,6 +406,11 @@ tw_render_context_create_egl(struct wl_display *display,
 	                         &ctx->surface_created,
 	                         notify_context_surface_created);
 	return &ctx->base;
+err_init_uploads:
+	tw_egl_render_context_fini_uploads(ctx);
+err_init_garbage:
+	tw_egl_render_context_fini_garbage(ctx);
+	tw_render_context_fini(&ctx->base);
 err_init_base:
 err_init_egl:
 	free(ctx);
@@ -41,9 +41,11 @@
 #include <taiwins/objects/egl.h>
 #include <taiwins/objects/utils.h>
 #include <taiwins/objects/surface.h>
+#include <taiwins/objects/subsurface.h>
 #include <taiwins/render_context.h>
 
 #include "internal.h"
+#include "utils.h"
 
 static inline bool
 wl_format_supported(struct tw_egl_render_context *ctx,
@@ -95,6 +97,36 @@ wl_format_has_alpha(enum wl_shm_format format)
  * texture import
  *****************************************************************************/
 
+/* replicate the edges of a buffer in an atlas into its gutter, so linear
+ * filtering on the border samples the buffer instead of its neighbours. The
+ * unpack row length has to be set */
+static void
+texture_fill_gutter(struct tw_egl_render_texture *texture, GLenum glfmt,
+                    uint32_t width, uint32_t height, const void *data)
+{
+	for (int dy = -1; dy <= 1; dy++) {
+		for (int dx = -1; dx <= 1; dx++) {
+			if (!dx && !dy)
+				continue;
+			glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT,
+			              dx > 0 ? width - 1 : 0);
+			glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT,
+			              dy > 0 ? height - 1 : 0);
+			glTexSubImage2D(texture->target, 0,
+			                dx < 0 ? texture->x - 1 :
+			                dx > 0 ? texture->x + width :
+			                texture->x,
+			                dy < 0 ? texture->y - 1 :
+			                dy > 0 ? texture->y + height :
+			                texture->y,
+			                dx ? 1 : width, dy ? 1 : height,
+			                glfmt, GL_UNSIGNED_BYTE, data);
+		}
+	}
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
+}
+
 static bool
 texture_init_pixels(struct tw_egl_render_texture *texture,
                     struct tw_egl_render_context *ctx,
@@ -124,13 +156,22 @@ texture_init_pixels(struct tw_egl_render_texture *texture,
 	TW_GLES_DEBUG_PUSH(ctx);
 
 	wl_shm_buffer_begin_access(buffer);
-	glGenTextures(1, &texture->gltex);
-	glBindTexture(texture->target, texture->gltex);
 	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, stride / 4);
-	glTexImage2D(texture->target, 0, glfmt,
-	             width, height, 0, glfmt,
-	             GL_UNSIGNED_BYTE,
-	             wl_shm_buffer_get_data(buffer));
+	if (tw_egl_atlas_alloc(ctx, texture, glfmt, width, height)) {
+		glBindTexture(texture->target, texture->gltex);
+		glTexSubImage2D(texture->target, 0, texture->x, texture->y,
+		                width, height, glfmt, GL_UNSIGNED_BYTE,
+		                wl_shm_buffer_get_data(buffer));
+		texture_fill_gutter(texture, glfmt, width, height,
+		                    wl_shm_buffer_get_data(buffer));
+	} else {
+		glGenTextures(1, &texture->gltex);
+		glBindTexture(texture->target, texture->gltex);
+		glTexImage2D(texture->target, 0, glfmt,
+		             width, height, 0, glfmt,
+		             GL_UNSIGNED_BYTE,
+		             wl_shm_buffer_get_data(buffer));
+	}
 	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
 	glBindTexture(texture->target, 0);
 	wl_shm_buffer_end_access(buffer);
@@ -257,49 +298,61 @@ texture_init_dma(struct tw_egl_render_texture *texture,
 	return true;
 }
 
+/* upload the damaged part of the buffer, the context has to be current */
 static bool
 texture_update_pixels(struct tw_egl_render_texture *texture,
                       struct tw_egl_render_context *ctx,
                       struct wl_shm_buffer *buffer,
-                      uint32_t src_x, uint32_t src_y,
-                      uint32_t dst_x, uint32_t dst_y,
-                      uint32_t width, uint32_t height)
+                      pixman_region32_t *damage)
 {
 	uint32_t stride;
 	enum wl_shm_format format;
 	GLuint glfmt;
-
-	tw_egl_make_current(&ctx->egl, EGL_NO_SURFACE);
+	pixman_box32_t *rects, *extents;
+	int n;
 
 	format = wl_shm_buffer_get_format(buffer);
 	stride = wl_shm_buffer_get_stride(buffer);
 	if (!wl_format_supported(ctx, format))
 		return false;
 	glfmt = wl_format_to_gl_format(format);
+	rects = pixman_region32_rectangles(damage, &n);
 
 	TW_GLES_DEBUG_PUSH(ctx);
 
 	wl_shm_buffer_begin_access(buffer);
 	glBindTexture(texture->target, texture->gltex);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, stride / 4);
 
-	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, stride / 4);;
-	glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, src_x);
-	glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, src_y);
-
-	glTexSubImage2D(texture->target, 0, dst_x, dst_y, width, height,
-	                glfmt, GL_UNSIGNED_BYTE,
-	                wl_shm_buffer_get_data(buffer));
+	for (int i = 0; i < n; i++) {
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, rects[i].x1);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, rects[i].y1);
+		//buffers in an atlas are offset in the texture
+		glTexSubImage2D(texture->target, 0,
+		                texture->x + rects[i].x1,
+		                texture->y + rects[i].y1,
+		                rects[i].x2 - rects[i].x1,
+		                rects[i].y2 - rects[i].y1,
+		                glfmt, GL_UNSIGNED_BYTE,
+		                wl_shm_buffer_get_data(buffer));
+	}
+	//the damage reaches the edges, the gutter is stale
+	extents = pixman_region32_extents(damage);
+	if (texture->atlas && n &&
+	    (extents->x1 <= 0 || extents->y1 <= 0 ||
+	     extents->x2 >= (int)texture->base.width ||
+	     extents->y2 >= (int)texture->base.height))
+		texture_fill_gutter(texture, glfmt, texture->base.width,
+		                    texture->base.height,
+		                    wl_shm_buffer_get_data(buffer));
 
 	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
 	glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
 	glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
-
 	glBindTexture(texture->target, 0);
 	wl_shm_buffer_end_access(buffer);
 
 	TW_GLES_DEBUG_POP(ctx);
-
-	tw_egl_unset_current(&ctx->egl);
 	return true;
 }
 
@@ -330,6 +383,10 @@ tw_egl_render_texture_init(struct tw_egl_render_texture *texture,
 	is_shm = wl_shm_buffer_get(buffer) != NULL;
 	is_wl_drm = wl_buffer_is_drm_texture(&ctx->egl, buffer);
 	is_dma = tw_is_wl_buffer_dmabuf(buffer);
+	texture->uv.x1 = 0.0f;
+	texture->uv.y1 = 0.0f;
+	texture->uv.x2 = 1.0f;
+	texture->uv.y2 = 1.0f;
 
         if (!ctx->funcs.image_get_texture2d_oes && (is_wl_drm || is_dma))
 		return false;
@@ -348,42 +405,186 @@ tw_egl_render_texture_init(struct tw_egl_render_texture *texture,
         return true;
 }
 
+/******************************************************************************
+ * deferred upload
+ *****************************************************************************/
+
+/**
+ * Shm buffers committed to an existing texture are not uploaded in the
+ * commit. The texture keeps the buffer and the damage until the next frame,
+ * where every pending texture is uploaded in one go with the context already
+ * current. A client committing a few times within a frame costs one upload
+ * and the dispatch of its requests does not wait for the copies. The buffer
+ * is released after the upload, or when a newer buffer replaces it since the
+ * newer one holds the whole content. A timer bounds the wait if no frame
+ * comes. Textures not in an atlas go to the upload thread instead if there is
+ * one, see upload.c, unless the surface is in a subsurface tree. The tree is
+ * drawn with the content committed for all of it in the same frame.
+ */
+
+static void
+texture_cancel_upload(struct tw_egl_render_texture *texture, bool release)
+{
+	if (texture->pending.buffer) {
+		if (release)
+			wl_buffer_send_release(texture->pending.buffer);
+		tw_reset_wl_list(&texture->pending.buffer_destroy.link);
+		texture->pending.buffer = NULL;
+	}
+	tw_reset_wl_list(&texture->pending.link);
+	pixman_region32_clear(&texture->pending.damage);
+}
+
+static void
+texture_flush_upload(struct tw_egl_render_texture *texture,
+                     struct tw_egl_render_context *ctx)
+{
+	struct wl_shm_buffer *shmbuf = texture->pending.buffer ?
+		wl_shm_buffer_get(texture->pending.buffer) : NULL;
+
+	if (shmbuf && !texture_update_pixels(texture, ctx, shmbuf,
+	                                     &texture->pending.damage))
+		tw_logl_level(TW_LOG_WARN, "failed to upload the buffer");
+	//the back texture of the upload thread misses it as well
+	if (texture->back.gltex)
+		pixman_region32_union(&texture->back.stale,
+		                      &texture->back.stale,
+		                      &texture->pending.damage);
+	texture_cancel_upload(texture, true);
+}
+
 static bool
-tw_egl_render_texture_update(struct tw_egl_render_texture *texture,
-                             struct tw_egl_render_context *ctx,
-                             struct wl_resource *wl_buffer,
-                             pixman_region32_t *update_damage,
-                             struct tw_surface_buffer *buffer)
+texture_upload_async(struct tw_egl_render_texture *texture,
+                     struct tw_egl_render_context *ctx)
 {
-	bool ret = true;
-	pixman_region32_t all_damage, *damages;
-	int n;
-	pixman_box32_t *rects, *r;
-	struct wl_shm_buffer *shmbuf = wl_shm_buffer_get(wl_buffer);
+	struct tw_surface *surface = texture->surface;
 
-	if (!shm_buffer_compatible(shmbuf, buffer))
+	if (!tw_egl_render_context_has_upload_thread(ctx) || texture->atlas)
 		return false;
+	//a job in flight takes the next commit after it
+	else if (texture->back.job)
+		return true;
+	return surface && !tw_surface_is_subsurface(surface, true) &&
+		wl_list_empty(&surface->subsurfaces);
+}
 
-	//copy data
-	pixman_region32_init_rect(&all_damage, 0, 0,
-	                          buffer->width, buffer->height);
-	wl_shm_buffer_begin_access(shmbuf);
-	damages = (update_damage) ? update_damage : &all_damage;
-	rects = pixman_region32_rectangles(damages, &n);
-	for (int i = 0; i < n; i++) {
-		r = &rects[i];
-		if (!texture_update_pixels(texture, ctx, shmbuf,
-		                           r->x1, r->y1,
-		                           r->x1, r->y1,
-		                           r->x2-r->x1, r->y2-r->y1)) {
-			ret = false;
-			goto out;
-		}
+static void
+notify_texture_pending_buffer_destroy(struct wl_listener *listener,
+                                      void *data)
+{
+	struct tw_egl_render_texture *texture =
+		wl_container_of(listener, texture, pending.buffer_destroy);
+
+	//the content is gone, the texture keeps what it has
+	texture_cancel_upload(texture, false);
+}
+
+static bool
+texture_defer_update(struct tw_egl_render_texture *texture,
+                     struct tw_egl_render_context *ctx,
+                     struct tw_event_buffer_uploading *event)
+{
+	struct tw_surface_buffer *buffer = event->buffer;
+	struct wl_shm_buffer *shmbuf = wl_shm_buffer_get(event->wl_buffer);
+	pixman_region32_t *damage = &texture->pending.damage;
+	pixman_box32_t *rects;
+	int n;
+
+	if (!shm_buffer_compatible(shmbuf, buffer) ||
+	    !wl_format_supported(ctx, buffer->format))
+		return false;
+	if (texture->pending.buffer != event->wl_buffer) {
+		//the damage stays, the new buffer has all of it
+		if (texture->pending.buffer)
+			wl_buffer_send_release(texture->pending.buffer);
+		tw_reset_wl_list(&texture->pending.buffer_destroy.link);
+		texture->pending.buffer = event->wl_buffer;
+		texture->pending.buffer_destroy.notify =
+			notify_texture_pending_buffer_destroy;
+		wl_resource_add_destroy_listener(event->wl_buffer,
+		                                 &texture->pending.buffer_destroy);
 	}
-out:
-	wl_shm_buffer_end_access(shmbuf);
-	pixman_region32_fini(&all_damage);
-	return ret;
+	if (event->damages)
+		pixman_region32_union(damage, damage, event->damages);
+	else
+		pixman_region32_union_rect(damage, damage, 0, 0,
+		                           buffer->width, buffer->height);
+	pixman_region32_intersect_rect(damage, damage, 0, 0,
+	                               buffer->width, buffer->height);
+	if (texture_upload_async(texture, ctx)) {
+		tw_egl_upload_submit(ctx, texture,
+		                     wl_format_to_gl_format(buffer->format));
+	} else if (wl_list_empty(&texture->pending.link)) {
+		wl_list_insert(ctx->uploads.textures.prev,
+		               &texture->pending.link);
+		wl_event_source_timer_update(ctx->uploads.timer,
+		                             TW_EGL_UPLOAD_DELAY);
+	}
+	//the stats count what the client asked for
+	rects = pixman_region32_rectangles(event->damages ?
+	                                   event->damages : damage, &n);
+	for (int i = 0; i < n; i++)
+		event->uploaded += (size_t)(rects[i].x2 - rects[i].x1) *
+			(rects[i].y2 - rects[i].y1) * 4;
+	event->deferred = true;
+	return true;
+}
+
+static int
+notify_uploads_timer(void *data)
+{
+	struct tw_egl_render_context *ctx = data;
+
+	//a frame may be in progress, do not take the draw surface away
+	if (eglGetCurrentContext() != ctx->egl.context &&
+	    !tw_egl_unset_current(&ctx->egl))
+		return 0;
+	tw_egl_render_context_flush_uploads(ctx);
+	return 0;
+}
+
+bool
+tw_egl_render_context_init_uploads(struct tw_egl_render_context *ctx,
+                                   struct wl_display *display)
+{
+	struct wl_event_loop *loop = wl_display_get_event_loop(display);
+
+	wl_list_init(&ctx->uploads.textures);
+	ctx->uploads.timer = wl_event_loop_add_timer(loop, notify_uploads_timer,
+	                                             ctx);
+	if (ctx->uploads.timer &&
+	    !tw_egl_render_context_init_upload_thread(ctx, display))
+		tw_logl("EGL: no upload thread, uploading on the main thread");
+	return ctx->uploads.timer != NULL;
+}
+
+void
+tw_egl_render_context_fini_uploads(struct tw_egl_render_context *ctx)
+{
+	struct tw_egl_render_texture *texture, *tmp;
+
+	tw_egl_render_context_fini_upload_thread(ctx);
+	wl_list_for_each_safe(texture, tmp, &ctx->uploads.textures,
+	                      pending.link)
+		texture_cancel_upload(texture, true);
+	if (ctx->uploads.timer)
+		wl_event_source_remove(ctx->uploads.timer);
+	ctx->uploads.timer = NULL;
+}
+
+void
+tw_egl_render_context_flush_uploads(struct tw_egl_render_context *ctx)
+{
+	struct tw_egl_render_texture *texture, *tmp;
+
+	if (wl_list_empty(&ctx->uploads.textures))
+		return;
+	SCOPE_PROFILE_BEG();
+	wl_list_for_each_safe(texture, tmp, &ctx->uploads.textures,
+	                      pending.link)
+		texture_flush_upload(texture, ctx);
+	wl_event_source_timer_update(ctx->uploads.timer, 0);
+	SCOPE_PROFILE_END();
 }
 
 /******************************************************************************
@@ -399,16 +600,18 @@ tw_egl_render_texture_destroy(struct tw_render_texture *texture,
 	struct tw_egl_render_texture *egl_texture =
 		wl_container_of(texture, egl_texture, base);
 
-	tw_egl_make_current(&ctx->egl, EGL_NO_SURFACE);
-
-        TW_GLES_DEBUG_PUSH(ctx);
-	glDeleteTextures(1, &egl_texture->gltex);
-	tw_egl_destroy_image(&ctx->egl, egl_texture->image);
-	TW_GLES_DEBUG_POP(ctx);
-
-	tw_egl_unset_current(&ctx->egl);
-
-        free(egl_texture);
+	texture_cancel_upload(egl_texture, true);
+	pixman_region32_fini(&egl_texture->pending.damage);
+	tw_egl_upload_detach(ctx, egl_texture);
+	pixman_region32_fini(&egl_texture->back.stale);
+	//the names are freed in batch when the context is current
+	if (egl_texture->atlas)
+		tw_egl_atlas_free(ctx, egl_texture);
+	else
+		tw_egl_render_context_defer_delete(ctx, TW_EGL_GARBAGE_TEXTURE,
+		                                   egl_texture->gltex);
+	tw_egl_render_context_defer_destroy_image(ctx, egl_texture->image);
+	free(egl_texture);
 }
 
 static struct tw_egl_render_texture *
@@ -424,6 +627,10 @@ tw_egl_render_texture_new(struct tw_render_context *base,
 		free(texture);
 		return NULL;
 	}
+	wl_list_init(&texture->pending.link);
+	wl_list_init(&texture->pending.buffer_destroy.link);
+	pixman_region32_init(&texture->pending.damage);
+	pixman_region32_init(&texture->back.stale);
 	texture->base.ctx = base;
 	texture->base.destroy = tw_egl_render_texture_destroy;
 	return texture;
@@ -456,20 +663,29 @@ tw_egl_render_context_import_buffer(struct tw_event_buffer_uploading *event,
 	struct tw_egl_render_texture *texture;
 	struct tw_egl_render_texture *old_texture = surface->buffer.handle.ptr;
 	struct tw_surface_buffer *buffer = event->buffer;
+	struct wl_shm_buffer *shmbuf;
 
 	if (!event->new_upload)
-		return tw_egl_render_texture_update(old_texture, ctx,
-		                                    event->wl_buffer,
-		                                    event->damages, buffer);
+		return texture_defer_update(old_texture, ctx, event);
+	//the buffer we hold is taken again, it is released as a new buffer
+	if (old_texture && old_texture->pending.buffer == event->wl_buffer)
+		texture_cancel_upload(old_texture, false);
 	texture = tw_egl_render_texture_new(&ctx->base, event->wl_buffer);
 	if (!texture) {
 		tw_logl_level(TW_LOG_WARN, "EE: failed to update the texture");
 		return false;
 	}
+	texture->surface = surface;
 	event->buffer->handle.ptr = &texture->base;
 	event->buffer->width = texture->base.width;
 	event->buffer->height = texture->base.height;
-
+	//other buffers are imported without copies
+	if ((shmbuf = wl_shm_buffer_get(event->wl_buffer))) {
+		event->buffer->format = wl_shm_buffer_get_format(shmbuf);
+		event->buffer->stride = wl_shm_buffer_get_stride(shmbuf);
+		event->uploaded = (size_t)wl_shm_buffer_get_stride(shmbuf) *
+			wl_shm_buffer_get_height(shmbuf);
+	}
 	if (old_texture)
 		tw_egl_render_texture_destroy(&old_texture->base, &ctx->base);
         tw_reset_wl_list(&buffer->surface_destroy_listener.link);
@@ -0,0 +1,418 @@
+/*
+ * upload.c - taiwins egl shm upload thread
+ *
+ * Copyright (c) 2021 Xichen Zhou
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <GLES3/gl3.h>
+#include <GLES2/gl2ext.h>
+#include <pixman.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <wayland-server.h>
+#include <taiwins/objects/logger.h>
+#include <taiwins/objects/utils.h>
+#include <taiwins/objects/surface.h>
+
+#include "internal.h"
+
+/**
+ * @brief the shm upload thread.
+ *
+ * Copying a large shm buffer into its texture stalls the dispatch of every
+ * client, whether it happens in the commit or at the start of a frame. The
+ * dedicated shm textures are written instead by a thread with its own EGL
+ * context, sharing the objects of the main one. The thread writes a back
+ * texture and waits on a fence, only then the dispatch thread swaps it with
+ * the texture drawn. A frame never samples a half written texture, and the
+ * commit shows up once its content is ready. The new back texture misses the
+ * damage of that upload, it is written along with the next one.
+ *
+ * Only updates of a texture go through the thread, a new or resized buffer
+ * is still uploaded in the commit so the surface never shows content of
+ * another size than its geometry. Surfaces in a subsurface tree keep the
+ * frame deferred upload as well, see texture.c.
+ *
+ * A buffer destroyed by its client is waited for if the thread is reading it
+ * right then, otherwise its job is cancelled. A texture going away leaves its
+ * job behind, the back texture is deleted once the job finishes.
+ */
+
+/******************************************************************************
+ * upload thread
+ *****************************************************************************/
+
+/* the only place the thread touches GL */
+static bool
+upload_job_write(struct tw_egl_upload_job *job)
+{
+	pixman_box32_t *rects;
+	int n;
+
+	wl_shm_buffer_begin_access(job->shmbuf);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, job->stride / 4);
+	if (!job->gltex) {
+		glGenTextures(1, &job->gltex);
+		glBindTexture(GL_TEXTURE_2D, job->gltex);
+		glTexImage2D(GL_TEXTURE_2D, 0, job->glfmt,
+		             job->width, job->height, 0, job->glfmt,
+		             GL_UNSIGNED_BYTE,
+		             wl_shm_buffer_get_data(job->shmbuf));
+	} else {
+		glBindTexture(GL_TEXTURE_2D, job->gltex);
+		rects = pixman_region32_rectangles(&job->region, &n);
+		for (int i = 0; i < n; i++) {
+			glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, rects[i].x1);
+			glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, rects[i].y1);
+			glTexSubImage2D(GL_TEXTURE_2D, 0,
+			                rects[i].x1, rects[i].y1,
+			                rects[i].x2 - rects[i].x1,
+			                rects[i].y2 - rects[i].y1,
+			                job->glfmt, GL_UNSIGNED_BYTE,
+			                wl_shm_buffer_get_data(job->shmbuf));
+		}
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
+	}
+	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	wl_shm_buffer_end_access(job->shmbuf);
+
+	return glGetError() == GL_NO_ERROR;
+}
+
+static void *
+upload_thread(void *data)
+{
+	struct tw_egl_render_context *ctx = data;
+	struct tw_egl_upload_job *job;
+	uint64_t done = 1;
+	bool current = eglMakeCurrent(ctx->egl.display, EGL_NO_SURFACE,
+	                              EGL_NO_SURFACE, ctx->uploads.context);
+
+	pthread_mutex_lock(&ctx->uploads.lock);
+	ctx->uploads.started = true;
+	ctx->uploads.quit = !current;
+	pthread_cond_broadcast(&ctx->uploads.finished);
+
+	while (!ctx->uploads.quit) {
+		if (wl_list_empty(&ctx->uploads.queue)) {
+			pthread_cond_wait(&ctx->uploads.queued,
+			                  &ctx->uploads.lock);
+			continue;
+		}
+		job = wl_container_of(ctx->uploads.queue.next, job, link);
+		wl_list_remove(&job->link);
+		if (!job->cancelled) {
+			job->written = true;
+			ctx->uploads.active = job;
+			pthread_mutex_unlock(&ctx->uploads.lock);
+			job->done = upload_job_write(job);
+			pthread_mutex_lock(&ctx->uploads.lock);
+			ctx->uploads.active = NULL;
+			pthread_cond_broadcast(&ctx->uploads.finished);
+			pthread_mutex_unlock(&ctx->uploads.lock);
+			//the buffer is copied, wait for the texture
+			job->done = job->done &&
+				tw_egl_wait_fence(&ctx->egl);
+			pthread_mutex_lock(&ctx->uploads.lock);
+		}
+		wl_list_insert(ctx->uploads.done.prev, &job->link);
+		if (write(ctx->uploads.fd, &done, sizeof(done)) !=
+		    sizeof(done))
+			tw_logl_level(TW_LOG_WARN, "failed to notify upload");
+	}
+	pthread_mutex_unlock(&ctx->uploads.lock);
+
+	if (current)
+		eglMakeCurrent(ctx->egl.display, EGL_NO_SURFACE,
+		               EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglReleaseThread();
+	return NULL;
+}
+
+/******************************************************************************
+ * jobs
+ *****************************************************************************/
+
+static void
+upload_job_destroy(struct tw_egl_upload_job *job)
+{
+	//a buffer submitted again is released by the next upload
+	if (job->buffer && (!job->texture ||
+	                    job->texture->pending.buffer != job->buffer))
+		wl_buffer_send_release(job->buffer);
+	if (job->buffer)
+		wl_list_remove(&job->buffer_destroy.link);
+	if (job->texture)
+		job->texture->back.job = NULL;
+	if (job->pool)
+		wl_shm_pool_unref(job->pool);
+	pixman_region32_fini(&job->region);
+	pixman_region32_fini(&job->damage);
+	free(job);
+}
+
+static void
+notify_upload_buffer_destroy(struct wl_listener *listener, void *data)
+{
+	struct tw_egl_upload_job *job =
+		wl_container_of(listener, job, buffer_destroy);
+	struct tw_egl_render_context *ctx = job->ctx;
+
+	pthread_mutex_lock(&ctx->uploads.lock);
+	//the thread may be copying it right now
+	while (ctx->uploads.active == job)
+		pthread_cond_wait(&ctx->uploads.finished, &ctx->uploads.lock);
+	job->cancelled = true;
+	pthread_mutex_unlock(&ctx->uploads.lock);
+
+	tw_reset_wl_list(&job->buffer_destroy.link);
+	job->buffer = NULL;
+}
+
+/* swap the back texture in, on the dispatch thread */
+static void
+upload_job_finish(struct tw_egl_render_context *ctx,
+                  struct tw_egl_upload_job *job)
+{
+	struct tw_egl_render_texture *texture = job->texture;
+	GLenum glfmt = job->glfmt;
+	GLuint front;
+
+	wl_list_remove(&job->link);
+	if (!texture) {
+		tw_egl_render_context_defer_delete(ctx, TW_EGL_GARBAGE_TEXTURE,
+		                                   job->gltex);
+	} else if (job->done) {
+		front = texture->gltex;
+		texture->gltex = job->gltex;
+		texture->back.gltex = front;
+		pixman_region32_copy(&texture->back.stale, &job->damage);
+	} else if (!job->written) {
+		//nothing written, the back misses all of it still
+		texture->back.gltex = job->gltex;
+		pixman_region32_union(&texture->back.stale,
+		                      &texture->back.stale, &job->region);
+	} else {
+		tw_logl_level(TW_LOG_WARN, "failed to upload the buffer");
+		tw_egl_render_context_defer_delete(ctx, TW_EGL_GARBAGE_TEXTURE,
+		                                   job->gltex);
+	}
+	upload_job_destroy(job);
+	if (!texture)
+		return;
+	//commits that came during the upload
+	if (texture->pending.buffer)
+		tw_egl_upload_submit(ctx, texture, glfmt);
+	if (texture->surface)
+		tw_surface_dirty_geometry(texture->surface);
+}
+
+static int
+notify_upload_done(int fd, uint32_t mask, void *data)
+{
+	struct tw_egl_render_context *ctx = data;
+	struct tw_egl_upload_job *job, *tmp;
+	struct wl_list done;
+	uint64_t count;
+
+	if (read(fd, &count, sizeof(count)) != sizeof(count))
+		return 0;
+	wl_list_init(&done);
+	pthread_mutex_lock(&ctx->uploads.lock);
+	wl_list_insert_list(&done, &ctx->uploads.done);
+	wl_list_init(&ctx->uploads.done);
+	pthread_mutex_unlock(&ctx->uploads.lock);
+
+	wl_list_for_each_safe(job, tmp, &done, link)
+		upload_job_finish(ctx, job);
+	return 0;
+}
+
+void
+tw_egl_upload_submit(struct tw_egl_render_context *ctx,
+                     struct tw_egl_render_texture *texture, GLenum glfmt)
+{
+	struct tw_egl_upload_job *job;
+	struct wl_resource *buffer = texture->pending.buffer;
+
+	if (!tw_egl_render_context_has_upload_thread(ctx) ||
+	    texture->back.job || !buffer)
+		return;
+	//the buffer stays pending, the next commit tries again
+	if (!(job = calloc(1, sizeof(*job)))) {
+		tw_logl_level(TW_LOG_WARN, "failed to queue the upload");
+		return;
+	}
+	job->ctx = ctx;
+	job->texture = texture;
+	job->buffer = buffer;
+	job->shmbuf = wl_shm_buffer_get(buffer);
+	//keep the memory around even if client destroys the pool
+	job->pool = wl_shm_buffer_ref_pool(job->shmbuf);
+	job->glfmt = glfmt;
+	job->width = texture->base.width;
+	job->height = texture->base.height;
+	job->stride = wl_shm_buffer_get_stride(job->shmbuf);
+	job->gltex = texture->back.gltex;
+	pixman_region32_init(&job->region);
+	pixman_region32_init(&job->damage);
+	pixman_region32_copy(&job->damage, &texture->pending.damage);
+	//a new back texture gets everything
+	if (job->gltex)
+		pixman_region32_union(&job->region, &texture->back.stale,
+		                      &texture->pending.damage);
+	else
+		pixman_region32_union_rect(&job->region, &job->region, 0, 0,
+		                           job->width, job->height);
+	texture->back.gltex = 0;
+	texture->back.job = job;
+	pixman_region32_clear(&texture->back.stale);
+
+	//the job holds the buffer now
+	tw_reset_wl_list(&texture->pending.buffer_destroy.link);
+	texture->pending.buffer = NULL;
+	pixman_region32_clear(&texture->pending.damage);
+	job->buffer_destroy.notify = notify_upload_buffer_destroy;
+	wl_resource_add_destroy_listener(buffer, &job->buffer_destroy);
+
+	pthread_mutex_lock(&ctx->uploads.lock);
+	wl_list_insert(ctx->uploads.queue.prev, &job->link);
+	pthread_cond_signal(&ctx->uploads.queued);
+	pthread_mutex_unlock(&ctx->uploads.lock);
+}
+
+void
+tw_egl_upload_detach(struct tw_egl_render_context *ctx,
+                     struct tw_egl_render_texture *texture)
+{
+	if (texture->back.job)
+		texture->back.job->texture = NULL;
+	texture->back.job = NULL;
+	tw_egl_render_context_defer_delete(ctx, TW_EGL_GARBAGE_TEXTURE,
+	                                   texture->back.gltex);
+	texture->back.gltex = 0;
+}
+
+/******************************************************************************
+ * initializers
+ *****************************************************************************/
+
+bool
+tw_egl_render_context_init_upload_thread(struct tw_egl_render_context *ctx,
+                                         struct wl_display *display)
+{
+	struct wl_event_loop *loop = wl_display_get_event_loop(display);
+	EGLContext context;
+	sigset_t all, old;
+	int ret;
+
+	ctx->uploads.context = EGL_NO_CONTEXT;
+	ctx->uploads.active = NULL;
+	ctx->uploads.started = false;
+	ctx->uploads.quit = false;
+	wl_list_init(&ctx->uploads.queue);
+	wl_list_init(&ctx->uploads.done);
+
+	ctx->uploads.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (ctx->uploads.fd < 0)
+		return false;
+	ctx->uploads.source = wl_event_loop_add_fd(loop, ctx->uploads.fd,
+	                                           WL_EVENT_READABLE,
+	                                           notify_upload_done, ctx);
+	if (!ctx->uploads.source)
+		goto err_source;
+	context = tw_egl_create_shared_context(&ctx->egl);
+	if (context == EGL_NO_CONTEXT)
+		goto err_context;
+	pthread_mutex_init(&ctx->uploads.lock, NULL);
+	pthread_cond_init(&ctx->uploads.queued, NULL);
+	pthread_cond_init(&ctx->uploads.finished, NULL);
+
+	ctx->uploads.context = context;
+	//the thread should never take the signals the event loop waits on
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	ret = pthread_create(&ctx->uploads.thread, NULL, upload_thread, ctx);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (ret)
+		goto err_thread;
+
+	pthread_mutex_lock(&ctx->uploads.lock);
+	while (!ctx->uploads.started)
+		pthread_cond_wait(&ctx->uploads.finished, &ctx->uploads.lock);
+	ret = ctx->uploads.quit;
+	pthread_mutex_unlock(&ctx->uploads.lock);
+	if (ret) {
+		tw_logl_level(TW_LOG_WARN, "failed to start the upload thread");
+		pthread_join(ctx->uploads.thread, NULL);
+		goto err_thread;
+	}
+	pthread_setname_np(ctx->uploads.thread, "tw-upload");
+	return true;
+err_thread:
+	ctx->uploads.context = EGL_NO_CONTEXT;
+	pthread_cond_destroy(&ctx->uploads.finished);
+	pthread_cond_destroy(&ctx->uploads.queued);
+	pthread_mutex_destroy(&ctx->uploads.lock);
+	eglDestroyContext(ctx->egl.display, context);
+err_context:
+	wl_event_source_remove(ctx->uploads.source);
+	ctx->uploads.source = NULL;
+err_source:
+	close(ctx->uploads.fd);
+	ctx->uploads.fd = -1;
+	return false;
+}
+
+void
+tw_egl_render_context_fini_upload_thread(struct tw_egl_render_context *ctx)
+{
+	struct tw_egl_upload_job *job, *tmp;
+
+	if (!tw_egl_render_context_has_upload_thread(ctx))
+		return;
+	pthread_mutex_lock(&ctx->uploads.lock);
+	ctx->uploads.quit = true;
+	pthread_cond_signal(&ctx->uploads.queued);
+	pthread_mutex_unlock(&ctx->uploads.lock);
+	pthread_join(ctx->uploads.thread, NULL);
+
+	//the textures keep what they show
+	wl_list_insert_list(&ctx->uploads.done, &ctx->uploads.queue);
+	wl_list_for_each_safe(job, tmp, &ctx->uploads.done, link) {
+		tw_egl_render_context_defer_delete(ctx, TW_EGL_GARBAGE_TEXTURE,
+		                                   job->gltex);
+		wl_list_remove(&job->link);
+		upload_job_destroy(job);
+	}
+	eglDestroyContext(ctx->egl.display, ctx->uploads.context);
+	ctx->uploads.context = EGL_NO_CONTEXT;
+	wl_event_source_remove(ctx->uploads.source);
+	ctx->uploads.source = NULL;
+	close(ctx->uploads.fd);
+	ctx->uploads.fd = -1;
+	pthread_cond_destroy(&ctx->uploads.finished);
+	pthread_cond_destroy(&ctx->uploads.queued);
+	pthread_mutex_destroy(&ctx->uploads.lock);
+}
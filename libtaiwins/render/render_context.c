@@ -75,8 +75,20 @@ notify_tw_surface_frame_request(struct wl_listener *listener, void *data)
 	//through a frame here
 	struct tw_render_surface *surface =
 		wl_container_of(listener, surface, listeners.frame);
+	struct tw_render_context *ctx = surface->ctx;
+
 	assert(data == &surface->surface);
-	wl_signal_emit(&surface->ctx->signals.wl_surface_dirty, data);
+	//not in any layer, like the surfaces of hidden workspaces. A repaint
+	//would not reach it, the frame waits until the surface is shown
+	if (surface->view_seq != ctx->view_seq) {
+		ctx->frame_throttle.hidden++;
+		return;
+	}
+	if (tw_render_surface_frame_throttled(surface)) {
+		tw_render_surface_throttle_frame(surface);
+		return;
+	}
+	wl_signal_emit(&ctx->signals.wl_surface_dirty, data);
 }
 
 void
@@ -90,6 +102,7 @@ tw_render_surface_init(struct tw_render_surface *surface,
 	wl_list_init(&surface->listeners.dirty.link);
 	wl_list_init(&surface->listeners.frame.link);
 	wl_list_init(&surface->listeners.output_lost.link);
+	wl_list_init(&surface->throttle_link);
 
 	pixman_region32_init(&surface->clip);
 	surface->ctx = ctx;
@@ -124,6 +137,7 @@ tw_render_surface_fini(struct tw_render_surface *surface)
 	wl_list_remove(&surface->listeners.frame.link);
 	wl_list_remove(&surface->listeners.commit.link);
 	wl_list_remove(&surface->listeners.output_lost.link);
+	tw_reset_wl_list(&surface->throttle_link);
 }
 
 struct tw_render_surface *
@@ -136,6 +150,26 @@ tw_render_surface_from_resource(struct wl_resource *resource)
 	return surface;
 }
 
+void
+tw_render_surface_throttle_frame(struct tw_render_surface *surface)
+{
+	struct tw_render_context *ctx = surface->ctx;
+
+	if (!wl_list_empty(&surface->throttle_link) ||
+	    wl_list_empty(&surface->surface.frame_callbacks))
+		return;
+	//the timer releases all the surfaces at once, so it only needs
+	//arming for the first one
+	if (wl_list_empty(&ctx->frame_throttle.surfaces))
+		wl_event_source_timer_update(ctx->frame_throttle.timer,
+		                             ctx->frame_throttle.interval);
+	wl_list_insert(ctx->frame_throttle.surfaces.prev,
+	               &surface->throttle_link);
+	ctx->frame_throttle.occluded++;
+	if (surface->surface.stats)
+		surface->surface.stats->throttled++;
+}
+
 
 /******************************************************************************
  * render_context allocator
@@ -213,11 +247,15 @@ subsurface_add_to_list(struct wl_list *parent, struct tw_surface *surface,
                        enum tw_subsurface_pos pos)
 {
 	struct tw_subsurface *sub;
+	struct tw_render_surface *render_surface =
+		wl_container_of(surface, render_surface, surface);
 	//insert subsurface BEFORE the parent if it is placed above or AFTER
 	//the if it is placed below
 	struct wl_list *node =
 		(pos == TW_SUBSURFACE_ABOVE) ? parent->prev : parent;
 
+	render_surface->view_seq = render_surface->ctx->view_seq;
+
 	wl_list_insert(node, &surface->links[TW_VIEW_GLOBAL_LINK]);
 	wl_list_for_each_reverse(sub, &surface->subsurfaces, parent_link) {
 		subsurface_add_to_list(&surface->links[TW_VIEW_GLOBAL_LINK],
@@ -231,6 +269,10 @@ surface_add_to_list(struct tw_layers_manager *manager,
 {
 	//we should also add to the output
 	struct tw_subsurface *sub;
+	struct tw_render_surface *render_surface =
+		wl_container_of(surface, render_surface, surface);
+
+	render_surface->view_seq = render_surface->ctx->view_seq;
 
 	wl_list_insert(manager->views.prev,
 	               &surface->links[TW_VIEW_GLOBAL_LINK]);
@@ -278,6 +320,7 @@ tw_render_context_build_view_list(struct tw_render_context *ctx,
 
 	SCOPE_PROFILE_BEG();
 
+	ctx->view_seq++;
 	wl_list_init(&manager->views);
 	wl_list_for_each(output, &ctx->outputs, link)
 		wl_list_init(&output->views);
@@ -292,6 +335,42 @@ tw_render_context_build_view_list(struct tw_render_context *ctx,
 	SCOPE_PROFILE_END();
 }
 
+static int
+handle_release_throttled_frames(void *data)
+{
+	struct tw_render_context *ctx = data;
+	struct tw_render_surface *surface, *tmp;
+	uint32_t now = tw_get_time_ms(CLOCK_MONOTONIC);
+
+	wl_list_for_each_safe(surface, tmp, &ctx->frame_throttle.surfaces,
+	                      throttle_link) {
+		tw_reset_wl_list(&surface->throttle_link);
+		tw_surface_send_frame_done(&surface->surface, now);
+	}
+	return 0;
+}
+
+WL_EXPORT void
+tw_render_context_set_occluded_frame_interval(struct tw_render_context *ctx,
+                                              uint32_t msec)
+{
+	ctx->frame_throttle.interval = msec;
+	//nothing should wait longer than the new interval
+	if (!wl_list_empty(&ctx->frame_throttle.surfaces))
+		handle_release_throttled_frames(ctx);
+}
+
+WL_EXPORT void
+tw_render_context_set_client_policy(struct tw_render_context *ctx,
+                                    bool (*policy)(const struct
+                                                   tw_client_stats *,
+                                                   void *),
+                                    void *data)
+{
+	ctx->frame_throttle.client_policy = policy;
+	ctx->frame_throttle.client_policy_data = data;
+}
+
 bool
 tw_render_context_init(struct tw_render_context *ctx,
                        struct wl_display *display,
@@ -310,6 +389,15 @@ tw_render_context_init(struct tw_render_context *ctx,
 
 	wl_list_init(&ctx->pipelines);
 	wl_list_init(&ctx->outputs);
+	tw_region_pool_init(&ctx->scratch_regions);
+
+	wl_list_init(&ctx->frame_throttle.surfaces);
+	ctx->frame_throttle.interval = TW_RENDER_OCCLUDED_FRAME_INTERVAL;
+	ctx->frame_throttle.timer =
+		wl_event_loop_add_timer(wl_display_get_event_loop(display),
+		                        handle_release_throttled_frames, ctx);
+	if (!ctx->frame_throttle.timer)
+		return false;
 
 	wl_signal_init(&ctx->signals.destroy);
 	wl_signal_init(&ctx->signals.destroy);
@@ -319,3 +407,32 @@ tw_render_context_init(struct tw_render_context *ctx,
 
 	return true;
 }
+
+void
+tw_render_context_fini(struct tw_render_context *ctx)
+{
+	struct tw_render_surface *surface, *tmp;
+
+	//surfaces may outlive us, leave their links in a sane state
+	wl_list_for_each_safe(surface, tmp, &ctx->frame_throttle.surfaces,
+	                      throttle_link)
+		tw_reset_wl_list(&surface->throttle_link);
+	wl_event_source_remove(ctx->frame_throttle.timer);
+	tw_linux_dmabuf_fini(&ctx->dma_manager);
+	tw_compositor_fini(&ctx->compositor_manager);
+	tw_region_pool_fini(&ctx->scratch_regions);
+}
+
+void
+tw_render_context_end_frame(struct tw_render_context *ctx)
+{
+	struct tw_region_pool *pool = &ctx->scratch_regions;
+
+	tw_region_pool_reset(pool);
+	PROFILE_COUNTER("scratch_region_allocs", pool->allocs);
+	PROFILE_COUNTER("scratch_region_reuses", pool->reuses);
+	PROFILE_COUNTER("frame_throttle_occluded", ctx->frame_throttle.occluded);
+	PROFILE_COUNTER("frame_throttle_hidden", ctx->frame_throttle.hidden);
+	pool->allocs = 0;
+	pool->reuses = 0;
+}
@@ -20,6 +20,7 @@
  */
 
 #include <assert.h>
+#include <math.h>
 #include <time.h>
 #include <pixman.h>
 #include <stdint.h>
@@ -139,6 +140,159 @@ commit_render_output(struct tw_render_output *output)
 	tw_render_presentable_commit(&output->surface, output->ctx);
 }
 
+/******************************************************************************
+ * capture
+ *****************************************************************************/
+
+static void
+finish_render_capture(struct tw_render_capture *capture, bool success)
+{
+	//the capture may be freed or queued again in done
+	pixman_region32_t damage = capture->region;
+
+	tw_reset_wl_list(&capture->link);
+	pixman_region32_init(&capture->region);
+	capture->done(capture, &damage, success);
+	pixman_region32_fini(&damage);
+}
+
+/*
+ * damage since the frame the capture target holds, in capture coordinates. We
+ * keep the damage of the last 3 frames, older targets get the full frame.
+ */
+static void
+render_output_capture_region(struct tw_render_output *output,
+                             struct tw_render_capture *capture)
+{
+	pixman_region32_t *damages[3] = {
+		output->state.pending_damage,
+		output->state.curr_damage,
+		output->state.prev_damage,
+	};
+	uint64_t age = output->state.frames - capture->seq;
+	pixman_region32_t damage;
+	pixman_box32_t *boxes, box;
+	int n;
+
+	if (!(capture->flags & TW_RENDER_CAPTURE_DAMAGE_ONLY) ||
+	    !capture->seq || age > 3) {
+		pixman_region32_init_rect(&capture->region, 0, 0,
+		                          capture->width, capture->height);
+		return;
+	}
+	pixman_region32_init(&damage);
+	for (unsigned i = 0; i < age; i++)
+		pixman_region32_union(&damage, &damage, damages[i]);
+	pixman_region32_init(&capture->region);
+	boxes = pixman_region32_rectangles(&damage, &n);
+	for (int i = 0; i < n; i++) {
+		tw_render_output_buffer_box(output, &box, &boxes[i]);
+		pixman_region32_union_rect(&capture->region, &capture->region,
+		                           box.x1 - capture->x,
+		                           box.y1 - capture->y,
+		                           box.x2 - box.x1, box.y2 - box.y1);
+	}
+	pixman_region32_intersect_rect(&capture->region, &capture->region,
+	                               0, 0, capture->width, capture->height);
+	pixman_region32_fini(&damage);
+}
+
+static inline int
+render_output_capture_begin(struct tw_render_context *ctx,
+                            struct tw_render_capture *capture)
+{
+	int ret;
+
+	if (capture->access)
+		capture->access(capture, true);
+	ret = ctx->impl->capture_begin(ctx, capture);
+	if (capture->access)
+		capture->access(capture, false);
+	return ret;
+}
+
+static inline int
+render_output_capture_poll(struct tw_render_context *ctx,
+                           struct tw_render_capture *capture, bool wait)
+{
+	int ret;
+
+	if (capture->access)
+		capture->access(capture, true);
+	ret = ctx->impl->capture_poll(ctx, capture, wait);
+	if (capture->access)
+		capture->access(capture, false);
+	return ret;
+}
+
+/* read the frame just repainted, before it is swapped */
+static void
+render_output_begin_captures(struct tw_render_output *output)
+{
+	struct tw_render_context *ctx = output->ctx;
+	struct tw_render_capture *capture, *tmp;
+	struct wl_list captures;
+
+	if (wl_list_empty(&output->captures))
+		return;
+	wl_list_init(&captures);
+	wl_list_insert_list(&captures, &output->captures);
+	wl_list_init(&output->captures);
+
+	wl_list_for_each_safe(capture, tmp, &captures, link) {
+		int ret;
+
+		pixman_region32_fini(&capture->region);
+		render_output_capture_region(output, capture);
+		capture->seq = output->state.frames;
+		ret = render_output_capture_begin(ctx, capture);
+		if (ret == 0) {
+			wl_list_remove(&capture->link);
+			wl_list_insert(output->readbacks.prev, &capture->link);
+		} else {
+			finish_render_capture(capture, ret > 0);
+		}
+	}
+}
+
+static void
+render_output_poll_captures(struct tw_render_output *output, bool wait)
+{
+	struct tw_render_capture *capture, *tmp;
+	struct wl_list readbacks;
+
+	if (wl_list_empty(&output->readbacks))
+		return;
+	wl_list_init(&readbacks);
+	wl_list_insert_list(&readbacks, &output->readbacks);
+	wl_list_init(&output->readbacks);
+
+	wl_list_for_each_safe(capture, tmp, &readbacks, link) {
+		struct tw_render_context *ctx = capture->ctx;
+		int ret = render_output_capture_poll(ctx, capture, wait);
+
+		if (ret == 0) {
+			wl_list_remove(&capture->link);
+			wl_list_insert(output->readbacks.prev, &capture->link);
+		} else {
+			finish_render_capture(capture, ret > 0);
+		}
+	}
+}
+
+static void
+render_output_cancel_captures(struct tw_render_output *output)
+{
+	struct tw_render_capture *capture, *tmp;
+
+	wl_list_for_each_safe(capture, tmp, &output->readbacks, link) {
+		capture->ctx->impl->capture_release(capture->ctx, capture);
+		finish_render_capture(capture, false);
+	}
+	wl_list_for_each_safe(capture, tmp, &output->captures, link)
+		finish_render_capture(capture, false);
+}
+
 static int
 tick_render_output_frame(struct tw_render_output *output)
 {
@@ -151,9 +305,17 @@ tick_render_output_frame(struct tw_render_output *output)
 	buffer_age = tw_render_presentable_make_current(presentable, ctx);
 	buffer_age = (buffer_age < 0) ? 2 : buffer_age;
 
+	//bring the textures up to date before anything samples them
+	if (ctx->impl->flush_uploads)
+		ctx->impl->flush_uploads(ctx);
 	wl_list_for_each(pipeline, &ctx->pipelines, link)
 		tw_render_pipeline_repaint(pipeline, output, buffer_age);
+	output->state.frames++;
 
+	render_output_begin_captures(output);
+	//free what died since last frame while we are current
+	if (ctx->impl->collect_garbage)
+		ctx->impl->collect_garbage(ctx);
 	shuffle_output_damage(output);
 	commit_render_output(output);
 	return 0;
@@ -197,6 +359,8 @@ tw_render_output_init(struct tw_render_output *output,
 	tw_output_device_reset_clock(&output->device, CLOCK_MONOTONIC);
 
 	wl_list_init(&output->link);
+	wl_list_init(&output->captures);
+	wl_list_init(&output->readbacks);
 
 	wl_signal_init(&output->surface.commit);
 	wl_signal_init(&output->signals.need_frame);
@@ -215,6 +379,7 @@ tw_render_output_init(struct tw_render_output *output,
 void
 tw_render_output_fini(struct tw_render_output *output)
 {
+	render_output_cancel_captures(output);
 	fini_output_state(output);
 	wl_list_remove(&output->listeners.destroy.link);
 	wl_list_remove(&output->listeners.set_mode.link);
@@ -256,10 +421,20 @@ tw_render_output_flush_frame(struct tw_render_output *output,
                              const struct timespec *now)
 {
 	struct tw_surface *surface;
+	struct tw_render_surface *render_surface;
 	uint32_t now_int = tw_timespec_to_ms(now);
 
-	wl_list_for_each(surface, &output->views, links[TW_VIEW_OUTPUT_LINK])
-		tw_surface_flush_frame(surface, now_int);
+	wl_list_for_each(surface, &output->views, links[TW_VIEW_OUTPUT_LINK]) {
+		render_surface = wl_container_of(surface, render_surface,
+		                                 surface);
+		if (tw_render_surface_frame_throttled(render_surface)) {
+			tw_surface_flush_damage(surface);
+			tw_render_surface_throttle_frame(render_surface);
+		} else {
+			tw_reset_wl_list(&render_surface->throttle_link);
+			tw_surface_flush_frame(surface, now_int);
+		}
+	}
 }
 
 WL_EXPORT void
@@ -286,6 +461,7 @@ tw_render_output_post_frame(struct tw_render_output *output)
 	output->state.repaint_state |= TW_REPAINT_SCHEDULED;
 	wl_signal_emit(&output->signals.pre_frame, output);
 	tick_render_output_frame(output);
+	tw_render_context_end_frame(output->ctx);
 	wl_signal_emit(&output->signals.post_frame, output);
 }
 
@@ -312,11 +488,104 @@ tw_render_output_present(struct tw_render_output *output,
 		.output = output,
 	};
 	struct timespec now;
+
+	//the frame is on screen, so the readbacks issued before its swap are
+	//done on the GPU, waiting here is free
+	render_output_poll_captures(output, true);
 	if (event == NULL) {
 		event = &_event;
-		clock_gettime(dev->clk_id, &now);
+		tw_output_device_read_clock(dev, &now);
 		event->time = now;
 	}
 	event->refresh = tw_millihertz_to_ns(mhz);
 	wl_signal_emit(&output->signals.present, event);
 }
+
+WL_EXPORT bool
+tw_render_output_capture(struct tw_render_output *output,
+                         struct tw_render_capture *capture)
+{
+	struct tw_render_context *ctx = output->ctx;
+	unsigned width, height;
+
+	if (!ctx || !ctx->impl->capture_begin || !capture->done)
+		return false;
+	if (!capture->pixels && (!capture->dmabuf ||
+	                         !tw_render_output_capture_dmabuf_format(output)))
+		return false;
+	tw_output_device_raw_resolution(&output->device, &width, &height);
+	if (capture->x < 0 || capture->y < 0 ||
+	    !capture->width || !capture->height ||
+	    capture->x + capture->width > width ||
+	    capture->y + capture->height > height)
+		return false;
+	if (capture->pixels && capture->stride < capture->width * 4)
+		return false;
+	if (!capture->pixels &&
+	    (capture->dmabuf->width != (int32_t)capture->width ||
+	     capture->dmabuf->height != (int32_t)capture->height))
+		return false;
+	capture->ctx = ctx;
+	capture->output_height = height;
+	capture->handle = 0;
+	pixman_region32_init(&capture->region);
+	wl_list_insert(output->captures.prev, &capture->link);
+	if (!(capture->flags & TW_RENDER_CAPTURE_DAMAGE_ONLY))
+		tw_render_output_dirty(output);
+	return true;
+}
+
+WL_EXPORT void
+tw_render_capture_cancel(struct tw_render_capture *capture)
+{
+	if (capture->handle)
+		capture->ctx->impl->capture_release(capture->ctx, capture);
+	capture->handle = 0;
+	tw_reset_wl_list(&capture->link);
+	pixman_region32_fini(&capture->region);
+	pixman_region32_init(&capture->region);
+}
+
+WL_EXPORT void
+tw_render_output_buffer_box(struct tw_render_output *output,
+                            pixman_box32_t *dst, const pixman_box32_t *src)
+{
+	const struct tw_output_device_state *state = &output->device.current;
+	pixman_box32_t box = {
+		floorf(src->x1 * state->scale), floorf(src->y1 * state->scale),
+		ceilf(src->x2 * state->scale), ceilf(src->y2 * state->scale),
+	};
+	unsigned width, height, tmp;
+	struct tw_mat3 mat;
+
+	//the same inverse transform as the view matrix, over the output size
+	//after the transform in buffer pixels
+	tw_output_device_raw_resolution(&output->device, &width, &height);
+	if (state->transform % WL_OUTPUT_TRANSFORM_180) {
+		tmp = width;
+		width = height;
+		height = tmp;
+	}
+	tw_mat3_transform_rect(&mat, false,
+	                       inverse_wl_transform(state->transform),
+	                       width, height, 1);
+	tw_mat3_box_transform(&mat, dst, &box);
+}
+
+WL_EXPORT uint32_t
+tw_render_output_capture_format(struct tw_render_output *output)
+{
+	struct tw_render_context *ctx = output->ctx;
+
+	return (ctx && ctx->impl->capture_format) ?
+		ctx->impl->capture_format(ctx) : WL_SHM_FORMAT_ABGR8888;
+}
+
+WL_EXPORT uint32_t
+tw_render_output_capture_dmabuf_format(struct tw_render_output *output)
+{
+	struct tw_render_context *ctx = output->ctx;
+
+	return (ctx && ctx->impl->capture_dmabuf_format) ?
+		ctx->impl->capture_dmabuf_format(ctx) : 0;
+}
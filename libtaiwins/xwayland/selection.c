@@ -317,9 +317,9 @@ tw_xwm_handle_selection_event(struct tw_xwm *xwm, xcb_generic_event_t *ge)
 		handle_selection_request(xwm, ge);
 		return 1;
 	case XCB_PROPERTY_NOTIFY:
-		//notify the owner of the selection done
-		handle_selection_property_notify(xwm, ge);
-		return 1;
+		//notify the owner of the selection done, the rest are for
+		//the xsurfaces
+		return handle_selection_property_notify(xwm, ge);
 	}
 	switch (ge->response_type - xwm->xfixes->first_event) {
 	case XCB_XFIXES_SELECTION_NOTIFY:
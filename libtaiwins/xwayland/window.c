@@ -492,7 +492,6 @@ read_surface_client_msg(struct tw_xsurface *surface, struct tw_xwm *xwm,
 		read_net_wm_moveresize_msg(surface, xwm, ev);
 	else if (ev->type == xwm->atoms.wm_protocols)
 		read_wm_protocols_msg(surface, xwm, ev);
-	xcb_flush(xwm->xcb_conn);
 	//TODO getting selection message
 }
 
@@ -622,11 +621,9 @@ handle_xsurface_configure_request(struct tw_xsurface *surface,
 		dsurf->desktop->api.configure_requested(
 			dsurf, ev->x, ev->y, ev->width, ev->height,
 			mask, dsurf->desktop->user_data);
-	else {
+	else
 		xcb_configure_window(surface->xwm->xcb_conn, surface->id,
 		                     geo_mask, values);
-		xcb_flush(surface->xwm->xcb_conn);
-	}
 }
 
 /******************************************************************************
@@ -801,10 +798,9 @@ static const uint8_t WINID_OFFSETS[XCB_EVENT_TYPE_MASK+1] = {
 static inline struct tw_xsurface *
 tw_xsurface_from_event(struct tw_xwm *xwm, xcb_generic_event_t *ge)
 {
-	uint8_t off = WINID_OFFSETS[ge->response_type & XCB_EVENT_TYPE_MASK];
-	xcb_window_t _win = *(xcb_window_t *)((unsigned char*)ge + off);
+	xcb_window_t win = tw_xsurface_event_window(ge);
 
-	return (off) ? tw_xsurface_from_id(xwm, _win) : NULL;
+	return (win != XCB_WINDOW_NONE) ? tw_xsurface_from_id(xwm, win) : NULL;
 }
 
 static bool
@@ -825,6 +821,15 @@ tw_xsurface_set_role(struct tw_xsurface *xsurface,
  * exposed API
  *****************************************************************************/
 
+xcb_window_t
+tw_xsurface_event_window(xcb_generic_event_t *ge)
+{
+	uint8_t off = WINID_OFFSETS[ge->response_type & XCB_EVENT_TYPE_MASK];
+
+	return (off) ? *(xcb_window_t *)((unsigned char*)ge + off) :
+		XCB_WINDOW_NONE;
+}
+
 //TODO replaces it with hash map?
 struct tw_xsurface *
 tw_xsurface_from_id(struct tw_xwm *xwm, xcb_window_t id)
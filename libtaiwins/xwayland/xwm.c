@@ -44,6 +44,7 @@
 #include <xcb/xfixes.h>
 #include <xcb/xproto.h>
 
+#include "utils.h"
 #include "xwayland/xwm.h"
 #include "xwayland/xsurface.h"
 
@@ -196,49 +197,219 @@ destroy_xwm(struct tw_xwm *xwm)
 	free(xwm);
 }
 
+/*
+ * The configure and property events of a window come in bursts when X
+ * clients resize interactively or animate their titles. Only the last
+ * ConfigureNotify and the last PropertyNotify of an atom matter, and
+ * ConfigureRequests fold into the last one. We only look forward until a
+ * map, unmap or client message of the same window so they see the same
+ * window state as before.
+ */
+static inline bool
+xwm_event_coalescable(xcb_generic_event_t *ge)
+{
+	switch (ge->response_type & XCB_EVENT_TYPE_MASK) {
+	case XCB_CONFIGURE_NOTIFY:
+	case XCB_CONFIGURE_REQUEST:
+	case XCB_PROPERTY_NOTIFY:
+		return true;
+	}
+	return false;
+}
+
+/* the later request takes the fields it does not set itself */
+static void
+xwm_configure_request_merge(xcb_configure_request_event_t *ev,
+                            xcb_configure_request_event_t *lev)
+{
+	uint16_t missing = ev->value_mask & ~lev->value_mask;
+
+	if (missing & XCB_CONFIG_WINDOW_X)
+		lev->x = ev->x;
+	if (missing & XCB_CONFIG_WINDOW_Y)
+		lev->y = ev->y;
+	if (missing & XCB_CONFIG_WINDOW_WIDTH)
+		lev->width = ev->width;
+	if (missing & XCB_CONFIG_WINDOW_HEIGHT)
+		lev->height = ev->height;
+	if (missing & XCB_CONFIG_WINDOW_BORDER_WIDTH)
+		lev->border_width = ev->border_width;
+	if (missing & XCB_CONFIG_WINDOW_SIBLING)
+		lev->sibling = ev->sibling;
+	if (missing & XCB_CONFIG_WINDOW_STACK_MODE)
+		lev->stack_mode = ev->stack_mode;
+	lev->value_mask |= ev->value_mask;
+}
+
+static struct tw_xwm_batch_slot *
+xwm_batch_slot(struct tw_xwm *xwm, xcb_window_t window, xcb_atom_t atom,
+               bool create)
+{
+	struct tw_xwm_batch_slot *slot;
+	unsigned i = (window * 2654435761u ^ atom * 40503u) & xwm->batch.mask;
+
+	for (;;) {
+		slot = &xwm->batch.slots[i];
+		if (slot->window == window && slot->atom == atom)
+			return slot;
+		if (slot->window == XCB_WINDOW_NONE)
+			break;
+		i = (i + 1) & xwm->batch.mask;
+	}
+	if (!create)
+		return NULL;
+	slot->window = window;
+	slot->atom = atom;
+	//property changes of the selection windows drive the transfers
+	if (atom == XCB_ATOM_NONE)
+		slot->managed = tw_xsurface_from_id(xwm, window) != NULL;
+	return slot;
+}
+
+static bool
+xwm_event_redundant(struct tw_xwm *xwm, struct tw_xwm_batch_slot *slot,
+                    xcb_generic_event_t **events, unsigned i)
+{
+	xcb_generic_event_t *ge = events[i];
+	unsigned seen = slot->epoch + 1;
+
+	switch (ge->response_type & XCB_EVENT_TYPE_MASK) {
+	case XCB_CONFIGURE_NOTIFY:
+		if (slot->configure == seen)
+			return true;
+		slot->configure = seen;
+		return false;
+	case XCB_PROPERTY_NOTIFY: {
+		xcb_property_notify_event_t *ev =
+			(xcb_property_notify_event_t *)ge;
+		struct tw_xwm_batch_slot *prop =
+			xwm_batch_slot(xwm, slot->window, ev->atom, true);
+
+		//properties are read back from the server anyway
+		if (prop->property == seen)
+			return true;
+		prop->property = seen;
+		return false;
+	}
+	case XCB_CONFIGURE_REQUEST:
+		if (slot->request == seen) {
+			xwm_configure_request_merge(
+				(xcb_configure_request_event_t *)ge,
+				(xcb_configure_request_event_t *)
+				events[slot->request_index]);
+			return true;
+		}
+		slot->request = seen;
+		slot->request_index = i;
+		return false;
+	}
+	return false;
+}
+
+WL_EXPORT unsigned
+tw_xwm_coalesce_events(struct tw_xwm *xwm, xcb_generic_event_t **events,
+                       unsigned n)
+{
+	unsigned left = n, size = 4;
+
+	assert(n <= TW_XWM_BATCH_MAX);
+	if (n < 2)
+		return n;
+	while (size < n * 4)
+		size <<= 1;
+	xwm->batch.mask = size - 1;
+	memset(xwm->batch.slots, 0, size * sizeof(xwm->batch.slots[0]));
+
+	for (unsigned i = n; i-- > 0;) {
+		xcb_window_t window = tw_xsurface_event_window(events[i]);
+		struct tw_xwm_batch_slot *slot;
+
+		if (window == XCB_WINDOW_NONE)
+			continue;
+		//map, unmap and client messages keep their order
+		if (!xwm_event_coalescable(events[i])) {
+			if ((slot = xwm_batch_slot(xwm, window, XCB_ATOM_NONE,
+			                           false)))
+				slot->epoch++;
+			continue;
+		}
+		slot = xwm_batch_slot(xwm, window, XCB_ATOM_NONE, true);
+		if (slot->managed && xwm_event_redundant(xwm, slot, events, i)) {
+			free(events[i]);
+			events[i] = NULL;
+			left--;
+		}
+	}
+	return left;
+}
+
+static void
+xwm_handle_event(struct tw_xwm *xwm, xcb_generic_event_t *event)
+{
+	if (tw_xwm_handle_selection_event(xwm, event))
+		return;
+	if (tw_xsurface_handle_event(xwm, event))
+		return;
+	switch (event->response_type & XCB_EVENT_TYPE_MASK) {
+	case XCB_CREATE_NOTIFY:
+		handle_xwm_create_surface(xwm, event);
+		break;
+	case XCB_DESTROY_NOTIFY:
+		handle_xwm_destroy_surface(xwm, event);
+		break;
+	case XCB_FOCUS_IN:
+		handle_xwm_focus_in(xwm, event);
+		break;
+	case 0:
+		handle_xwm_xcb_error(xwm, event);
+		break;
+	default:
+		handle_xwm_unhandled_event(xwm, event);
+		break;
+	}
+}
+
 static int
 handle_x11_events(int fd, uint32_t mask, void *data)
 {
 	int count = 0;
+	unsigned n;
 	xcb_generic_event_t *event = NULL;
 	struct tw_xwm *xwm = data;
+	xcb_generic_event_t **events = xwm->batch.events;
 
 	if ((mask & WL_EVENT_HANGUP) || (mask & WL_EVENT_ERROR)) {
 		destroy_xwm(xwm);
 		return 0;
 	}
-	while ((event = xcb_poll_for_event(xwm->xcb_conn))) {
-		count++;
-		if (tw_xwm_handle_selection_event(xwm, event)) {
-			free(event);
-			continue;
-		}
-		if (tw_xsurface_handle_event(xwm, event)) {
-			free(event);
-			continue;
-		}
-		switch (event->response_type & XCB_EVENT_TYPE_MASK) {
-		case XCB_CREATE_NOTIFY:
-			handle_xwm_create_surface(xwm, event);
-			break;
-		case XCB_DESTROY_NOTIFY:
-			handle_xwm_destroy_surface(xwm, event);
-			break;
-		case XCB_FOCUS_IN:
-			handle_xwm_focus_in(xwm, event);
-			break;
-		case 0:
-			handle_xwm_xcb_error(xwm, event);
-			break;
-		default:
-			handle_xwm_unhandled_event(xwm, event);
-			break;
+	SCOPE_PROFILE_BEG();
+	//xcb reads everything from the socket, a full batch may leave events
+	//queued, and the replies the handlers wait for pull more events off the
+	//socket. Neither wakes us up again, so we stop at an empty poll
+	do {
+		n = 0;
+		while (n < TW_XWM_BATCH_MAX &&
+		       (event = xcb_poll_for_event(xwm->xcb_conn)))
+			events[n++] = event;
+		count += n;
+		xwm->batch.received += n;
+
+		tw_xwm_coalesce_events(xwm, events, n);
+		for (unsigned i = 0; i < n; i++) {
+			if (!events[i])
+				continue;
+			xwm_handle_event(xwm, events[i]);
+			xwm->batch.applied++;
+			free(events[i]);
 		}
+	} while (n);
 
-		free(event);
-	}
-	if (count)
+	if (count) {
 		xcb_flush(xwm->xcb_conn);
+		PROFILE_COUNTER("xwm_events_received", xwm->batch.received);
+		PROFILE_COUNTER("xwm_events_applied", xwm->batch.applied);
+	}
+	SCOPE_PROFILE_END();
 	return count;
 }
 
@@ -0,0 +1,714 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <gbm.h>
+#include <wayland-client.h>
+#include <wayland-client-protocol.h>
+#include <wayland-xdg-shell-client-protocol.h>
+#include <wayland-presentation-time-client-protocol.h>
+#include <wayland-linux-dmabuf-client-protocol.h>
+
+#include "bench-client.h"
+
+#define N_BUFFERS 3
+#define MAX_RECTS 8
+#define SUBSURFACE_OFFSET 16
+#define DRAIN_TIMEOUT 200
+
+struct bench_rect {
+	int x, y, w, h;
+};
+
+struct bench_buffer {
+	struct wl_buffer *buffer;
+	struct gbm_bo *bo;
+	void *data;
+	uint32_t stride;
+	bool busy;
+};
+
+struct bench_surface {
+	struct wl_surface *surface;
+	struct wl_subsurface *subsurface;
+	struct bench_buffer buffers[N_BUFFERS];
+};
+
+struct bench_client {
+	const struct tw_bench_client_options *opts;
+	struct wl_display *display;
+	struct wl_registry *registry;
+	struct wl_compositor *compositor;
+	struct wl_subcompositor *subcompositor;
+	struct wl_shm *shm;
+	struct xdg_wm_base *wm_base;
+	struct wp_presentation *presentation;
+	struct zwp_linux_dmabuf_v1 *dmabuf;
+	uint32_t compositor_version;
+
+	int drm_fd;
+	struct gbm_device *gbm;
+
+	struct xdg_surface *xdg_surface;
+	struct xdg_toplevel *toplevel;
+	bool configured, closed, frame_pending;
+
+	unsigned n_surfaces;
+	struct bench_surface *surfaces; /**< the toplevel comes first */
+
+	unsigned frame, seed;
+	unsigned pending_feedbacks;
+	struct tw_bench_client_report report;
+	uint32_t *samples;
+	size_t n_alloc;
+};
+
+struct bench_feedback {
+	struct bench_client *client;
+	struct timespec commit;
+};
+
+static inline uint64_t
+timespec_ns(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * 1000000000ull + ts->tv_nsec;
+}
+
+static void
+client_add_sample(struct bench_client *client, uint32_t us)
+{
+	uint32_t *tmp;
+
+	if (client->report.n_samples == client->n_alloc) {
+		size_t n = client->n_alloc ? client->n_alloc * 2 : 1024;
+		if (!(tmp = realloc(client->samples, n * sizeof(uint32_t))))
+			return;
+		client->samples = tmp;
+		client->n_alloc = n;
+	}
+	client->samples[client->report.n_samples++] = us;
+}
+
+/******************************************************************************
+ * listeners
+ *****************************************************************************/
+
+static void
+handle_buffer_release(void *data, struct wl_buffer *wl_buffer)
+{
+	struct bench_buffer *buffer = data;
+	buffer->busy = false;
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+	.release = handle_buffer_release,
+};
+
+static void
+handle_wm_base_ping(void *data, struct xdg_wm_base *wm_base, uint32_t serial)
+{
+	xdg_wm_base_pong(wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener wm_base_listener = {
+	.ping = handle_wm_base_ping,
+};
+
+static void
+handle_xdg_surface_configure(void *data, struct xdg_surface *xdg_surface,
+                             uint32_t serial)
+{
+	struct bench_client *client = data;
+
+	xdg_surface_ack_configure(xdg_surface, serial);
+	client->configured = true;
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+	.configure = handle_xdg_surface_configure,
+};
+
+static void
+handle_toplevel_configure(void *data, struct xdg_toplevel *toplevel,
+                          int32_t width, int32_t height,
+                          struct wl_array *states)
+{
+	//we keep our own size, resizing is not part of the benchmark
+}
+
+static void
+handle_toplevel_close(void *data, struct xdg_toplevel *toplevel)
+{
+	struct bench_client *client = data;
+	client->closed = true;
+}
+
+static const struct xdg_toplevel_listener toplevel_listener = {
+	.configure = handle_toplevel_configure,
+	.close = handle_toplevel_close,
+};
+
+static void
+handle_frame_done(void *data, struct wl_callback *callback, uint32_t time)
+{
+	struct bench_client *client = data;
+
+	wl_callback_destroy(callback);
+	client->frame_pending = false;
+}
+
+static const struct wl_callback_listener frame_listener = {
+	.done = handle_frame_done,
+};
+
+static void
+handle_feedback_sync_output(void *data,
+                            struct wp_presentation_feedback *feedback,
+                            struct wl_output *output)
+{
+}
+
+static void
+handle_feedback_presented(void *data, struct wp_presentation_feedback *wp_fb,
+                          uint32_t tv_sec_hi, uint32_t tv_sec_lo,
+                          uint32_t tv_nsec, uint32_t refresh,
+                          uint32_t seq_hi, uint32_t seq_lo, uint32_t flags)
+{
+	struct bench_feedback *feedback = data;
+	struct bench_client *client = feedback->client;
+	struct timespec presented = {
+		.tv_sec = ((uint64_t)tv_sec_hi << 32) | tv_sec_lo,
+		.tv_nsec = tv_nsec,
+	};
+	uint64_t commit_ns = timespec_ns(&feedback->commit);
+	uint64_t present_ns = timespec_ns(&presented);
+
+	//presentation clock is CLOCK_MONOTONIC, same as our commit clock
+	client_add_sample(client, present_ns > commit_ns ?
+	                  (present_ns - commit_ns) / 1000 : 0);
+	client->report.presented++;
+	client->pending_feedbacks--;
+	wp_presentation_feedback_destroy(wp_fb);
+	free(feedback);
+}
+
+static void
+handle_feedback_discarded(void *data, struct wp_presentation_feedback *wp_fb)
+{
+	struct bench_feedback *feedback = data;
+
+	feedback->client->report.discarded++;
+	feedback->client->pending_feedbacks--;
+	wp_presentation_feedback_destroy(wp_fb);
+	free(feedback);
+}
+
+static const struct wp_presentation_feedback_listener feedback_listener = {
+	.sync_output = handle_feedback_sync_output,
+	.presented = handle_feedback_presented,
+	.discarded = handle_feedback_discarded,
+};
+
+static void
+handle_registry_global(void *data, struct wl_registry *registry,
+                       uint32_t name, const char *interface,
+                       uint32_t version)
+{
+	struct bench_client *client = data;
+
+	if (strcmp(interface, wl_compositor_interface.name) == 0) {
+		client->compositor_version = version < 4 ? version : 4;
+		client->compositor =
+			wl_registry_bind(registry, name,
+			                 &wl_compositor_interface,
+			                 client->compositor_version);
+	} else if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
+		client->subcompositor =
+			wl_registry_bind(registry, name,
+			                 &wl_subcompositor_interface, 1);
+	} else if (strcmp(interface, wl_shm_interface.name) == 0) {
+		client->shm = wl_registry_bind(registry, name,
+		                               &wl_shm_interface, 1);
+	} else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
+		client->wm_base = wl_registry_bind(registry, name,
+		                                   &xdg_wm_base_interface, 1);
+		xdg_wm_base_add_listener(client->wm_base, &wm_base_listener,
+		                         client);
+	} else if (strcmp(interface, wp_presentation_interface.name) == 0) {
+		client->presentation =
+			wl_registry_bind(registry, name,
+			                 &wp_presentation_interface, 1);
+	} else if (strcmp(interface,
+	                  zwp_linux_dmabuf_v1_interface.name) == 0 &&
+	           version >= 2) {
+		client->dmabuf =
+			wl_registry_bind(registry, name,
+			                 &zwp_linux_dmabuf_v1_interface, 2);
+	}
+}
+
+static void
+handle_registry_global_remove(void *data, struct wl_registry *registry,
+                              uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+	.global = handle_registry_global,
+	.global_remove = handle_registry_global_remove,
+};
+
+/******************************************************************************
+ * buffers
+ *****************************************************************************/
+
+static bool
+buffer_init_shm(struct bench_client *client, struct bench_buffer *buffer)
+{
+	unsigned w = client->opts->width, h = client->opts->height;
+	size_t size = (size_t)w * h * 4;
+	struct wl_shm_pool *pool;
+	int fd = memfd_create("tw-bench-client", MFD_CLOEXEC);
+
+	if (fd < 0)
+		return false;
+	if (ftruncate(fd, size) < 0)
+		goto err;
+	buffer->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+	                    fd, 0);
+	if (buffer->data == MAP_FAILED) {
+		buffer->data = NULL;
+		goto err;
+	}
+	pool = wl_shm_create_pool(client->shm, fd, size);
+	buffer->stride = w * 4;
+	buffer->buffer = wl_shm_pool_create_buffer(pool, 0, w, h,
+	                                           buffer->stride,
+	                                           WL_SHM_FORMAT_ARGB8888);
+	wl_shm_pool_destroy(pool);
+	close(fd);
+	memset(buffer->data, 0xff, size);
+	return true;
+err:
+	close(fd);
+	return false;
+}
+
+static bool
+buffer_init_dmabuf(struct bench_client *client, struct bench_buffer *buffer)
+{
+	unsigned w = client->opts->width, h = client->opts->height;
+	struct zwp_linux_buffer_params_v1 *params;
+	uint64_t modifier;
+	int fd;
+
+	buffer->bo = gbm_bo_create(client->gbm, w, h, GBM_FORMAT_ARGB8888,
+	                           GBM_BO_USE_LINEAR | GBM_BO_USE_RENDERING);
+	if (!buffer->bo)
+		return false;
+	if ((fd = gbm_bo_get_fd(buffer->bo)) < 0) {
+		gbm_bo_destroy(buffer->bo);
+		buffer->bo = NULL;
+		return false;
+	}
+	modifier = gbm_bo_get_modifier(buffer->bo);
+	buffer->stride = gbm_bo_get_stride(buffer->bo);
+	params = zwp_linux_dmabuf_v1_create_params(client->dmabuf);
+	zwp_linux_buffer_params_v1_add(params, fd, 0, 0, buffer->stride,
+	                               modifier >> 32,
+	                               modifier & 0xffffffff);
+	buffer->buffer =
+		zwp_linux_buffer_params_v1_create_immed(params, w, h,
+		                                        GBM_FORMAT_ARGB8888,
+		                                        0);
+	zwp_linux_buffer_params_v1_destroy(params);
+	close(fd);
+	return true;
+}
+
+static void
+buffer_fini(struct bench_client *client, struct bench_buffer *buffer)
+{
+	if (buffer->buffer)
+		wl_buffer_destroy(buffer->buffer);
+	if (buffer->bo)
+		gbm_bo_destroy(buffer->bo);
+	else if (buffer->data)
+		munmap(buffer->data, (size_t)client->opts->width *
+		       client->opts->height * 4);
+	memset(buffer, 0, sizeof(*buffer));
+}
+
+static bool
+client_init_buffers(struct bench_client *client, struct bench_surface *surf)
+{
+	bool dmabuf = client->gbm != NULL;
+
+	for (int i = 0; i < N_BUFFERS; i++) {
+		struct bench_buffer *buffer = &surf->buffers[i];
+		bool ret = dmabuf ? buffer_init_dmabuf(client, buffer) :
+			buffer_init_shm(client, buffer);
+		if (!ret)
+			return false;
+		wl_buffer_add_listener(buffer->buffer, &buffer_listener,
+		                       buffer);
+	}
+	return true;
+}
+
+static void
+buffer_fill(struct bench_client *client, struct bench_buffer *buffer,
+            const struct bench_rect *rects, unsigned n)
+{
+	uint32_t color = 0xff000000 | (client->frame * 0x010305);
+	uint32_t stride = buffer->stride;
+	void *map_data = NULL;
+	uint8_t *data = buffer->data;
+
+	if (buffer->bo) {
+		data = gbm_bo_map(buffer->bo, 0, 0, client->opts->width,
+		                  client->opts->height, GBM_BO_TRANSFER_WRITE,
+		                  &stride, &map_data);
+		if (!data)
+			return;
+	}
+	for (unsigned i = 0; i < n; i++)
+		for (int y = rects[i].y; y < rects[i].y + rects[i].h; y++) {
+			uint32_t *row = (uint32_t *)(data + (size_t)y * stride);
+			for (int x = rects[i].x; x < rects[i].x + rects[i].w; x++)
+				row[x] = color;
+		}
+	if (buffer->bo)
+		gbm_bo_unmap(buffer->bo, map_data);
+}
+
+/******************************************************************************
+ * frames
+ *****************************************************************************/
+
+static unsigned
+client_gen_damage(struct bench_client *client, struct bench_rect *rects)
+{
+	int w = client->opts->width, h = client->opts->height;
+	int size;
+
+	switch (client->opts->damage) {
+	case TW_BENCH_DAMAGE_PARTIAL:
+		size = 64 < w && 64 < h ? 64 : 1;
+		rects[0].w = rects[0].h = size;
+		rects[0].x = (client->frame * 8) % (w - size + 1);
+		rects[0].y = (client->frame * 4) % (h - size + 1);
+		return 1;
+	case TW_BENCH_DAMAGE_SCATTER:
+		size = 16 < w && 16 < h ? 16 : 1;
+		for (int i = 0; i < MAX_RECTS; i++) {
+			rects[i].w = rects[i].h = size;
+			rects[i].x = rand_r(&client->seed) % (w - size + 1);
+			rects[i].y = rand_r(&client->seed) % (h - size + 1);
+		}
+		return MAX_RECTS;
+	case TW_BENCH_DAMAGE_FULL:
+	default:
+		rects[0].x = rects[0].y = 0;
+		rects[0].w = w;
+		rects[0].h = h;
+		return 1;
+	}
+}
+
+static struct bench_buffer *
+surface_free_buffer(struct bench_surface *surf)
+{
+	for (int i = 0; i < N_BUFFERS; i++)
+		if (!surf->buffers[i].busy)
+			return &surf->buffers[i];
+	return NULL;
+}
+
+static void
+client_commit_frame(struct bench_client *client)
+{
+	struct bench_rect rects[MAX_RECTS];
+	struct bench_buffer *buffers[client->n_surfaces];
+	struct bench_feedback *feedback;
+	unsigned n_rects;
+
+	for (unsigned i = 0; i < client->n_surfaces; i++)
+		if (!(buffers[i] = surface_free_buffer(&client->surfaces[i]))) {
+			client->report.skipped++;
+			return;
+		}
+	client->frame++;
+	n_rects = client_gen_damage(client, rects);
+	//subsurfaces are synchronized, deepest first so the toplevel commit
+	//applies the whole tree.
+	for (int i = client->n_surfaces-1; i >= 0; i--) {
+		struct wl_surface *surface = client->surfaces[i].surface;
+
+		buffer_fill(client, buffers[i], rects, n_rects);
+		buffers[i]->busy = true;
+		wl_surface_attach(surface, buffers[i]->buffer, 0, 0);
+		for (unsigned j = 0; j < n_rects; j++) {
+			if (client->compositor_version >= 4)
+				wl_surface_damage_buffer(surface,
+				                         rects[j].x, rects[j].y,
+				                         rects[j].w, rects[j].h);
+			else
+				wl_surface_damage(surface,
+				                  rects[j].x, rects[j].y,
+				                  rects[j].w, rects[j].h);
+		}
+		if (i > 0)
+			wl_surface_commit(surface);
+	}
+	if (!client->opts->commit_rate) {
+		struct wl_callback *cb =
+			wl_surface_frame(client->surfaces[0].surface);
+		wl_callback_add_listener(cb, &frame_listener, client);
+		client->frame_pending = true;
+	}
+	if (client->presentation && (feedback = calloc(1, sizeof(*feedback)))) {
+		struct wp_presentation_feedback *wp_fb =
+			wp_presentation_feedback(client->presentation,
+			                         client->surfaces[0].surface);
+		feedback->client = client;
+		wp_presentation_feedback_add_listener(wp_fb,
+		                                      &feedback_listener,
+		                                      feedback);
+		clock_gettime(CLOCK_MONOTONIC, &feedback->commit);
+		client->pending_feedbacks++;
+	}
+	wl_surface_commit(client->surfaces[0].surface);
+	client->report.commits++;
+}
+
+/******************************************************************************
+ * client setup
+ *****************************************************************************/
+
+static bool
+client_init_gbm(struct bench_client *client)
+{
+	const char *node = client->opts->render_node ?
+		client->opts->render_node : "/dev/dri/renderD128";
+
+	if (!client->dmabuf)
+		return false;
+	if ((client->drm_fd = open(node, O_RDWR | O_CLOEXEC)) < 0)
+		return false;
+	if (!(client->gbm = gbm_create_device(client->drm_fd))) {
+		close(client->drm_fd);
+		client->drm_fd = -1;
+		return false;
+	}
+	return true;
+}
+
+/* the regions are set once, then every commit carries them over */
+static void
+client_init_regions(struct bench_client *client)
+{
+	unsigned n = client->opts->region_rects;
+	unsigned h = client->opts->height;
+	unsigned stripe = (n && h / (2 * n)) ? h / (2 * n) : 1;
+	struct wl_region *region;
+
+	if (!n)
+		return;
+	region = wl_compositor_create_region(client->compositor);
+	//horizontal stripes with gaps, pixman keeps them as separated boxes
+	for (unsigned i = 0; i < n; i++)
+		wl_region_add(region, 0, (int)(i * h / n),
+		              client->opts->width, stripe);
+	for (unsigned i = 0; i < client->n_surfaces; i++) {
+		wl_surface_set_opaque_region(client->surfaces[i].surface,
+		                             region);
+		wl_surface_set_input_region(client->surfaces[i].surface,
+		                            region);
+	}
+	wl_region_destroy(region);
+}
+
+static bool
+client_init_surfaces(struct bench_client *client)
+{
+	client->n_surfaces = 1 + client->opts->subsurface_depth;
+	client->surfaces = calloc(client->n_surfaces,
+	                          sizeof(struct bench_surface));
+	if (!client->surfaces)
+		return false;
+
+	for (unsigned i = 0; i < client->n_surfaces; i++) {
+		struct bench_surface *surf = &client->surfaces[i];
+
+		surf->surface = wl_compositor_create_surface(client->compositor);
+		if (i == 0)
+			continue;
+		surf->subsurface =
+			wl_subcompositor_get_subsurface(client->subcompositor,
+			                                surf->surface,
+			                                surf[-1].surface);
+		wl_subsurface_set_position(surf->subsurface,
+		                           SUBSURFACE_OFFSET,
+		                           SUBSURFACE_OFFSET);
+	}
+	client->xdg_surface =
+		xdg_wm_base_get_xdg_surface(client->wm_base,
+		                            client->surfaces[0].surface);
+	xdg_surface_add_listener(client->xdg_surface, &xdg_surface_listener,
+	                         client);
+	client->toplevel = xdg_surface_get_toplevel(client->xdg_surface);
+	xdg_toplevel_add_listener(client->toplevel, &toplevel_listener,
+	                          client);
+	xdg_toplevel_set_title(client->toplevel, "tw-bench-client");
+	client_init_regions(client);
+	wl_surface_commit(client->surfaces[0].surface);
+
+	for (unsigned i = 0; i < client->n_surfaces; i++)
+		if (!client_init_buffers(client, &client->surfaces[i]))
+			return false;
+	return true;
+}
+
+static void
+client_fini(struct bench_client *client)
+{
+	for (unsigned i = 0; client->surfaces && i < client->n_surfaces; i++) {
+		struct bench_surface *surf = &client->surfaces[i];
+
+		for (int j = 0; j < N_BUFFERS; j++)
+			buffer_fini(client, &surf->buffers[j]);
+		if (surf->subsurface)
+			wl_subsurface_destroy(surf->subsurface);
+		if (i == 0 && client->toplevel)
+			xdg_toplevel_destroy(client->toplevel);
+		if (i == 0 && client->xdg_surface)
+			xdg_surface_destroy(client->xdg_surface);
+		if (surf->surface)
+			wl_surface_destroy(surf->surface);
+	}
+	free(client->surfaces);
+	if (client->gbm)
+		gbm_device_destroy(client->gbm);
+	if (client->drm_fd >= 0)
+		close(client->drm_fd);
+	if (client->display) {
+		wl_display_flush(client->display);
+		wl_display_disconnect(client->display);
+	}
+}
+
+static bool
+write_all(int fd, const void *data, size_t size)
+{
+	const char *ptr = data;
+
+	while (size) {
+		ssize_t n = write(fd, ptr, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		ptr += n;
+		size -= n;
+	}
+	return true;
+}
+
+/* poll the display until the deadline, returns false if connection is lost */
+static bool
+client_wait(struct bench_client *client, int timeout)
+{
+	struct pollfd pfd = {
+		.fd = wl_display_get_fd(client->display),
+		.events = POLLIN,
+	};
+
+	while (wl_display_prepare_read(client->display) != 0)
+		if (wl_display_dispatch_pending(client->display) < 0)
+			return false;
+	wl_display_flush(client->display);
+	if (poll(&pfd, 1, timeout) > 0 && (pfd.revents & POLLIN)) {
+		if (wl_display_read_events(client->display) < 0)
+			return false;
+	} else {
+		wl_display_cancel_read(client->display);
+	}
+	return wl_display_dispatch_pending(client->display) >= 0;
+}
+
+static inline int64_t
+ms_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)(timespec_ns(&now) - timespec_ns(start)) / 1000000;
+}
+
+int
+tw_bench_client_run(const struct tw_bench_client_options *opts,
+                    int report_fd)
+{
+	struct bench_client client = {
+		.opts = opts,
+		.drm_fd = -1,
+		.seed = opts->seed,
+	};
+	struct timespec start;
+	int64_t next = 0, elapsed;
+	bool ret = false;
+
+	if (!(client.display = wl_display_connect(opts->socket)))
+		goto out;
+	client.registry = wl_display_get_registry(client.display);
+	wl_registry_add_listener(client.registry, &registry_listener, &client);
+	wl_display_roundtrip(client.display);
+	if (!client.compositor || !client.shm || !client.wm_base ||
+	    (opts->subsurface_depth && !client.subcompositor))
+		goto out;
+	if (opts->buffer == TW_BENCH_BUFFER_DMABUF && !client_init_gbm(&client))
+		fprintf(stderr, "dmabuf unavailable, falling back to shm\n");
+	client.report.dmabuf = client.gbm != NULL;
+	if (!client_init_surfaces(&client))
+		goto out;
+	while (!client.configured && !client.closed)
+		if (wl_display_dispatch(client.display) < 0)
+			goto out;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (!client.closed &&
+	       (elapsed = ms_since(&start)) < opts->duration_ms) {
+		int timeout = opts->duration_ms - elapsed;
+
+		if (opts->commit_rate && elapsed >= next) {
+			client_commit_frame(&client);
+			next += 1000 / opts->commit_rate;
+		} else if (!opts->commit_rate && !client.frame_pending) {
+			client_commit_frame(&client);
+		}
+		if (opts->commit_rate && next - elapsed < timeout)
+			timeout = next - elapsed > 0 ? next - elapsed : 0;
+		if (!client_wait(&client, timeout))
+			goto out;
+	}
+	//collect feedbacks for the last frames
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (client.pending_feedbacks &&
+	       (elapsed = ms_since(&start)) < DRAIN_TIMEOUT)
+		if (!client_wait(&client, DRAIN_TIMEOUT - elapsed))
+			goto out;
+	ret = true;
+out:
+	client_fini(&client);
+	ret = write_all(report_fd, &client.report, sizeof(client.report)) &&
+		write_all(report_fd, client.samples,
+		          client.report.n_samples * sizeof(uint32_t)) && ret;
+	free(client.samples);
+	return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
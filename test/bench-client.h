@@ -0,0 +1,65 @@
+#ifndef TW_BENCH_CLIENT_H
+#define TW_BENCH_CLIENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum tw_bench_damage {
+	TW_BENCH_DAMAGE_FULL,
+	TW_BENCH_DAMAGE_PARTIAL, /**< one moving 64x64 rectangle */
+	TW_BENCH_DAMAGE_SCATTER, /**< 8 small rectangles spread around */
+};
+
+enum tw_bench_buffer {
+	TW_BENCH_BUFFER_SHM,
+	TW_BENCH_BUFFER_DMABUF,
+};
+
+struct tw_bench_client_options {
+	const char *socket;
+	enum tw_bench_buffer buffer;
+	enum tw_bench_damage damage;
+	unsigned width, height;
+	unsigned subsurface_depth;
+	unsigned commit_rate; /**< commits per second, 0 follows frame done */
+	/** opaque and input regions of that many rectangles, set once */
+	unsigned region_rects;
+	unsigned duration_ms;
+	unsigned seed;
+	const char *render_node; /**< for dmabuf clients */
+};
+
+/**
+ * @brief the report a client writes to the harness before exiting
+ *
+ * The header is followed by n_samples commit-to-present latencies in
+ * microseconds.
+ */
+struct tw_bench_client_report {
+	uint32_t commits;
+	uint32_t skipped; /**< no free buffer at commit time */
+	uint32_t presented;
+	uint32_t discarded;
+	uint32_t dmabuf; /**< dmabuf buffers were really used */
+	uint32_t n_samples;
+};
+
+/**
+ * @brief run a synthetic client, write the report to report_fd.
+ *
+ * Supposed to run in a forked process, returns the exit code.
+ */
+int
+tw_bench_client_run(const struct tw_bench_client_options *options,
+                    int report_fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* EOF */
@@ -0,0 +1,51 @@
+#include <stdbool.h>
+#include <unistd.h>
+#include <wayland-server.h>
+#include <taiwins/objects/client_data.h>
+
+#include "test_client.h"
+
+static bool
+client_data_index_test(struct wl_display *display)
+{
+	int key0, key1, key2, value0, value1, value2;
+	int fd0, fd1;
+	struct wl_client *a = tw_test_client_create(display, &fd0);
+	struct wl_client *b = tw_test_client_create(display, &fd1);
+	bool ret = a && b;
+
+	if (!ret)
+		return false;
+	//nothing set yet, finding does not create the record
+	ret = ret && !tw_client_data_find(a, &key0);
+	ret = ret && !tw_client_data_get(a, false);
+
+	ret = ret && tw_client_data_set(a, &key0, &value0);
+	ret = ret && tw_client_data_set(a, &key1, &value1);
+	ret = ret && tw_client_data_set(b, &key0, &value2);
+	ret = ret && tw_client_data_find(a, &key0) == &value0;
+	ret = ret && tw_client_data_find(a, &key1) == &value1;
+	ret = ret && tw_client_data_find(b, &key0) == &value2;
+	ret = ret && !tw_client_data_find(b, &key1);
+
+	//overwrite and remove
+	ret = ret && tw_client_data_set(a, &key0, &value2);
+	ret = ret && tw_client_data_find(a, &key0) == &value2;
+	tw_client_data_unset(a, &key0);
+	ret = ret && !tw_client_data_find(a, &key0);
+	ret = ret && tw_client_data_find(a, &key1) == &value1;
+	tw_client_data_unset(a, &key2);
+
+	//the record goes with the client
+	wl_client_destroy(a);
+	ret = ret && tw_client_data_find(b, &key0) == &value2;
+	wl_client_destroy(b);
+	close(fd0);
+	close(fd1);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	return tw_test_client_run("client data", client_data_index_test);
+}
@@ -0,0 +1,69 @@
+#include <stdbool.h>
+#include <unistd.h>
+#include <wayland-server.h>
+#include <taiwins/objects/client_stats.h>
+#include <taiwins/objects/utils.h>
+
+#include "test_client.h"
+
+static bool
+client_stats_rate_test(struct wl_display *display)
+{
+	int fd;
+	struct wl_client *client = tw_test_client_create(display, &fd);
+	struct tw_client_stats *stats, *again;
+	struct tw_client_budget budget = {0};
+	uint32_t start;
+	bool ret = client;
+
+	if (!ret)
+		return false;
+	//nothing counted yet, getting does not create the record
+	ret = ret && !tw_client_stats_get(client);
+	stats = tw_client_stats_ref(client);
+	again = tw_client_stats_ref(client);
+	ret = ret && stats && stats == again;
+	ret = ret && tw_client_stats_get(client) == stats;
+	tw_client_stats_unref(again);
+	if (!ret)
+		goto out;
+
+	//the rates only move once the window is over
+	start = stats->window_start;
+	stats->total.commits += 120;
+	stats->total.damage += 2000000;
+	stats->total.upload += 4096;
+	tw_client_stats_sample(stats, start + TW_CLIENT_STATS_WINDOW / 2);
+	ret = ret && stats->rate.commits == 0;
+	tw_client_stats_sample(stats, start + 2 * TW_CLIENT_STATS_WINDOW);
+	ret = ret && stats->rate.commits == 60;
+	ret = ret && stats->rate.damage == 1000000;
+	ret = ret && stats->rate.upload == 2048;
+	ret = ret && stats->window_start == start + 2 * TW_CLIENT_STATS_WINDOW;
+
+	//nothing new in the next window
+	tw_client_stats_sample(stats, start + 3 * TW_CLIENT_STATS_WINDOW);
+	ret = ret && stats->rate.commits == 0 && stats->rate.upload == 0;
+
+	//budgets of 0 are no limit, checking never samples
+	stats->rate.commits = 100;
+	ret = ret && !tw_client_stats_over_budget(stats, &budget);
+	budget.commits = 200;
+	ret = ret && !tw_client_stats_over_budget(stats, &budget);
+	budget.commits = 50;
+	ret = ret && tw_client_stats_over_budget(stats, &budget);
+	ret = ret && stats->rate.commits == 100;
+	ret = ret && stats->window_start == start + 3 * TW_CLIENT_STATS_WINDOW;
+out:
+	//surfaces of the client outlive it
+	wl_client_destroy(client);
+	ret = ret && stats && stats->client == NULL;
+	tw_client_stats_unref(stats);
+	close(fd);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	return tw_test_client_run("client stats", client_stats_rate_test);
+}
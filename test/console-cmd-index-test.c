@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "console_cmd_index.h"
+
+static const char *cmds[] = {
+	"ls", "lsblk", "lsof", "grep", "git", "gitk", "make", "meson",
+};
+
+static bool
+touch(const char *dir, const char *name)
+{
+	char path[512];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	if ((fd = open(path, O_CREAT | O_WRONLY, 0755)) < 0)
+		return false;
+	close(fd);
+	return true;
+}
+
+static int
+remove_entry(const char *path, const struct stat *sb, int flag,
+             struct FTW *ftw)
+{
+	return remove(path);
+}
+
+static bool
+prefix_test(struct console_cmd_index *index)
+{
+	uint32_t i = console_cmd_index_lower_bound(index, "ls", 2);
+	int count = 0;
+
+	for (; i < index->n_cmds; i++, count++)
+		if (strncmp(console_cmd_index_at(index, i), "ls", 2))
+			break;
+	return count == 3;
+}
+
+int
+main(int argc, char *argv[])
+{
+	char tmpl[] = "/tmp/tw-cmd-index-XXXXXX";
+	char dir0[512], dir1[512], path_env[1100], file[512];
+	struct console_cmd_index index;
+	struct timespec ts = {0, 20000000};
+	char *base = mkdtemp(tmpl);
+	bool ret = true;
+
+	if (!base)
+		return -1;
+	snprintf(dir0, sizeof(dir0), "%s/bin0", base);
+	snprintf(dir1, sizeof(dir1), "%s/bin1", base);
+	snprintf(file, sizeof(file), "%s/cmds.index", base);
+	snprintf(path_env, sizeof(path_env), "%s:%s:%s/none", dir0, dir1,
+	         base);
+	mkdir(dir0, 0755);
+	mkdir(dir1, 0755);
+	for (unsigned i = 0; i < sizeof(cmds)/sizeof(cmds[0]); i++)
+		ret = ret && touch((i % 2) ? dir1 : dir0, cmds[i]);
+	//duplicated entry in two directories
+	ret = ret && touch(dir1, "ls");
+
+	ret = ret && console_cmd_index_build(file, path_env);
+	ret = ret && console_cmd_index_load(&index, file, path_env);
+	ret = ret && !index.stale;
+	ret = ret && index.n_cmds == sizeof(cmds)/sizeof(cmds[0]);
+	ret = ret && console_cmd_index_find(&index, "git", 3);
+	ret = ret && console_cmd_index_find(&index, "git status", 3);
+	ret = ret && !console_cmd_index_find(&index, "gi", 2);
+	ret = ret && !console_cmd_index_find(&index, "vim", 3);
+	ret = ret && prefix_test(&index);
+	console_cmd_index_unload(&index);
+
+	//a new command makes the index stale
+	nanosleep(&ts, NULL);
+	ret = ret && touch(dir0, "vim");
+	ret = ret && console_cmd_index_load(&index, file, path_env);
+	ret = ret && index.stale;
+	console_cmd_index_unload(&index);
+	//so does a different PATH
+	ret = ret && console_cmd_index_load(&index, file, dir0);
+	ret = ret && index.stale;
+	console_cmd_index_unload(&index);
+
+	ret = ret && console_cmd_index_build(file, path_env);
+	ret = ret && console_cmd_index_load(&index, file, path_env);
+	ret = ret && !index.stale && console_cmd_index_find(&index, "vim", 3);
+	console_cmd_index_unload(&index);
+
+	nftw(base, remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+	return ret ? 0 : -1;
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "console_fuzzy.h"
+
+#define N_APPS 10000
+#define N_ROUNDS 20
+
+static const char *words[] = {
+	"fire", "fox", "terminal", "office", "writer", "calc", "image",
+	"viewer", "editor", "player", "media", "music", "video", "chat",
+	"mail", "code", "studio", "gnome", "kde", "system", "monitor",
+	"settings", "manager", "file", "browser", "text", "paint", "game",
+	"network", "sound", "screen", "shot", "recorder", "disk", "usage",
+};
+
+static const char *queries[] = {
+	"firefox", "terminal", "libreoffice", "gnome-system-monitor",
+	"vlc", "ffx", "txtedt", "zzzz",
+};
+
+static inline double
+elapsed_us(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1e6 + (b->tv_nsec - a->tv_nsec) / 1e3;
+}
+
+static char **
+make_corpus(unsigned n)
+{
+	char **names = calloc(n, sizeof(char *));
+	unsigned nw = sizeof(words) / sizeof(words[0]);
+
+	srand(42);
+	for (unsigned i = 0; i < n; i++) {
+		char name[128] = {0};
+		int parts = 1 + rand() % 3;
+
+		for (int j = 0; j < parts; j++) {
+			if (j)
+				strcat(name, (rand() % 2) ? " " : "-");
+			strcat(name, words[rand() % nw]);
+		}
+		snprintf(name + strlen(name), sizeof(name) - strlen(name),
+		         " %u", i);
+		names[i] = strdup(name);
+	}
+	return names;
+}
+
+static bool
+check_ranking(struct console_fuzzy_index *index, char **names)
+{
+	const struct console_fuzzy_match *matches;
+	uint32_t n = console_fuzzy_index_search(index, "fire", &matches);
+
+	//prefix matches has to come first
+	if (!n || strncmp(names[matches[0].index], "fire", 4))
+		return false;
+	for (uint32_t i = 1; i < n; i++)
+		if (matches[i].score < matches[i-1].score)
+			return false;
+	return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct console_fuzzy_index index;
+	const struct console_fuzzy_match *matches;
+	struct timespec start, end;
+	double build_us, total_us = 0.0, max_us = 0.0;
+	unsigned n_searches = 0, n_apps = argc > 1 ? atoi(argv[1]) : N_APPS;
+	char **names = make_corpus(n_apps);
+	char query[64];
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (!console_fuzzy_index_init(&index, (const char *const *)names,
+	                              n_apps))
+		return -1;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	build_us = elapsed_us(&start, &end);
+
+	//simulate typing, every prefix of the query is a keystroke
+	for (int r = 0; r < N_ROUNDS; r++) {
+		for (unsigned q = 0; q < sizeof(queries)/sizeof(queries[0]);
+		     q++) {
+			for (size_t l = 1; l <= strlen(queries[q]); l++) {
+				double us;
+
+				strncpy(query, queries[q], l);
+				query[l] = '\0';
+				clock_gettime(CLOCK_MONOTONIC, &start);
+				console_fuzzy_index_search(&index, query,
+				                           &matches);
+				clock_gettime(CLOCK_MONOTONIC, &end);
+				us = elapsed_us(&start, &end);
+				total_us += us;
+				max_us = us > max_us ? us : max_us;
+				n_searches++;
+			}
+		}
+	}
+	printf("{\"entries\": %u, \"build_us\": %.1f, \"searches\": %u, "
+	       "\"avg_us\": %.1f, \"max_us\": %.1f}\n", n_apps, build_us,
+	       n_searches, total_us / n_searches, max_us);
+
+	if (!check_ranking(&index, names))
+		return -1;
+	console_fuzzy_index_fini(&index);
+	for (unsigned i = 0; i < n_apps; i++)
+		free(names[i]);
+	free(names);
+	return 0;
+}
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "internal.h"
+
+static unsigned flips = 0;
+static uint64_t last_seq = 0;
+static uint64_t last_flip = 0;
+
+static void
+handle_flip(int fd, unsigned seq, unsigned tv_sec, unsigned tv_usec,
+            unsigned crtc_id, void *data)
+{
+	flips++;
+	last_seq = seq;
+	last_flip = (uint64_t)tv_sec * 1000000000 + (uint64_t)tv_usec * 1000;
+}
+
+static inline void
+dispatch(struct tw_drm_gpu *gpu)
+{
+	gpu->kms->impl->dispatch(gpu, handle_flip);
+}
+
+static void
+setup_mode(drmModeModeInfo *mode)
+{
+	memset(mode, 0, sizeof(*mode));
+	mode->clock = 148500;
+	mode->hdisplay = 1920;
+	mode->htotal = 2200;
+	mode->vdisplay = 1080;
+	mode->vtotal = 1125;
+	mode->vrefresh = 60;
+}
+
+static bool
+test_frame_pacing(struct tw_kms_fake_device *dev, struct tw_drm_gpu *gpu,
+                  struct tw_drm_display *dpy, uint64_t period)
+{
+	bool ret = true;
+	uint64_t seq = last_seq;
+
+	//render takes 5ms, every frame flips on the next vblank
+	for (int i = 0; i < 100 && ret; i++) {
+		tw_kms_fake_device_advance(dev, 5000000);
+		dpy->status.next.fb.fb = 42 + (i % 2);
+		ret = ret && tw_kms_state_submit_atomic(&dpy->status.next, dpy,
+		                                        DRM_MODE_PAGE_FLIP_EVENT);
+		dispatch(gpu);
+		ret = ret && flips == 0;
+		tw_kms_fake_device_advance(dev, period - 5000000);
+		dispatch(gpu);
+		seq++;
+		ret = ret && flips == 1 && last_seq == seq &&
+			last_flip == (seq * period) / 1000 * 1000;
+		flips = 0;
+	}
+	return ret;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct tw_kms_fake_device dev;
+	struct tw_drm_gpu gpu = {0};
+	struct tw_drm_display *dpy = calloc(1, sizeof(*dpy));
+	struct tw_kms_state *next = &dpy->status.next;
+	uint32_t crtc0, conn;
+	uint64_t period;
+	int fds[2];
+	bool ret = true;
+
+	tw_kms_fake_device_init(&dev);
+	crtc0 = tw_kms_fake_device_add_crtc(&dev);
+	tw_kms_fake_device_add_crtc(&dev);
+	tw_kms_fake_device_add_plane(&dev, TW_DRM_PLANE_MAJOR, 1 << 0);
+	tw_kms_fake_device_add_plane(&dev, TW_DRM_PLANE_MAJOR, 1 << 1);
+	tw_kms_fake_device_add_plane(&dev, TW_DRM_PLANE_CURSOR, 3);
+	conn = tw_kms_fake_device_add_connector(&dev, 1 << 0);
+	tw_kms_fake_device_setup_gpu(&dev, &gpu);
+
+	dpy->gpu = &gpu;
+	tw_kms_fake_device_read_connector(&dev, conn, &dpy->props);
+	dpy->status.now.in_fence_fd = -1;
+	next->in_fence_fd = -1;
+	next->props_connector = &dpy->props;
+	next->props_crtc = &gpu.crtcs[0].props;
+	next->props_main_plane = &gpu.planes[0].props;
+	next->crtc_id = crtc0;
+	next->active = true;
+	next->fb.fb = 42;
+	next->fb.w = 1920;
+	next->fb.h = 1080;
+	setup_mode(&next->mode);
+	dpy->status.pending = TW_DRM_PENDING_MODE | TW_DRM_PENDING_ACTIVE |
+		TW_DRM_PENDING_CRTC;
+
+	//test only commit does not change anything
+	ret = ret && tw_kms_state_submit_atomic(next, dpy,
+	                                        DRM_MODE_ATOMIC_TEST_ONLY);
+	ret = ret && dev.stats.test_commits == 1 && dev.stats.commits == 0;
+	ret = ret && dpy->status.pending && dev.n_blobs == 0;
+	ret = ret && !dev.crtcs[0].obj.values[TW_KMS_FAKE_CRTC_ACTIVE];
+	//plane not possible for the crtc
+	next->props_main_plane = &gpu.planes[1].props;
+	ret = ret && !tw_kms_state_submit_atomic(next, dpy,
+	                                         DRM_MODE_ATOMIC_TEST_ONLY);
+	next->props_main_plane = &gpu.planes[0].props;
+	//primary plane has to cover the crtc
+	next->fb.w = 1280;
+	ret = ret && !tw_kms_state_submit_atomic(next, dpy,
+	                                         DRM_MODE_ATOMIC_TEST_ONLY);
+	next->fb.w = 1920;
+	ret = ret && dev.stats.rejected == 2 && dev.n_blobs == 0;
+
+	//modeset then the first flip lands on the next vblank
+	ret = ret && tw_kms_state_submit_atomic(next, dpy,
+	                                        DRM_MODE_PAGE_FLIP_EVENT);
+	ret = ret && dev.stats.modesets == 1 && !dpy->status.pending;
+	period = dev.crtcs[0].period;
+	ret = ret && period == 16666666;
+	//flipping again before the vblank is busy
+	ret = ret && !tw_kms_state_submit_atomic(next, dpy,
+	                                         DRM_MODE_PAGE_FLIP_EVENT);
+	dispatch(&gpu);
+	ret = ret && flips == 0;
+	tw_kms_fake_device_advance(&dev, period);
+	dispatch(&gpu);
+	//timestamps are in microseconds
+	ret = ret && flips == 1 && last_flip == period / 1000 * 1000;
+	flips = 0;
+
+	ret = ret && test_frame_pacing(&dev, &gpu, dpy, period);
+
+	//explicit fence is passed to the plane then closed
+	ret = ret && !pipe(fds);
+	next->in_fence_fd = fds[0];
+	ret = ret && tw_kms_state_submit_atomic(next, dpy,
+	                                        DRM_MODE_PAGE_FLIP_EVENT);
+	ret = ret && dev.stats.fences == 1 && next->in_fence_fd == -1;
+	close(fds[1]);
+	tw_kms_fake_device_advance(&dev, period);
+	dispatch(&gpu);
+
+	//disabling the crtc is a modeset
+	tw_kms_state_deactivate(next);
+	dpy->status.pending = TW_DRM_PENDING_ACTIVE;
+	ret = ret && tw_kms_state_submit_atomic(next, dpy, 0);
+	ret = ret && dev.stats.modesets == 2;
+	ret = ret && !dev.crtcs[0].obj.values[TW_KMS_FAKE_CRTC_ACTIVE];
+
+	for (unsigned i = 0; i < dev.n_planes; i++)
+		tw_drm_plane_fini(&gpu.planes[i]);
+	free(dpy);
+	if (!ret)
+		fprintf(stderr, "fake KMS test failed\n");
+	return ret ? 0 : -1;
+}
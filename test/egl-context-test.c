@@ -1,11 +1,76 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <wayland-server.h>
 #include <taiwins/objects/logger.h>
 #include <taiwins/objects/egl.h>
 
+#include "internal.h"
+
+#define GUTTER TW_EGL_ATLAS_GUTTER
+
+static bool
+egl_atlas_test(const struct tw_egl_options *opts)
+{
+	struct wl_display *display = wl_display_create();
+	struct tw_render_context *base = display ?
+		tw_render_context_create_egl(display, opts) : NULL;
+	struct tw_egl_render_context *ctx;
+	struct tw_egl_render_texture a = {0}, b = {0}, c = {0}, d = {0};
+	struct tw_egl_render_texture e = {0}, big = {0};
+	struct tw_egl_atlas *atlas;
+	bool ret;
+
+	if (!base) {
+		if (display)
+			wl_display_destroy(display);
+		return false;
+	}
+	ctx = wl_container_of(base, ctx, base);
+	tw_egl_make_current(&ctx->egl, EGL_NO_SURFACE);
+
+	//a and b share the first shelf, c is too tall and opens another one
+	ret = tw_egl_atlas_alloc(ctx, &a, GL_BGRA_EXT, 32, 32);
+	ret = ret && tw_egl_atlas_alloc(ctx, &b, GL_BGRA_EXT, 32, 32);
+	ret = ret && tw_egl_atlas_alloc(ctx, &c, GL_BGRA_EXT, 64, 100);
+	ret = ret && !tw_egl_atlas_alloc(ctx, &big, GL_BGRA_EXT,
+	                                 TW_EGL_ATLAS_MAX_SIZE + 1, 16);
+	if (!ret)
+		goto out;
+	atlas = a.atlas;
+	ret = ret && b.atlas == atlas && c.atlas == atlas;
+	ret = ret && a.gltex == atlas->gltex && atlas->used == 3;
+	ret = ret && a.shelf == 0 && a.x == GUTTER && a.y == GUTTER;
+	ret = ret && b.shelf == 0 && b.x == 32 + 3 * GUTTER && b.y == GUTTER;
+	ret = ret && c.shelf == 1 && c.x == GUTTER && c.y == 32 + 3 * GUTTER;
+	ret = ret && a.uv.x1 == (GLfloat)GUTTER / atlas->size;
+	ret = ret && a.uv.x2 == (GLfloat)(32 + GUTTER) / atlas->size;
+
+	//the emptied shelf is reused from the start
+	tw_egl_atlas_free(ctx, &a);
+	tw_egl_atlas_free(ctx, &b);
+	ret = ret && !a.atlas && !a.gltex;
+	ret = ret && tw_egl_atlas_alloc(ctx, &d, GL_BGRA_EXT, 16, 16);
+	ret = ret && d.shelf == 0 && d.x == GUTTER && d.y == GUTTER;
+
+	//the trailing shelf is given back, e opens one right below d
+	tw_egl_atlas_free(ctx, &c);
+	ret = ret && tw_egl_atlas_alloc(ctx, &e, GL_BGRA_EXT, 64, 200);
+	ret = ret && e.shelf == 1 && e.y == 32 + 3 * GUTTER;
+
+	//the last atlas stays around empty
+	tw_egl_atlas_free(ctx, &d);
+	tw_egl_atlas_free(ctx, &e);
+	ret = ret && atlas->used == 0 && atlas->shelves.size == 0;
+	ret = ret && ctx->atlases.next == &atlas->link;
+out:
+	tw_egl_unset_current(&ctx->egl);
+	wl_display_destroy(display);
+	return ret;
+}
 
 int main(int argc, char *argv[])
 {
@@ -27,5 +92,9 @@ int main(int argc, char *argv[])
 
 	tw_egl_fini(&egl);
 
+	if (!egl_atlas_test(&opts)) {
+		fprintf(stderr, "egl atlas test failed!\n");
+		exit(EXIT_FAILURE);
+	}
 	return 0;
 }
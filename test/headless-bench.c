@@ -0,0 +1,472 @@
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <wayland-server-core.h>
+#include <wayland-server.h>
+#include <taiwins/objects/logger.h>
+#include <taiwins/objects/egl.h>
+#include <taiwins/objects/utils.h>
+#include <taiwins/render_context.h>
+#include <taiwins/render_pipeline.h>
+#include <taiwins/render_output.h>
+#include <taiwins/backend_headless.h>
+#include <taiwins/engine.h>
+#include "test_desktop.h"
+#include "bench-client.h"
+
+#define MAX_CLIENTS 256
+#define SHUTDOWN_MARGIN 1000
+
+struct tw_render_pipeline *
+tw_egl_render_pipeline_create_default(struct tw_render_context *ctx,
+                                      struct tw_layers_manager *manager);
+struct tw_server_output_manager *
+tw_server_output_manager_create_global(struct tw_engine *engine,
+                                       struct tw_render_context *ctx);
+
+struct bench_samples {
+	uint32_t *v;
+	size_t n, alloc;
+};
+
+struct bench_output {
+	struct tw_render_output *output;
+	struct bench_harness *harness;
+	struct timespec cpu_start, wall_start;
+	struct wl_listener pre_frame, post_frame;
+};
+
+struct bench_harness {
+	struct bench_output outputs[8];
+	unsigned n_outputs;
+
+	struct bench_samples frame_cpu, frame_wall, latency;
+	struct tw_bench_client_report total;
+	unsigned clients_failed;
+
+	struct {
+		pid_t pid;
+		int fd;
+	} clients[MAX_CLIENTS];
+	unsigned n_clients;
+};
+
+static const char *damage_names[] = {
+	[TW_BENCH_DAMAGE_FULL] = "full",
+	[TW_BENCH_DAMAGE_PARTIAL] = "partial",
+	[TW_BENCH_DAMAGE_SCATTER] = "scatter",
+};
+
+static inline uint32_t
+diff_us(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1000000 +
+		(b->tv_nsec - a->tv_nsec) / 1000;
+}
+
+static void
+samples_add(struct bench_samples *samples, uint32_t v)
+{
+	uint32_t *tmp;
+
+	if (samples->n == samples->alloc) {
+		size_t n = samples->alloc ? samples->alloc * 2 : 1024;
+		if (!(tmp = realloc(samples->v, n * sizeof(uint32_t))))
+			return;
+		samples->v = tmp;
+		samples->alloc = n;
+	}
+	samples->v[samples->n++] = v;
+}
+
+static int
+cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void
+samples_print(FILE *f, const char *name, struct bench_samples *samples)
+{
+	double sum = 0.0;
+	size_t n = samples->n;
+
+	if (!n) {
+		fprintf(f, "  \"%s\": null,\n", name);
+		return;
+	}
+	qsort(samples->v, n, sizeof(uint32_t), cmp_u32);
+	for (size_t i = 0; i < n; i++)
+		sum += samples->v[i];
+	fprintf(f, "  \"%s\": {\"samples\": %zu, \"mean\": %.1f, "
+	        "\"p50\": %u, \"p90\": %u, \"p99\": %u, \"max\": %u},\n",
+	        name, n, sum / n, samples->v[n / 2], samples->v[n * 9 / 10],
+	        samples->v[n * 99 / 100], samples->v[n-1]);
+}
+
+/* returns the value of a kB field in /proc/self/status */
+static long
+read_proc_status_kb(const char *field)
+{
+	char line[256];
+	size_t len = strlen(field);
+	long kb = -1;
+	FILE *f = fopen("/proc/self/status", "r");
+
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f))
+		if (!strncmp(line, field, len) && line[len] == ':') {
+			kb = strtol(line + len + 1, NULL, 10);
+			break;
+		}
+	fclose(f);
+	return kb;
+}
+
+/******************************************************************************
+ * frame instrumentation
+ *****************************************************************************/
+
+static void
+notify_bench_pre_frame(struct wl_listener *listener, void *data)
+{
+	struct bench_output *output =
+		wl_container_of(listener, output, pre_frame);
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &output->cpu_start);
+	clock_gettime(CLOCK_MONOTONIC, &output->wall_start);
+}
+
+static void
+notify_bench_post_frame(struct wl_listener *listener, void *data)
+{
+	struct bench_output *output =
+		wl_container_of(listener, output, post_frame);
+	struct bench_harness *harness = output->harness;
+	struct timespec cpu, wall;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+	clock_gettime(CLOCK_MONOTONIC, &wall);
+	samples_add(&harness->frame_cpu, diff_us(&output->cpu_start, &cpu));
+	samples_add(&harness->frame_wall, diff_us(&output->wall_start, &wall));
+}
+
+static void
+harness_watch_outputs(struct bench_harness *harness,
+                      struct tw_backend *backend)
+{
+	struct tw_output_device *device;
+
+	wl_list_for_each(device, &backend->outputs, link) {
+		struct bench_output *output =
+			&harness->outputs[harness->n_outputs];
+
+		if (harness->n_outputs >= 8)
+			break;
+		output->output = wl_container_of(device, output->output,
+		                                 device);
+		output->harness = harness;
+		tw_signal_setup_listener(&output->output->signals.pre_frame,
+		                         &output->pre_frame,
+		                         notify_bench_pre_frame);
+		tw_signal_setup_listener(&output->output->signals.post_frame,
+		                         &output->post_frame,
+		                         notify_bench_post_frame);
+		harness->n_outputs++;
+	}
+}
+
+/******************************************************************************
+ * clients
+ *****************************************************************************/
+
+static bool
+harness_spawn_client(struct bench_harness *harness,
+                     struct tw_bench_client_options *opts)
+{
+	int fds[2];
+	pid_t pid;
+
+	if (harness->n_clients >= MAX_CLIENTS || pipe(fds) < 0)
+		return false;
+	fflush(NULL);
+	if ((pid = fork()) < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	} else if (pid == 0) {
+		close(fds[0]);
+		_exit(tw_bench_client_run(opts, fds[1]));
+	}
+	close(fds[1]);
+	harness->clients[harness->n_clients].pid = pid;
+	harness->clients[harness->n_clients].fd = fds[0];
+	harness->n_clients++;
+	return true;
+}
+
+static bool
+read_all(int fd, void *data, size_t size)
+{
+	char *ptr = data;
+
+	while (size) {
+		ssize_t n = read(fd, ptr, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		ptr += n;
+		size -= n;
+	}
+	return true;
+}
+
+static void
+harness_collect_client(struct bench_harness *harness, unsigned i)
+{
+	struct tw_bench_client_report report;
+	int fd = harness->clients[i].fd, status = 0;
+	bool ret = read_all(fd, &report, sizeof(report));
+
+	for (uint32_t j = 0; ret && j < report.n_samples; j++) {
+		uint32_t sample;
+
+		if (!(ret = read_all(fd, &sample, sizeof(sample))))
+			break;
+		samples_add(&harness->latency, sample);
+	}
+	if (ret) {
+		harness->total.commits += report.commits;
+		harness->total.skipped += report.skipped;
+		harness->total.presented += report.presented;
+		harness->total.discarded += report.discarded;
+		harness->total.dmabuf += report.dmabuf;
+	}
+	close(fd);
+	waitpid(harness->clients[i].pid, &status, 0);
+	if (!ret || !WIFEXITED(status) || WEXITSTATUS(status))
+		harness->clients_failed++;
+}
+
+static int
+bench_on_timeout(void *data)
+{
+	wl_display_terminate(data);
+	return 0;
+}
+
+static void
+print_report(FILE *f, struct bench_harness *harness,
+             const struct tw_bench_client_options *opts,
+             unsigned n_shm, unsigned n_dmabuf, unsigned ow, unsigned oh,
+             const struct rusage *usage, long rss_start)
+{
+	double cpu_ms = usage->ru_utime.tv_sec * 1e3 +
+		usage->ru_utime.tv_usec / 1e3 +
+		usage->ru_stime.tv_sec * 1e3 + usage->ru_stime.tv_usec / 1e3;
+
+	fprintf(f, "{\n  \"benchmark\": \"headless\",\n");
+	fprintf(f, "  \"config\": {\"output\": \"%ux%u\", "
+	        "\"client\": \"%ux%u\", \"shm_clients\": %u, "
+	        "\"dmabuf_clients\": %u, \"subsurface_depth\": %u, "
+	        "\"commit_rate\": %u, \"damage\": \"%s\", "
+	        "\"region_rects\": %u, \"duration_ms\": %u},\n",
+	        ow, oh, opts->width, opts->height, n_shm, n_dmabuf,
+	        opts->subsurface_depth, opts->commit_rate,
+	        damage_names[opts->damage], opts->region_rects,
+	        opts->duration_ms);
+	fprintf(f, "  \"frames\": %zu,\n", harness->frame_cpu.n);
+	samples_print(f, "frame_cpu_us", &harness->frame_cpu);
+	samples_print(f, "frame_wall_us", &harness->frame_wall);
+	samples_print(f, "latency_us", &harness->latency);
+	fprintf(f, "  \"commits\": %u,\n  \"skipped\": %u,\n"
+	        "  \"presented\": %u,\n  \"discarded\": %u,\n"
+	        "  \"dmabuf_used\": %u,\n  \"clients_failed\": %u,\n",
+	        harness->total.commits, harness->total.skipped,
+	        harness->total.presented, harness->total.discarded,
+	        harness->total.dmabuf, harness->clients_failed);
+	fprintf(f, "  \"cpu_total_ms\": %.1f,\n", cpu_ms);
+	fprintf(f, "  \"cpu_per_commit_us\": %.2f,\n",
+	        harness->total.commits ?
+	        cpu_ms * 1e3 / harness->total.commits : 0.0);
+	fprintf(f, "  \"rss_start_kb\": %ld,\n  \"rss_end_kb\": %ld,\n"
+	        "  \"rss_peak_kb\": %ld\n}\n", rss_start,
+	        read_proc_status_kb("VmRSS"), read_proc_status_kb("VmHWM"));
+}
+
+static void
+print_usage(const char *prog)
+{
+	fprintf(stderr,
+	        "usage: %s [options]\n"
+	        "  -c N        number of shm clients (4)\n"
+	        "  -d N        number of dmabuf clients (0)\n"
+	        "  -s N        subsurface depth of every client (0)\n"
+	        "  -r HZ       commit rate, 0 follows frame callbacks (0)\n"
+	        "  -R N        opaque and input regions of N rectangles (0)\n"
+	        "  -p PATTERN  damage pattern: full, partial, scatter "
+	        "(partial)\n"
+	        "  -t MS       duration in milliseconds (5000)\n"
+	        "  -g WxH      client size (256x256)\n"
+	        "  -O WxH      output size (1920x1080)\n"
+	        "  -n NODE     render node for dmabuf clients\n"
+	        "  -o FILE     write the JSON report to FILE (stdout)\n",
+	        prog);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct bench_harness harness = {0};
+	struct tw_bench_client_options opts = {
+		.buffer = TW_BENCH_BUFFER_SHM,
+		.damage = TW_BENCH_DAMAGE_PARTIAL,
+		.width = 256, .height = 256,
+		.duration_ms = 5000,
+	};
+	unsigned n_shm = 4, n_dmabuf = 0, ow = 1920, oh = 1080;
+	const char *report_file = NULL;
+	struct wl_display *display;
+	struct wl_event_source *timer;
+	struct tw_test_desktop desktop;
+	struct tw_render_context *ctx;
+	struct tw_render_pipeline *pipeline;
+	struct tw_backend *backend;
+	struct tw_engine *engine;
+	struct rusage usage;
+	long rss_start;
+	FILE *f = stdout;
+	int opt, ret = EXIT_FAILURE;
+
+	while ((opt = getopt(argc, argv, "c:d:s:r:R:p:t:g:O:n:o:h")) != -1) {
+		switch (opt) {
+		case 'c':
+			n_shm = atoi(optarg);
+			break;
+		case 'd':
+			n_dmabuf = atoi(optarg);
+			break;
+		case 's':
+			opts.subsurface_depth = atoi(optarg);
+			break;
+		case 'r':
+			opts.commit_rate = atoi(optarg);
+			break;
+		case 'R':
+			opts.region_rects = atoi(optarg);
+			break;
+		case 'p':
+			if (!strcmp(optarg, "full"))
+				opts.damage = TW_BENCH_DAMAGE_FULL;
+			else if (!strcmp(optarg, "scatter"))
+				opts.damage = TW_BENCH_DAMAGE_SCATTER;
+			else
+				opts.damage = TW_BENCH_DAMAGE_PARTIAL;
+			break;
+		case 't':
+			opts.duration_ms = atoi(optarg);
+			break;
+		case 'g':
+			if (sscanf(optarg, "%ux%u", &opts.width,
+			           &opts.height) != 2)
+				goto err_usage;
+			break;
+		case 'O':
+			if (sscanf(optarg, "%ux%u", &ow, &oh) != 2)
+				goto err_usage;
+			break;
+		case 'n':
+			opts.render_node = optarg;
+			break;
+		case 'o':
+			report_file = optarg;
+			break;
+		default:
+			goto err_usage;
+		}
+	}
+	if (!opts.width || !opts.height || !ow || !oh ||
+	    n_shm + n_dmabuf > MAX_CLIENTS)
+		goto err_usage;
+
+	tw_logger_use_file(stderr);
+	display = wl_display_create();
+	if (!display)
+		return EXIT_FAILURE;
+	if (!(opts.socket = wl_display_add_socket_auto(display)))
+		goto out;
+	rss_start = read_proc_status_kb("VmRSS");
+
+	//spawn the clients before touching the GPU, they connect once the
+	//event loop runs
+	for (unsigned i = 0; i < n_shm + n_dmabuf; i++) {
+		opts.buffer = i < n_shm ?
+			TW_BENCH_BUFFER_SHM : TW_BENCH_BUFFER_DMABUF;
+		opts.seed = i + 1;
+		if (!harness_spawn_client(&harness, &opts))
+			harness.clients_failed++;
+	}
+
+	if (!(backend = tw_headless_backend_create(display)))
+		goto out;
+	engine = tw_engine_create_global(display, backend);
+	if (!engine)
+		goto out;
+	tw_test_desktop_init(&desktop, engine);
+	ctx = tw_render_context_create_egl(display,
+	                                   tw_backend_get_egl_params(backend));
+	if (!ctx)
+		goto out_desktop;
+	if (!tw_headless_backend_add_output(backend, ow, oh))
+		goto out_desktop;
+	pipeline = tw_egl_render_pipeline_create_default(
+		ctx, &engine->layers_manager);
+	wl_list_insert(ctx->pipelines.next, &pipeline->link);
+	tw_server_output_manager_create_global(engine, ctx);
+	harness_watch_outputs(&harness, backend);
+	tw_backend_start(backend, ctx);
+
+	timer = wl_event_loop_add_timer(wl_display_get_event_loop(display),
+	                                bench_on_timeout, display);
+	wl_event_source_timer_update(timer,
+	                             opts.duration_ms + SHUTDOWN_MARGIN);
+	wl_display_run(display);
+	wl_event_source_remove(timer);
+	getrusage(RUSAGE_SELF, &usage);
+
+	for (unsigned i = 0; i < harness.n_clients; i++)
+		harness_collect_client(&harness, i);
+	harness.n_clients = 0;
+	if (report_file && !(f = fopen(report_file, "w")))
+		f = stdout;
+	print_report(f, &harness, &opts, n_shm, n_dmabuf, ow, oh, &usage,
+	             rss_start);
+	if (f != stdout)
+		fclose(f);
+	ret = harness.clients_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+out_desktop:
+	tw_test_desktop_fini(&desktop);
+out:
+	for (unsigned i = 0; i < harness.n_clients; i++) {
+		kill(harness.clients[i].pid, SIGTERM);
+		harness_collect_client(&harness, i);
+	}
+	wl_display_destroy(display);
+	free(harness.frame_cpu.v);
+	free(harness.frame_wall.v);
+	free(harness.latency.v);
+	return ret;
+err_usage:
+	print_usage(argv[0]);
+	return EXIT_FAILURE;
+}
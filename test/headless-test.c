@@ -1,8 +1,10 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
+#include <GLES2/gl2.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <unistd.h>
 #include <wayland-server-core.h>
 #include <wayland-server.h>
@@ -10,6 +12,141 @@
 #include <taiwins/objects/egl.h>
 #include <taiwins/backend_headless.h>
 #include <taiwins/render_context.h>
+#include <taiwins/render_output.h>
+#include <taiwins/render_pipeline.h>
+#include <taiwins/objects/utils.h>
+
+struct vblank_counter {
+	struct wl_listener listener;
+	unsigned count;
+};
+
+static void
+notify_need_frame(struct wl_listener *listener, void *data)
+{
+	struct vblank_counter *counter =
+		wl_container_of(listener, counter, listener);
+	counter->count++;
+}
+
+static bool
+test_virtual_clock(struct tw_backend *backend)
+{
+	struct vblank_counter counters[2] = {0};
+	struct tw_output_device *device;
+	struct timespec now;
+	unsigned i = 0;
+	bool ret = true;
+
+	wl_list_for_each(device, &backend->outputs, link) {
+		struct tw_render_output *output =
+			wl_container_of(device, output, device);
+		tw_signal_setup_listener(&output->signals.need_frame,
+		                         &counters[i++].listener,
+		                         notify_need_frame);
+	}
+	//vblanks only come from stepping the clock
+	tw_headless_backend_advance_clock(backend, TW_NS_PER_S);
+	ret = ret && counters[0].count == 60 && counters[1].count == 144;
+	device = wl_container_of(backend->outputs.next, device, link);
+	tw_output_device_read_clock(device, &now);
+	ret = ret && now.tv_sec == 1 && now.tv_nsec == 0;
+
+	for (i = 0; i < 2; i++)
+		wl_list_remove(&counters[i].listener.link);
+	return ret;
+}
+
+struct capture_result {
+	bool done, success, damaged;
+};
+
+static void
+clear_repaint(struct tw_render_pipeline *pipeline,
+              struct tw_render_output *output, int buffer_age)
+{
+	glClearColor(1.0, 1.0, 0.0, 1.0);
+	glClear(GL_COLOR_BUFFER_BIT);
+}
+
+static void
+handle_capture_done(struct tw_render_capture *capture,
+                    const pixman_region32_t *damage, bool success)
+{
+	struct capture_result *result = capture->user_data;
+
+	result->done = true;
+	result->success = success;
+	result->damaged = pixman_region32_not_empty(
+		(pixman_region32_t *)damage);
+}
+
+static bool
+run_capture(struct tw_backend *backend, struct tw_render_output *output,
+            struct tw_render_capture *capture)
+{
+	struct capture_result *result = capture->user_data;
+
+	memset(result, 0, sizeof(*result));
+	if (!tw_render_output_capture(output, capture))
+		return false;
+	tw_render_output_dirty(output);
+	tw_render_output_post_frame(output);
+	for (int i = 0; i < 3 && !result->done; i++)
+		tw_headless_backend_advance_clock(backend, TW_NS_PER_S / 50);
+	return result->done && result->success;
+}
+
+static bool
+test_capture(struct tw_backend *backend, struct tw_render_context *ctx)
+{
+	struct tw_render_pipeline pipeline = {0};
+	struct tw_output_device *device =
+		wl_container_of(backend->outputs.next, device, link);
+	struct tw_render_output *output =
+		wl_container_of(device, output, device);
+	struct capture_result result;
+	struct tw_render_capture capture = {
+		.width = 640, .height = 480, .stride = 640 * 4,
+		.done = handle_capture_done,
+		.user_data = &result,
+	};
+	uint32_t *pixels = calloc(640 * 480, sizeof(uint32_t));
+	uint32_t yellow =
+		tw_render_output_capture_format(output) ==
+		WL_SHM_FORMAT_ARGB8888 ? 0xffffff00 : 0xff00ffff;
+	bool ret = pixels != NULL;
+
+	tw_render_pipeline_init(&pipeline, "clear", ctx);
+	pipeline.impl.repaint_output = clear_repaint;
+	wl_list_insert(&ctx->pipelines, &pipeline.link);
+
+	capture.pixels = pixels;
+	ret = ret && run_capture(backend, output, &capture);
+	ret = ret && result.damaged && pixels[0] == yellow &&
+		pixels[640 * 480 - 1] == yellow;
+	//nothing changed on screen, so nothing to copy
+	capture.flags = TW_RENDER_CAPTURE_DAMAGE_ONLY;
+	ret = ret && run_capture(backend, output, &capture);
+	ret = ret && !result.damaged;
+	//a region of the output
+	pixels[0] = 0;
+	capture.flags = 0;
+	capture.x = 320;
+	capture.y = 240;
+	capture.width = 16;
+	capture.height = 16;
+	capture.stride = 16 * 4;
+	ret = ret && run_capture(backend, output, &capture);
+	ret = ret && pixels[0] == yellow && pixels[16 * 16 - 1] == yellow;
+	//out of the output
+	capture.x = 630;
+	ret = ret && !tw_render_output_capture(output, &capture);
+
+	tw_render_pipeline_fini(&pipeline);
+	free(pixels);
+	return ret;
+}
 
 int main(int argc, char *argv[])
 {
@@ -30,6 +167,16 @@ int main(int argc, char *argv[])
 		tw_backend_get_egl_params(backend);
 	struct tw_render_context *ctx =
 		tw_render_context_create_egl(display, opts);
+	if (!ctx)
+		goto err;
+	tw_headless_backend_add_output(backend, 640, 480);
+	tw_headless_backend_add_output_with_refresh(backend, 640, 480, 144000);
+	tw_headless_backend_use_virtual_clock(backend, 0);
+	tw_backend_start(backend, ctx);
+	if (!test_virtual_clock(backend))
+		goto err;
+	if (!test_capture(backend, ctx))
+		goto err;
 	tw_render_context_destroy(ctx);
 
 	wl_display_destroy(display);
@@ -0,0 +1,54 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <taiwins/objects/logger.h>
+
+static int
+count_lines(FILE *file, const char *needle)
+{
+	char line[1024];
+	int n = 0;
+
+	rewind(file);
+	while (fgets(line, sizeof(line), file))
+		if (strstr(line, needle))
+			n++;
+	return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct tw_logger_stats stats;
+	FILE *file = tmpfile();
+	FILE *copy;
+
+	if (!file)
+		return EXIT_FAILURE;
+	//the logger closes the file, keep a handle to read it back
+	copy = fdopen(dup(fileno(file)), "r");
+	tw_logger_use_file(file);
+
+	//one call site floods, the other one is not affected. The window opens on
+	//the first message, the loop is well within it
+	for (int i = 0; i < 100; i++)
+		tw_logl_level(TW_LOG_WARN, "flooding %d", i);
+	tw_logl_level(TW_LOG_INFO, "still here");
+	tw_logger_close();
+
+	tw_logger_get_stats(&stats);
+	if (stats.rate_limited != 100 - TW_LOG_RATE_BURST)
+		goto err;
+	if (stats.logged != TW_LOG_RATE_BURST + 1 || stats.queue_full)
+		goto err;
+	if (count_lines(copy, "flooding") != TW_LOG_RATE_BURST ||
+	    count_lines(copy, "still here") != 1)
+		goto err;
+	fclose(copy);
+	return 0;
+err:
+	fprintf(stderr, "logger test failed!\n");
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <taiwins/objects/matrix.h>
+
+#define N_BOXES 512
+#define N_ROUNDS 2000
+
+static inline double
+elapsed_us(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1e6 + (b->tv_nsec - a->tv_nsec) / 1e3;
+}
+
+/* what the damage code did before, one corner at a time */
+static void
+boxes_transform_scalar(const struct tw_mat3 *mat, pixman_box32_t *dst,
+                       const pixman_box32_t *src, unsigned n)
+{
+	for (unsigned i = 0; i < n; i++) {
+		float xs[4] = {src[i].x1, src[i].x1, src[i].x2, src[i].x2};
+		float ys[4] = {src[i].y1, src[i].y2, src[i].y1, src[i].y2};
+		pixman_box32_t box = {INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+
+		for (int j = 0; j < 4; j++) {
+			float x, y;
+
+			tw_mat3_vec_transform(mat, xs[j], ys[j], &x, &y);
+			box.x1 = (int32_t)x < box.x1 ? (int32_t)x : box.x1;
+			box.y1 = (int32_t)y < box.y1 ? (int32_t)y : box.y1;
+			box.x2 = (int32_t)x > box.x2 ? (int32_t)x : box.x2;
+			box.y2 = (int32_t)y > box.y2 ? (int32_t)y : box.y2;
+		}
+		dst[i] = box;
+	}
+}
+
+static double
+bench(const struct tw_mat3 *mat, pixman_box32_t *dst,
+      const pixman_box32_t *src, unsigned n, bool batched)
+{
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int r = 0; r < N_ROUNDS; r++) {
+		if (batched)
+			tw_mat3_boxes_transform(mat, dst, src, n);
+		else
+			boxes_transform_scalar(mat, dst, src, n);
+		//keep the compiler from dropping the rounds
+		__asm__ volatile("" : : "r"(dst) : "memory");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return elapsed_us(&start, &end) / N_ROUNDS;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned n = argc > 1 ? atoi(argv[1]) : N_BOXES;
+	pixman_box32_t *src = calloc(n, sizeof(pixman_box32_t));
+	pixman_box32_t *dst = calloc(n, sizeof(pixman_box32_t));
+	pixman_box32_t *ref = calloc(n, sizeof(pixman_box32_t));
+	struct tw_mat3 mats[3], tmp;
+	const char *names[3] = {"translate", "scale", "transform_90"};
+	int ret = 0;
+
+	if (!src || !dst || !ref)
+		return -1;
+	srand(42);
+	for (unsigned i = 0; i < n; i++) {
+		src[i].x1 = rand() % 3840;
+		src[i].y1 = rand() % 2160;
+		src[i].x2 = src[i].x1 + 1 + rand() % 256;
+		src[i].y2 = src[i].y1 + 1 + rand() % 256;
+	}
+	tw_mat3_translate(&mats[0], -1920, 0);
+	tw_mat3_scale(&mats[1], 2.0, 2.0);
+	tw_mat3_translate(&tmp, 0.0, 0.5);
+	tw_mat3_multiply(&mats[1], &tmp, &mats[1]);
+	tw_mat3_transform_rect(&mats[2], false, WL_OUTPUT_TRANSFORM_90,
+	                       3840, 2160, 1);
+
+	printf("[");
+	for (int m = 0; m < 3; m++) {
+		double scalar_us = bench(&mats[m], ref, src, n, false);
+		double batched_us = bench(&mats[m], dst, src, n, true);
+
+		if (memcmp(ref, dst, n * sizeof(pixman_box32_t)))
+			ret = -1;
+		printf("%s{\"matrix\": \"%s\", \"boxes\": %u, "
+		       "\"scalar_us\": %.2f, \"batched_us\": %.2f}\n",
+		       m ? "," : "", names[m], n, scalar_us, batched_us);
+	}
+	printf("]\n");
+
+	free(src);
+	free(dst);
+	free(ref);
+	return ret;
+}
@@ -1,7 +1,9 @@
 #include <stdio.h>
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <limits.h>
 #include <taiwins/objects/matrix.h>
 
 #define EPSILON 1.0e-6
@@ -147,6 +149,79 @@ transform_inverse_test()
 	return matrix_is_identity(&mul);
 }
 
+static void
+box_transform_ref(const struct tw_mat3 *mat, pixman_box32_t *dst,
+                  const pixman_box32_t *src)
+{
+	float xs[4] = {src->x1, src->x1, src->x2, src->x2};
+	float ys[4] = {src->y1, src->y2, src->y1, src->y2};
+	pixman_box32_t box = {INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+
+	for (int i = 0; i < 4; i++) {
+		float x, y;
+
+		tw_mat3_vec_transform(mat, xs[i], ys[i], &x, &y);
+		box.x1 = (int32_t)x < box.x1 ? (int32_t)x : box.x1;
+		box.y1 = (int32_t)y < box.y1 ? (int32_t)y : box.y1;
+		box.x2 = (int32_t)x > box.x2 ? (int32_t)x : box.x2;
+		box.y2 = (int32_t)y > box.y2 ? (int32_t)y : box.y2;
+	}
+	*dst = box;
+}
+
+static bool
+boxes_match(const struct tw_mat3 *mat, int slack)
+{
+	pixman_box32_t src[37], dst[37], ref;
+
+	for (int i = 0; i < 37; i++) {
+		src[i].x1 = rand() % 4096 - 1024;
+		src[i].y1 = rand() % 4096 - 1024;
+		src[i].x2 = src[i].x1 + rand() % 512;
+		src[i].y2 = src[i].y1 + rand() % 512;
+	}
+	tw_mat3_boxes_transform(mat, dst, src, 37);
+	for (int i = 0; i < 37; i++) {
+		box_transform_ref(mat, &ref, &src[i]);
+		if (abs(ref.x1 - dst[i].x1) > slack ||
+		    abs(ref.y1 - dst[i].y1) > slack ||
+		    abs(ref.x2 - dst[i].x2) > slack ||
+		    abs(ref.y2 - dst[i].y2) > slack)
+			return false;
+	}
+	//transform in place
+	tw_mat3_boxes_transform(mat, src, src, 37);
+	return memcmp(src, dst, sizeof(src)) == 0;
+}
+
+static bool
+boxes_transform_test()
+{
+	struct tw_mat3 mat, tmp;
+
+	//translate
+	tw_mat3_translate(&mat, rand() % 2000 - 1000, rand() % 2000 - 1000);
+	if (!boxes_match(&mat, 0))
+		return false;
+	tw_mat3_translate(&mat, 10.5, -3.25);
+	if (!boxes_match(&mat, 0))
+		return false;
+	//scale, flips and the output transforms
+	tw_mat3_scale(&mat, 0.5, -2.0);
+	if (!boxes_match(&mat, 0))
+		return false;
+	for (int t = 0; t < 8; t++) {
+		tw_mat3_transform_rect(&mat, false, t, 1920, 1080, 2);
+		tw_mat3_translate(&tmp, 64, -32);
+		tw_mat3_multiply(&mat, &tmp, &mat);
+		if (!boxes_match(&mat, 0))
+			return false;
+	}
+	//rotations may round differently on the last bit
+	tw_mat3_rotate(&mat, rand() % 360, false);
+	return boxes_match(&mat, 1);
+}
+
 int main(int argc, char *argv[])
 {
 	setup_random();
@@ -169,8 +244,12 @@ int main(int argc, char *argv[])
 	for (int i = 0; i < 10; i++)
 		if (!transform_inverse_test())
 			goto err;
+	for (int i = 0; i < 10; i++)
+		if (!boxes_transform_test())
+			goto err;
 	//should work without inverse
 	return 0;
 err:
 	perror("matrix test failed!");
+	return -1;
 }
@@ -0,0 +1,89 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pixman.h>
+#include <taiwins/objects/region_pool.h>
+
+static bool
+region_pool_reuse_test(void)
+{
+	struct tw_region_pool pool;
+	pixman_region32_t *a, *b, bars;
+	pixman_region32_data_t *storage;
+	unsigned mark;
+	bool ret = true;
+
+	pixman_region32_init(&bars);
+	for (int i = 0; i < 8; i++)
+		pixman_region32_union_rect(&bars, &bars, i * 20, 0, 10, 10);
+
+	tw_region_pool_init(&pool);
+	//a fragmented region makes pixman allocate storage
+	mark = tw_region_pool_mark(&pool);
+	a = tw_region_pool_get(&pool);
+	pixman_region32_copy(a, &bars);
+	storage = a->data;
+	tw_region_pool_release(&pool, mark);
+	ret = ret && pool.allocs == 1 && pool.reuses == 0;
+	ret = ret && !pixman_region32_not_empty(a);
+
+	//the same region comes back with its storage
+	b = tw_region_pool_get(&pool);
+	ret = ret && a == b && pool.reuses == 1;
+	pixman_region32_copy(b, &bars);
+	ret = ret && b->data == storage && pixman_region32_n_rects(b) == 8;
+	tw_region_pool_reset(&pool);
+	ret = ret && pool.allocs == 1 && pool.used == 0;
+
+	//a rectangle drops the storage, it is not a reuse
+	b = tw_region_pool_get_rect(&pool, 0, 0, 10, 10);
+	ret = ret && a == b && pool.reuses == 1;
+	ret = ret && pixman_region32_n_rects(b) == 1;
+	tw_region_pool_reset(&pool);
+
+	tw_region_pool_fini(&pool);
+	pixman_region32_fini(&bars);
+	return ret;
+}
+
+static bool
+region_pool_stack_test(void)
+{
+	struct tw_region_pool pool;
+	pixman_region32_t *outer, *inner, *rect;
+	unsigned mark0, mark1;
+	bool ret = true;
+
+	tw_region_pool_init(&pool);
+	mark0 = tw_region_pool_mark(&pool);
+	outer = tw_region_pool_get(&pool);
+	pixman_region32_union_rect(outer, outer, 0, 0, 10, 10);
+
+	mark1 = tw_region_pool_mark(&pool);
+	inner = tw_region_pool_get(&pool);
+	rect = tw_region_pool_get_rect(&pool, 5, 5, 10, 10);
+	pixman_region32_intersect(inner, outer, rect);
+	ret = ret && pixman_region32_extents(inner)->x1 == 5;
+	tw_region_pool_release(&pool, mark1);
+
+	//releasing the inner scope leaves the outer region alone
+	ret = ret && pool.used == 1;
+	ret = ret && pixman_region32_extents(outer)->x2 == 10;
+	tw_region_pool_release(&pool, mark0);
+	ret = ret && pool.used == 0;
+
+	tw_region_pool_fini(&pool);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	if (!region_pool_reuse_test())
+		goto err;
+	if (!region_pool_stack_test())
+		goto err;
+	return 0;
+err:
+	fprintf(stderr, "region pool test failed!\n");
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,41 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <wayland-server.h>
+
+#include "test_client.h"
+
+struct wl_client *
+tw_test_client_create(struct wl_display *display, int *fd)
+{
+	int fds[2];
+	struct wl_client *client;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+		return NULL;
+	if (!(client = wl_client_create(display, fds[0]))) {
+		close(fds[0]);
+		close(fds[1]);
+		return NULL;
+	}
+	*fd = fds[1];
+	return client;
+}
+
+int
+tw_test_client_run(const char *name, bool (*test)(struct wl_display *))
+{
+	struct wl_display *display = wl_display_create();
+
+	if (!display)
+		goto err;
+	if (!test(display))
+		goto err;
+	wl_display_destroy(display);
+	return 0;
+err:
+	fprintf(stderr, "%s test failed!\n", name);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,28 @@
+#ifndef TW_TEST_CLIENT_H
+#define TW_TEST_CLIENT_H
+
+#include <stdbool.h>
+#include <wayland-server-core.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief create a wl_client on one end of a socketpair, the other end is
+ * returned in fd, the caller closes it after destroying the client.
+ */
+struct wl_client *
+tw_test_client_create(struct wl_display *display, int *fd);
+
+/**
+ * @brief run a test on a new wl_display, the exit code of a test program.
+ */
+int
+tw_test_client_run(const char *name, bool (*test)(struct wl_display *));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EOF */
@@ -0,0 +1,166 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "xwayland/xsurface.h"
+#include "xwayland/xwm.h"
+
+#define ATOM_TITLE 100
+#define ATOM_HINTS 101
+
+static xcb_generic_event_t *
+event_new(uint8_t type)
+{
+	xcb_generic_event_t *ge = calloc(1, sizeof(*ge));
+
+	ge->response_type = type;
+	return ge;
+}
+
+static xcb_generic_event_t *
+configure_notify(xcb_window_t window)
+{
+	xcb_generic_event_t *ge = event_new(XCB_CONFIGURE_NOTIFY);
+
+	((xcb_configure_notify_event_t *)ge)->window = window;
+	return ge;
+}
+
+static xcb_generic_event_t *
+property_notify(xcb_window_t window, xcb_atom_t atom)
+{
+	xcb_generic_event_t *ge = event_new(XCB_PROPERTY_NOTIFY);
+
+	((xcb_property_notify_event_t *)ge)->window = window;
+	((xcb_property_notify_event_t *)ge)->atom = atom;
+	return ge;
+}
+
+static xcb_generic_event_t *
+configure_request(xcb_window_t window, uint16_t mask, int16_t x,
+                  uint16_t width)
+{
+	xcb_generic_event_t *ge = event_new(XCB_CONFIGURE_REQUEST);
+	xcb_configure_request_event_t *ev =
+		(xcb_configure_request_event_t *)ge;
+
+	ev->window = window;
+	ev->value_mask = mask;
+	ev->x = x;
+	ev->width = width;
+	return ge;
+}
+
+static xcb_generic_event_t *
+map_notify(xcb_window_t window)
+{
+	xcb_generic_event_t *ge = event_new(XCB_MAP_NOTIFY);
+
+	((xcb_map_notify_event_t *)ge)->window = window;
+	return ge;
+}
+
+static void
+xwm_add_window(struct tw_xwm *xwm, xcb_window_t id)
+{
+	struct tw_xsurface *surface = calloc(1, sizeof(*surface));
+
+	surface->id = id;
+	wl_list_insert(&xwm->surfaces, &surface->link);
+}
+
+static void
+free_events(xcb_generic_event_t **events, unsigned n)
+{
+	for (unsigned i = 0; i < n; i++)
+		free(events[i]);
+}
+
+static bool
+xwm_coalesce_test(struct tw_xwm *xwm)
+{
+	xcb_generic_event_t *events[11] = {
+		configure_notify(1),
+		property_notify(1, ATOM_TITLE),
+		configure_request(1, XCB_CONFIG_WINDOW_X, 10, 0),
+		property_notify(1, ATOM_HINTS),
+		configure_notify(1),
+		property_notify(1, ATOM_TITLE),
+		configure_request(1, XCB_CONFIG_WINDOW_WIDTH, 0, 50),
+		//not an xsurface, every change is kept
+		property_notify(2, ATOM_TITLE),
+		property_notify(2, ATOM_TITLE),
+		//nothing is folded across a map
+		map_notify(1),
+		configure_notify(1),
+	};
+	xcb_configure_request_event_t *request =
+		(xcb_configure_request_event_t *)events[6];
+	bool ret = true;
+
+	ret = ret && tw_xwm_coalesce_events(xwm, events, 11) == 8;
+	ret = ret && !events[0] && !events[1] && !events[2];
+	ret = ret && events[3] && events[4] && events[5] && events[6];
+	ret = ret && events[7] && events[8] && events[9] && events[10];
+	//the earlier request is folded into the later one
+	ret = ret && request->value_mask ==
+		(XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_WIDTH);
+	ret = ret && request->x == 10 && request->width == 50;
+
+	free_events(events, 11);
+	return ret;
+}
+
+static bool
+xwm_coalesce_full_batch_test(struct tw_xwm *xwm)
+{
+	xcb_generic_event_t *events[TW_XWM_BATCH_MAX];
+	unsigned windows = TW_XWM_BATCH_MAX / 4, left = 0;
+	bool ret = true;
+
+	//interleaved bursts of many windows, one of each survives
+	for (unsigned i = 0; i < TW_XWM_BATCH_MAX; i += 2) {
+		xcb_window_t window = 10 + (i / 2) % windows;
+
+		events[i] = configure_notify(window);
+		events[i+1] = property_notify(window, ATOM_TITLE);
+	}
+	ret = ret && tw_xwm_coalesce_events(xwm, events, TW_XWM_BATCH_MAX) ==
+		windows * 2;
+	for (unsigned i = 0; i < TW_XWM_BATCH_MAX; i++)
+		left += events[i] != NULL;
+	ret = ret && left == windows * 2;
+	//the last burst is the one kept
+	ret = ret && events[TW_XWM_BATCH_MAX-1] && !events[1];
+
+	free_events(events, TW_XWM_BATCH_MAX);
+	return ret;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct tw_xwm *xwm = calloc(1, sizeof(*xwm));
+	struct tw_xsurface *surface, *tmp;
+	bool ret = true;
+
+	if (!xwm)
+		return EXIT_FAILURE;
+	wl_list_init(&xwm->surfaces);
+	xwm_add_window(xwm, 1);
+	for (unsigned i = 0; i < TW_XWM_BATCH_MAX / 4; i++)
+		xwm_add_window(xwm, 10 + i);
+
+	ret = ret && xwm_coalesce_test(xwm);
+	ret = ret && xwm_coalesce_full_batch_test(xwm);
+
+	wl_list_for_each_safe(surface, tmp, &xwm->surfaces, link)
+		free(surface);
+	free(xwm);
+	if (ret)
+		return 0;
+	fprintf(stderr, "xwm batch test failed!\n");
+	return EXIT_FAILURE;
+}